@@ -0,0 +1,501 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <algorithm>
+#include <thread>
+#include "FakeTPer.h"
+#include "DtaEndianFixup.h"
+#include "DtaLexicon.h"
+#include "DtaSession.h"
+
+using namespace std;
+
+/** total length of the token at p */
+static uint32_t tokenLength(const uint8_t * p)
+{
+	if (!(p[0] & 0x80)) return 1;                                // tiny atom
+	if (!(p[0] & 0x40)) return (p[0] & 0x0f) + 1;                // short atom
+	if (!(p[0] & 0x20)) return (((p[0] & 0x07) << 8) | p[1]) + 2; // medium atom
+	if (!(p[0] & 0x10)) return ((p[1] << 16) | (p[2] << 8) | p[3]) + 4; // long atom
+	return 1;                                                    // token
+}
+
+/** Table table row describing the DataStore */
+static const uint8_t tableDataStore[8] = { 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x10, 0x01 };
+
+/** value of an unsigned tiny or short atom */
+static uint64_t tokenValue(const uint8_t * p)
+{
+	uint64_t v = 0;
+	if (!(p[0] & 0x80)) return p[0] & 0x3f;
+	for (uint32_t i = 1; i < tokenLength(p); i++) v = (v << 8) | p[i];
+	return v;
+}
+
+FakeTPer::FakeTPer(uint32_t latency_us)
+{
+	commands = 0;
+	polls = 0;
+	stackResets = 0;
+	sets = 0;
+	tperResets = 0;
+	wedged = 0;
+	busy = 0;
+	comIDRequestCode = 0;
+	HSN = 0;
+	TSN = 0;
+	nextTSN = 1;
+	latency = latency_us;
+	ready = chrono::steady_clock::now();
+	datastore.resize(FAKETPER_DATASTORE_SIZE);
+}
+
+FakeTPer::~FakeTPer()
+{
+}
+
+void FakeTPer::addUint(uint64_t value)
+{
+	if (value < 64) {
+		reply.push_back((uint8_t)value);
+		return;
+	}
+	int bytes = (value < 0x100) ? 1 : (value < 0x10000) ? 2 : (value < 0x100000000ULL) ? 4 : 8;
+	reply.push_back(0x80 | (uint8_t)bytes);
+	for (int i = bytes - 1; i >= 0; i--) reply.push_back((uint8_t)(value >> (8 * i)));
+}
+
+void FakeTPer::addString(const char * value)
+{
+	size_t len = strlen(value);
+	if (len < 16)
+		reply.push_back(0xa0 | (uint8_t)len);
+	else {
+		reply.push_back(0xd0 | (uint8_t)((len >> 8) & 0x07));
+		reply.push_back((uint8_t)len);
+	}
+	reply.insert(reply.end(), value, value + len);
+}
+
+void FakeTPer::addBytes(const uint8_t * value, uint32_t length)
+{
+	if (length < 16)
+		reply.push_back(0xa0 | (uint8_t)length);
+	else if (length < 2048) {
+		reply.push_back(0xd0 | (uint8_t)((length >> 8) & 0x07));
+		reply.push_back((uint8_t)length);
+	}
+	else {
+		reply.push_back(0xe2);
+		reply.push_back((uint8_t)(length >> 16));
+		reply.push_back((uint8_t)(length >> 8));
+		reply.push_back((uint8_t)length);
+	}
+	reply.insert(reply.end(), value, value + length);
+}
+
+void FakeTPer::addUID(const uint8_t uid[8])
+{
+	reply.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	reply.insert(reply.end(), uid, uid + 8);
+}
+
+void FakeTPer::addStatus(uint8_t status)
+{
+	reply.push_back(OPAL_TOKEN::ENDOFDATA);
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	reply.push_back(status);
+	reply.push_back(0x00);
+	reply.push_back(0x00);
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+}
+
+uint8_t FakeTPer::send(void * buffer, uint32_t bufferlen)
+{
+	OPALHeader * hdr = (OPALHeader *)buffer;
+	uint8_t * p = (uint8_t *)buffer + sizeof(OPALHeader);
+	uint32_t len = SWAP32(hdr->subpkt.length);
+	if ((len + sizeof(OPALHeader)) > bufferlen) return 0xff;
+	commands++;
+	reply.clear();
+	ready = chrono::steady_clock::now() + chrono::microseconds(latency);
+	if (OPAL_TOKEN::ENDOFSESSION == p[0]) {
+		reply.push_back(OPAL_TOKEN::ENDOFSESSION);
+		TSN = 0;
+		return 0;
+	}
+	if ((OPAL_TOKEN::CALL != p[0]) || (len < 19)) {
+		addStatus(OPALSTATUSCODE::INVALID_PARAMETER);
+		return 0;
+	}
+	const uint8_t * invoker = p + 2;
+	const uint8_t * method = p + 11;
+	uint8_t * q = p + 19;
+	uint8_t * end = p + len;
+	if (logCalls)
+		calls.push_back(make_pair(vector<uint8_t>(invoker, invoker + 8), vector<uint8_t>(method, method + 8)));
+	if (!refuse.empty() && refuse.count(vector<uint8_t>(invoker, invoker + 8))) {
+		addStatus(OPALSTATUSCODE::NOT_AUTHORIZED);
+		return 0;
+	}
+	if (!memcmp(method, OPALMETHOD[OPAL_METHOD::PROPERTIES], 8)) {
+		reply.push_back(OPAL_TOKEN::CALL);
+		addUID(OPALUID[OPAL_UID::OPAL_SMUID_UID]);
+		addUID(OPALMETHOD[OPAL_METHOD::PROPERTIES]);
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(OPAL_TOKEN::STARTNAME);
+		addString("MaxComPacketSize");
+		addUint(MAX_BUFFER_LENGTH + 4096);
+		reply.push_back(OPAL_TOKEN::ENDNAME);
+		reply.push_back(OPAL_TOKEN::STARTNAME);
+		addString("MaxIndTokenSize");
+		addUint(MAX_BUFFER_LENGTH);
+		reply.push_back(OPAL_TOKEN::ENDNAME);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		addStatus(OPALSTATUSCODE::SUCCESS);
+	}
+	else if (!memcmp(method, OPALMETHOD[OPAL_METHOD::STARTSESSION], 8)) {
+		// [ HostSessionID SPID write ... HostSigningAuthority = uid ]
+		HSN = (uint32_t)tokenValue(q + 1);
+		const uint8_t * spid = q + 1 + tokenLength(q + 1);
+		bool adminSP = (spid + 9 <= end) && !memcmp(spid + 1, OPALUID[OPAL_UID::OPAL_ADMINSP_UID], 8);
+		if ((wedged && !adminSP) || busy) {
+			if (busy) busy--;
+			addStatus(OPALSTATUSCODE::SP_BUSY);
+			return 0;
+		}
+		for (uint8_t * r = q; !signAuthority.empty() && (r + 11 < end); r += tokenLength(r)) {
+			if ((OPAL_TOKEN::STARTNAME == r[0]) && (0x03 == r[1]) &&
+				(OPAL_SHORT_ATOM::BYTESTRING8 == r[2]) && memcmp(r + 3, signAuthority.data(), 8)) {
+				addStatus(OPALSTATUSCODE::NOT_AUTHORIZED);
+				return 0;
+			}
+		}
+		TSN = nextTSN++;
+		reply.push_back(OPAL_TOKEN::CALL);
+		addUID(OPALUID[OPAL_UID::OPAL_SMUID_UID]);
+		static const uint8_t syncsession[8] = { 0, 0, 0, 0, 0, 0, 0xff, 0x03 };
+		addUID(syncsession);
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		addUint(HSN);
+		addUint(TSN);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		addStatus(OPALSTATUSCODE::SUCCESS);
+	}
+	else if (!memcmp(method, OPALMETHOD[OPAL_METHOD::GET], 8) ||
+		!memcmp(method, OPALMETHOD[OPAL_METHOD::EGET], 8)) {
+		// pick the row/column range out of the cellblock, every cell reads as 0
+		uint64_t startrow = 0, endrow = 0, startcol = 0, endcol = 0;
+		while (q < end) {
+			if ((OPAL_TOKEN::STARTNAME == q[0]) && (q + 2 < end)) {
+				if (OPAL_TOKEN::STARTROW == q[1]) startrow = tokenValue(q + 2);
+				if (OPAL_TOKEN::ENDROW == q[1]) endrow = tokenValue(q + 2);
+				if (OPAL_TOKEN::STARTCOLUMN == q[1]) startcol = tokenValue(q + 2);
+				if (OPAL_TOKEN::ENDCOLUMN == q[1]) endcol = tokenValue(q + 2);
+			}
+			q += tokenLength(q);
+		}
+		if (!memcmp(invoker, OPALUID[OPAL_UID::OPAL_DATASTORE], 8)) {
+			if ((endrow < startrow) || (endrow >= datastore.size())) {
+				addStatus(OPALSTATUSCODE::INVALID_PARAMETER);
+				return 0;
+			}
+			reply.push_back(OPAL_TOKEN::STARTLIST);
+			addBytes(&datastore[startrow], (uint32_t)(endrow - startrow + 1));
+			reply.push_back(OPAL_TOKEN::ENDLIST);
+			addStatus(OPALSTATUSCODE::SUCCESS);
+			return 0;
+		}
+		std::map<uint64_t, uint64_t> & row = rows[vector<uint8_t>(invoker, invoker + 8)];
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		for (uint64_t col = startcol; col <= endcol; col++) {
+			reply.push_back(OPAL_TOKEN::STARTNAME);
+			addUint(col);
+			if ((OPAL_TOKEN::PIN == col) && !memcmp(invoker, OPALUID[OPAL_UID::OPAL_C_PIN_MSID], 8))
+				addString("FAKEMSIDFAKEMSID");
+			else if ((OPAL_TOKEN::ROWS == col) && !memcmp(invoker, tableDataStore, 8))
+				addUint(datastore.size());
+			else if ((OPAL_TOKEN::MAXRANGES == col) && !memcmp(invoker, OPALUID[OPAL_UID::OPAL_LOCKING_INFO_TABLE], 8))
+				addUint(FAKETPER_MAX_RANGES);
+			else if ((OPAL_TOKEN::ACTIVEKEY == col) && !memcmp(invoker, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 4)) {
+				// K_AES_256 key rows are numbered like the Locking rows
+				uint8_t key[8];
+				memcpy(key, invoker, 8);
+				key[3] = 0x06;
+				addUID(key);
+			}
+			else
+				addUint(row[col]);
+			reply.push_back(OPAL_TOKEN::ENDNAME);
+		}
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		addStatus(OPALSTATUSCODE::SUCCESS);
+	}
+	else if (!memcmp(method, OPALMETHOD[OPAL_METHOD::SET], 8) &&
+		!memcmp(invoker, OPALUID[OPAL_UID::OPAL_DATASTORE], 8)) {
+		// [ Where = offset, Values = bytes ]
+		uint64_t where = 0;
+		sets++;
+		while (q < end) {
+			if ((OPAL_TOKEN::STARTNAME == q[0]) && (q + 2 < end)) {
+				if (OPAL_TOKEN::WHERE == q[1]) where = tokenValue(q + 2);
+				if (OPAL_TOKEN::VALUES == q[1]) {
+					const uint8_t * atom = q + 2;
+					uint32_t header = (!(atom[0] & 0x40)) ? 1 : (!(atom[0] & 0x20)) ? 2 : 4;
+					uint32_t length = tokenLength(atom) - header;
+					if (where + length > datastore.size()) {
+						addStatus(OPALSTATUSCODE::INVALID_PARAMETER);
+						return 0;
+					}
+					memcpy(&datastore[where], atom + header, length);
+				}
+			}
+			q += tokenLength(q);
+		}
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		addStatus(OPALSTATUSCODE::SUCCESS);
+	}
+	else if (!memcmp(method, OPALMETHOD[OPAL_METHOD::AUTHENTICATE], 8) ||
+		!memcmp(method, OPALMETHOD[OPAL_METHOD::EAUTHENTICATE], 8)) {
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(OPAL_TOKEN::OPAL_TRUE);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		addStatus(OPALSTATUSCODE::SUCCESS);
+	}
+	else if (!memcmp(method, OPALMETHOD[OPAL_METHOD::SET], 8)) {
+		// [ Values = [ column = uint ... ] ], other values are accepted and dropped
+		std::map<uint64_t, uint64_t> & row = rows[vector<uint8_t>(invoker, invoker + 8)];
+		sets++;
+		while (q < end) {
+			if ((OPAL_TOKEN::STARTNAME == q[0]) && (q + 3 < end) && !(q[1] & 0x80) &&
+				((q[2] < 0x80) || (0x80 == (q[2] & 0xe0))) && // tiny or short uint
+				(OPAL_TOKEN::ENDNAME == q[2 + tokenLength(q + 2)])) {
+				row[tokenValue(q + 1)] = tokenValue(q + 2);
+			}
+			q += tokenLength(q);
+		}
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		addStatus(OPALSTATUSCODE::SUCCESS);
+	}
+	else {
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		addStatus(OPALSTATUSCODE::SUCCESS);
+	}
+	return 0;
+}
+
+uint8_t FakeTPer::recv(void * buffer, uint32_t bufferlen)
+{
+	OPALHeader * hdr = (OPALHeader *)buffer;
+	uint32_t len = (uint32_t)reply.size();
+	uint32_t padded = (len + 3) & ~3;
+	memset(buffer, 0, bufferlen);
+	if (chrono::steady_clock::now() < ready) {
+		// still working on it
+		polls++;
+		hdr->cp.outstandingData = SWAP32(1);
+		return 0;
+	}
+	if (sizeof(OPALHeader) + padded > bufferlen) return 0xff;
+	hdr->cp.length = SWAP32(padded + sizeof(OPALPacket) + sizeof(OPALDataSubPacket));
+	hdr->pkt.TSN = SWAP32(TSN);
+	hdr->pkt.HSN = SWAP32(HSN);
+	hdr->pkt.length = SWAP32(padded + sizeof(OPALDataSubPacket));
+	hdr->subpkt.length = SWAP32(len);
+	memcpy((uint8_t *)buffer + sizeof(OPALHeader), reply.data(), len);
+	return 0;
+}
+
+uint8_t FakeTPer::comIDRequest(ATACOMMAND cmd, void * buffer, uint32_t bufferlen)
+{
+	uint8_t * p = (uint8_t *)buffer;
+	if (16 > bufferlen) return 0xff;
+	if (IF_SEND == cmd) {
+		comIDRequestCode = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+		if (DTA_STACK_RESET == comIDRequestCode) {
+			// drop the session and whatever response was pending
+			stackResets++;
+			reply.clear();
+			TSN = 0;
+			ready = chrono::steady_clock::now();
+			if (1 == wedged) wedged = 0;
+		}
+		return 0;
+	}
+	memset(buffer, 0, bufferlen);
+	if ((DTA_STACK_RESET != comIDRequestCode) && (DTA_COMID_VERIFY != comIDRequestCode))
+		return 0; // nothing available
+	p[0] = 0x10; // base ComID 0x1000
+	p[7] = (uint8_t)comIDRequestCode;
+	if (DTA_STACK_RESET == comIDRequestCode) {
+		p[11] = 4; // available data length, success
+		p[15] = wedged ? 1 : 0;
+	}
+	else {
+		p[11] = 34; // state and the three timestamps
+		p[15] = wedged ? 3 : 2; // Associated while the stale session holds it, else Issued
+	}
+	comIDRequestCode = 0;
+	return 0;
+}
+
+void FakeTPer::tperReset()
+{
+	tperResets++;
+	reply.clear();
+	TSN = 0;
+	wedged = 0;
+	ready = chrono::steady_clock::now();
+}
+
+BenchDev::BenchDev(uint32_t latency_us) : tper(latency_us)
+{
+	memset(&disk_info, 0, sizeof(OPAL_DiskInfo));
+	dev = "fake";
+	disk_info.devType = DEVICE_TYPE_OTHER;
+	memcpy(disk_info.serialNum, "FAKE0000000000000001", sizeof(disk_info.serialNum));
+	memcpy(disk_info.firmwareRev, "FAKE0001", sizeof(disk_info.firmwareRev));
+	memcpy(disk_info.modelNum, "sedutil-bench fake TPer                 ", sizeof(disk_info.modelNum));
+	disk_info.TPer = 1;
+	disk_info.Locking = 1;
+	disk_info.Locking_lockingSupported = 1;
+	disk_info.OPAL20 = 1;
+	disk_info.ANY_OPAL_SSC = 1;
+	disk_info.OPAL20_basecomID = 0x1000;
+	disk_info.OPAL20_numcomIDs = 1;
+	isOpen = TRUE;
+	no_hash_passwords = false;
+	output_format = sedutilReadable;
+	properties();
+}
+
+BenchDev::~BenchDev()
+{
+}
+
+void BenchDev::init(const char * devref)
+{
+}
+
+uint8_t BenchDev::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen)
+{
+	if (gone) return 0xff;
+	if ((0x01 == protocol) && (0x0001 == comID) && (IF_RECV == cmd))
+		return discovery0(buffer, bufferlen);
+	if ((0x02 == protocol) && (DTA_TPER_RESET_COMID == comID) && (IF_SEND == cmd)) {
+		tper.tperReset();
+		return 0;
+	}
+	if (0x02 == protocol) return tper.comIDRequest(cmd, buffer, bufferlen);
+	if (IF_SEND == cmd) return tper.send(buffer, bufferlen);
+	if (IF_RECV == cmd) return tper.recv(buffer, bufferlen);
+	return 0xff;
+}
+
+void BenchDev::setLocked(bool locked)
+{
+	disk_info.Locking_lockingEnabled = 1;
+	disk_info.Locking_locked = locked ? 1 : 0;
+}
+
+void BenchDev::setSerial(const char * serial)
+{
+	memset(disk_info.serialNum, ' ', sizeof(disk_info.serialNum));
+	memcpy(disk_info.serialNum, serial, min(strlen(serial), sizeof(disk_info.serialNum)));
+}
+
+uint8_t BenchDev::discovery0(void * buffer, uint32_t bufferlen)
+{
+	uint8_t * d0 = (uint8_t *) buffer;
+	if (bufferlen < sizeof(Discovery0Header) + 32 + sizeof(Discovery0LockingFeatures)) return 0xff;
+	memset(d0, 0, bufferlen);
+	/* the header and its vendor area take 48 bytes, then the features */
+	Discovery0LockingFeatures * locking = (Discovery0LockingFeatures *) (d0 + 48);
+	((Discovery0Header *) d0)->length = SWAP32((uint32_t) (48 + sizeof(*locking) - 4));
+	locking->featureCode = SWAP16(FC_LOCKING);
+	locking->version = 1;
+	locking->length = sizeof(*locking) - 4;
+	locking->lockingSupported = disk_info.Locking_lockingSupported;
+	locking->lockingEnabled = disk_info.Locking_lockingEnabled;
+	locking->locked = disk_info.Locking_locked;
+	locking->MBREnabled = disk_info.Locking_MBREnabled;
+	locking->MBRDone = disk_info.Locking_MBRDone;
+	return 0;
+}
+
+uint16_t BenchDev::comID()
+{
+	return disk_info.OPAL20_basecomID;
+}
+
+uint8_t BenchDev::sessionGet(OPAL_UID sp, OPAL_UID table, uint16_t startcol, uint16_t endcol)
+{
+	uint8_t lastRC;
+	session = new DtaSession(this);
+	if (NULL == session) return DTAERROR_OBJECT_CREATE_FAILED;
+	if ((lastRC = session->start(sp)) == 0)
+		lastRC = getTable(OPALUID[table], startcol, endcol);
+	delete session;
+	return lastRC;
+}
+
+EnterpriseBenchDev::EnterpriseBenchDev()
+{
+	memset(&disk_info, 0, sizeof(OPAL_DiskInfo));
+	dev = "fake";
+	disk_info.devType = DEVICE_TYPE_OTHER;
+	disk_info.TPer = 1;
+	disk_info.Locking = 1;
+	disk_info.Locking_lockingSupported = 1;
+	disk_info.Enterprise = 1;
+	disk_info.Enterprise_basecomID = 0x07fe;
+	disk_info.Enterprise_numcomID = 1;
+	isOpen = TRUE;
+	no_hash_passwords = true;
+	output_format = sedutilReadable;
+	// the fake TPer only names columns by number, LockingInfo answers by name
+	setCached("MaxRanges", FAKETPER_MAX_RANGES);
+	properties();
+}
+
+EnterpriseBenchDev::~EnterpriseBenchDev()
+{
+}
+
+void EnterpriseBenchDev::init(const char * devref)
+{
+}
+
+uint8_t EnterpriseBenchDev::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen)
+{
+	if (0x02 == protocol) return tper.comIDRequest(cmd, buffer, bufferlen);
+	if (IF_SEND == cmd) return tper.send(buffer, bufferlen);
+	if (IF_RECV == cmd) return tper.recv(buffer, bufferlen);
+	return 0xff;
+}
@@ -0,0 +1,125 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include "DtaStructures.h"
+#include "DtaDevOpal.h"
+#include "DtaDevEnterprise.h"
+
+/** size of the simulated DataStore table */
+#define FAKETPER_DATASTORE_SIZE (32 * 1024)
+/** number of non global locking ranges reported in LockingInfo */
+#define FAKETPER_MAX_RANGES 8
+
+/** An in-process stand in for an Opal TPer.
+ * Understands just enough of the protocol (Properties, StartSession,
+ * Get, Set, Authenticate, EndSession) to let the unmodified session and
+ * command code run against it.  Responses can be held back for a fixed
+ * time to simulate device latency; until then IF_RECV reports
+ * outstanding data with no payload the way a busy drive does.
+ */
+class FakeTPer {
+public:
+	/** @param latency_us how long each command takes to complete */
+	FakeTPer(uint32_t latency_us = 0);
+	~FakeTPer();
+	/** accept an IF_SEND buffer */
+	uint8_t send(void * buffer, uint32_t bufferlen);
+	/** fill an IF_RECV buffer */
+	uint8_t recv(void * buffer, uint32_t bufferlen);
+	/** handle a security protocol 2 (ComID management) IF_SEND or IF_RECV,
+	 * only STACK_RESET and VERIFY_COMID_VALID are understood */
+	uint8_t comIDRequest(ATACOMMAND cmd, void * buffer, uint32_t bufferlen);
+	/** the Opal 2 TPer Reset, ends the session and clears any wedge */
+	void tperReset();
+	uint32_t commands; /**< number of commands accepted */
+	uint32_t polls;    /**< number of IF_RECVs answered with no data */
+	uint32_t stackResets; /**< number of STACK_RESETs accepted */
+	uint32_t sets;     /**< number of Set methods accepted */
+	uint32_t tperResets; /**< number of TPer Resets accepted */
+	/** while non zero StartSession is refused with SP_BUSY, as if another
+	 * host had left a session open on the Locking SP; the Admin SP still
+	 * opens. 1 is cleared by a STACK_RESET, 2 only by a TPer Reset */
+	uint8_t wedged;
+	/** number of StartSessions still to refuse with SP_BUSY, as if
+	 * another host's session were about to end */
+	uint32_t busy;
+	/** the only authority StartSession accepts, any if empty */
+	std::vector<uint8_t> signAuthority;
+	/** uint column values written by Set, keyed by row UID; unset columns read as 0 */
+	std::map<std::vector<uint8_t>, std::map<uint64_t, uint64_t> > rows;
+	/** invoking UID and method UID of every method call, in order, while logCalls is set */
+	std::vector<std::pair<std::vector<uint8_t>, std::vector<uint8_t> > > calls;
+	bool logCalls = false;
+	/** invoking UIDs whose methods are refused with NOT_AUTHORIZED */
+	std::set<std::vector<uint8_t> > refuse;
+private:
+	void addUint(uint64_t value);
+	void addString(const char * value);
+	void addBytes(const uint8_t * value, uint32_t length);
+	void addUID(const uint8_t uid[8]);
+	void addStatus(uint8_t status);
+	std::vector<uint8_t> reply;  /**< token stream of the pending response */
+	std::vector<uint8_t> datastore;  /**< contents of the DataStore table */
+	uint32_t HSN, TSN, nextTSN;
+	uint32_t latency;
+	uint32_t comIDRequestCode;  /**< pending protocol 2 request, 0 if none */
+	std::chrono::steady_clock::time_point ready;
+};
+
+/** An Opal 2 device object whose commands are answered by a FakeTPer */
+class BenchDev : public DtaDevOpal {
+public:
+	/** @param latency_us simulated per command device latency */
+	BenchDev(uint32_t latency_us = 0);
+	~BenchDev();
+	void init(const char * devref);
+	uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+		void * buffer, uint32_t bufferlen);
+	uint16_t comID();
+	/** Report the Locking feature as enabled and locked or not in Discovery 0 */
+	void setLocked(bool locked);
+	/** Set the serial number identify reports */
+	void setSerial(const char * serial);
+	/** Open an unauthenticated session to an SP, read a range of columns
+	 * from a table and close the session again.
+	 */
+	uint8_t sessionGet(OPAL_UID sp, OPAL_UID table, uint16_t startcol, uint16_t endcol);
+	FakeTPer tper; /**< the drive */
+	bool gone = false;  /**< every command fails, as on a stale handle */
+private:
+	/** answer a Level 0 Discovery with the Locking feature of disk_info */
+	uint8_t discovery0(void * buffer, uint32_t bufferlen);
+};
+
+/** An Enterprise device object whose commands are answered by a FakeTPer */
+class EnterpriseBenchDev : public DtaDevEnterprise {
+public:
+	EnterpriseBenchDev();
+	~EnterpriseBenchDev();
+	void init(const char * devref);
+	uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+		void * buffer, uint32_t bufferlen);
+	FakeTPer tper; /**< the drive */
+};
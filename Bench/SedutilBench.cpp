@@ -0,0 +1,1156 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FakeTPer.h"
+#include "DtaCommand.h"
+#include "DtaResponse.h"
+#include "DtaSession.h"
+#include "DtaMultiplexer.h"
+#include "DtaEndianFixup.h"
+#include "DtaHashPwd.h"
+#include "DtaAnnotatedDump.h"
+#include "DtaDevLinuxScan.h"
+#include "DtaUnlockAgent.h"
+#include "DtaLockWatch.h"
+#include "DtaTrace.h"
+#include "DtaEraseVerify.h"
+#include "DtaStats.h"
+#include "Version.h"
+
+/** sedutil-bench: microbenchmarks for the protocol stack.
+ * Everything runs in process against a FakeTPer so the numbers measure
+ * sedutil itself, not a drive.  Results are written one line per
+ * benchmark so runs can be diffed or fed to a spreadsheet.
+ *
+ * Some benchmarks also check the result of what they time; a failed
+ * check is reported on stderr and makes the exit status non zero.
+ *
+ * usage: sedutil-bench [--json] [--quick] [filter]
+ */
+
+using namespace std;
+
+typedef struct benchResult {
+	const char * name;
+	uint32_t iterations;
+	double nsPerOp;
+} benchResult;
+
+static vector<benchResult> results;
+static bool quick = false;
+static const char * filter = NULL;
+static uint32_t failures = 0;
+
+/** is the benchmark called name to be run */
+static bool selected(const char * name)
+{
+	return (NULL == filter) || (NULL != strstr(name, filter));
+}
+
+/** note a check of a result, reporting it if it failed */
+static void check(const char * what, bool ok)
+{
+	if (ok) return;
+	fprintf(stderr, "FAILED: %s\n", what);
+	failures++;
+}
+
+/** time iterations calls of fn and record the result */
+static void bench(const char * name, uint32_t iterations, function<void()> fn)
+{
+	if (!selected(name)) return;
+	if (quick) iterations = (iterations + 9) / 10;
+	fn(); // warm up
+	auto start = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations; i++) fn();
+	auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+	benchResult r = { name, iterations, (double)elapsed.count() / iterations };
+	results.push_back(r);
+}
+
+/** Build an IF_SEND buffer by hand: Get of columns 0-10 of C_PIN_MSID */
+static void buildGet(uint8_t * buffer, uint32_t bufferlen)
+{
+	memset(buffer, 0, bufferlen);
+	uint8_t * p = buffer + sizeof(OPALHeader);
+	uint8_t * start = p;
+	*p++ = OPAL_TOKEN::CALL;
+	*p++ = OPAL_SHORT_ATOM::BYTESTRING8;
+	memcpy(p, OPALUID[OPAL_UID::OPAL_C_PIN_MSID], 8); p += 8;
+	*p++ = OPAL_SHORT_ATOM::BYTESTRING8;
+	memcpy(p, OPALMETHOD[OPAL_METHOD::GET], 8); p += 8;
+	const uint8_t args[] = { 0xf0, 0xf0, 0xf2, 0x03, 0x00, 0xf3, 0xf2, 0x04, 0x0a, 0xf3, 0xf1, 0xf1,
+		0xf9, 0xf0, 0x00, 0x00, 0x00, 0xf1 };
+	memcpy(p, args, sizeof(args)); p += sizeof(args);
+	((OPALHeader *)buffer)->subpkt.length = SWAP32((uint32_t)(p - start));
+}
+
+/** A BenchDev that keeps a copy of the last IF_SEND buffer */
+class SendSpy : public BenchDev {
+public:
+	SendSpy() : BenchDev(0) {}
+	uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+		void * buffer, uint32_t bufferlen)
+	{
+		if ((IF_SEND == cmd) && (0x01 == protocol))
+			sent.assign((uint8_t *)buffer, (uint8_t *)buffer + bufferlen);
+		return BenchDev::sendCmd(cmd, protocol, comID, buffer, bufferlen);
+	}
+	vector<uint8_t> sent;  /**< what went to the drive */
+};
+
+static void encodeBenchmarks()
+{
+	DtaCommand * cmd = new DtaCommand();
+	bench("encode.get_cellblock", 20000, [&]() {
+		cmd->reset(OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, OPAL_METHOD::GET);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::STARTCOLUMN);
+		cmd->addToken((uint64_t)0);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::ENDCOLUMN);
+		cmd->addToken((uint64_t)10);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->complete();
+	});
+	bench("encode.set_lockingrange", 20000, [&]() {
+		cmd->reset(OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, OPAL_METHOD::SET);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::VALUES);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::READLOCKED);
+		cmd->addToken(OPAL_TOKEN::OPAL_TRUE);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::WRITELOCKED);
+		cmd->addToken(OPAL_TOKEN::OPAL_TRUE);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->complete();
+	});
+	bench("encode.start_session", 20000, [&]() {
+		cmd->reset(OPAL_UID::OPAL_SMUID_UID, OPAL_METHOD::STARTSESSION);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken((uint64_t)105);
+		cmd->addToken(OPAL_UID::OPAL_LOCKINGSP_UID);
+		cmd->addToken((uint64_t)1);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TINY_ATOM::UINT_00);
+		cmd->addToken("0123456789abcdef0123456789abcdef");
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TINY_ATOM::UINT_03);
+		cmd->addToken(OPAL_UID::OPAL_ADMIN1_UID);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->complete();
+	});
+	// space reserved for an in-place bytestring and not used, or rolled
+	// back after an overrun, must not go out as padding
+	SendSpy spy;
+	uint32_t stale = 0;
+	bench("encode.inplace_bytestring", 20000, [&]() {
+		cmd->reset(OPAL_UID::OPAL_DATASTORE, OPAL_METHOD::SET);
+		memset(cmd->startBytestring(64), 0xa5, 80);
+		cmd->endBytestring(80);
+		cmd->reset(OPAL_UID::OPAL_DATASTORE, OPAL_METHOD::SET);
+		memset(cmd->startBytestring(64), 0xa5, 64);
+		cmd->endBytestring(16);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->complete();
+		spy.post(cmd);
+		stale = (uint32_t)count(spy.sent.begin(), spy.sent.end(), 0xa5);
+	});
+	if (selected("encode.inplace_bytestring"))
+		check("unused in-place bytestring space is zeroed", 16 == stale);
+	delete cmd;
+}
+
+static void decodeBenchmarks()
+{
+	// canned response to a Get of 11 columns straight from the fake TPer
+	FakeTPer tper;
+	vector<uint8_t> sendbuf(MIN_BUFFER_LENGTH), recvbuf(MIN_BUFFER_LENGTH);
+	buildGet(sendbuf.data(), (uint32_t)sendbuf.size());
+	tper.send(sendbuf.data(), (uint32_t)sendbuf.size());
+	tper.recv(recvbuf.data(), (uint32_t)recvbuf.size());
+	DtaResponse resp;
+	uint64_t sink = 0;
+	bench("decode.response_init", 20000, [&]() {
+		resp.init(recvbuf.data());
+	});
+	bench("decode.getUint64", 20000, [&]() {
+		// cell values are tokens 4, 8, ... 44; column 3 (16) is the PIN string
+		for (uint32_t i = 4; i <= 44; i += 4)
+			if (16 != i) sink += resp.getUint64(i);
+	});
+	bench("decode.getString", 20000, [&]() {
+		sink += resp.getString(16).size();
+	});
+	if (selected("decode.getUint64")) {
+		DtaResponse bad(recvbuf.data());
+		check("a well formed response reads cleanly", (0 == bad.getUint64(4)) && !bad.isMalformed());
+		check("an integer asked of a string is refused", (0 == bad.getUint64(16)) && bad.isMalformed());
+		bad.init(recvbuf.data());
+		check("a token beyond the response is refused",
+			(0 == bad.getUint64(bad.getTokenCount())) && bad.getString(bad.getTokenCount()).empty() &&
+			bad.isMalformed());
+	}
+	FILE * devnull = fopen("/dev/null", "w");
+	if (NULL != devnull) {
+		bench("dump.annotated_recv", 2000, [&]() {
+			DtaAnnotatedDump(IF_RECV, recvbuf.data(), (uint32_t)recvbuf.size(), devnull);
+		});
+		bench("dump.annotated_send", 2000, [&]() {
+			DtaAnnotatedDump(IF_SEND, sendbuf.data(), (uint32_t)sendbuf.size(), devnull);
+		});
+		fclose(devnull);
+	}
+	if (sink == 0xffffffffffffffffULL) printf("\n"); // keep sink alive
+}
+
+static void hashBenchmarks()
+{
+	vector<uint8_t> hash, salt(20, 'S');
+	char password[] = "correct horse battery staple";
+	bench("hash.pbkdf2_75000", 10, [&]() {
+		DtaHashPassword(hash, password, salt);
+	});
+}
+
+static void sessionBenchmarks()
+{
+	// start, get and end session; every exec pays the 25ms poll sleep in
+	// DtaDevOpal::exec, so these are dominated by it and run few iterations
+	BenchDev fast(0), slow(1000);
+	bench("session.get_latency0", 20, [&]() {
+		fast.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+	});
+	bench("session.get_latency1ms", 10, [&]() {
+		slow.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+	});
+	// one device per thread, the sessions should overlap rather than queue
+	vector<BenchDev *> devs;
+	for (int i = 0; i < 4; i++) devs.push_back(new BenchDev(1000));
+	bench("session.get_4devices_parallel", 10, [&]() {
+		vector<thread> threads;
+		for (size_t i = 0; i < devs.size(); i++)
+			threads.push_back(thread([&devs, i]() {
+				devs[i]->sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+			}));
+		for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+	});
+	// four threads sharing one device, each session holds the device lock
+	uint32_t sharedFailed = 0;
+	bench("session.get_shared_device", 10, [&]() {
+		vector<thread> threads;
+		mutex failedLock;
+		for (size_t i = 0; i < devs.size(); i++)
+			threads.push_back(thread([&]() {
+				std::lock_guard<DtaDev> hold(*devs[0]);
+				if (devs[0]->sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID,
+						OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10)) {
+					std::lock_guard<mutex> count(failedLock);
+					sharedFailed++;
+				}
+			}));
+		for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+	});
+	check("sessions on a shared device do not interfere", 0 == sharedFailed);
+	for (size_t i = 0; i < devs.size(); i++) delete devs[i];
+	devs.clear();
+	// a rack's worth of drives unlocked from one thread
+	char unlockpw[] = "password";
+	for (int i = 0; i < 64; i++) {
+		devs.push_back(new BenchDev(1000));
+		devs.back()->no_hash_passwords = true;
+	}
+	uint8_t muxRC = 0;
+	bench("mux.unlock_64devices", 3, [&]() {
+		DtaMultiplexer mux;
+		vector<DtaMuxUnlock *> unlocks;
+		for (size_t i = 0; i < devs.size(); i++) {
+			unlocks.push_back(new DtaMuxUnlock(devs[i], unlockpw));
+			mux.add(unlocks.back());
+		}
+		muxRC |= mux.run();
+		for (size_t i = 0; i < unlocks.size(); i++) delete unlocks[i];
+	});
+	check("multiplexed unlocks succeed", 0 == muxRC);
+	for (size_t i = 0; i < devs.size(); i++) delete devs[i];
+	devs.clear();
+	// only User5 can start a Locking SP session; after the first (cold)
+	// probe the cached authority is tried first
+	BenchDev multi(0);
+	char password[] = "password";
+	multi.multistart = true;
+	multi.tper.signAuthority.assign(OPALUID[OPAL_UID::OPAL_USER1_UID], OPALUID[OPAL_UID::OPAL_USER1_UID] + 8);
+	multi.tper.signAuthority[7] = 5;
+	bench("session.multistart_user5", 5, [&]() {
+		DtaSession session(&multi);
+		session.start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID);
+	});
+	// another host's session that ends shortly: StartSession is retried
+	// with backoff and the ComID is left alone
+	BenchDev other(0);
+	uint8_t otherRC = 0;
+	bench("session.busy_wait", 3, [&]() {
+		other.tper.busy = 2;
+		otherRC |= other.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+	});
+	if (selected("session.busy_wait")) {
+		check("a busy SP is waited for", 0 == otherRC);
+		check("a busy SP is not reset", 0 == other.tper.stackResets);
+		// without -S a session that never ends is not aborted either
+		other.busy_wait = 0;
+		other.tper.wedged = 1;
+		check("a wedged SP is not reset without -S", (OPALSTATUSCODE::SP_BUSY ==
+			other.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10)) &&
+			(0 == other.tper.stackResets));
+	}
+	// a session left open by a dead process: SP_BUSY, STACK_RESET, verify
+	// and StartSession again, then the same when only a TPer Reset helps
+	uint8_t wedgedRC = 0;
+	uint8_t againRC = 0, liveRC = 0;
+	uint32_t againResets = 0, liveResets = 0;
+	bench("session.recover_stackreset", 10, [&]() {
+		BenchDev wedged(0);
+		wedged.busy_wait = 0;
+		wedged.stack_reset = true;
+		wedged.tper.wedged = 1;
+		wedgedRC |= wedged.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		// wedged again later, after sessions have worked: reset again
+		wedged.tper.wedged = 1;
+		againRC = wedged.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		againResets = wedged.tper.stackResets;
+		// busy again straight after the reset: a live session, left alone
+		wedged.tper.wedged = 1;
+		wedged.tper.busy = 100;
+		liveRC = wedged.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		liveRC |= wedged.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		liveResets = wedged.tper.stackResets;
+	});
+	if (selected("session.recover_stackreset")) {
+		check("a wedged ComID is reset with -S", 0 == wedgedRC);
+		check("a ComID wedged again after sessions worked is reset again",
+			(0 == againRC) && (2 == againResets));
+		check("a ComID busy again straight after its reset is left alone",
+			(0 != liveRC) && (3 == liveResets));
+	}
+	wedgedRC = 0;
+	uint32_t tperResets = 0;
+	vector<uint8_t> tperInfo = { 0x00, 0x00, 0x02, 0x01, 0x00, 0x03, 0x00, 0x01 };
+	bench("session.recover_tperreset", 10, [&]() {
+		BenchDev wedged(0);
+		wedged.busy_wait = 0;
+		wedged.stack_reset = true;
+		wedged.tper_reset = true;
+		wedged.tper.wedged = 2;
+		wedged.tper.rows[tperInfo][0x08] = 1;  // ProgrammaticResetEnable
+		wedgedRC |= wedged.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		tperResets += wedged.tper.tperResets;
+	});
+	if (selected("session.recover_tperreset")) {
+		check("a wedged TPer is reset with -R", (0 == wedgedRC) && (0 != tperResets));
+		BenchDev locked(0);
+		locked.busy_wait = 0;
+		locked.stack_reset = true;
+		locked.tper_reset = true;
+		locked.tper.wedged = 2;
+		check("a TPer without ProgrammaticResetEnable is not reset",
+			(0 != locked.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10)) &&
+			(0 == locked.tper.tperResets));
+	}
+	// a drive that answers in 200 ms against a 50 ms deadline, then ^C
+	if (selected("session.timeout")) {
+		BenchDev slow(200000);
+		slow.command_timeout = 50;
+		uint8_t slowRC = 0;
+		bench("session.timeout", 1, [&]() {
+			slowRC = slow.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		});
+		check("a command past its deadline times out", DTAERROR_TIMEOUT == slowRC);
+		check("a timed out command leaves the ComID alone", 0 == slow.tper.stackResets);
+		slow.stack_reset = true;
+		slowRC = slow.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		check("a timed out command resets the ComID with -S",
+			(DTAERROR_TIMEOUT == slowRC) && (0 != slow.tper.stackResets));
+		slow.command_timeout = 0;
+		uint32_t asked = 0;
+		slow.setCancelHook([](void * context) { return ++*(uint32_t *)context > 2; }, &asked);
+		auto start = chrono::steady_clock::now();
+		slowRC = slow.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		check("a cancelled command ends before the drive answers", (DTAERROR_CANCELLED == slowRC) &&
+			(chrono::steady_clock::now() - start < chrono::milliseconds(200)));
+	}
+}
+
+static void dataStoreBenchmarks()
+{
+	// whole table out and back in, one session each
+	BenchDev dev(0);
+	dev.no_hash_passwords = true;
+	char datafile[] = "/tmp/sedutil-bench-XXXXXX";
+	int fd = mkstemp(datafile);
+	if (fd < 0) return;
+	close(fd);
+	char password[] = "password";
+	bench("datastore.read_32k", 1, [&]() {
+		dev.readDataStore(password, datafile);
+	});
+	bench("datastore.write_32k", 1, [&]() {
+		dev.writeDataStore(password, datafile);
+	});
+	if (selected("datastore.read_32k")) {
+		char full[] = "/dev/full";
+		check("a DataStore read to a full disk fails",
+			DTAERROR_WRITE_ERR == dev.readDataStore(password, full));
+	}
+	unlink(datafile);
+}
+
+/** UID of row n of a Locking SP table, 0x09 Authority or 0x0b C_PIN, that
+ * belongs to a user */
+static vector<uint8_t> userRow(uint8_t table, uint8_t n)
+{
+	const uint8_t uid[8] = { 0x00, 0x00, 0x00, table, 0x00, 0x03, 0x00, n };
+	return vector<uint8_t>(uid, uid + 8);
+}
+
+/** the invokers of the calls of a method logged by tper, in order */
+static vector<vector<uint8_t> > invokers(FakeTPer & tper, const uint8_t method[8])
+{
+	vector<vector<uint8_t> > rows;
+	vector<uint8_t> wanted(method, method + 8);
+	for (size_t i = 0; i < tper.calls.size(); i++)
+		if (wanted == tper.calls[i].second) rows.push_back(tper.calls[i].first);
+	return rows;
+}
+
+/** the rows the Set calls logged by tper went to, in order */
+static vector<vector<uint8_t> > setRows(FakeTPer & tper)
+{
+	return invokers(tper, OPALMETHOD[OPAL_METHOD::SET]);
+}
+
+/** the number of sessions started in the calls logged by tper */
+static uint32_t sessions(FakeTPer & tper)
+{
+	vector<uint8_t> start(OPALMETHOD[OPAL_METHOD::STARTSESSION], OPALMETHOD[OPAL_METHOD::STARTSESSION] + 8);
+	uint32_t n = 0;
+	for (size_t i = 0; i < tper.calls.size(); i++)
+		if (start == tper.calls[i].second) n++;
+	return n;
+}
+
+/** UID of the Locking table row of non global range n */
+static vector<uint8_t> rangeRow(uint8_t n)
+{
+	const uint8_t uid[8] = { 0x00, 0x00, 0x08, 0x02, 0x00, 0x03, 0x00, n };
+	return vector<uint8_t>(uid, uid + 8);
+}
+
+/** write text to a new temporary file, name is the mkstemp template */
+static void specFile(char * name, const char * text)
+{
+	int fd = mkstemp(name);
+	size_t len = strlen(text);
+	check("spec file written", (fd >= 0) && (write(fd, text, len) == (ssize_t)len));
+	if (fd >= 0) close(fd);
+}
+
+/** set a range's extent on the fake drive */
+static void presetRange(FakeTPer & tper, uint8_t n, uint64_t start, uint64_t length)
+{
+	tper.rows[rangeRow(n)][OPAL_TOKEN::RANGESTART] = start;
+	tper.rows[rangeRow(n)][OPAL_TOKEN::RANGELENGTH] = length;
+}
+
+static void provisionBenchmarks()
+{
+	char password[] = "password";
+	// enable, keep and disable users and set passwords in one session;
+	// User4's Authority row refuses the Set, which fails that entry only
+	if (selected("provision.users")) {
+		BenchDev dev(0);
+		dev.no_hash_passwords = true;
+		dev.tper.logCalls = true;
+		dev.tper.refuse.insert(userRow(0x09, 4));
+		vector<DtaDevOpal::userProvision_t> users;
+		uint8_t provisionRC = 0;
+		bench("provision.users", 10, [&]() {
+			const struct { const char * userid; int8_t enable; const char * newpassword; } spec[] = {
+				{ "User1", 1, "one" }, { "User2", -1, "two" }, { "User3", 0, NULL },
+				{ "User4", 1, "four" }, { "User5", 1, "five" } };
+			users.clear();
+			for (size_t i = 0; i < sizeof(spec) / sizeof(spec[0]); i++) {
+				DtaDevOpal::userProvision_t user;
+				user.userid = spec[i].userid;
+				user.enable = spec[i].enable;
+				user.setPassword = (NULL != spec[i].newpassword);
+				if (user.setPassword) user.newpassword = spec[i].newpassword;
+				user.status = 0xff;
+				users.push_back(user);
+			}
+			dev.tper.calls.clear();
+			provisionRC = dev.provisionUsers(password, users);
+		});
+		vector<vector<uint8_t> > expected;
+		expected.push_back(userRow(0x09, 1));
+		expected.push_back(userRow(0x0b, 1));
+		expected.push_back(userRow(0x0b, 2));
+		expected.push_back(userRow(0x09, 3));
+		expected.push_back(userRow(0x09, 4));
+		expected.push_back(userRow(0x09, 5));
+		expected.push_back(userRow(0x0b, 5));
+		check("users are provisioned in one session", 1 == sessions(dev.tper));
+		check("users are enabled, disabled and given passwords in order", expected == setRows(dev.tper));
+		check("provisioned users are enabled or disabled",
+			(1 == dev.tper.rows[userRow(0x09, 1)][5]) && (0 == dev.tper.rows[userRow(0x09, 3)][5]) &&
+			(1 == dev.tper.rows[userRow(0x09, 5)][5]) && (0 == dev.tper.rows.count(userRow(0x09, 2))));
+		check("a refused user fails alone",
+			(OPALSTATUSCODE::NOT_AUTHORIZED == provisionRC) && (5 == users.size()) &&
+			(0 == users[0].status) && (0 == users[1].status) && (0 == users[2].status) &&
+			(OPALSTATUSCODE::NOT_AUTHORIZED == users[3].status) && (0 == users[4].status));
+	}
+	// LR1 grows into the space LR2 moves out of, which only works if LR2
+	// is moved first even though the file lists LR1 first
+	if (selected("provision.layout_shift")) {
+		BenchDev dev(0);
+		dev.no_hash_passwords = true;
+		dev.tper.logCalls = true;
+		char layoutfile[] = "/tmp/sedutil-bench-XXXXXX";
+		specFile(layoutfile, "1 0 1500 Y Y RW\n2 1500 1000 Y Y RW\n");
+		vector<uint8_t> lr1 = rangeRow(1), lr2 = rangeRow(2);
+		uint8_t layoutRC = 0;
+		bench("provision.layout_shift", 10, [&]() {
+			presetRange(dev.tper, 1, 0, 1000);
+			presetRange(dev.tper, 2, 1000, 1000);
+			dev.tper.calls.clear();
+			layoutRC = dev.applyRangeLayout(password, layoutfile);
+		});
+		unlink(layoutfile);
+		vector<vector<uint8_t> > expected;
+		expected.push_back(lr2);
+		expected.push_back(lr1);
+		check("a layout shifting adjacent ranges is applied", 0 == layoutRC);
+		check("a range moves out before its neighbour grows into the space", expected == setRows(dev.tper));
+		check("the shifted ranges end up where the layout puts them",
+			(0 == dev.tper.rows[lr1][OPAL_TOKEN::RANGESTART]) && (1500 == dev.tper.rows[lr1][OPAL_TOKEN::RANGELENGTH]) &&
+			(1500 == dev.tper.rows[lr2][OPAL_TOKEN::RANGESTART]) && (1000 == dev.tper.rows[lr2][OPAL_TOKEN::RANGELENGTH]));
+	}
+	// reconcile plans that add, shrink and remove ranges: only what differs
+	// is Set, MBR and users before ranges, and ranges in an order in which
+	// they never overlap
+	if (selected("provision.reconcile")) {
+		BenchDev dev(0);
+		dev.no_hash_passwords = true;
+		dev.tper.logCalls = true;
+		vector<uint8_t> mbrControl(OPALUID[OPAL_UID::OPAL_MBRCONTROL], OPALUID[OPAL_UID::OPAL_MBRCONTROL] + 8);
+		char addfile[] = "/tmp/sedutil-bench-XXXXXX";
+		char shrinkfile[] = "/tmp/sedutil-bench-XXXXXX";
+		char removefile[] = "/tmp/sedutil-bench-XXXXXX";
+		specFile(addfile, "mbr enable Y\nuser User1 enable\nrange 1 0 1000 Y Y RW\nrange 3 3000 1000 Y Y LK\n");
+		specFile(shrinkfile, "range 1 0 1000 Y Y RW\nrange 2 1000 1000 Y Y RW\n");
+		specFile(removefile, "range 1 0 2000 Y Y RW\nrange 2 0 0 N N RW\n");
+		uint8_t addRC = 0xff, shrinkRC = 0xff, removeRC = 0xff, dryRC = 0xff, againRC = 0xff;
+		uint32_t addSets = 0, shrinkSets = 0, removeSets = 0, drySets = 0, againSets = 0;
+		vector<vector<uint8_t> > added, shrunk, removed;
+		bench("provision.reconcile", 10, [&]() {
+			dev.tper.rows.clear();
+			presetRange(dev.tper, 1, 0, 1000);
+			dev.tper.rows[rangeRow(1)][OPAL_TOKEN::READLOCKENABLED] = 1;
+			dev.tper.rows[rangeRow(1)][OPAL_TOKEN::WRITELOCKENABLED] = 1;
+			dev.tper.calls.clear();
+			dev.tper.sets = 0;
+			dryRC = dev.reconcile(password, addfile, true);
+			drySets = dev.tper.sets;
+			addRC = dev.reconcile(password, addfile, false);
+			addSets = dev.tper.sets - drySets;
+			added = setRows(dev.tper);
+			dev.tper.sets = 0;
+			againRC = dev.reconcile(password, addfile, false);
+			againSets = dev.tper.sets;
+
+			presetRange(dev.tper, 1, 0, 2000);
+			presetRange(dev.tper, 2, 2000, 1000);
+			dev.tper.calls.clear();
+			dev.tper.sets = 0;
+			shrinkRC = dev.reconcile(password, shrinkfile, false);
+			shrinkSets = dev.tper.sets;
+			shrunk = setRows(dev.tper);
+
+			presetRange(dev.tper, 1, 0, 1000);
+			presetRange(dev.tper, 2, 1000, 1000);
+			dev.tper.calls.clear();
+			dev.tper.sets = 0;
+			removeRC = dev.reconcile(password, removefile, false);
+			removeSets = dev.tper.sets;
+			removed = setRows(dev.tper);
+		});
+		unlink(addfile);
+		unlink(shrinkfile);
+		unlink(removefile);
+		vector<vector<uint8_t> > expected;
+		expected.push_back(mbrControl);
+		expected.push_back(userRow(0x09, 1));
+		expected.push_back(rangeRow(3));
+		check("a dry run sets nothing", (0 == dryRC) && (0 == drySets));
+		check("adding a range sets MBR, user and the new range in order",
+			(0 == addRC) && (3 == addSets) && (expected == added));
+		check("an added range ends up locked where the plan puts it",
+			(3000 == dev.tper.rows[rangeRow(3)][OPAL_TOKEN::RANGESTART]) &&
+			(1000 == dev.tper.rows[rangeRow(3)][OPAL_TOKEN::RANGELENGTH]) &&
+			(1 == dev.tper.rows[rangeRow(3)][OPAL_TOKEN::READLOCKED]));
+		check("a drive that matches the plan is not set", (0 == againRC) && (0 == againSets));
+		expected.clear();
+		expected.push_back(rangeRow(1));
+		expected.push_back(rangeRow(2));
+		check("a range shrinks before its neighbour moves into the space",
+			(0 == shrinkRC) && (2 == shrinkSets) && (expected == shrunk));
+		expected.clear();
+		expected.push_back(rangeRow(2));
+		expected.push_back(rangeRow(1));
+		check("a range is removed before its neighbour grows into the space",
+			(0 == removeRC) && (2 == removeSets) && (expected == removed));
+		check("a removed range is left empty",
+			(0 == dev.tper.rows[rangeRow(2)][OPAL_TOKEN::RANGELENGTH]) &&
+			(2000 == dev.tper.rows[rangeRow(1)][OPAL_TOKEN::RANGELENGTH]));
+	}
+}
+
+static void eraseBenchmarks()
+{
+	char password[] = "password";
+	// Opal erases by a GenKey on the ActiveKey of every range, Enterprise
+	// by an Erase of every band; both go on past a range that is refused
+	if (selected("erase.all_opal")) {
+		BenchDev dev(0);
+		dev.no_hash_passwords = true;
+		dev.tper.logCalls = true;
+		vector<uint8_t> refused = rangeRow(3);
+		refused[3] = 0x06;
+		dev.tper.refuse.insert(refused);
+		uint8_t eraseRC = 0;
+		bench("erase.all_opal", 10, [&]() {
+			dev.tper.calls.clear();
+			eraseRC = dev.eraseAllLockingRanges(password);
+		});
+		vector<vector<uint8_t> > expected;
+		vector<uint8_t> key(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL] + 8);
+		key[3] = 0x06;
+		expected.push_back(key);
+		for (uint8_t i = 1; i <= FAKETPER_MAX_RANGES; i++) {
+			key = rangeRow(i);
+			key[3] = 0x06;
+			expected.push_back(key);
+		}
+		check("Opal ranges are erased in one session", 1 == sessions(dev.tper));
+		check("every Opal range gets a new key in order",
+			expected == invokers(dev.tper, OPALMETHOD[OPAL_METHOD::GENKEY]));
+		check("a refused Opal range fails the erase", OPALSTATUSCODE::NOT_AUTHORIZED == eraseRC);
+	}
+	if (selected("erase.all_enterprise")) {
+		EnterpriseBenchDev dev;
+		dev.tper.logCalls = true;
+		vector<uint8_t> band(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL] + 8);
+		vector<uint8_t> refused(band);
+		refused[7] = 0x04;  // Band3
+		dev.tper.refuse.insert(refused);
+		dev.tper.signAuthority.assign(OPALUID[OPAL_UID::ENTERPRISE_ERASEMASTER_UID],
+			OPALUID[OPAL_UID::ENTERPRISE_ERASEMASTER_UID] + 8);
+		uint8_t eraseRC = 0;
+		bench("erase.all_enterprise", 10, [&]() {
+			dev.tper.calls.clear();
+			eraseRC = dev.eraseAllLockingRanges(password);
+		});
+		vector<vector<uint8_t> > expected;
+		for (uint8_t i = 0; i <= FAKETPER_MAX_RANGES; i++) {
+			band[7] = i + 1;
+			expected.push_back(band);
+		}
+		check("Enterprise bands are erased in one EraseMaster session", 1 == sessions(dev.tper));
+		check("every Enterprise band is erased in order",
+			expected == invokers(dev.tper, OPALMETHOD[OPAL_METHOD::ERASE]));
+		check("a refused Enterprise band fails the erase", OPALSTATUSCODE::NOT_AUTHORIZED == eraseRC);
+	}
+	// fingerprint a file standing in for a drive, then "erase" all or part
+	// of it by writing new contents and check the verdict
+	if (selected("erase.verify_file")) {
+		char devfile[] = "/tmp/sedutil-bench-XXXXXX";
+		char samplefile[] = "/tmp/sedutil-bench-XXXXXX";
+		int fd = mkstemp(devfile);
+		close(mkstemp(samplefile));
+		const uint32_t blocks = 1024;
+		vector<uint8_t> contents(blocks * DTA_VERIFY_BLOCK);
+		uint64_t lcg = 1;
+		auto fill = [&](uint32_t first, uint32_t count) {
+			for (uint32_t i = first * DTA_VERIFY_BLOCK; i < (first + count) * DTA_VERIFY_BLOCK; i++) {
+				lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+				contents[i] = (uint8_t)(lcg >> 56);
+			}
+			return pwrite(fd, &contents[first * DTA_VERIFY_BLOCK], count * DTA_VERIFY_BLOCK,
+				(off_t)first * DTA_VERIFY_BLOCK) == (ssize_t)(count * DTA_VERIFY_BLOCK);
+		};
+		vector<DTA_EXTENT> all, firstHalf(1);
+		firstHalf[0].start = 0;
+		firstHalf[0].length = blocks / 2 * (DTA_VERIFY_BLOCK / 512);
+		uint8_t sameRC = 0, erasedRC = 0, halfRC = 0, partRC = 0;
+		uint64_t sameUnchanged = 0, erasedChanged = 0, erasedUnchanged = 0, partUnchanged = 0;
+		bool written = (fd >= 0) && fill(0, blocks);
+		bench("erase.verify_file", 10, [&]() {
+			// untouched, every sampled block must still match
+			DtaEraseVerify before(devfile);
+			before.fingerprint(samplefile, all);
+			DtaEraseVerify same(devfile);
+			sameRC = same.verify(samplefile);
+			sameUnchanged = same.unchanged;
+			// the whole file rewritten
+			written = written && fill(0, blocks);
+			DtaEraseVerify erased(devfile);
+			erasedRC = erased.verify(samplefile);
+			erasedChanged = erased.changed;
+			erasedUnchanged = erased.unchanged;
+			// a range covering the first half, which alone is rewritten
+			DtaEraseVerify range(devfile);
+			range.fingerprint(samplefile, firstHalf);
+			written = written && fill(0, blocks / 2);
+			DtaEraseVerify half(devfile);
+			halfRC = half.verify(samplefile);
+			// the whole file sampled, only the first half rewritten
+			DtaEraseVerify whole(devfile);
+			whole.fingerprint(samplefile, all);
+			written = written && fill(0, blocks / 2);
+			DtaEraseVerify part(devfile);
+			partRC = part.verify(samplefile);
+			partUnchanged = part.unchanged;
+		});
+		close(fd);
+		unlink(devfile);
+		unlink(samplefile);
+		check("the stand in file is written", written);
+		check("an unchanged file fails verification",
+			(DTAERROR_ERASE_NOT_VERIFIED == sameRC) && (blocks == sameUnchanged));
+		check("a rewritten file passes verification",
+			(0 == erasedRC) && (blocks == erasedChanged) && (0 == erasedUnchanged));
+		check("a rewritten range passes verification of that range", 0 == halfRC);
+		check("a half rewritten file fails verification of all of it",
+			(DTAERROR_ERASE_NOT_VERIFIED == partRC) && (blocks / 2 == partUnchanged));
+	}
+}
+
+/** A BenchDev behind the capture and replay hooks of the OS layer */
+class TraceDev : public BenchDev {
+public:
+	TraceDev(const char * name) : BenchDev(0) { dev = name; }
+	uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+		void * buffer, uint32_t bufferlen)
+	{
+		if (DtaTrace::replaying())
+			return DtaTrace::replay(dev, cmd, protocol, comID, buffer, bufferlen);
+		uint8_t rc = BenchDev::sendCmd(cmd, protocol, comID, buffer, bufferlen);
+		DtaTrace::record(dev, cmd, protocol, comID, buffer, bufferlen, rc);
+		return rc;
+	}
+};
+
+static void traceBenchmarks()
+{
+	if (!selected("trace.replay_2devices")) return;
+	char tracefile[] = "/tmp/sedutil-bench-trace-XXXXXX";
+	int fd = mkstemp(tracefile);
+	if (fd < 0) return;
+	close(fd);
+	// two drives captured interleaved, as the multiplexer or threads do
+	uint8_t captureRC = DtaTrace::startCapture(tracefile);
+	{
+		TraceDev a("/dev/sda"), b("/dev/sdb");
+		captureRC |= a.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		captureRC |= b.sessionGet(OPAL_UID::OPAL_ADMINSP_UID, OPAL_UID::OPAL_C_PIN_MSID, 0, 10);
+		captureRC |= a.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+	}
+	DtaTrace::stop();
+	struct stat st;
+	check("a trace is captured", 0 == captureRC);
+	check("a trace is readable by its owner only",
+		(0 == stat(tracefile, &st)) && (0 == (st.st_mode & (S_IRWXG | S_IRWXO))));
+	// and replayed per device in another order, without touching a drive
+	uint8_t replayRC = 0;
+	uint32_t commands = 0;
+	bench("trace.replay_2devices", 10, [&]() {
+		replayRC |= DtaTrace::startReplay(tracefile);
+		TraceDev a("/dev/sda"), b("/dev/sdb");
+		// the constructors have talked to the fakes directly
+		commands -= a.tper.commands + b.tper.commands;
+		replayRC |= b.sessionGet(OPAL_UID::OPAL_ADMINSP_UID, OPAL_UID::OPAL_C_PIN_MSID, 0, 10);
+		replayRC |= a.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		replayRC |= a.sessionGet(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL, 0, 10);
+		commands += a.tper.commands + b.tper.commands;
+	});
+	check("a two device trace replays in any device order", 0 == replayRC);
+	check("a replay sends nothing to the drive", 0 == commands);
+	DtaTrace::startReplay(tracefile);
+	TraceDev c("/dev/sdc");
+	check("a device missing from a two device trace is not replayed",
+		0 != c.sessionGet(OPAL_UID::OPAL_ADMINSP_UID, OPAL_UID::OPAL_C_PIN_MSID, 0, 10));
+	DtaTrace::stop();
+	unlink(tracefile);
+}
+
+/** A sysfs tree in a temporary directory, removed again on destruction */
+class FakeSysfs {
+public:
+	FakeSysfs()
+	{
+		char tmp[] = "/tmp/sedutil-bench-sysfs-XXXXXX";
+		if (NULL != mkdtemp(tmp)) root = tmp;
+	}
+	~FakeSysfs()
+	{
+		for (size_t i = made.size(); i > 0; i--)
+			remove(made[i - 1].c_str());
+		if (!root.empty()) rmdir(root.c_str());
+	}
+	/** create a file, and the directories leading to it, below the root */
+	void file(const string & path, const string & content)
+	{
+		parents(path);
+		ofstream f((root + "/" + path).c_str(), ios::binary);
+		f << content;
+		made.push_back(root + "/" + path);
+	}
+	/** create a symbolic link below the root */
+	void link(const string & path, const string & target)
+	{
+		parents(path);
+		if (0 == symlink(target.c_str(), (root + "/" + path).c_str()))
+			made.push_back(root + "/" + path);
+	}
+	string root;
+private:
+	void parents(const string & path)
+	{
+		for (size_t slash = path.find('/'); string::npos != slash; slash = path.find('/', slash + 1)) {
+			string dir = root + "/" + path.substr(0, slash);
+			if (0 == mkdir(dir.c_str(), 0755)) made.push_back(dir);
+		}
+	}
+	vector<string> made;
+};
+
+/** unit serial number VPD page as the kernel shows it in vpd_pg80 */
+static string vpdPage(const string & serial)
+{
+	string page("\x00\x80\x00", 3);
+	page += (char)serial.size();
+	return page + serial;
+}
+
+/** A machine with an NVMe drive, disks on SATA and virtio, a removable
+ * disk, a partition, an optical drive and a loop device */
+static void fakeMachine(FakeSysfs & sysfs)
+{
+	sysfs.file("class/nvme/nvme0/model", "Fake NVMe\n");
+	sysfs.file("class/nvme/nvme0/serial", "SER-NVME0  \n");
+	sysfs.file("class/nvme/nvme0/transport", "pcie\n");
+	sysfs.file("class/nvme/nvme0/nvme0n1/queue/rotational", "0\n");
+	// class/block entries are links into the device tree
+	string sda = "devices/pci0000:00/0000:00:17.0/ata1/host0/target0:0:0/0:0:0:0/block/sda/";
+	sysfs.file(sda + "device/type", "0\n");
+	sysfs.file(sda + "device/model", "Fake SATA\n");
+	sysfs.file(sda + "device/vpd_pg80", vpdPage("SER-SDA"));
+	sysfs.file(sda + "removable", "0\n");
+	sysfs.file(sda + "queue/rotational", "1\n");
+	sysfs.link("class/block/sda", "../../" + sda);
+	sysfs.file("class/block/sda1/partition", "1\n");
+	sysfs.file("class/block/sdb/device/type", "0\n");
+	sysfs.file("class/block/sdb/device/vpd_pg80", vpdPage("SER-SDB"));
+	sysfs.file("class/block/sdb/removable", "1\n");
+	sysfs.file("class/block/sr0/device/type", "5\n");
+	sysfs.file("class/block/loop0/removable", "0\n");
+	sysfs.file("class/block/vda/device/vendor", "0x1af4\n");
+	sysfs.file("class/block/sdaa/device/type", "0\n");
+	sysfs.file("class/block/sdaa/device/vpd_pg80", vpdPage("SER-SDAA"));
+}
+
+static void scanBenchmarks()
+{
+	if (!selected("scan.enumerate_sysfs")) return;
+	FakeSysfs sysfs;
+	if (sysfs.root.empty()) return;
+	fakeMachine(sysfs);
+	vector<DTA_BLOCKDEV> devices;
+	bench("scan.enumerate_sysfs", 100, [&]() {
+		devices.clear();
+		DtaDevLinuxScan::enumerate(devices, sysfs.root.c_str());
+	});
+	// controllers first, then the disks in kernel name order
+	string names, candidates;
+	for (size_t i = 0; i < devices.size(); i++) {
+		names += devices[i].name + " ";
+		if (devices[i].candidate) candidates += devices[i].name + " ";
+	}
+	check("scan finds nvme0 sda sdb vda sdaa", "nvme0 sda sdb vda sdaa " == names);
+	check("scan candidates are nvme0 sda sdaa", "nvme0 sda sdaa " == candidates);
+	if (5 != devices.size()) return;
+	check("nvme0 identity", ("SER-NVME0" == devices[0].serial) && ("Fake NVMe" == devices[0].model) &&
+		("/dev/nvme0" == devices[0].devref) && (1 == devices[0].namespaces.size()));
+	check("sda identity", ("SER-SDA" == devices[1].serial) && ("Fake SATA" == devices[1].model) &&
+		("sata" == devices[1].transport) && devices[1].rotational);
+	check("sdb is removable", devices[2].removable);
+}
+
+/** A lock watch whose drives are BenchDevs, named by a table of what is
+ * plugged in where */
+class BenchWatch : public DtaLockWatch {
+public:
+	BenchWatch(FILE * out) : DtaLockWatch(out) {}
+	map<string, string> plugged;  /**< serial number of the drive at each name */
+	map<string, bool> locked;     /**< lock state of each drive by serial */
+	BenchDev * last = NULL;       /**< device most recently opened */
+protected:
+	DtaDev * openDevice(const char * devref)
+	{
+		if (!plugged.count(devref)) return NULL;
+		last = new BenchDev(0);
+		last->setSerial(plugged[devref].c_str());
+		last->setLocked(locked[plugged[devref]]);
+		return last;
+	}
+};
+
+static void watchBenchmarks()
+{
+	if (!selected("watch.reopen")) return;
+	FILE * out = tmpfile();
+	if (NULL == out) return;
+	{
+		BenchWatch watch(out);
+		watch.plugged["/dev/sdx"] = "SER-ONE";
+		watch.locked["SER-ONE"] = true;
+		watch.locked["SER-TWO"] = true;
+		watch.add("/dev/sdx");
+		watch.poll();           // state, locked
+		watch.locked["SER-ONE"] = false;
+		watch.last->gone = true;
+		watch.poll();           // reset: reopened, change to unlocked
+		watch.plugged["/dev/sdx"] = "SER-TWO";
+		watch.last->gone = true;
+		watch.poll();           // hot swap: another drive, state again
+		watch.plugged.erase("/dev/sdx");
+		watch.last->gone = true;
+		watch.poll();           // removed: error
+		watch.poll();           // still removed, nothing new
+		watch.plugged["/dev/sdx"] = "SER-TWO";
+		watch.poll();           // back: state
+		check("lock watch reports every event once", 5 == watch.events);
+	}
+	rewind(out);
+	string kinds;
+	char line[256], stamp1[16], stamp2[16], name[64], kind[16];
+	while (fgets(line, sizeof(line), out))
+		if (4 == sscanf(line, "%15s %15s %63s %15s", stamp1, stamp2, name, kind))
+			kinds += string(kind) + " ";
+	fclose(out);
+	check("lock watch reopens a device that stops answering",
+		"state change state error state " == kinds);
+}
+
+/** A drive for the unlock agent: reports the lock state the drive
+ * had when it was opened and clears it again once the TPer has been
+ * told to set the global range read/write */
+class AgentDrive : public BenchDev {
+public:
+	AgentDrive(bool & state) : locked(state)
+	{
+		no_hash_passwords = true;
+		setLocked(locked);
+	}
+	~AgentDrive()
+	{
+		vector<uint8_t> global(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL],
+			OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL] + 8);
+		map<uint64_t, uint64_t> & row = tper.rows[global];
+		if (row.count(OPAL_TOKEN::READLOCKED) && row.count(OPAL_TOKEN::WRITELOCKED) &&
+			!row[OPAL_TOKEN::READLOCKED] && !row[OPAL_TOKEN::WRITELOCKED])
+			locked = false;
+	}
+private:
+	bool & locked;
+};
+
+/** An unlock agent whose drives are AgentDrives, opened by node name */
+class BenchAgent : public DtaUnlockAgent {
+public:
+	BenchAgent(const char * password, const char * sysfs) : DtaUnlockAgent(password, sysfs) {}
+	map<string, bool> locked;  /**< Opal drives present and their lock state */
+	map<string, uint32_t> opened;  /**< times each node was opened */
+protected:
+	DtaDev * openDevice(const char * devref)
+	{
+		opened[devref]++;
+		if (!locked.count(devref)) return NULL; // not an Opal drive
+		return new AgentDrive(locked[devref]);
+	}
+};
+
+/** Replays a list of events to the agent */
+class BenchEventSource : public DtaEventSource {
+public:
+	void add(const char * action, const char * subsystem, const char * devtype, const char * devname)
+	{
+		DTA_UEVENT event = { action, subsystem, devtype, devname };
+		events.push_back(event);
+	}
+	bool next(DTA_UEVENT & event)
+	{
+		if (events.empty()) return false;
+		event = events.front();
+		events.erase(events.begin());
+		return true;
+	}
+private:
+	vector<DTA_UEVENT> events;
+};
+
+static void agentBenchmarks()
+{
+	if (!selected("agent.add_event")) return;
+	FakeSysfs sysfs;
+	if (sysfs.root.empty()) return;
+	fakeMachine(sysfs);
+	BenchAgent agent("password", sysfs.root.c_str());
+	agent.manage("SER-SDA");
+	agent.manage("SER-SDAA");
+	// sda is a locked Opal drive, sdaa is managed but not Opal and the
+	// NVMe drive is Opal but not managed
+	agent.locked["/dev/sda"] = true;
+	agent.locked["/dev/nvme0"] = true;
+	BenchEventSource events;
+	events.add("add", "block", "partition", "sda1");
+	events.add("remove", "block", "disk", "sda");
+	events.add("add", "block", "disk", "sda");
+	events.add("add", "block", "disk", "sda");  // duplicate, already unlocked
+	events.add("add", "nvme", "", "nvme0");
+	events.add("add", "block", "disk", "loop0");
+	events.add("change", "block", "disk", "sdb");
+	events.add("add", "block", "disk", "sdaa");
+	DTA_UEVENT event;
+	while (events.next(event))
+		agent.handle(event);
+	check("agent unlocks sda once", (1 == agent.unlocked) && !agent.locked["/dev/sda"]);
+	check("agent reopens sda for the duplicate event", 2 == agent.opened["/dev/sda"]);
+	check("agent reports managed non Opal sdaa", (1 == agent.failures) && (1 == agent.opened["/dev/sdaa"]));
+	check("agent leaves unmanaged and non disk devices alone",
+		(2 == agent.opened.size()) && agent.locked["/dev/nvme0"]);
+	bench("agent.add_event_unlock", 10, [&]() {
+		agent.locked["/dev/sda"] = true;
+		DTA_UEVENT add = { "add", "block", "disk", "sda" };
+		agent.handle(add);
+	});
+	check("agent unlocks sda every time it is locked", !agent.locked["/dev/sda"]);
+}
+
+/** runs last, statistics can't be switched off again */
+static void statsBenchmarks()
+{
+	if (!selected("stats.print_json")) return;
+	DtaStats::enable(true);
+	DtaStats::hash("\\\\.\\PhysicalDrive0", 1000);
+	DtaStats::hash("sd\"a\"", 1000);
+	FILE * out = tmpfile();
+	if (NULL == out) return;
+	bench("stats.print_json", 100, [&]() {
+		rewind(out);
+		DtaStats::print(out);
+	});
+	string json(4096, '\0');
+	rewind(out);
+	json.resize(fread(&json[0], 1, json.size(), out));
+	fclose(out);
+	check("device names are escaped in JSON statistics",
+		(string::npos != json.find("\"device\":\"\\\\\\\\.\\\\PhysicalDrive0\"")) &&
+		(string::npos != json.find("\"device\":\"sd\\\"a\\\"\"")));
+}
+
+int main(int argc, char * argv[])
+{
+	bool json = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--json")) json = true;
+		else if (!strcmp(argv[i], "--quick")) quick = true;
+		else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+			printf("usage: %s [--json] [--quick] [filter]\n", argv[0]);
+			return 0;
+		}
+		else filter = argv[i];
+	}
+	CLog::Level() = CLog::FromInt(0);
+	RCLog::Level() = RCLog::FromInt(0);
+	encodeBenchmarks();
+	decodeBenchmarks();
+	hashBenchmarks();
+	sessionBenchmarks();
+	dataStoreBenchmarks();
+	provisionBenchmarks();
+	eraseBenchmarks();
+	traceBenchmarks();
+	scanBenchmarks();
+	agentBenchmarks();
+	watchBenchmarks();
+	statsBenchmarks();
+	if (json) {
+		printf("{\n  \"version\": \"%s\",\n  \"results\": [", GIT_VERSION);
+		for (size_t i = 0; i < results.size(); i++)
+			printf("%s\n    { \"name\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.1f, \"ops_per_sec\": %.1f }",
+				i ? "," : "", results[i].name, results[i].iterations, results[i].nsPerOp,
+				1e9 / results[i].nsPerOp);
+		printf("\n  ]\n}\n");
+	}
+	else {
+		printf("# sedutil-bench %s\n", GIT_VERSION);
+		printf("benchmark\titerations\tns_per_op\tops_per_sec\n");
+		for (size_t i = 0; i < results.size(); i++)
+			printf("%s\t%u\t%.1f\t%.1f\n", results[i].name, results[i].iterations,
+				results[i].nsPerOp, 1e9 / results[i].nsPerOp);
+	}
+	return failures ? 1 : 0;
+}
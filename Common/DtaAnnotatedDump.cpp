@@ -33,6 +33,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaSession.h"
 #include "DtaHexDump.h"
 #include "DtaAnnotatedDump.h"
+#include "DtaUIDTable.h"
 
 using namespace std;
 
@@ -255,66 +256,10 @@ int DtaToken::printTokenType(FILE *stream, uint8_t token)
 int DtaToken::printUID(FILE *stream, uint8_t buf[8])
 ////////////////////////////////////////////////////////////////////////////////
 {
-    struct uidlist
-    {
-        uint8_t         UID[8];
-        const char *    name;
-    };
-    
-    struct uidlist list1[] =
-    {
-		{ { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 }, "ThisSP" },
-		{ { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, "Session Manager UID" },
-		{ { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x01 }, "Session Properties Method UID" },
-		{ { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x02 }, "StartSessionMethod" },
-		{ { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x03 }, "SyncSession Method UID" },
-		{ { 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x06 }, "Enterprise Get" },
-		{ { 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x07 }, "Enterprise Set" },
-		{ { 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x0C }, "Enterprise Authenticate" },
-		{ { 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x10 }, "GenKey" },
-		{ { 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x11 }, "RevertSP" },
-		{ { 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x02, 0x02 }, "Revert" },
-		{ { 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x08, 0x03 }, "Erase" },
-		{ { 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x01 }, "Anybody" },
-		{ { 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x06 }, "SID" },
-		{ { 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x84, 0x01 }, "EraseMaster" },
-		{ { 0x00, 0x00, 0x00, 0x0B, 0x00, 0x00, 0x00, 0x01 }, "C_PIN" },
-		{ { 0x00, 0x00, 0x02, 0x05, 0x00, 0x00, 0x00, 0x01 }, "SP Admin" },
-		{ { 0x00, 0x00, 0x02, 0x05, 0x00, 0x01, 0x00, 0x01 }, "SP" },
-		{ { 0x00, 0x00, 0x08, 0x01, 0x00, 0x00, 0x00, 0x00 }, "Enterprise Locking Info" },
-	};
-
-    const int len1 = sizeof(list1) / sizeof(list1[0]);
-
-    for(int n=0; n<len1; n++)
-    {
-        if (!memcmp(list1[n].UID, buf, sizeof(list1[n].UID))) return fprintf(stream, "%s", list1[n].name);
-    }
-
-    // band-specific UID ?
-    const uint32_t band = uint32_t((buf[6] & 0x7F) | buf[7]) - 1;
-    if (band == uint32_t(-1)) return 0;
-
-    uint8_t buf2[8];
-    memcpy(buf2, buf, sizeof(buf2));
-    buf2[6] &= 0x80;
-    buf2[7] = 0x00;
-
-    struct uidlist list2[] =
-    {
-		{ { 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x80, 0x00 }, "BandMaster%u" },
-		{ { 0x00, 0x00, 0x08, 0x02, 0x00, 0x00, 0x00, 0x00 }, "Locking Range %u" },
-		{ { 0x00, 0x00, 0x08, 0x06, 0x00, 0x00, 0x00, 0x00 }, "Band%u_AES_256" },
-    };
-
-    const int len2 = sizeof(list2) / sizeof(list2[0]);
-
-    for(int n=0; n<len2; n++)
-    {
-        if (!memcmp(list2[n].UID, buf2, sizeof(list2[n].UID))) return fprintf(stream, list2[n].name, band);
-    }
-
-    return 0;
+    char name[48];
+    const char * p = DtaUIDName(buf, name, sizeof(name));
+    if (NULL == p) return 0;
+    return fprintf(stream, "%s", p);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -342,11 +287,9 @@ int DtaToken::printAscii(FILE *stream, uint8_t * buf, uint32_t buflen)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-uint8_t DtaAnnotatedDump(ATACOMMAND cmd, void * buffer, uint32_t bufferlen)
+uint8_t DtaAnnotatedDump(ATACOMMAND cmd, void * buffer, uint32_t bufferlen, FILE * stream)
 ////////////////////////////////////////////////////////////////////////////////
 {
-    FILE * stream = stderr;
-
     // hello
     if (cmd == IF_RECV)
         fprintf(stream, "<< IF_RECV >>\n");
@@ -33,6 +33,8 @@ DtaCommand::DtaCommand()
 	cmdbuf = (uint8_t*)((uintptr_t)cmdbuf & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
 	respbuf = responsebuffer + IO_BUFFER_ALIGNMENT;
 	respbuf = (uint8_t*)((uintptr_t)respbuf & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
+	memset(cmdbuf, 0, MAX_BUFFER_LENGTH);
+	memset(respbuf, 0, MIN_BUFFER_LENGTH);
 }
 
 /* Fill in the header information and format the call */
@@ -43,19 +45,47 @@ DtaCommand::DtaCommand(OPAL_UID InvokingUid, OPAL_METHOD method)
 	cmdbuf = (uint8_t*)((uintptr_t)cmdbuf & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
 	respbuf = responsebuffer + IO_BUFFER_ALIGNMENT;
 	respbuf = (uint8_t*)((uintptr_t)respbuf & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
+	memset(cmdbuf, 0, MAX_BUFFER_LENGTH);
+	memset(respbuf, 0, MIN_BUFFER_LENGTH);
 	reset(InvokingUid, method);
 }
 
+/** Default deadline for a method, the ones that erase or generate keys
+ * are given minutes because the TPer may do the work before answering */
+static uint32_t methodTimeout(OPAL_METHOD method)
+{
+	switch (method) {
+	case OPAL_METHOD::REVERT:
+	case OPAL_METHOD::REVERTSP:
+	case OPAL_METHOD::ACTIVATE:
+	case OPAL_METHOD::GENKEY:
+	case OPAL_METHOD::ERASE:
+		return DTA_LONG_TIMEOUT;
+	default:
+		return DTA_DEFAULT_TIMEOUT;
+	}
+}
+
 void
 DtaCommand::reset()
 {
     LOG(D1) << "Entering DtaCommand::reset()";
-    memset(cmdbuf, 0, MAX_BUFFER_LENGTH);
-	memset(respbuf, 0, MIN_BUFFER_LENGTH);
+    /* the buffers were cleared when the object was built, since then
+     * only the command up to bufferpos and the response up to the length
+     * in its header can have been written */
+    memset(cmdbuf, 0, bufferpos);
+    OPALHeader * hdr = (OPALHeader *) respbuf;
+    uint32_t respused = SWAP32(hdr->cp.length) + sizeof (OPALComPacket);
+    if (respused > MIN_BUFFER_LENGTH) respused = MIN_BUFFER_LENGTH;
+    memset(respbuf, 0, respused);
     bufferpos = sizeof (OPALHeader);
+    overrun = 0;
+    atompos = 0;
+    atomroom = 0;
+    timeout = DTA_DEFAULT_TIMEOUT;
 }
 void 
-DtaCommand::reset(OPAL_UID InvokingUid, vector<uint8_t> method){
+DtaCommand::reset(OPAL_UID InvokingUid, const vector<uint8_t> & method){
 	LOG(D1) << "Entering DtaCommand::reset(OPAL_UID,uint8_t)";
 	reset();
 	cmdbuf[bufferpos++] = OPAL_TOKEN::CALL;
@@ -63,19 +93,30 @@ DtaCommand::reset(OPAL_UID InvokingUid, vector<uint8_t> method){
 	addToken(method);
 }
 void 
-DtaCommand::reset(vector<uint8_t> InvokingUid, vector<uint8_t> method){
+DtaCommand::reset(const vector<uint8_t> & InvokingUid, const vector<uint8_t> & method){
 	LOG(D1) << "Entering DtaCommand::reset(uint8_t,uint8_t)";
 	reset();
 	cmdbuf[bufferpos++] = OPAL_TOKEN::CALL;
 	addToken(InvokingUid);
 	addToken(method);
 }
+void
+DtaCommand::reset(const uint8_t InvokingUid[8], OPAL_METHOD method)
+{
+	LOG(D1) << "Entering DtaCommand::reset(uint8_t[8], OPAL_METHOD)";
+	reset();
+	timeout = methodTimeout(method);
+	cmdbuf[bufferpos++] = OPAL_TOKEN::CALL;
+	addUID(InvokingUid);
+	addUID(OPALMETHOD[method]);
+}
 
 void
 DtaCommand::reset(OPAL_UID InvokingUid, OPAL_METHOD method)
 {
     LOG(D1) << "Entering DtaCommand::reset(OPAL_UID, OPAL_METHOD)";
     reset(); 
+    timeout = methodTimeout(method);
     cmdbuf[bufferpos++] = OPAL_TOKEN::CALL;
 	addToken(InvokingUid);
     cmdbuf[bufferpos++] = OPAL_SHORT_ATOM::BYTESTRING8;
@@ -88,6 +129,7 @@ DtaCommand::addToken(uint64_t number)
 {
     int startat = 0;
     LOG(D1) << "Entering DtaCommand::addToken(uint64_t)";
+    if (!room(9)) return;
     if (number < 64) {
         cmdbuf[bufferpos++] = (uint8_t) number & 0x000000000000003f;
     }
@@ -115,19 +157,33 @@ DtaCommand::addToken(uint64_t number)
 }
 
 void
-DtaCommand::addToken(vector<uint8_t> token)
+DtaCommand::addToken(const vector<uint8_t> & token)
 {
     LOG(D1) << "Entering addToken(vector<uint8_t>)";
-    for (uint32_t i = 0; i < token.size(); i++) {
-        cmdbuf[bufferpos++] = token[i];
-    }
+    addToken(token.data(), (uint32_t)token.size());
+}
+
+void
+DtaCommand::addToken(const uint8_t * token, uint32_t length)
+{
+    LOG(D1) << "Entering DtaCommand::addToken(uint8_t *, uint32_t)";
+    if (!room(length)) return;
+    memcpy(&cmdbuf[bufferpos], token, length);
+    bufferpos += length;
 }
 
 void
 DtaCommand::addToken(const char * bytestring)
 {
     LOG(D1) << "Entering DtaCommand::addToken(const char * )";
-    uint16_t length = (uint16_t) strlen(bytestring);
+    addToken(bytestring, (uint32_t)strlen(bytestring));
+}
+
+void
+DtaCommand::addToken(const char * bytestring, uint32_t length)
+{
+    LOG(D1) << "Entering DtaCommand::addToken(const char *, uint32_t)";
+    if (!room(length + 2)) return;
     if (length == 0) {
         /* null token e.g. default password */
         cmdbuf[bufferpos++] = (uint8_t)0xa1;
@@ -143,9 +199,12 @@ DtaCommand::addToken(const char * bytestring)
         cmdbuf[bufferpos++] = (uint8_t) (length & 0x00ff);
     }
     else {
-        /* Use Large Atom */
-        LOG(E) << "FAIL -- can't send LARGE ATOM size bytestring in 2048 Packet";
-		exit(EXIT_FAILURE);
+        /* Use Long Atom */
+        if (!room(length + 4)) return;
+        cmdbuf[bufferpos++] = 0xe2;
+        cmdbuf[bufferpos++] = (uint8_t) ((length >> 16) & 0x000000ff);
+        cmdbuf[bufferpos++] = (uint8_t) ((length >> 8) & 0x000000ff);
+        cmdbuf[bufferpos++] = (uint8_t) (length & 0x000000ff);
     }
     memcpy(&cmdbuf[bufferpos], bytestring, length);
     bufferpos += length;
@@ -156,6 +215,7 @@ void
 DtaCommand::addToken(OPAL_TOKEN token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_TOKEN)";
+    if (!room(1)) return;
     cmdbuf[bufferpos++] = (uint8_t) token;
 }
 
@@ -163,6 +223,7 @@ void
 DtaCommand::addToken(OPAL_SHORT_ATOM token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_SHORT_ATOM)";
+    if (!room(1)) return;
     cmdbuf[bufferpos++] = (uint8_t)token;
 }
 
@@ -170,6 +231,7 @@ void
 DtaCommand::addToken(OPAL_TINY_ATOM token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_TINY_ATOM)";
+    if (!room(1)) return;
     cmdbuf[bufferpos++] = (uint8_t) token;
 }
 
@@ -177,15 +239,104 @@ void
 DtaCommand::addToken(OPAL_UID token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_UID)";
+    addUID(OPALUID[token]);
+}
+
+void
+DtaCommand::addUID(const uint8_t uid[8])
+{
+    LOG(D1) << "Entering DtaCommand::addUID()";
+    if (!room(9)) return;
     cmdbuf[bufferpos++] = OPAL_SHORT_ATOM::BYTESTRING8;
-    memcpy(&cmdbuf[bufferpos], &OPALUID[token][0], 8);
+    memcpy(&cmdbuf[bufferpos], uid, 8);
     bufferpos += 8;
 }
 
+uint8_t *
+DtaCommand::startBytestring(uint32_t maxlength)
+{
+    LOG(D1) << "Entering DtaCommand::startBytestring()";
+    if (!room(maxlength + 4)) return NULL;
+    atompos = bufferpos;
+    atomroom = maxlength;
+    bufferpos += 4;
+    return &cmdbuf[bufferpos];
+}
+
 void
+DtaCommand::endBytestring(uint32_t length)
+{
+    LOG(D1) << "Entering DtaCommand::endBytestring() " << length;
+    if (0 == atompos) return;
+    if (length > atomroom) {
+        LOG(E) << "Bytestring of " << length << " bytes written in place of " << atomroom;
+        // drop the atom, complete() refuses the command. reset() only clears
+        // up to bufferpos, so clear what was written past it here
+        uint32_t written = 4 + length;
+        if (atompos + written > MAX_BUFFER_LENGTH) written = MAX_BUFFER_LENGTH - atompos;
+        memset(&cmdbuf[atompos], 0, written);
+        bufferpos = atompos;
+        atompos = 0;
+        overrun = 1;
+        return;
+    }
+    /* always a long atom, the header space was reserved before the size was known */
+    cmdbuf[atompos] = 0xe2;
+    cmdbuf[atompos + 1] = (uint8_t) ((length >> 16) & 0x000000ff);
+    cmdbuf[atompos + 2] = (uint8_t) ((length >> 8) & 0x000000ff);
+    cmdbuf[atompos + 3] = (uint8_t) (length & 0x000000ff);
+    // the reserved space past the payload becomes padding, it must be zero
+    memset(&cmdbuf[bufferpos + length], 0, atomroom - length);
+    bufferpos += length;
+    atompos = 0;
+}
+
+uint32_t
+DtaCommand::addToken(std::istream & stream, uint32_t length)
+{
+    LOG(D1) << "Entering DtaCommand::addToken(istream, uint32_t)";
+    uint8_t * payload = startBytestring(length);
+    if (NULL == payload) return 0;
+    stream.read((char *) payload, length);
+    uint32_t got = (uint32_t) stream.gcount();
+    endBytestring(got);
+    return got;
+}
+
+uint32_t
+DtaCommand::bytestringRoom()
+{
+    /* long atom header + EOD + method status list + padding */
+    const uint32_t overhead = 4 + 6 + 3;
+    if ((bufferpos + overhead) >= MAX_BUFFER_LENGTH) return 0;
+    return MAX_BUFFER_LENGTH - bufferpos - overhead;
+}
+
+bool
+DtaCommand::room(uint32_t length)
+{
+    /* EOD + method status list + up to 3 bytes of padding */
+    const uint32_t trailer = 6 + 3;
+    if ((bufferpos + length + trailer) <= MAX_BUFFER_LENGTH) return true;
+    if (!overrun) {
+        LOG(E) << "Command buffer overrun, " << length << " byte token at " << bufferpos;
+    }
+    overrun = 1;
+    return false;
+}
+
+uint8_t
 DtaCommand::complete(uint8_t EOD)
 {
     LOG(D1) << "Entering DtaCommand::complete(uint8_t EOD)";
+    if (atompos) {
+        LOG(E) << "Command completed with an unfinished bytestring";
+        overrun = 1;
+    }
+	if (overrun) {
+		LOG(E) << "Command does not fit in the command buffer, not sending it";
+		return DTAERROR_BUFFER_OVERRUN;
+	}
     if (EOD) {
         cmdbuf[bufferpos++] = OPAL_TOKEN::ENDOFDATA;
         cmdbuf[bufferpos++] = OPAL_TOKEN::STARTLIST;
@@ -204,21 +355,24 @@ DtaCommand::complete(uint8_t EOD)
     hdr->pkt.length = SWAP32((bufferpos - sizeof (OPALComPacket))
                              - sizeof (OPALPacket));
     hdr->cp.length = SWAP32(bufferpos - sizeof (OPALComPacket));
-	if (bufferpos > MAX_BUFFER_LENGTH) {
-		LOG(D1) << " Standard Buffer Overrun " << bufferpos;
-		exit(EXIT_FAILURE);
-	}
+    return 0;
 }
 
 void
-DtaCommand::changeInvokingUid(std::vector<uint8_t> Invoker)
+DtaCommand::changeInvokingUid(const std::vector<uint8_t> & Invoker)
 {
     LOG(D1) << "Entering DtaCommand::changeInvokingUid()";
     int offset = sizeof (OPALHeader) + 1; /* bytes 2-9 */
-    for (uint32_t i = 0; i < Invoker.size(); i++) {
-        cmdbuf[offset + i] = Invoker[i];
-    }
+    if (Invoker.size() > 9) return;
+    memcpy(&cmdbuf[offset], Invoker.data(), Invoker.size());
+}
 
+void
+DtaCommand::changeInvokingUid(const uint8_t Invoker[8])
+{
+    LOG(D1) << "Entering DtaCommand::changeInvokingUid(uint8_t[8])";
+    int offset = sizeof (OPALHeader) + 2; /* bytes 3-10, after the bytestring header */
+    memcpy(&cmdbuf[offset], Invoker, 8);
 }
 
 void *
@@ -253,6 +407,16 @@ DtaCommand::outputBufferSize() {
 		return((uint16_t)(bufferpos / 512) * 512);
 }
 void
+DtaCommand::setTimeout(uint32_t ms)
+{
+	timeout = ms;
+}
+uint32_t
+DtaCommand::getTimeout()
+{
+	return timeout;
+}
+void
 DtaCommand::setcomID(uint16_t comID)
 {
     OPALHeader * hdr;
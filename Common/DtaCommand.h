@@ -20,6 +20,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <vector>
+#include <istream>
 #include "DtaLexicon.h"
 class DtaDevOpal;
 class DtaDevEnterprise;
@@ -39,6 +40,8 @@ using namespace std;
 class DtaCommand {
 	friend class DtaDevOpal;
 	friend class DtaDevEnterprise;
+	friend class DtaDev;
+	friend class DtaStats;
 public:
     /** Default constructor, allocates the command and resonse buffers. */
     DtaCommand();
@@ -62,7 +65,36 @@ public:
     /** Add a Token to the bytstream of type vector<uint8_t>.
      * This token must be a complete token properly encoded
      * with the proper TCG bytestream header information  */
-    void addToken(std::vector<uint8_t> token);
+    void addToken(const std::vector<uint8_t> & token);
+    /** Add length bytes of an already encoded token to the bytestream.
+     * Like the vector form but nothing has to be built on the heap first.  */
+    void addToken(const uint8_t * token, uint32_t length);
+    /** Add a Token to the bytstream of type bytestring, length bytes long.
+     * The bytes need not be NUL terminated. */
+    void addToken(const char * bytestring, uint32_t length);
+    /** Add a bare 8 byte UID (e.g. an OPALUID[] entry) as a bytestring token */
+    void addUID(const uint8_t uid[8]);
+    /** Start a long atom bytestring whose payload the caller writes in place.
+     * The atom header is reserved and a pointer to where the payload goes
+     * in the command buffer is returned; fill in up to maxlength bytes there
+     * and then call endBytestring with the number actually written.
+     *
+     * @param maxlength the most bytes that will be written
+     * @return where to write the payload, NULL if it would not fit
+     */
+    uint8_t * startBytestring(uint32_t maxlength);
+    /** Finish the bytestring begun by startBytestring.
+     * A length over the maxlength reserved flags an overrun.
+     * @param length the number of payload bytes written
+     */
+    void endBytestring(uint32_t length);
+    /** Add length bytes read from a stream as a bytestring token, the data
+     * goes straight from the stream into the command buffer.
+     * @return the number of bytes read, less than length at end of file
+     */
+    uint32_t addToken(std::istream & stream, uint32_t length);
+    /** The largest bytestring payload that still fits in the command */
+    uint32_t bytestringRoom();
     /** Add a Token to the bytstream of type uint64. */
     void addToken(uint64_t number);
     /** Set the commid to be used in the command. */
@@ -78,7 +110,7 @@ public:
      * 
      *  @param EOD a bool to signal that command requires the EOD and method status fields 
      */
-    void complete(uint8_t EOD = 1);
+    uint8_t complete(uint8_t EOD = 1);
     /** Clears the command buffer and resets the the end of buffer pointer
      * @see bufferpos
      */
@@ -98,7 +130,7 @@ public:
      *   @param InvokingUid  The UID used to call the SSC method 
      *   @param method The SSC method to be called  
      */
-    void reset(OPAL_UID InvokingUid, vector<uint8_t> method);
+    void reset(OPAL_UID InvokingUid, const vector<uint8_t> & method);
     /** Clears the command buffer and resets the the end of buffer pointer
      * also initializes the invoker and method fields.
      * Both the invoker and method are passed as a vector<uint8_t>
@@ -106,28 +138,54 @@ public:
      *   @param InvokingUid  The UID used to call the SSC method 
      *   @param method The SSC method to be called  
      */
-    void reset(vector<uint8_t> InvokingUid, vector<uint8_t> method);
+    void reset(const vector<uint8_t> & InvokingUid, const vector<uint8_t> & method);
+    /** Clears the command buffer and resets the the end of buffer pointer
+     * also initializes the invoker and method fields.
+     * The invoker is a bare 8 byte UID, typically a row of a table.
+     *
+     *   @param InvokingUid  The UID used to call the SSC method
+     *   @param method The SSC method to be called
+     */
+    void reset(const uint8_t InvokingUid[8], OPAL_METHOD method);
     /** Changes the invoker field.
      * The invoker is passed as a vector<uint8_t> this is used for the case
      * where the invoker is not an OPAL user, typically a table. 
      * 
      *   @param Invoker  The UID used to call the SSC method
      */
-    void changeInvokingUid(vector<uint8_t> Invoker);
+    void changeInvokingUid(const vector<uint8_t> & Invoker);
+    /** Changes the invoker field to a bare 8 byte UID.
+     *
+     *   @param Invoker  The UID used to call the SSC method
+     */
+    void changeInvokingUid(const uint8_t Invoker[8]);
     /** Produce a hexdump of the response.  Typically used in debugging and tracing */
 	void dumpResponse();
     /** Produce a hexdump of the command.  Typically used in debugging and tracing */
 	void dumpCommand();
 	/** Return the space used in the command buffer (rounded to 512 bytes) */
 	uint16_t outputBufferSize();
+	/** Set how long the TPer is given to answer this command.
+	 * reset() sets a default for the method being called.
+	 * @param ms the deadline in milliseconds from when the command is sent */
+	void setTimeout(uint32_t ms);
+	/** Return how long the TPer is given to answer this command, in ms */
+	uint32_t getTimeout();
 private:
     /** return a pointer to the command buffer */
 	void * getCmdBuffer();
     /** return a pointer to the response buffer. */
 	void * getRespBuffer();
+	/** check that length more bytes fit in the command buffer, leaving room
+	 * for the trailer complete() adds.  Flags an overrun if they don't. */
+	bool room(uint32_t length);
 	uint8_t commandbuffer[MAX_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT]; /**< buffer allocation allow for 1k alignment */
 	uint8_t responsebuffer[MIN_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT]; /**< buffer allocation allow for 1k alignment */
 	uint8_t *cmdbuf;  /**< Pointer to the command buffer */
     uint8_t *respbuf;  /**< pointer to the response buffer */
     uint32_t bufferpos = 0;  /**< position of the next byte in the command buffer */
+    uint8_t overrun = 0;  /**< a token did not fit in the command buffer */
+    uint32_t atompos = 0;  /**< header of the bytestring being written in place, 0 if none */
+    uint32_t atomroom = 0;  /**< payload bytes reserved for that bytestring */
+    uint32_t timeout = DTA_DEFAULT_TIMEOUT;  /**< ms the TPer is given to answer */
 };
@@ -44,6 +44,23 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #define DTAERROR_COMMAND_ERROR				0x88
 #define DTAERROR_NO_METHOD_STATUS			0x89
 #define DTAERROR_NO_LOCKING_INFO			0x8a
+#define DTAERROR_TRACE_ERROR				0x8b
+#define DTAERROR_BUFFER_OVERRUN			0x8c
+#define DTAERROR_TIMEOUT					0x8d
+#define DTAERROR_CANCELLED					0x8e
+#define DTAERROR_ERASE_NOT_VERIFIED		0x8f
+#define DTAERROR_WRITE_ERR					0x90
+/** Time a TPer is given to answer a method, in milliseconds */
+#define DTA_DEFAULT_TIMEOUT	20000
+/** Time a TPer is given for methods that erase or generate keys */
+#define DTA_LONG_TIMEOUT	300000
+/** ComID management (security protocol 2) request codes */
+#define DTA_COMID_VERIFY	0x00000001
+#define DTA_STACK_RESET		0x00000002
+/** ComID that takes the Opal 2 TPer Reset, sent with security protocol 2 */
+#define DTA_TPER_RESET_COMID	0x0004
+/** ms the TPer is given to come back after a TPer Reset */
+#define DTA_TPER_RESET_SETTLE	500
 /** Locking Range Configurations */
 #define DTA_DISABLELOCKING		0x00
 #define DTA_READLOCKINGENABLED		0x01
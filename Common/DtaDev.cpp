@@ -26,15 +26,26 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <thread>
 #include "DtaOptions.h"
 #include "DtaDev.h"
 #include "DtaStructures.h"
 #include "DtaConstants.h"
 #include "DtaEndianFixup.h"
 #include "DtaHexDump.h"
+#include "DtaCommand.h"
+#include "DtaDevGeneric.h"
+#include "DtaDevOpal1.h"
+#include "DtaDevOpal2.h"
+#include "DtaDevEnterprise.h"
 
 using namespace std;
 
+/* Default to output that includes timestamps and goes to stderr,
+ * programs that want another choose it before they log anything */
+sedutiloutput outputFormat = sedutilNormal;
+
 /** Device Class (Base) represents a single disk device.
  *  This is the functionality that is common to all OS's and SSC's
  */
@@ -43,6 +54,319 @@ DtaDev::DtaDev()
 }
 DtaDev::~DtaDev()
 {
+	for (uint32_t i = 0; i < commandPool.size(); i++)
+		delete commandPool[i];
+}
+void DtaDev::setCancelHook(bool (*hook)(void * context), void * context)
+{
+	cancelHook = hook;
+	cancelContext = context;
+}
+uint8_t DtaDev::checkDeadline(DtaCommand * cmd, std::chrono::steady_clock::time_point sent)
+{
+	uint32_t limit = command_timeout ? command_timeout : cmd->getTimeout();
+	if ((NULL != cancelHook) && cancelHook(cancelContext)) {
+		LOG(E) << "Command cancelled";
+		return DTAERROR_CANCELLED;
+	}
+	if (std::chrono::steady_clock::now() - sent >= std::chrono::milliseconds(limit)) {
+		LOG(E) << "TPer did not answer within " << limit << " ms";
+		return DTAERROR_TIMEOUT;
+	}
+	return 0;
+}
+uint8_t DtaDev::abandonCommand(uint8_t abandonRC)
+{
+	/* the TPer still owns the ComID, taking it back aborts the session
+	 * on it, which need not be ours if another process shares the ComID */
+	if (stack_reset)
+		resetComID();
+	else
+		LOG(W) << "ComID " << HEXON(4) << comID() << HEXOFF << " is left busy until the TPer answers";
+	return abandonRC;
+}
+uint8_t DtaDev::comIDRequest(uint32_t code, uint8_t reply[32])
+{
+	LOG(D1) << "Entering DtaDev::comIDRequest()";
+	uint8_t lastRC;
+	uint8_t buffer[MIN_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT];
+	uint8_t * request = buffer + IO_BUFFER_ALIGNMENT;
+	request = (uint8_t *)((uintptr_t)request & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
+	uint16_t comid = comID();
+	/* ComID, ComID extension, request code; the reply adds two reserved
+	 * bytes, the available data length and the request specific data */
+	memset(request, 0, 512);
+	request[0] = comid >> 8;
+	request[1] = comid & 0xff;
+	request[4] = (code >> 24) & 0xff;
+	request[5] = (code >> 16) & 0xff;
+	request[6] = (code >> 8) & 0xff;
+	request[7] = code & 0xff;
+	if ((lastRC = sendCmd(IF_SEND, 0x02, comid, request, 512)) != 0) {
+		LOG(E) << "ComID request " << code << " failed on send " << (uint16_t) lastRC;
+		return lastRC;
+	}
+	/* these are answered in well under a millisecond by a healthy TPer,
+	 * poll right away and then often for up to a second */
+	for (int polls = 0; polls < 200; polls++) {
+		if (polls) osmsSleep(5);
+		memset(request, 0, 512);
+		if ((lastRC = sendCmd(IF_RECV, 0x02, comid, request, 512)) != 0) {
+			LOG(E) << "ComID request " << code << " failed on recv " << (uint16_t) lastRC;
+			return lastRC;
+		}
+		if (0 == ((request[10] << 8) | request[11]))
+			continue; // no response yet
+		memcpy(reply, request, 32);
+		return 0;
+	}
+	LOG(E) << "No response to ComID request " << code;
+	return DTAERROR_TIMEOUT;
+}
+uint8_t DtaDev::stackReset()
+{
+	LOG(D1) << "Entering DtaDev::stackReset()";
+	uint8_t lastRC;
+	uint8_t reply[32];
+	if ((lastRC = comIDRequest(DTA_STACK_RESET, reply)) != 0) {
+		LOG(E) << "STACK_RESET failed";
+		return lastRC;
+	}
+	if (0 != reply[15]) {
+		LOG(E) << "TPer reported STACK_RESET failure on ComID " << HEXON(4) << comID() << HEXOFF;
+		return DTAERROR_COMMAND_ERROR;
+	}
+	LOG(D1) << "ComID " << HEXON(4) << comID() << HEXOFF << " reset";
+	return 0;
+}
+uint8_t DtaDev::resetComID()
+{
+	LOG(D1) << "Entering DtaDev::resetComID()";
+	uint8_t lastRC;
+	uint32_t state = 0;
+	// there is nothing to verify if the TPer refused the reset
+	if (((lastRC = stackReset()) != 0) || ((lastRC = verifyComID(state)) != 0)) {
+		LOG(E) << "ComID " << HEXON(4) << comID() << HEXOFF << " could not be taken back";
+		return lastRC;
+	}
+	return 0;
+}
+uint8_t DtaDev::verifyComID(uint32_t & state)
+{
+	LOG(D1) << "Entering DtaDev::verifyComID()";
+	uint8_t lastRC;
+	uint8_t reply[32];
+	if ((lastRC = comIDRequest(DTA_COMID_VERIFY, reply)) != 0)
+		return lastRC;
+	state = (reply[12] << 24) | (reply[13] << 16) | (reply[14] << 8) | reply[15];
+	LOG(D1) << "ComID " << HEXON(4) << comID() << HEXOFF << " state " << state;
+	// 0 Invalid, 1 Inactive, 2 Issued, 3 Associated
+	if (0 == state) {
+		LOG(E) << "TPer reports ComID " << HEXON(4) << comID() << HEXOFF << " invalid";
+		return DTAERROR_COMMAND_ERROR;
+	}
+	return 0;
+}
+uint8_t DtaDev::tperReset()
+{
+	LOG(D1) << "Entering DtaDev::tperReset()";
+	uint8_t lastRC;
+	uint8_t buffer[MIN_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT];
+	uint8_t * request = buffer + IO_BUFFER_ALIGNMENT;
+	request = (uint8_t *)((uintptr_t)request & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
+	// the content is ignored, only the ComID matters
+	memset(request, 0, 512);
+	if ((lastRC = sendCmd(IF_SEND, 0x02, DTA_TPER_RESET_COMID, request, 512)) != 0) {
+		LOG(E) << "TPer Reset failed on send " << (uint16_t) lastRC;
+		return lastRC;
+	}
+	return 0;
+}
+uint8_t DtaDev::getProgrammaticResetEnable(bool & enabled)
+{
+	LOG(D1) << "Entering DtaDev::getProgrammaticResetEnable()";
+	enabled = false;
+	LOG(D) << "The TPer Reset is not supported on " << dev;
+	return DTAERROR_INVALID_COMMAND;
+}
+uint8_t DtaDev::recoverComID()
+{
+	LOG(D1) << "Entering DtaDev::recoverComID()";
+	uint8_t lastRC;
+	std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+	if (comIDRecovered) {
+		LOG(E) << "ComID " << HEXON(4) << comID() << HEXOFF << " is busy again, not resetting it twice";
+		return DTAERROR_COMMAND_ERROR;
+	}
+	comIDRecovered = true;
+	/* only the Locking SP is held, so TPerInfo can still be read; the TPer
+	 * ignores a TPer Reset unless ProgrammaticResetEnable is set */
+	bool resettable = false;
+	if (tper_reset && (getProgrammaticResetEnable(resettable) != 0)) {
+		LOG(W) << "Unable to read ProgrammaticResetEnable, the TPer will not be reset";
+	}
+	LOG(W) << "ComID " << HEXON(4) << comID() << HEXOFF << " is busy, resetting it";
+	if ((lastRC = resetComID()) != 0) {
+		if (!resettable) {
+			if (tper_reset) {
+				LOG(E) << "ProgrammaticResetEnable is not set, the TPer can't be reset";
+			}
+			return lastRC;
+		}
+		/* a TPer Reset also ends every session on every ComID and
+		 * relocks the ranges that have Programmatic in LockOnReset */
+		LOG(W) << "STACK_RESET did not recover the ComID, resetting the TPer";
+		if ((lastRC = tperReset()) != 0)
+			return lastRC;
+		std::this_thread::sleep_for(std::chrono::milliseconds(DTA_TPER_RESET_SETTLE));
+		if ((lastRC = resetComID()) != 0)
+			return lastRC;
+	}
+	LOG(I) << "ComID " << HEXON(4) << comID() << HEXOFF << " recovered in " <<
+		std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - began).count() << " ms";
+	return 0;
+}
+uint8_t DtaDev::post(DtaCommand * cmd, uint8_t protocol)
+{
+	LOG(D1) << "Entering DtaDev::post()";
+	std::lock_guard<DtaDev> hold(*this);
+	uint8_t lastRC;
+	if (cmd->overrun) {
+		LOG(E) << "Command not sent, it did not fit in the command buffer";
+		return DTAERROR_BUFFER_OVERRUN;
+	}
+	OPALHeader * hdr = (OPALHeader *) cmd->getCmdBuffer();
+	LOG(D3) << endl << "Dumping command buffer";
+	IFLOG(D3) DtaHexDump(cmd->getCmdBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
+	if ((lastRC = sendCmd(IF_SEND, protocol, comID(), cmd->getCmdBuffer(), cmd->outputBufferSize())) != 0) {
+		LOG(E) << "Command failed on send " << (uint16_t) lastRC;
+		return lastRC;
+	}
+	return 0;
+}
+uint8_t DtaDev::poll(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol,
+	std::chrono::steady_clock::time_point sent, bool & done)
+{
+	LOG(D1) << "Entering DtaDev::poll()";
+	std::lock_guard<DtaDev> hold(*this);
+	uint8_t lastRC, abandonRC;
+	OPALHeader * hdr = (OPALHeader *) cmd->getRespBuffer();
+	done = true;
+	memset(cmd->getRespBuffer(), 0, MIN_BUFFER_LENGTH);
+	lastRC = sendCmd(IF_RECV, protocol, comID(), cmd->getRespBuffer(), MIN_BUFFER_LENGTH);
+	if ((0 != hdr->cp.outstandingData) && (0 == hdr->cp.minTransfer)) {
+		if (0 != (abandonRC = checkDeadline(cmd, sent)))
+			return abandonCommand(abandonRC);
+		done = false;
+		return 0;
+	}
+	LOG(D3) << std::endl << "Dumping reply buffer";
+	IFLOG(D3) DtaHexDump(cmd->getRespBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
+	if (0 != lastRC) {
+		LOG(E) << "Command failed on recv, returned " << (uint16_t) lastRC;
+		return lastRC;
+	}
+	resp.init(cmd->getRespBuffer());
+	return 0;
+}
+/* A handful covers the deepest nesting of commands in flight at once
+ * (a session command plus the one it runs). */
+#define DTA_COMMAND_POOL_MAX 4
+DtaCommand * DtaDev::getCommand()
+{
+	LOG(D1) << "Entering DtaDev::getCommand " << commandPool.size();
+	std::lock_guard<DtaDev> hold(*this);
+	if (commandPool.empty())
+		return new DtaCommand();
+	DtaCommand * cmd = commandPool.back();
+	commandPool.pop_back();
+	return cmd;
+}
+void DtaDev::releaseCommand(DtaCommand * cmd)
+{
+	LOG(D1) << "Entering DtaDev::releaseCommand " << commandPool.size();
+	if (NULL == cmd) return;
+	std::lock_guard<DtaDev> hold(*this);
+	if (commandPool.size() >= DTA_COMMAND_POOL_MAX) {
+		delete cmd;
+		return;
+	}
+	cmd->reset();
+	commandPool.push_back(cmd);
+}
+bool DtaDev::getCached(const char * name, std::string & value)
+{
+	lock_guard<mutex> guard(cacheLock);
+	map<string, string>::iterator cached = cachedStrings.find(name);
+	if (cached == cachedStrings.end()) return false;
+	LOG(D1) << name << " read from cache";
+	value = cached->second;
+	return true;
+}
+bool DtaDev::getCached(const char * name, uint64_t & value)
+{
+	lock_guard<mutex> guard(cacheLock);
+	map<string, uint64_t>::iterator cached = cachedUints.find(name);
+	if (cached == cachedUints.end()) return false;
+	LOG(D1) << name << " read from cache";
+	value = cached->second;
+	return true;
+}
+void DtaDev::setCached(const char * name, const std::string & value)
+{
+	lock_guard<mutex> guard(cacheLock);
+	cachedStrings[name] = value;
+}
+void DtaDev::setCached(const char * name, uint64_t value)
+{
+	lock_guard<mutex> guard(cacheLock);
+	cachedUints[name] = value;
+}
+uint32_t DtaDev::getLogicalBlockSize()
+{
+	return disk_info.Geometry_logicalBlockSize ? disk_info.Geometry_logicalBlockSize : 512;
+}
+void DtaDev::globalExtents(std::vector<DTA_EXTENT> ranges, std::vector<DTA_EXTENT> & extents)
+{
+	extents.clear();
+	std::sort(ranges.begin(), ranges.end(),
+		[](const DTA_EXTENT & a, const DTA_EXTENT & b) { return a.start < b.start; });
+	uint64_t next = 0;
+	for (uint32_t i = 0; i < ranges.size(); i++) {
+		if (0 == ranges[i].length) continue;
+		if (ranges[i].start > next) {
+			DTA_EXTENT gap = { next, ranges[i].start - next };
+			extents.push_back(gap);
+		}
+		next = std::max(next, ranges[i].start + ranges[i].length);
+	}
+	DTA_EXTENT rest = { next, UINT64_MAX - next };
+	extents.push_back(rest);
+}
+uint8_t DtaDev::getDevice(const char * devref, DtaDev * & device)
+{
+	LOG(D1) << "Entering DtaDev::getDevice " << devref;
+	device = NULL;
+	DtaDev * tempDev = new DtaDevGeneric(devref);
+	if ((!tempDev->isPresent()) || (!tempDev->isAnySSC())) {
+		LOG(E) << "Invalid or unsupported disk " << devref;
+		delete tempDev;
+		return DTAERROR_COMMAND_ERROR;
+	}
+	if (tempDev->isOpal2())
+		device = new DtaDevOpal2(devref);
+	else if (tempDev->isOpal1())
+		device = new DtaDevOpal1(devref);
+	else if (tempDev->isEprise())
+		device = new DtaDevEnterprise(devref);
+	delete tempDev;
+	if (NULL == device) {
+		LOG(E) << "Unknown OPAL SSC ";
+		return DTAERROR_INVALID_COMMAND;
+	}
+	device->no_hash_passwords = false;
+	return 0;
 }
 uint8_t DtaDev::isOpal2()
 {
@@ -102,13 +426,18 @@ char *DtaDev::getSerialNum()
 {
 	return (char *)&disk_info.serialNum;
 }
+const char *DtaDev::getDevName()
+{
+	return dev;
+}
 DTA_DEVICE_TYPE DtaDev::getDevType()
 	{
 		return disk_info.devType;
 	}
-void DtaDev::discovery0()
+uint8_t DtaDev::discovery0()
 {
     LOG(D1) << "Entering DtaDev::discovery0()";
+	std::lock_guard<DtaDev> hold(*this);
 	uint8_t lastRC;
     void * d0Response = NULL;
     uint8_t * epos, *cpos;
@@ -119,7 +448,7 @@ void DtaDev::discovery0()
 	memset(d0Response, 0, MIN_BUFFER_LENGTH);
     if ((lastRC = sendCmd(IF_RECV, 0x01, 0x0001, d0Response, MIN_BUFFER_LENGTH)) != 0) {
         LOG(D) << "Send D0 request to device failed " << (uint16_t)lastRC;
-        return;
+        return lastRC;
     }
 
     epos = cpos = (uint8_t *) d0Response;
@@ -210,6 +539,43 @@ void DtaDev::discovery0()
     }
     while (cpos < epos);
 
+    return 0;
+}
+/* Locking is feature 0x0002 and features come in order, so it is always
+ * within the first few dozen bytes of the Discovery 0 response */
+#define DTA_LOCKING_D0_LENGTH 512
+uint8_t DtaDev::refreshLocking()
+{
+	LOG(D1) << "Entering DtaDev::refreshLocking()";
+	uint8_t lastRC;
+	uint8_t buffer[DTA_LOCKING_D0_LENGTH + IO_BUFFER_ALIGNMENT];
+	uint8_t * d0 = buffer + IO_BUFFER_ALIGNMENT;
+	d0 = (uint8_t *)((uintptr_t)d0 & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
+	memset(d0, 0, DTA_LOCKING_D0_LENGTH);
+	if ((lastRC = sendCmd(IF_RECV, 0x01, 0x0001, d0, DTA_LOCKING_D0_LENGTH)) != 0) {
+		LOG(D) << "Send D0 request to device failed " << (uint16_t)lastRC;
+		return lastRC;
+	}
+	/* the length does not count the length field itself */
+	uint32_t length = SWAP32(((Discovery0Header *) d0)->length) + 4;
+	if (length > DTA_LOCKING_D0_LENGTH) length = DTA_LOCKING_D0_LENGTH;
+	/* feature code, version, length and the flags byte */
+	for (uint8_t * cpos = d0 + 48; cpos + 5 <= d0 + length; ) {
+		Discovery0Features * body = (Discovery0Features *) cpos;
+		uint16_t code = SWAP16(body->TPer.featureCode);
+		if (FC_LOCKING == code) {
+			disk_info.Locking = 1;
+			disk_info.Locking_locked = body->locking.locked;
+			disk_info.Locking_lockingEnabled = body->locking.lockingEnabled;
+			disk_info.Locking_MBRDone = body->locking.MBRDone;
+			disk_info.Locking_MBREnabled = body->locking.MBREnabled;
+			return 0;
+		}
+		if (code > FC_LOCKING) break;
+		cpos = cpos + (body->TPer.length + 4);
+	}
+	LOG(D) << "No Locking feature in Discovery 0 response";
+	return DTAERROR_NO_LOCKING_INFO;
 }
 void DtaDev::puke()
 {
@@ -21,6 +21,10 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaStructures.h"
 #include "DtaLexicon.h"
 #include <vector>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
 #include "DtaOptions.h"
 #include "DtaResponse.h"
 class DtaCommand;
@@ -31,6 +35,16 @@ using namespace std;
  * This is a virtual base class defining the minimum functionality of device
  * object.  The methods defined here are called by other parts of the program 
  * so must be present in all devices
+ *
+ * Threading: a device object carries the state of the operation in progress
+ * (the session, the last response, the command pool), so calls on it are
+ * serialized by its lock. A thread sharing a device with other threads
+ * holds the lock around each call, std::lock_guard<DtaDev> hold(*d);
+ * exec, post, poll, discovery0 and the command pool take it themselves so
+ * two commands never share the ComID. Different device objects can be used
+ * from different threads in parallel; what they share (the MSID/authority
+ * caches, statistics, trace capture and log output) is locked. Set the log
+ * levels, output format and trace/statistics options before starting threads.
  */
 class DtaDev {
 public:
@@ -62,6 +76,8 @@ public:
 	char *getModelNum();
 	/** Returns the Serial Number reported by the Identify command */
 	char *getSerialNum();
+	/** Returns the name the device was opened with */
+	const char *getDevName();
 	/* What type of disk attachment is used */
 	DTA_DEVICE_TYPE getDevType();
 	/** displays the information returned by the Discovery 0 reply */
@@ -71,8 +87,15 @@ public:
 	 * that can be queried later as required.This code also takes care of
 	 * the endianess conversions either via a bitswap in the structure or executing
 	 * a macro when the input buffer is read.
+	 * @return 0 or the error from sending the request, the disk info is
+	 * left as it was if the request failed
 	 */
-	void discovery0();
+	uint8_t discovery0();
+	/** Re-read just the Locking feature of Discovery 0, no session is
+	 * needed.  Locked(), MBRDone(), MBREnabled() and LockingEnabled()
+	 * then report the current state.
+	 */
+	uint8_t refreshLocking();
 
 	/*
 	 * virtual methods required in the OS specific
@@ -147,6 +170,22 @@ public:
 	 * @param filename the filename of the disk image
 	 */
 	virtual uint8_t loadPBA(char * password, char * filename) = 0;
+	/** Copy the contents of the DataStore table to a file.
+	 * @param password the password for the administrative authority with access to the table
+	 * @param filename the file to be written
+	 */
+	virtual uint8_t readDataStore(char * password, char * filename) = 0;
+	/** Write a file to the start of the DataStore table.
+	 * @param password the password for the administrative authority with access to the table
+	 * @param filename the file to be written to the table
+	 */
+	virtual uint8_t writeDataStore(char * password, char * filename) = 0;
+	/** Enable or disable users and set their passwords from a file, all in
+	 * one session of the Locking SP administrative authority.
+	 * @param password the password for the administrative authority
+	 * @param filename lines of "<userid> <enable|disable|keep> [newpassword]"
+	 */
+	virtual uint8_t provisionUsers(char * password, char * filename) = 0;
 	/** Change the locking state of a locking range
 	 * @param lockingrange The number of the locking range (0 = global)
 	 * @param lockingstate  the locking state to set
@@ -190,6 +229,23 @@ public:
 	*  @param password Password of administrator
 	*/
 	virtual uint8_t listLockingRanges(char * password, int16_t rangeid) = 0;
+	/** Set up the locking ranges listed in a file in one session.  Each line is
+	 *  "<range> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>".
+	 *  @param password Password of administrator
+	 *  @param filename the range layout
+	 */
+	virtual uint8_t applyRangeLayout(char * password, char * filename) = 0;
+	/** Bring the drive to the state described in a file, changing only what
+	 * differs.  Each line is one of
+	 *   lockingsp active
+	 *   mbr <enable|done> <Y|N>
+	 *   user <userid> <enable|disable>
+	 *   range <0...n> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>
+	 * @param password Password of administrator
+	 * @param filename the desired state
+	 * @param dryrun report the changes without making them
+	 */
+	virtual uint8_t reconcile(char * password, char * filename, bool dryrun) = 0;
 	/** Generate a new encryption key for a locking range.
 	* @param lockingrange locking range number
 	* @param password password of the locking administrative authority
@@ -249,6 +305,22 @@ public:
 	 * @param password Password of administrative authority for locking range
 	 */
 	virtual uint8_t eraseLockingRange(uint8_t lockingrange, char * password) = 0;
+	/** Erase every locking range, the global range included, in a
+	 * single session and report the result and time taken for each
+	 * @param password Password of administrative authority for locking range
+	 */
+	virtual uint8_t eraseAllLockingRanges(char * password) = 0;
+	/** The blocks an erase of a locking range destroys, read from the
+	 * locking table.  The global range holds what the other ranges leave,
+	 * its last extent runs to the end of the device (length UINT64_MAX - start).
+	 * @param lockingrange The number of the locking range (0 = global)
+	 * @param password Password of administrative authority for locking range
+	 * @param extents receives the extents in ascending order
+	 */
+	virtual uint8_t getRangeExtents(uint8_t lockingrange, char * password,
+		std::vector<DTA_EXTENT> & extents) = 0;
+	/** logical block size from the Geometry feature, 512 if not reported */
+	uint32_t getLogicalBlockSize();
 	/** Dumps an object for diagnostic purposes
 	 * @param sp index into the OPALUID table for the SP the object is in
 	 * @param auth the authority ti use for the dump
@@ -271,6 +343,16 @@ public:
 	/** Read MSID
 	 */
 	virtual uint8_t printDefaultPassword() = 0;
+	/** The MSID password.  It can't change for the life of the drive so it
+	 * is read once, in its own anonymous session, and cached.
+	 * @param msid where the MSID is returned
+	 */
+	virtual uint8_t getMSID(std::string & msid) = 0;
+	/** Open a drive as the device object that matches the SSC it reports
+	 * @param devref character representation of the device is standard OS lexicon
+	 * @param device where the new object is returned, NULL on error
+	 */
+	static uint8_t getDevice(const char * devref, DtaDev * & device);
 	/*
 	* virtual functions required to be implemented
 	* because they are called by DtaSession.cpp
@@ -283,16 +365,140 @@ public:
 	virtual uint8_t exec(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol = 0x01) = 0;
 	/** return the communications ID to be used for sessions to this device */
 	virtual uint16_t comID() = 0;
+	/** Get a command object from this device's pool, creating one if the
+	 * pool is empty.  Hand it back with releaseCommand when done.
+	 */
+	DtaCommand * getCommand();
+	/** Return a command object obtained from getCommand to the pool
+	 * @param cmd the command object, may be NULL
+	 */
+	void releaseCommand(DtaCommand * cmd);
+	/** Install a hook that exec calls between IF_RECV polls, returning
+	 * true from it abandons the command in flight.
+	 * @param hook the function to call, NULL to remove the hook
+	 * @param context passed to the hook
+	 */
+	void setCancelHook(bool (*hook)(void * context), void * context);
+	/** Abandon whatever is outstanding on the ComID with a security
+	 * protocol 2 STACK_RESET, closing any open session.
+	 */
+	uint8_t stackReset();
+	/** Ask the TPer for the state of the ComID with a security protocol 2
+	 * VERIFY_COMID_VALID request
+	 * @param state 0 Invalid, 1 Inactive, 2 Issued or 3 Associated
+	 * @return DTAERROR_COMMAND_ERROR if the ComID is invalid
+	 */
+	uint8_t verifyComID(uint32_t & state);
+	/** STACK_RESET the ComID and, if the TPer accepted that, check with
+	 * verifyComID that it is valid again
+	 */
+	uint8_t resetComID();
+	/** Send the Opal 2 TPer Reset, ending every session on the drive.
+	 * The TPer only acts on it if ProgrammaticResetEnable is set.
+	 */
+	uint8_t tperReset();
+	/** Read ProgrammaticResetEnable from the TPerInfo table, whether the
+	 * TPer acts on a TPer Reset at all
+	 * @param enabled the value of the column
+	 */
+	virtual uint8_t getProgrammaticResetEnable(bool & enabled);
+	/** Free a ComID left busy by a session nobody will end: STACK_RESET,
+	 * check the ComID is valid again and, if that did not work, tper_reset
+	 * allows it and the TPer has ProgrammaticResetEnable set, do the same
+	 * after a TPer Reset.
+	 * Tried again only once a session has started since, a ComID that is
+	 * busy again straight away belongs to a session that is alive and is
+	 * left alone.
+	 */
+	uint8_t recoverComID();
+	/** A session has started, a ComID busy from now on may be recovered again */
+	void comIDWorking() { comIDRecovered = false; }
+	/** Send a command without waiting for the response, the first half
+	 * of exec for callers that keep commands in flight on several devices
+	 * from one thread.  Collect the response with poll.
+	 * @param cmd the command, complete and with the session numbers set
+	 * @param protocol The security protocol number to use for the command
+	 */
+	uint8_t post(DtaCommand * cmd, uint8_t protocol = 0x01);
+	/** One IF_RECV for a command sent with post
+	 * @param cmd the command in flight
+	 * @param resp filled in once the TPer has answered
+	 * @param protocol the security protocol the command was sent with
+	 * @param sent when post returned, for the command deadline
+	 * @param done set once there is nothing more to wait for
+	 * @return 0 while waiting or once answered, otherwise the error that
+	 * ended the command (see abandonCommand)
+	 */
+	uint8_t poll(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol,
+		std::chrono::steady_clock::time_point sent, bool & done);
+	/** Take the device for a call, the lock is recursive */
+	void lock() { callLock.lock(); }
+	/** @see lock */
+	bool try_lock() { return callLock.try_lock(); }
+	/** Give the device back after a call */
+	void unlock() { callLock.unlock(); }
 	bool no_hash_passwords; /** disables hashing of passwords */
+	uint32_t command_timeout = 0; /** ms allowed per command, 0 for the method default */
+	bool multistart = false; /** retry refused Locking SP sessions as User1..User8 */
+	uint32_t busy_wait = 3000; /** ms a StartSession refused as busy is retried for */
+	bool stack_reset = false; /** a ComID still busy after busy_wait, or left busy by an abandoned command, may be reset */
+	bool tper_reset = false; /** recoverComID may reset the whole TPer */
 	sedutiloutput output_format; /** standard, readable, JSON */
 protected:
 	const char * dev;   /**< character string representing the device in the OS lexicon */
 	uint8_t isOpen = FALSE;  /**< The device has been opened */
+	bool comIDRecovered = false;  /**< recoverComID has been tried since the last session started */
 	OPAL_DiskInfo disk_info;  /**< Structure containing info from identify and discovery 0 */
-	DtaResponse response;   /**< shared response object */
+	DtaResponse response;   /**< response of the call in progress */
 	DtaResponse propertiesResponse;  /**< response fron properties exchange */
-	DtaSession *session;  /**< shared session object pointer */
+	DtaSession *session;  /**< session of the call in progress */
 	uint8_t discovery0buffer[MIN_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT];
 	uint32_t tperMaxPacket = 2048;
 	uint32_t tperMaxToken = 1950;
+	vector<DtaCommand *> commandPool;  /**< idle command objects for reuse */
+	/** Look up a value that never changes for the life of the drive
+	 * @param name what the value is, e.g. "MSID"
+	 * @param value where the value is returned
+	 * @return false if it hasn't been read yet
+	 */
+	bool getCached(const char * name, std::string & value);
+	/** @see getCached */
+	bool getCached(const char * name, uint64_t & value);
+	/** Remember a value that never changes for the life of the drive
+	 * @param name what the value is
+	 * @param value the value read from the drive
+	 */
+	void setCached(const char * name, const std::string & value);
+	/** @see setCached */
+	void setCached(const char * name, uint64_t value);
+	std::map<std::string, std::string> cachedStrings;  /**< immutable string values by name */
+	std::map<std::string, uint64_t> cachedUints;  /**< immutable numeric values by name */
+	std::mutex cacheLock;  /**< guards the cached values */
+	std::recursive_mutex callLock;  /**< serializes the calls on the device */
+	/** Called by exec between IF_RECV polls.
+	 * @param cmd the command being waited for
+	 * @param sent when the command was sent
+	 * @return 0 to keep waiting, DTAERROR_TIMEOUT once the deadline of the
+	 * command has passed or DTAERROR_CANCELLED if the cancel hook fired
+	 */
+	uint8_t checkDeadline(DtaCommand * cmd, std::chrono::steady_clock::time_point sent);
+	/** Give up on a command checkDeadline ended, resetting the ComID the
+	 * TPer still owns only if stack_reset allows it
+	 * @param abandonRC the code checkDeadline returned
+	 * @return abandonRC
+	 */
+	uint8_t abandonCommand(uint8_t abandonRC);
+	/** Send a security protocol 2 ComID management request to the ComID
+	 * and wait for the TPer to answer it
+	 * @param code the request code, e.g. DTA_STACK_RESET
+	 * @param reply the first 32 bytes of the answer
+	 */
+	uint8_t comIDRequest(uint32_t code, uint8_t reply[32]);
+	/** The extents of the global range: the gaps the other ranges leave
+	 * @param ranges the other ranges, empty ones are ignored
+	 * @param extents receives the gaps, the last runs to the end of the device
+	 */
+	static void globalExtents(std::vector<DTA_EXTENT> ranges, std::vector<DTA_EXTENT> & extents);
+	bool (*cancelHook)(void * context) = NULL;  /**< cooperative cancellation */
+	void * cancelContext = NULL;  /**< argument for cancelHook */
 };
@@ -23,6 +23,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <fstream>
 #include<iomanip>
+#include <chrono>
 #include "DtaDevEnterprise.h"
 #include "DtaHashPwd.h"
 #include "DtaEndianFixup.h"
@@ -31,6 +32,8 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaResponse.h"
 #include "DtaSession.h"
 #include "DtaHexDump.h"
+#include "DtaUIDTable.h"
+#include "DtaStats.h"
 #include "DtaAnnotatedDump.h"
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -101,6 +104,12 @@ uint8_t DtaDevEnterprise::getMaxRanges(char * password, uint16_t *maxRanges)
     //
     // Therefore: 0 <= supported range <= MaxRanges
 
+	uint64_t ranges;
+	if (getCached("MaxRanges", ranges)) {
+		*maxRanges = (uint16_t) ranges;
+		return 0;
+	}
+
     // create session
 	session = new DtaSession(this);
 	if (session == NULL) {
@@ -123,8 +132,12 @@ uint8_t DtaDevEnterprise::getMaxRanges(char * password, uint16_t *maxRanges)
 	}
 	delete session;
 
-    // "MaxRanges" is token 5 of response
-	*maxRanges = response.getUint16(5);
+	if (!response.getColumn("MaxRanges", ranges)) {
+		LOG(E) << "LockingInfo table did not return MaxRanges";
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	setCached("MaxRanges", ranges);
+	*maxRanges = (uint16_t) ranges;
     return 0;
 }
 
@@ -157,8 +170,13 @@ uint8_t DtaDevEnterprise::getMaxRangesOpal(char * password, uint16_t *maxRanges)
 	}
 	delete session;
 
-    // "MaxRanges" is token 5 of response
-	*maxRanges = response.getUint16(5);
+	uint64_t ranges;
+	if (!response.getColumn("MaxRanges", ranges)) {
+		LOG(E) << "LockingInfo table did not return MaxRanges";
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	setCached("MaxRanges", ranges);
+	*maxRanges = (uint16_t) ranges;
     return 0;
 }
 
@@ -168,6 +186,9 @@ DtaDevEnterprise::DtaDevEnterprise(const char * devref)
 	assert(isEprise());
 	if (properties()) { LOG(E) << "Properties exchange failed"; }
 }
+DtaDevEnterprise::DtaDevEnterprise()
+{
+}
 DtaDevEnterprise::~DtaDevEnterprise()
 {
 }
@@ -234,7 +255,7 @@ uint8_t DtaDevEnterprise::configureLockingRange(uint8_t lockingrange, uint8_t en
     vector<uint8_t> method;
     set8(method, OPALMETHOD[OPAL_METHOD::ESET]);
 
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (set == NULL) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -268,10 +289,10 @@ uint8_t DtaDevEnterprise::configureLockingRange(uint8_t lockingrange, uint8_t en
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "Set Failed ";
 		delete session;
-		delete set;
+		releaseCommand(set);
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	LOG(I) << "Locking range configured " << (uint16_t) enabled;
 	LOG(D1) << "Exiting DtaDevEnterprise::configureLockingRange()";
@@ -305,14 +326,20 @@ uint8_t DtaDevEnterprise::rekeyLockingRange(uint8_t lockingrange, char * passwor
 		delete session;
 		return lastRC;
 	}
-	std::vector<uint8_t> ActiveKey = response.getRawToken(5);
+	uint32_t activeKey = response.column("ActiveKey");
+	if (DTA_NOCOLUMN == activeKey) {
+		LOG(E) << "Unable to read the ActiveKey of the band";
+		delete session;
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	std::vector<uint8_t> ActiveKey = response.getRawToken(activeKey);
     if (is_NULL_UID(ActiveKey))
     {
 	    LOG(I) << "LockingRange" << (uint16_t)lockingrange << " remains in plaintext ";
 		delete session;
         return 0;
     }
-	DtaCommand *rekey = new DtaCommand();
+	DtaCommand *rekey = getCommand();
 	if (NULL == rekey) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -325,11 +352,11 @@ uint8_t DtaDevEnterprise::rekeyLockingRange(uint8_t lockingrange, char * passwor
 	rekey->complete();
 	if ((lastRC = session->sendCommand(rekey, response)) != 0) {
 		LOG(E) << "rekeyLockingRange Failed ";
-		delete rekey;
+		releaseCommand(rekey);
 		delete session;
 		return lastRC;
 	}
-	delete rekey;
+	releaseCommand(rekey);
 	delete session;
 	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " reKeyed ";
 	LOG(D1) << "Exiting DtaDevEnterprise::rekeyLockingRange()";
@@ -340,7 +367,7 @@ uint8_t DtaDevEnterprise::revertLockingSP(char * password, uint8_t keep)
 	LOG(D1) << "Entering DtaDevEnterprise::revertLockingSP()";
 	if(password == NULL) { LOG(D4) << "Referencing formal parameters " << keep; }
 	uint8_t lastRC;
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -348,12 +375,12 @@ uint8_t DtaDevEnterprise::revertLockingSP(char * password, uint8_t keep)
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
-		delete cmd;
+		releaseCommand(cmd);
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	OPAL_UID uid = OPAL_UID::OPAL_SID_UID;
 	if ((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID, password, uid)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
@@ -367,12 +394,12 @@ uint8_t DtaDevEnterprise::revertLockingSP(char * password, uint8_t keep)
 	cmd->complete();
 	session->expectAbort();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "revertLockingSP completed successfully";
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(D1) << "Exiting DtaDevEnterprise::revertLockingSP()";
 	return 0;
@@ -409,11 +436,10 @@ uint8_t DtaDevEnterprise::setPassword(char * password, char * userid, char * new
 
 	if ((password == NULL) || (*password == '\0') || (newpassword == NULL) ||
 		(*newpassword == '\0')) {
-		if ((lastRC = getDefaultPassword()) != 0) {
+		if ((lastRC = getMSID(defaultPassword)) != 0) {
 			LOG(E) << "setPassword failed to retrieve MSID";
 			return lastRC;
 		}
-		defaultPassword = response.getString(5);
 		if ((password == NULL) || (*password == '\0'))
 			pwd = (char *)defaultPassword.c_str();
 
@@ -520,7 +546,7 @@ uint8_t DtaDevEnterprise::setupLockingRange(uint8_t lockingrange, uint64_t start
     vector<uint8_t> method;
     set8(method, OPALMETHOD[OPAL_METHOD::ESET]);
 
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	set->reset(object, method);
 	set->addToken(OPAL_TOKEN::STARTLIST);
 	set->addToken(OPAL_TOKEN::STARTLIST);
@@ -572,11 +598,11 @@ uint8_t DtaDevEnterprise::setupLockingRange(uint8_t lockingrange, uint64_t start
 	}
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "setupLockingRange Failed ";
-		delete set;
+		releaseCommand(set);
 		delete session;
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " starting block " << start <<
 		" for " << length << " blocks configured as unlocked range";
@@ -603,11 +629,10 @@ uint8_t DtaDevEnterprise::listLockingRanges(char * password, int16_t rangeid)
 	// if (NULL == password) { LOG(E) << "password NULL"; }
 	if ((password == NULL) || (*password == '\0')) {
 
-		if ((lastRC = getDefaultPassword()) != 0) {
+		if ((lastRC = getMSID(defaultPassword)) != 0) {
 			LOG(E) << __func__ << ": unable to retrieve MSID";
 			return lastRC;
 		}
-		defaultPassword = response.getString(5);
 		pwd = (char *)defaultPassword.c_str();
 	} else {
 		pwd = password;
@@ -716,17 +741,28 @@ uint8_t DtaDevEnterprise::listLockingRanges(char * password, int16_t rangeid)
 		// 38	1   ( 00 ) 0 (0h)
 		// 39	1   ( F1 ) End_List
 		// 40	1   ( F3 ) End_Name
-        const std::string Name          = response.getString(5+4*0);
-        const std::string CommonName    = response.getString(5+4*1);
-        const uint64_t RangeStart       = response.getUint64(5+4*2);
-        const uint64_t RangeLength      = response.getUint64(5+4*3);
-        const bool ReadLockEnabled      = response.getUint8(5+4*4) != 0;
-        const bool WriteLockEnabled     = response.getUint8(5+4*5) != 0;
-        const bool ReadLocked           = response.getUint8(5+4*6) != 0;
-        const bool WriteLocked          = response.getUint8(5+4*7) != 0;
+        std::string Name, CommonName;
+        uint64_t RangeStart, RangeLength;
+        uint64_t ReadLockEnabled, WriteLockEnabled, ReadLocked, WriteLocked;
+        if (!response.getColumn("Name", Name) ||
+            !response.getColumn("CommonName", CommonName) ||
+            !response.getColumn("RangeStart", RangeStart) ||
+            !response.getColumn("RangeLength", RangeLength) ||
+            !response.getColumn("ReadLockEnabled", ReadLockEnabled) ||
+            !response.getColumn("WriteLockEnabled", WriteLockEnabled) ||
+            !response.getColumn("ReadLocked", ReadLocked) ||
+            !response.getColumn("WriteLocked", WriteLocked))
+        {
+			LOG(I) << "    row[" << i << "] is missing LOCKING table columns";
+			delete session;
+			continue;
+        }
         // LockOnReset list has at least one element
-        const bool LockOnReset          = response.tokenIs(5+4*8) == STARTLIST
-                                        && response.tokenIs(5+4*8+1) == DTA_TOKENID_UINT;
+        const uint32_t lor = response.column("LockOnReset");
+        const bool LockOnReset          = (DTA_NOCOLUMN != lor)
+                                        && response.tokenIs(lor) == STARTLIST
+                                        && response.listEnd(lor) > lor + 1
+                                        && response.tokenIs(lor + 1) == DTA_TOKENID_UINT;
         delete session;
 
 		if (output_format == sedutilReadable) {
@@ -737,10 +773,10 @@ uint8_t DtaDevEnterprise::listLockingRanges(char * password, int16_t rangeid)
 		LOG(I) << "    CommonName:      " << CommonName;
 		LOG(I) << "    RangeStart:      " << RangeStart;
 		LOG(I) << "    RangeLength:     " << RangeLength;
-		LOG(I) << "    ReadLockEnabled: " << ReadLockEnabled;
-		LOG(I) << "    WriteLockEnabled:" << WriteLockEnabled;
-		LOG(I) << "    ReadLocked:      " << ReadLocked;
-		LOG(I) << "    WriteLocked:     " << WriteLocked;
+		LOG(I) << "    ReadLockEnabled: " << (ReadLockEnabled != 0);
+		LOG(I) << "    WriteLockEnabled:" << (WriteLockEnabled != 0);
+		LOG(I) << "    ReadLocked:      " << (ReadLocked != 0);
+		LOG(I) << "    WriteLocked:     " << (WriteLocked != 0);
 		LOG(I) << "    LockOnReset:     " << LockOnReset;
 
 		one_succeeded = 1;
@@ -808,7 +844,7 @@ uint8_t DtaDevEnterprise::setLockingRange(uint8_t lockingrange, uint8_t lockings
     vector<uint8_t> method;
     set8(method, OPALMETHOD[OPAL_METHOD::ESET]);
 
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	set->reset(object, method);
 	set->addToken(OPAL_TOKEN::STARTLIST);
 	set->addToken(OPAL_TOKEN::STARTLIST);
@@ -840,10 +876,10 @@ uint8_t DtaDevEnterprise::setLockingRange(uint8_t lockingrange, uint8_t lockings
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "Set Failed ";
 		delete session;
-		delete set;
+		releaseCommand(set);
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	LOG(I) << "Locking range Read/Write set " << (uint16_t)locked;
 	LOG(D1) << "Exiting DtaDevEnterprise::setLockingRange";
@@ -869,7 +905,7 @@ uint8_t DtaDevEnterprise::revertTPer(char * password, uint8_t PSID, uint8_t Admi
 	LOG(D1) << "Entering DtaDevEnterprise::revertTPer()";
 	if (password == NULL) { LOG(D4) << "Referencing formal parameters " << PSID; }
 	uint8_t lastRC;
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -877,7 +913,7 @@ uint8_t DtaDevEnterprise::revertTPer(char * password, uint8_t PSID, uint8_t Admi
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
-		delete cmd;
+		releaseCommand(cmd);
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	OPAL_UID uid = OPAL_UID::OPAL_SID_UID;
@@ -886,7 +922,7 @@ uint8_t DtaDevEnterprise::revertTPer(char * password, uint8_t PSID, uint8_t Admi
 		uid = OPAL_UID::OPAL_PSID_UID;
 		}
 	if ((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID, password, uid)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
@@ -899,12 +935,12 @@ uint8_t DtaDevEnterprise::revertTPer(char * password, uint8_t PSID, uint8_t Admi
 	cmd->complete();
 	session->expectAbort();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "revertTper completed successfully";
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(D1) << "Exiting DtaDevEnterprise::revertTPer()";
 	return 0;
@@ -921,11 +957,10 @@ uint8_t DtaDevEnterprise::eraseLockingRange(uint8_t lockingrange, char * passwor
 
 	if ((password == NULL) || (*password == '\0')) {
 
-		if ((lastRC = getDefaultPassword()) != 0) {
+		if ((lastRC = getMSID(defaultPassword)) != 0) {
 			LOG(E) << __func__ << ": unable to retrieve MSID";
 			return lastRC;
 		}
-		defaultPassword = response.getString(5);
 		pwd = (char *)defaultPassword.c_str();
 	} else {
 		pwd = password;
@@ -956,7 +991,7 @@ uint8_t DtaDevEnterprise::eraseLockingRange(uint8_t lockingrange, char * passwor
     vector<uint8_t> method;
     set8(method, OPALMETHOD[OPAL_METHOD::ERASE]);
 
-	DtaCommand *erase = new DtaCommand();
+	DtaCommand *erase = getCommand();
 	if (erase == NULL) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -980,16 +1015,167 @@ uint8_t DtaDevEnterprise::eraseLockingRange(uint8_t lockingrange, char * passwor
 	}
 	if ((lastRC = session->sendCommand(erase, response)) != 0) {
 		LOG(E) << "eraseLockingRange Failed ";
-		delete erase;
+		releaseCommand(erase);
 		delete session;
 		return lastRC;
 	}
-	delete erase;
+	releaseCommand(erase);
 	delete session;
 	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " erased";
 	LOG(D1) << "Exiting DtaDevEnterprise::eraseLockingRange";
 	return 0;
 }
+uint8_t DtaDevEnterprise::eraseAllLockingRanges(char * password)
+{
+	uint8_t lastRC, bandRC;
+	uint8_t firstRC = 0;
+	uint16_t erased = 0;
+	string defaultPassword;
+	char *pwd = NULL;
+	LOG(D1) << "Entering DtaDevEnterprise::eraseAllLockingRanges";
+
+	if ((password == NULL) || (*password == '\0')) {
+		if ((lastRC = getMSID(defaultPassword)) != 0) {
+			LOG(E) << __func__ << ": unable to retrieve MSID";
+			return lastRC;
+		}
+		pwd = (char *)defaultPassword.c_str();
+	} else {
+		pwd = password;
+	}
+
+	uint16_t MaxRanges = 0;
+	if ((lastRC = getMaxRanges(pwd, &MaxRanges)) != 0) {
+		return lastRC;
+	}
+	if (MaxRanges == 0 || MaxRanges >= 1024)
+		return DTAERROR_UNSUPORTED_LOCKING_RANGE;
+
+	vector<uint8_t> user;
+	set8(user, OPALUID[OPAL_UID::ENTERPRISE_ERASEMASTER_UID]);
+	vector<uint8_t> object;
+	set8(object, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL]);
+	vector<uint8_t> method;
+	set8(method, OPALMETHOD[OPAL_METHOD::ERASE]);
+
+	DtaCommand *erase = getCommand();
+	if (erase == NULL) {
+		LOG(E) << "Unable to create command object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		releaseCommand(erase);
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if (!defaultPassword.empty())
+		session->dontHashPwd();
+	if ((lastRC = session->start(OPAL_UID::ENTERPRISE_LOCKINGSP_UID, pwd, user)) != 0) {
+		releaseCommand(erase);
+		delete session;
+		return lastRC;
+	}
+	std::chrono::steady_clock::time_point all = std::chrono::steady_clock::now();
+	for (uint16_t band = 0; band <= MaxRanges; band++) {
+		setband(object, band);
+		erase->reset(object, method);
+		erase->addToken(OPAL_TOKEN::STARTLIST);
+		erase->addToken(OPAL_TOKEN::ENDLIST);
+		erase->complete();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bandRC = session->sendCommand(erase, response);
+		uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		if (0 == bandRC) {
+			LOG(I) << "LockingRange" << band << " erased in " << ms << " ms";
+			erased++;
+			continue;
+		}
+		if (0 == firstRC) firstRC = bandRC;
+		if ((DTAERROR_TIMEOUT == bandRC) || (DTAERROR_CANCELLED == bandRC)) {
+			// the ComID was reset, the session is gone with it
+			LOG(E) << "LockingRange" << band << " erase abandoned after " << ms << " ms";
+			break;
+		}
+		LOG(E) << "LockingRange" << band << " erase failed after " << ms << " ms, status "
+			<< DtaSession::methodStatus(bandRC);
+	}
+	releaseCommand(erase);
+	delete session;
+	LOG(I) << erased << " of " << MaxRanges + 1 << " locking ranges erased in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - all).count() << " ms";
+	LOG(D1) << "Exiting DtaDevEnterprise::eraseAllLockingRanges";
+	return firstRC;
+}
+uint8_t DtaDevEnterprise::getRangeExtents(uint8_t lockingrange, char * password,
+	std::vector<DTA_EXTENT> & extents)
+{
+	uint8_t lastRC;
+	string defaultPassword;
+	char *pwd = NULL;
+	LOG(D1) << "Entering DtaDevEnterprise::getRangeExtents " << (uint16_t)lockingrange;
+	extents.clear();
+	if ((password == NULL) || (*password == '\0')) {
+		if ((lastRC = getMSID(defaultPassword)) != 0) {
+			LOG(E) << __func__ << ": unable to retrieve MSID";
+			return lastRC;
+		}
+		pwd = (char *)defaultPassword.c_str();
+	} else {
+		pwd = password;
+	}
+	uint16_t MaxRanges = lockingrange;
+	if ((0 == lockingrange) && ((lastRC = getMaxRanges(pwd, &MaxRanges)) != 0))
+		return lastRC;
+	if (MaxRanges >= 1024)
+		return DTAERROR_UNSUPORTED_LOCKING_RANGE;
+	vector<uint8_t> user;
+	set8(user, OPALUID[ENTERPRISE_BANDMASTER0_UID]);
+	vector<uint8_t> table;
+	set8(table, OPALUID[OPAL_LOCKINGRANGE_GLOBAL]);
+	vector<DTA_EXTENT> ranges;
+	for (uint16_t i = lockingrange ? lockingrange : 1; i <= MaxRanges; i++) {
+		setband(user, i);
+		setband(table, i);
+		session = new DtaSession(this);
+		if (session == NULL) {
+			LOG(E) << "Unable to create session object ";
+			return DTAERROR_OBJECT_CREATE_FAILED;
+		}
+		if (!defaultPassword.empty())
+			session->dontHashPwd();
+		if ((lastRC = session->start(OPAL_UID::ENTERPRISE_LOCKINGSP_UID, pwd, user)) != 0) {
+			LOG(E) << "Unable to read band " << i << " as BandMaster" << i;
+			delete session;
+			return lastRC;
+		}
+		DTA_EXTENT extent;
+		if ((lastRC = getTable(table, "RangeStart", "RangeLength")) != 0) {
+			delete session;
+			return lastRC;
+		}
+		if (!response.getColumn("RangeStart", extent.start) ||
+			!response.getColumn("RangeLength", extent.length)) {
+			LOG(E) << "Band " << i << " is missing LOCKING table columns";
+			delete session;
+			return DTAERROR_NO_LOCKING_INFO;
+		}
+		delete session;
+		ranges.push_back(extent);
+	}
+	if (0 == lockingrange)
+		globalExtents(ranges, extents);
+	else if (ranges[0].length)
+		extents = ranges;
+	else {
+		LOG(E) << "Band " << (uint16_t)lockingrange << " is empty";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	LOG(D1) << "Exiting DtaDevEnterprise::getRangeExtents " << extents.size();
+	return 0;
+}
 uint8_t DtaDevEnterprise::loadPBA(char * password, char * filename) {
 	LOG(D1) << "Entering DtaDevEnterprise::loadPBAimage()" << filename << " " << dev;
 	if (password == NULL) { LOG(D4) << "Referencing formal parameters " << filename; }
@@ -998,6 +1184,41 @@ uint8_t DtaDevEnterprise::loadPBA(char * password, char * filename) {
 	LOG(D1) << "Exiting DtaDevEnterprise::loadPBAimage()";
 	return DTAERROR_INVALID_PARAMETER;
 }
+uint8_t DtaDevEnterprise::readDataStore(char * password, char * filename) {
+	LOG(D1) << "Entering DtaDevEnterprise::readDataStore()" << filename << " " << dev;
+	if (password == NULL) { LOG(D4) << "Referencing formal parameters " << filename; }
+	LOG(I) << "readDataStore is not implemented for the enterprise SSC ";
+	LOG(D1) << "Exiting DtaDevEnterprise::readDataStore()";
+	return DTAERROR_INVALID_PARAMETER;
+}
+uint8_t DtaDevEnterprise::writeDataStore(char * password, char * filename) {
+	LOG(D1) << "Entering DtaDevEnterprise::writeDataStore()" << filename << " " << dev;
+	if (password == NULL) { LOG(D4) << "Referencing formal parameters " << filename; }
+	LOG(I) << "writeDataStore is not implemented for the enterprise SSC ";
+	LOG(D1) << "Exiting DtaDevEnterprise::writeDataStore()";
+	return DTAERROR_INVALID_PARAMETER;
+}
+uint8_t DtaDevEnterprise::applyRangeLayout(char * password, char * filename) {
+	LOG(D1) << "Entering DtaDevEnterprise::applyRangeLayout()" << filename << " " << dev;
+	if (password == NULL) { LOG(D4) << "Referencing formal parameters " << filename; }
+	LOG(I) << "applyRangeLayout is not implemented for the enterprise SSC ";
+	LOG(D1) << "Exiting DtaDevEnterprise::applyRangeLayout()";
+	return DTAERROR_INVALID_PARAMETER;
+}
+uint8_t DtaDevEnterprise::reconcile(char * password, char * filename, bool dryrun) {
+	LOG(D1) << "Entering DtaDevEnterprise::reconcile()" << filename << " " << dev;
+	if (password == NULL) { LOG(D4) << "Referencing formal parameters " << filename << dryrun; }
+	LOG(I) << "reconcile is not implemented for the enterprise SSC ";
+	LOG(D1) << "Exiting DtaDevEnterprise::reconcile()";
+	return DTAERROR_INVALID_PARAMETER;
+}
+uint8_t DtaDevEnterprise::provisionUsers(char * password, char * filename) {
+	LOG(D1) << "Entering DtaDevEnterprise::provisionUsers()" << filename << " " << dev;
+	if (password == NULL) { LOG(D4) << "Referencing formal parameters " << filename; }
+	LOG(I) << "provisionUsers is not implemented for the enterprise SSC ";
+	LOG(D1) << "Exiting DtaDevEnterprise::provisionUsers()";
+	return DTAERROR_INVALID_PARAMETER;
+}
 uint8_t DtaDevEnterprise::activateLockingSP(char * password)
 {
 	LOG(D1) << "Entering DtaDevEnterprise::activateLockingSP()";
@@ -1028,11 +1249,10 @@ uint8_t DtaDevEnterprise::takeOwnership(char * newpassword)
 	uint8_t lastRC;
 
 	LOG(D1) << "Entering DtaDevEnterprise::takeOwnership()";
-	if ((lastRC = getDefaultPassword()) != 0) {
+	if ((lastRC = getMSID(defaultPassword)) != 0) {
 		LOG(E) << "takeOwnership failed unable to retrieve MSID";
 		return lastRC;
 	}
-	defaultPassword = response.getString(5);
 	if ((lastRC = setSIDPassword((char *)defaultPassword.c_str(), newpassword, 0)) != 0) {
 		LOG(E) << "takeOwnership failed unable to set new SID password";
 		return lastRC;
@@ -1088,9 +1308,8 @@ uint8_t DtaDevEnterprise::setBandsEnabled(int16_t lockingrange, char * password)
     }
     else
     {
-        if ((lastRC = getDefaultPassword()) != 0)
+        if ((lastRC = getMSID(pwd)) != 0)
 			return lastRC;
-        pwd = response.getString(5);
     }
 
     vector<uint8_t> erasemaster;
@@ -1111,7 +1330,7 @@ uint8_t DtaDevEnterprise::setBandsEnabled(int16_t lockingrange, char * password)
         setband(object, (uint16_t) n);
 
         // command to set Enabled column
-        DtaCommand *cmd = new DtaCommand();
+        DtaCommand *cmd = getCommand();
 		if (cmd == NULL) {
 			LOG(E) << "Unable to create command object ";
 			return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1135,7 +1354,7 @@ uint8_t DtaDevEnterprise::setBandsEnabled(int16_t lockingrange, char * password)
         session = new DtaSession(this);
 		if (session == NULL) {
 			LOG(E) << "Unable to create session object ";
-			delete cmd;
+			releaseCommand(cmd);
 			return DTAERROR_OBJECT_CREATE_FAILED;
 		}
 
@@ -1150,7 +1369,7 @@ uint8_t DtaDevEnterprise::setBandsEnabled(int16_t lockingrange, char * password)
             lastRC = session->sendCommand(cmd, response);
         }
 
-        delete cmd;
+        releaseCommand(cmd);
         delete session;
     }
 
@@ -1254,18 +1473,37 @@ uint8_t DtaDevEnterprise::getDefaultPassword()
 		delete session;
 		return lastRC;
 	}
+	if (DTA_NOCOLUMN == response.column("PIN")) {
+		LOG(E) << "C_PIN_MSID row has no PIN column";
+		delete session;
+		return DTAERROR_COMMAND_ERROR;
+	}
 	delete session;
 	LOG(D1) << "Exiting getDefaultPassword()";
 	return 0;
 }
+uint8_t DtaDevEnterprise::getMSID(string & msid)
+{
+	uint8_t lastRC;
+	if (getCached("MSID", msid)) return 0;
+	if ((lastRC = getDefaultPassword()) != 0) return lastRC;
+	// don't remember a failed read for the life of the device
+	if (!response.getColumn("PIN", msid) || msid.empty()) {
+		LOG(E) << "C_PIN_MSID row has no PIN";
+		msid.clear();
+		return DTAERROR_COMMAND_ERROR;
+	}
+	setCached("MSID", msid);
+	return 0;
+}
 uint8_t DtaDevEnterprise::printDefaultPassword()
 {
-    const uint8_t rc = getDefaultPassword();
+	string defaultPassword;
+    const uint8_t rc = getMSID(defaultPassword);
 	if (rc) {
 		LOG(E) << "unable to retrieve MSID";
 		return rc;
 	}
-	string defaultPassword = response.getString(5);
     fprintf(stdout, "MSID: %s\n", (char *)defaultPassword.c_str());
     return 0;
 }
@@ -1283,11 +1521,11 @@ uint8_t DtaDevEnterprise::setSIDPassword(char * oldpassword, char * newpassword,
 
 	if (*oldpassword == '\0')
 	{
-		if ((lastRC = getDefaultPassword()) != 0) {
+		string defaultPassword;
+		if ((lastRC = getMSID(defaultPassword)) != 0) {
 			LOG(E) << "setPassword failed to retrieve MSID";
 			return lastRC;
 		}
-		string defaultPassword = response.getString(5);
 		session = new DtaSession(this);
 		if (session == NULL) {
 			LOG(E) << "Unable to create session object ";
@@ -1348,7 +1586,7 @@ uint8_t DtaDevEnterprise::setTable(vector<uint8_t> table, const char *name,
 {
 	LOG(D1) << "Entering DtaDevEnterprise::setTable";
 	uint8_t lastRC;
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (set == NULL) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1370,10 +1608,10 @@ uint8_t DtaDevEnterprise::setTable(vector<uint8_t> table, const char *name,
 	set->complete();
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "Set Failed ";
-		delete set;
+		releaseCommand(set);
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	LOG(D1) << "Leaving DtaDevEnterprise::setTable";
 	return 0;
 }
@@ -1382,7 +1620,7 @@ uint8_t DtaDevEnterprise::getTable(vector<uint8_t> table, const char * startcol,
 {
 	LOG(D1) << "Entering DtaDevEnterprise::getTable";
 	uint8_t lastRC;
-	DtaCommand *get = new DtaCommand();
+	DtaCommand *get = getCommand();
 	if (get == NULL) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1403,10 +1641,10 @@ uint8_t DtaDevEnterprise::getTable(vector<uint8_t> table, const char * startcol,
 	get->addToken(OPAL_TOKEN::ENDLIST);
 	get->complete();
 	if ((lastRC = session->sendCommand(get, response)) != 0) {
-		delete get;
+		releaseCommand(get);
 		return lastRC;
 	}
-	delete get;
+	releaseCommand(get);
 	return 0;
 }
 uint16_t DtaDevEnterprise::comID()
@@ -1416,25 +1654,45 @@ uint16_t DtaDevEnterprise::comID()
 }
 uint8_t DtaDevEnterprise::exec(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol)
 {
+    std::lock_guard<DtaDev> hold(*this);
     uint8_t rc = 0;
+    if (cmd->overrun) {
+        LOG(E) << "Command not sent, it did not fit in the command buffer";
+        return DTAERROR_BUFFER_OVERRUN;
+    }
     OPALHeader * hdr = (OPALHeader *) cmd->getCmdBuffer();
     LOG(D3) << endl << "Dumping command buffer";
     IFLOG(D) DtaAnnotatedDump(IF_SEND, cmd->getCmdBuffer(), cmd->outputBufferSize());
     IFLOG(D3) DtaHexDump(cmd->getCmdBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
+    DtaStats::clock::time_point start;
+    uint64_t sendNs = 0;
+    uint32_t polls = 0;
+    if (DtaStats::enabled()) start = DtaStats::clock::now();
     rc = sendCmd(IF_SEND, protocol, comID(), cmd->getCmdBuffer(), cmd->outputBufferSize());
     if (0 != rc) {
         LOG(E) << "Command failed on send " << (uint16_t) rc;
         return rc;
     }
+    if (DtaStats::enabled()) {
+        sendNs = DtaStats::since(start);
+        start = DtaStats::clock::now();
+    }
+    std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+    uint8_t abandonRC = 0;
     hdr = (OPALHeader *) cmd->getRespBuffer();
     do {
+        polls++;
         //LOG(I) << "read loop";
         osmsSleep(25);
         memset(cmd->getRespBuffer(), 0, MIN_BUFFER_LENGTH);
         rc = sendCmd(IF_RECV, protocol, comID(), cmd->getRespBuffer(), MIN_BUFFER_LENGTH);
 
     }
-    while ((0 != hdr->cp.outstandingData) && (0 == hdr->cp.minTransfer));
+    while ((0 != hdr->cp.outstandingData) && (0 == hdr->cp.minTransfer) &&
+        (0 == (abandonRC = checkDeadline(cmd, sent))));
+    if (DtaStats::enabled()) DtaStats::transport(sendNs, polls, DtaStats::since(start));
+    if (0 != abandonRC)
+        return abandonCommand(abandonRC);
     LOG(D3) << std::endl << "Dumping reply buffer";
     IFLOG(D) DtaAnnotatedDump(IF_RECV, cmd->getRespBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
     IFLOG(D3) DtaHexDump(cmd->getRespBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
@@ -1454,12 +1712,13 @@ uint8_t DtaDevEnterprise::properties()
 		LOG(E) << "Unable to create session object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
-	DtaCommand *props = new DtaCommand(OPAL_UID::OPAL_SMUID_UID, OPAL_METHOD::PROPERTIES);
+	DtaCommand *props = getCommand();
 	if (props == NULL) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
+	props->reset(OPAL_UID::OPAL_SMUID_UID, OPAL_METHOD::PROPERTIES);
 	props->addToken(OPAL_TOKEN::STARTLIST);
 	props->addToken(OPAL_TOKEN::STARTNAME);
 	props->addToken("HostProperties");	
@@ -1493,11 +1752,11 @@ uint8_t DtaDevEnterprise::properties()
 	props->addToken(OPAL_TOKEN::ENDLIST);
 	props->complete();
 	if ((lastRC = session->sendCommand(props, propertiesResponse)) != 0) {
-		delete props;
+		releaseCommand(props);
 		return lastRC;
 	}
 	disk_info.Properties = 1;
-	delete props;
+	releaseCommand(props);
 	LOG(D1) << "Leaving DtaDevEnterprise::properties()";
 	return 0;
 }
@@ -1542,38 +1801,11 @@ uint8_t DtaDevEnterprise::rawCmd(char *sp, char *hexauth, char *pass,
 	LOG(D1) << sp << " " << hexauth << " " << pass << " " ;
 	LOG(D1) << hexinvokingUID << " " << hexmethod << " " << hexparms;
 	uint8_t lastRC;
-	vector<uint8_t> authority, object, invokingUID, method, parms;
+	vector<uint8_t> authority, invokingUID, method, parms;
 	uint8_t work;
-	if (16 != strnlen(hexauth, 32)) {
-		LOG(E) << "Authority must be 16 byte ascii string of hex authority uid";
-		return DTAERROR_INVALID_PARAMETER;
-	}
-	authority.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = hexauth[i] & 0x40 ? 16 * ((hexauth[i] & 0xf) + 9) : 16 * (hexauth[i] & 0x0f);
-		work += hexauth[i + 1] & 0x40 ? (hexauth[i + 1] & 0xf) + 9 : hexauth[i + 1] & 0x0f;
-		authority.push_back(work);
-	}
-	if (16 != strnlen(hexinvokingUID, 32)) {
-		LOG(E) << "invoker must be 16 byte ascii string of invoking uid";
+	if (DtaUIDToken(hexauth, authority) || DtaUIDToken(hexinvokingUID, invokingUID) ||
+		DtaUIDToken(hexmethod, method))
 		return DTAERROR_INVALID_PARAMETER;
-	}
-	invokingUID.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = hexinvokingUID[i] & 0x40 ? 16 * ((hexinvokingUID[i] & 0xf) + 9) : 16 * (hexinvokingUID[i] & 0x0f);
-		work += hexinvokingUID[i + 1] & 0x40 ? (hexinvokingUID[i + 1] & 0xf) + 9 : hexinvokingUID[i + 1] & 0x0f;
-		invokingUID.push_back(work);
-	}
-	if (16 != strnlen(hexmethod, 32)) {
-		LOG(E) << "invoker must be 16 byte ascii string of method uid";
-		return DTAERROR_INVALID_PARAMETER;
-	}
-	method.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = hexmethod[i] & 0x40 ? 16 * ((hexmethod[i] & 0xf) + 9) : 16 * (hexmethod[i] & 0x0f);
-		work += hexmethod[i + 1] & 0x40 ? (hexmethod[i + 1] & 0xf) + 9 : hexmethod[i + 1] & 0x0f;
-		method.push_back(work);
-	}
 	if (1020 < strnlen(hexparms, 1024)) {
 		LOG(E) << "Parmlist limited to 1020 characters";
 		return DTAERROR_INVALID_PARAMETER;
@@ -1588,7 +1820,7 @@ uint8_t DtaDevEnterprise::rawCmd(char *sp, char *hexauth, char *pass,
 		work += hexparms[i + 1] & 0x40 ? (hexparms[i + 1] & 0xf) + 9 : hexparms[i + 1] & 0x0f;
 		parms.push_back(work);
 	}
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (cmd == NULL) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1600,24 +1832,24 @@ uint8_t DtaDevEnterprise::rawCmd(char *sp, char *hexauth, char *pass,
 	session = new DtaSession(this);
 	if (session == NULL) {
 		LOG(E) << "Unable to create session object ";
-		delete cmd;
+		releaseCommand(cmd);
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	if ((lastRC = session->start((OPAL_UID) atoi(sp), pass, authority)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "Command:";
 	cmd->dumpCommand();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "Response:";
 	cmd->dumpResponse();
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(D1) << "Exiting DtaDevEnterprise::rawCmd";
 	return 0;
@@ -1627,28 +1859,11 @@ uint8_t DtaDevEnterprise::objDump(char *sp, char * auth, char *pass,
 {
 	LOG(D1) << "Entering DtaDevEnterprise::objDump";
 	LOG(D1) << sp << " " << auth << " " << pass << " " << objID;
-	DtaCommand *get = new DtaCommand();
+	DtaCommand *get = getCommand();
 	vector<uint8_t> authority, object;
-	uint8_t work;
-	if (16 != strnlen(auth, 32)) {
-		LOG(E) << "Authority must be 16 byte ascii string of hex authority uid";
-		return 0xff;
-	}
-	if (16 != strnlen(objID, 32)) {
-		LOG(E) << "ObjectID must be 16 byte ascii string of hex object uid";
-		return 0xff;
-	}
-	authority.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = auth[i] & 0x40 ? 16 * ((auth[i] & 0xf) + 9) : 16 * (auth[i] & 0x0f);
-		work += auth[i + 1] & 0x40 ? (auth[i + 1] & 0xf) + 9 : auth[i + 1] & 0x0f;
-		authority.push_back(work);
-	}
-	object.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = objID[i] & 0x40 ? 16 * ((objID[i] & 0xf) + 9) : 16 * (objID[i] & 0x0f);
-		work += objID[i + 1] & 0x40 ? (objID[i + 1] & 0xf) + 9 : objID[i + 1] & 0x0f;
-		object.push_back(work);
+	if (DtaUIDToken(auth, authority) || DtaUIDToken(objID, object)) {
+		releaseCommand(get);
+		return DTAERROR_INVALID_PARAMETER;
 	}
 	get->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::EGET);
 	get->changeInvokingUid(object);
@@ -1661,18 +1876,18 @@ uint8_t DtaDevEnterprise::objDump(char *sp, char * auth, char *pass,
 	get->dumpCommand();
 	session = new DtaSession(this);
 	if (session->start((OPAL_UID)atoi(sp), pass, authority)) {
-		delete get;
+		releaseCommand(get);
 		delete session;
 		return 0xff;
 	}
 	if (session->sendCommand(get, response)) {
-		delete get;
+		releaseCommand(get);
 		delete session;
 		return 0xff;
 	}
 	LOG(I) << "Response:";
 	get->dumpResponse();
-	delete get;
+	releaseCommand(get);
 	delete session;
 	LOG(D1) << "Exiting DtaDevEnterprise::objDump";
 	return 0;
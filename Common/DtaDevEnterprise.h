@@ -30,6 +30,7 @@ class DtaSession;
 #include "DtaLexicon.h"
 #include "DtaResponse.h"   // wouldn't take class
 #include <vector>
+#include <string>
 
 using namespace std;
 /** Device Class represents a disk device, conforming to the TCG Enterprise standard
@@ -41,6 +42,8 @@ public:
          * @param devref reference to device is OS specific lexicon 
          *  */
 	DtaDevEnterprise(const char * devref);
+        /** Default constructor, for derived classes that reach the device themselves */
+	DtaDevEnterprise();
          /** Default destructor, does nothing*/
 	~DtaDevEnterprise();
         /** Inform TPer of the communication propertied I wiah to use and 
@@ -67,6 +70,10 @@ public:
 	uint8_t initLSPUsers(char * defaultPassword, char * newPassword);
         /** retrieve the MSID password */
 	uint8_t printDefaultPassword();
+        /** The MSID password, read from the drive the first time only
+         * @param msid where the MSID is returned
+         */
+	uint8_t getMSID(std::string & msid);
         /** retrieve a single row from a table 
          * @param table the UID of the table
          * @param startcol the starting column of data requested
@@ -149,6 +156,23 @@ public:
 	*  @param password Password of administrator
 	*/
 	uint8_t listLockingRanges(char * password, int16_t rangeid);
+	/** Set up the locking ranges listed in a file in one session.  Each line is
+	 *  "<range> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>".
+	 *  @param password Password of administrator
+	 *  @param filename the range layout
+	 */
+	uint8_t applyRangeLayout(char * password, char * filename);
+	/** Bring the drive to the state described in a file, changing only what
+	 * differs.  Each line is one of
+	 *   lockingsp active
+	 *   mbr <enable|done> <Y|N>
+	 *   user <userid> <enable|disable>
+	 *   range <0...n> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>
+	 * @param password Password of administrator
+	 * @param filename the desired state
+	 * @param dryrun report the changes without making them
+	 */
+	uint8_t reconcile(char * password, char * filename, bool dryrun);
 	/** Change the active state of a locking range
 	* @param lockingrange The number of the locking range (0 = global)
 	* @param enabled  enable (true) or disable (false) the lockingrange
@@ -172,11 +196,38 @@ public:
 	    * @param password Password of administrative authority for locking range
 	    */
 	uint8_t eraseLockingRange(uint8_t lockingrange, char * password);
+	    /** Erase every band in one EraseMaster session
+	    * @param password EraseMaster password, the MSID if empty
+	    */
+	uint8_t eraseAllLockingRanges(char * password);
+	    /** The blocks an erase of a band destroys, each band read as its BandMaster
+	    * @param lockingrange The number of the band (0 = global)
+	    * @param password BandMaster password, the MSID if empty
+	    * @param extents receives the extents
+	    */
+	uint8_t getRangeExtents(uint8_t lockingrange, char * password,
+		std::vector<DTA_EXTENT> & extents);
        /** Loads a disk image file to the shadow MBR table.
          * @param password the password for the administrative authority with access to the table
          * @param filename the filename of the disk image
          */
 	uint8_t loadPBA(char * password, char * filename);
+        /** Copy the contents of the DataStore table to a file.
+         * @param password the password for the administrative authority with access to the table
+         * @param filename the file to be written
+         */
+	uint8_t readDataStore(char * password, char * filename);
+        /** Write a file to the start of the DataStore table.
+         * @param password the password for the administrative authority with access to the table
+         * @param filename the file to be written to the table
+         */
+	uint8_t writeDataStore(char * password, char * filename);
+        /** Enable or disable users and set their passwords from a file, all in
+         * one session of the Locking SP administrative authority.
+         * @param password the password for the administrative authority
+         * @param filename lines of "<userid> <enable|disable|keep> [newpassword]"
+         */
+	uint8_t provisionUsers(char * password, char * filename);
          /** User command to prepare the device for management by sedutil. 
          * Specific to the SSC that the device supports
          * @param password the password that is to be assigned to the SSC master entities 
@@ -78,6 +78,8 @@ uint8NOCODE(setLockingRange_SUM, uint8_t lockingrange, uint8_t lockingstate,
 uint8NOCODE(setupLockingRange,uint8_t lockingrange, uint64_t start,
 	uint64_t length, char * password)
 uint8NOCODE(listLockingRanges, char * password, int16_t rangeid)
+uint8NOCODE(applyRangeLayout, char * password, char * filename)
+uint8NOCODE(reconcile, char * password, char * filename, bool dryrun)
 uint8NOCODE(setupLockingRange_SUM, uint8_t lockingrange, uint64_t start,
 	uint64_t length, char * password)
 uint8NOCODE(rekeyLockingRange, uint8_t lockingrange, char * password)
@@ -85,8 +87,15 @@ uint8NOCODE(setBandsEnabled, int16_t lockingrange, char * password)
 uint8NOCODE(enableUser,char * password, char * userid, OPAL_TOKEN status)
 uint8NOCODE(revertTPer,char * password, uint8_t PSID, uint8_t AdminSP)
 uint8NOCODE(eraseLockingRange,uint8_t lockingrange, char * password)
+uint8NOCODE(eraseAllLockingRanges, char * password)
+uint8NOCODE(getRangeExtents, uint8_t lockingrange, char * password,
+	std::vector<DTA_EXTENT> & extents)
 uint8NOCODE(printDefaultPassword);
+uint8NOCODE(getMSID, std::string & msid)
 uint8NOCODE(loadPBA,char * password, char * filename)
+uint8NOCODE(readDataStore,char * password, char * filename)
+uint8NOCODE(writeDataStore,char * password, char * filename)
+uint8NOCODE(provisionUsers,char * password, char * filename)
 uint8NOCODE(activateLockingSP,char * password)
 uint8NOCODE(activateLockingSP_SUM,uint8_t lockingrange, char * password)
 uint8NOCODE(eraseLockingRange_SUM, uint8_t lockingrange, char * password)
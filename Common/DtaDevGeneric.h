@@ -91,6 +91,22 @@ public:
          * @param filename the filename of the disk image
          */
 	 uint8_t loadPBA(char * password, char * filename) ;
+          /** Copy the contents of the DataStore table to a file.
+         * @param password the password for the administrative authority with access to the table
+         * @param filename the file to be written
+         */
+	 uint8_t readDataStore(char * password, char * filename) ;
+          /** Write a file to the start of the DataStore table.
+         * @param password the password for the administrative authority with access to the table
+         * @param filename the file to be written to the table
+         */
+	 uint8_t writeDataStore(char * password, char * filename) ;
+          /** Enable or disable users and set their passwords from a file, all in
+           * one session of the Locking SP administrative authority.
+           * @param password the password for the administrative authority
+           * @param filename lines of "<userid> <enable|disable|keep> [newpassword]"
+           */
+	 uint8_t provisionUsers(char * password, char * filename) ;
          /** Change the locking state of a locking range 
          * @param lockingrange The number of the locking range (0 = global)
          * @param lockingstate  the locking state to set
@@ -138,6 +154,23 @@ public:
 	 *  @param password Password of administrator
 	 */
 	 uint8_t listLockingRanges(char * password, int16_t rangeid);
+	 /** Set up the locking ranges listed in a file in one session.  Each line is
+	  *  "<range> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>".
+	  *  @param password Password of administrator
+	  *  @param filename the range layout
+	  */
+	 uint8_t applyRangeLayout(char * password, char * filename);
+	 /** Bring the drive to the state described in a file, changing only what
+	  * differs.  Each line is one of
+	  *   lockingsp active
+	  *   mbr <enable|done> <Y|N>
+	  *   user <userid> <enable|disable>
+	  *   range <0...n> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>
+	  * @param password Password of administrator
+	  * @param filename the desired state
+	  * @param dryrun report the changes without making them
+	  */
+	 uint8_t reconcile(char * password, char * filename, bool dryrun);
 	 /** Generate a new encryption key for a locking range.
 	 * @param lockingrange locking range number
 	 * @param password password of the locking administrative authority
@@ -193,6 +226,17 @@ public:
 	    * @param password Password of administrative authority for locking range
 	    */
 	virtual uint8_t eraseLockingRange(uint8_t lockingrange, char * password);
+	    /** Erase every locking range
+	    * @param password Password of administrative authority for locking range
+	    */
+	uint8_t eraseAllLockingRanges(char * password);
+	    /** The blocks an erase of a locking range destroys
+	    * @param lockingrange The number of the locking range (0 = global)
+	    * @param password Password of administrative authority for locking range
+	    * @param extents receives the extents
+	    */
+	uint8_t getRangeExtents(uint8_t lockingrange, char * password,
+		std::vector<DTA_EXTENT> & extents);
          /** Dumps an object for diagnostic purposes
          * @param sp index into the OPALUID table for the SP the object is in
          * @param auth the authority ti use for the dump
@@ -215,6 +259,9 @@ public:
 	/** Read MSID
 	 */
 	uint8_t printDefaultPassword();
+	/** Read MSID, cached after the first read
+	 */
+	uint8_t getMSID(std::string & msid);
 	/* DtaSession.cpp 	*/
         /** Send a command to the device and wait for the response
          * @param cmd the MswdCommand object containg the command
@@ -25,6 +25,11 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <fstream>
 #include<iomanip>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <atomic>
 #include "DtaDevOpal.h"
 #include "DtaHashPwd.h"
 #include "DtaEndianFixup.h"
@@ -33,6 +38,8 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaResponse.h"
 #include "DtaSession.h"
 #include "DtaHexDump.h"
+#include "DtaUIDTable.h"
+#include "DtaStats.h"
 
 using namespace std;
 
@@ -161,11 +168,8 @@ DtaDevOpal::lrStatus_t DtaDevOpal::getLockingRange_status(uint8_t lockingrange,
 	uint8_t lastRC;
 	lrStatus_t lrStatus;
 	LOG(D1) << "Entering DtaDevOpal:getLockingRange_status()";
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 
 	session = new DtaSession(this);
 	if (NULL == session) {
@@ -179,29 +183,16 @@ DtaDevOpal::lrStatus_t DtaDevOpal::getLockingRange_status(uint8_t lockingrange,
 		return lrStatus;
 	}
 	if (0 != lockingrange) {
-		LR[8] = lockingrange & 0xff;
-		LR[6] = 0x03;  // non global ranges are 00000802000300nn 
+		LR[7] = lockingrange & 0xff;
+		LR[5] = 0x03;  // non global ranges are 00000802000300nn 
 	}
-	if ((lastRC = getTable(LR, _OPAL_TOKEN::RANGESTART, _OPAL_TOKEN::WRITELOCKED)) != 0) {
+	if ((lastRC = getLockingRangeRow(LR, lrStatus)) != 0) {
 		delete session;
 		lrStatus.command_status = lastRC;
 		return lrStatus;
 	}
-	if (response.getTokenCount() < 24)
-	{
-		LOG(E) << "locking range getTable command did not return enough data";
-		delete session;
-		lrStatus.command_status = DTAERROR_NO_LOCKING_INFO;
-		return lrStatus;
-	}
 	lrStatus.command_status = 0;
 	lrStatus.lockingrange_num = lockingrange;
-	lrStatus.start = response.getUint64(4);
-	lrStatus.size = response.getUint64(8);
-	lrStatus.RLKEna = (response.getUint8(12) != 0);
-	lrStatus.WLKEna = (response.getUint8(16) != 0);
-	lrStatus.RLocked = (response.getUint8(20) != 0);
-	lrStatus.WLocked = (response.getUint8(24) != 0);
 	LOG(D1) << "Locking Range " << lockingrange << " Begin: " << lrStatus.start << " Length: "
 		<< lrStatus.size << " RLKEna: " << lrStatus.RLKEna << " WLKEna: " << lrStatus.WLKEna
 		<< " RLocked: " << lrStatus.RLocked << " WLocked: " << lrStatus.WLocked;
@@ -209,15 +200,36 @@ DtaDevOpal::lrStatus_t DtaDevOpal::getLockingRange_status(uint8_t lockingrange,
 	LOG(D1) << "Exiting DtaDevOpal:getLockingRange_status()";
 	return lrStatus;
 }
+uint8_t DtaDevOpal::getLockingRangeRow(const uint8_t LR[8], lrStatus_t & lrStatus)
+{
+	uint8_t lastRC;
+	uint64_t RLKEna, WLKEna, RLocked, WLocked;
+	LOG(D1) << "Entering DtaDevOpal:getLockingRangeRow()";
+	if ((lastRC = getTable(LR, _OPAL_TOKEN::RANGESTART, _OPAL_TOKEN::WRITELOCKED)) != 0) {
+		return lastRC;
+	}
+	if (!response.getColumn(_OPAL_TOKEN::RANGESTART, lrStatus.start) ||
+		!response.getColumn(_OPAL_TOKEN::RANGELENGTH, lrStatus.size) ||
+		!response.getColumn(_OPAL_TOKEN::READLOCKENABLED, RLKEna) ||
+		!response.getColumn(_OPAL_TOKEN::WRITELOCKENABLED, WLKEna) ||
+		!response.getColumn(_OPAL_TOKEN::READLOCKED, RLocked) ||
+		!response.getColumn(_OPAL_TOKEN::WRITELOCKED, WLocked)) {
+		LOG(E) << "locking range getTable command did not return enough data";
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	lrStatus.RLKEna = (RLKEna != 0);
+	lrStatus.WLKEna = (WLKEna != 0);
+	lrStatus.RLocked = (RLocked != 0);
+	lrStatus.WLocked = (WLocked != 0);
+	LOG(D1) << "Exiting DtaDevOpal:getLockingRangeRow()";
+	return 0;
+}
 uint8_t DtaDevOpal::listLockingRanges(char * password, int16_t rangeid)
 {
 	uint8_t lastRC;
 	LOG(D1) << "Entering DtaDevOpal:listLockingRanges()" << rangeid;
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 	
 	session = new DtaSession(this);
 	if (NULL == session) {
@@ -228,38 +240,523 @@ uint8_t DtaDevOpal::listLockingRanges(char * password, int16_t rangeid)
 		delete session;
 		return lastRC;
 	}
-	vector<uint8_t> table;
-	table.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	uint64_t maxRanges;
+	if ((lastRC = getMaxRanges(maxRanges)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	LOG(I) << "Locking Range Configuration for " << dev;
+	uint32_t numRanges = (uint32_t) maxRanges + 1;
+	lrStatus_t lr;
+	for (uint32_t i = 0; i < numRanges; i++){
+		if(0 != i) LR[7] = i & 0xff;
+		if ((lastRC = getLockingRangeRow(LR, lr)) != 0) {
+			delete session;
+			return lastRC;
+		}
+		LR[5] = 0x03;  // non global ranges are 00000802000300nn 
+		LOG(I) << "LR" << i << " Begin " << lr.start <<
+			" for " << lr.size;
+		LOG(I)	<< "            RLKEna =" << (lr.RLKEna ? " Y " : " N ") <<
+			" WLKEna =" << (lr.WLKEna ? " Y " : " N ") <<
+			" RLocked =" << (lr.RLocked ? " Y " : " N ") <<
+			" WLocked =" << (lr.WLocked ? " Y " : " N ");
+	}
+	delete session;
+	LOG(D1) << "Exiting DtaDevOpal:listLockingRanges()";
+	return 0;
+}
+uint8_t DtaDevOpal::setLockingRangeRow(const uint8_t LR[8], const lrStatus_t & lrStatus, bool extent)
+{
+	uint8_t lastRC;
+	LOG(D1) << "Entering DtaDevOpal:setLockingRangeRow()";
+	DtaCommand *set = getCommand();
+	if (NULL == set) {
+		LOG(E) << "Unable to create command object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	set->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::SET);
+	set->changeInvokingUid(LR);
+	set->addToken(OPAL_TOKEN::STARTLIST);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::VALUES);
+	set->addToken(OPAL_TOKEN::STARTLIST);
+	if (extent) {
+		set->addToken(OPAL_TOKEN::STARTNAME);
+		set->addToken(OPAL_TOKEN::RANGESTART);
+		set->addToken(lrStatus.start);
+		set->addToken(OPAL_TOKEN::ENDNAME);
+		set->addToken(OPAL_TOKEN::STARTNAME);
+		set->addToken(OPAL_TOKEN::RANGELENGTH);
+		set->addToken(lrStatus.size);
+		set->addToken(OPAL_TOKEN::ENDNAME);
+	}
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::READLOCKENABLED);
+	set->addToken(lrStatus.RLKEna ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::WRITELOCKENABLED);
+	set->addToken(lrStatus.WLKEna ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::READLOCKED);
+	set->addToken(lrStatus.RLocked ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::WRITELOCKED);
+	set->addToken(lrStatus.WLocked ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::ENDLIST);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::ENDLIST);
+	set->complete();
+	lastRC = session->sendCommand(set, response);
+	releaseCommand(set);
+	LOG(D1) << "Exiting DtaDevOpal:setLockingRangeRow()";
+	return lastRC;
+}
+uint8_t DtaDevOpal::checkRangeLayout(vector<lrStatus_t> & ranges)
+{
+	LOG(D1) << "Entering DtaDevOpal:checkRangeLayout()";
+	uint64_t blockSize = disk_info.Geometry_logicalBlockSize ? disk_info.Geometry_logicalBlockSize : 512;
+	uint64_t blocks = getSize() / blockSize;
+	uint64_t granularity = (disk_info.Geometry && disk_info.Geometry_align) ?
+		disk_info.Geometry_alignmentGranularity : 0;
+	vector<lrStatus_t> sorted;
+	if (0 == blocks) {
+		LOG(W) << "Size of " << dev << " unknown, ranges are not checked against it";
+	}
+	for (uint32_t i = 0; i < ranges.size(); i++) {
+		lrStatus_t & lr = ranges[i];
+		if ((0 == lr.lockingrange_num) || (0 == lr.size)) continue;
+		if (blocks && ((lr.start >= blocks) || (lr.size > blocks - lr.start))) {
+			LOG(E) << "LR" << (uint16_t)lr.lockingrange_num << " " << lr.start << " for " << lr.size <<
+				" does not fit in the " << blocks << " blocks of " << dev;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		// a range starting below the lowest aligned LBA can't be aligned
+		if (granularity && ((lr.start < disk_info.Geometry_lowestAlignedLBA) ||
+			(((lr.start - disk_info.Geometry_lowestAlignedLBA) % granularity) != 0) ||
+			((lr.size % granularity) != 0))) {
+			LOG(E) << "LR" << (uint16_t)lr.lockingrange_num << " is not aligned to " << granularity <<
+				" blocks from LBA " << disk_info.Geometry_lowestAlignedLBA;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		sorted.push_back(lr);
+	}
+	sort(sorted.begin(), sorted.end(),
+		[](const lrStatus_t & a, const lrStatus_t & b) { return a.start < b.start; });
+	for (uint32_t i = 1; i < sorted.size(); i++) {
+		if (sorted[i - 1].start + sorted[i - 1].size > sorted[i].start) {
+			LOG(E) << "LR" << (uint16_t)sorted[i - 1].lockingrange_num << " overlaps LR" <<
+				(uint16_t)sorted[i].lockingrange_num;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+	}
+	LOG(D1) << "Exiting DtaDevOpal:checkRangeLayout()";
+	return 0;
+}
+bool DtaDevOpal::parseRangeFields(istream & fields, lrStatus_t & lr)
+{
+	string rlkena, wlkena, state;
+	uint32_t range;
+	memset(&lr, 0, sizeof(lr));
+	if (!(fields >> range >> lr.start >> lr.size >> rlkena >> wlkena >> state) || (range > 0xff) ||
+		((rlkena != "Y") && (rlkena != "N")) || ((wlkena != "Y") && (wlkena != "N")))
+		return false;
+	lr.lockingrange_num = (uint8_t)range;
+	lr.RLKEna = ("Y" == rlkena);
+	lr.WLKEna = ("Y" == wlkena);
+	if ("RW" == state) lr.RLocked = lr.WLocked = false;
+	else if ("RO" == state) { lr.RLocked = false; lr.WLocked = true; }
+	else if ("LK" == state) lr.RLocked = lr.WLocked = true;
+	else return false;
+	return true;
+}
+uint8_t DtaDevOpal::applyRangeLayout(char * password, char * filename)
+{
+	LOG(D1) << "Entering DtaDevOpal:applyRangeLayout() " << filename;
+	vector<lrStatus_t> layout;
+	string line;
+	uint32_t lineno = 0;
+	ifstream specfile(filename);
+	if (!specfile) {
+		LOG(E) << "Unable to open range layout file " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	while (getline(specfile, line)) {
+		lineno++;
+		istringstream fields(line);
+		lrStatus_t lr;
+		memset(&lr, 0, sizeof(lr));
+		if (!(fields >> ws) || fields.eof() || ('#' == fields.peek())) continue;
+		if (!parseRangeFields(fields, lr)) {
+			LOG(E) << filename << ":" << lineno << " expected <range> <start> <length> <Y|N> <Y|N> <RW|RO|LK>";
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		layout.push_back(lr);
+	}
+	if (layout.empty()) {
+		LOG(E) << "No locking ranges found in " << filename;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	uint8_t lastRC = applyRangeLayout(password, layout);
+	LOG(D1) << "Exiting DtaDevOpal:applyRangeLayout()";
+	return lastRC;
+}
+uint8_t DtaDevOpal::applyRangeLayout(char * password, vector<lrStatus_t> & layout)
+{
+	uint8_t lastRC;
+	uint64_t maxRanges;
+	LOG(D1) << "Entering DtaDevOpal:applyRangeLayout() " << layout.size() << " ranges";
+	vector<bool> listed(256, false);
+	for (uint32_t i = 0; i < layout.size(); i++) {
+		if (listed[layout[i].lockingrange_num]) {
+			LOG(E) << "LR" << (uint16_t)layout[i].lockingrange_num << " is listed more than once";
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		listed[layout[i].lockingrange_num] = true;
+		if ((0 == layout[i].lockingrange_num) && (layout[i].start || layout[i].size)) {
+			LOG(E) << "the start and length of the global locking range cannot be changed";
+			return DTAERROR_UNSUPORTED_LOCKING_RANGE;
+		}
+	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	if ((lastRC = getMaxRanges(maxRanges)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	// the ranges left alone still take up their part of the drive, and the
+	// ones in the layout have to get out of each other's way in order
+	vector<lrStatus_t> current(maxRanges + 1);
+	for (uint32_t i = 0; i < listed.size(); i++) {
+		if (listed[i] && (i > maxRanges)) {
+			LOG(E) << "LR" << i << " is beyond the " << maxRanges << " ranges of " << dev;
+			delete session;
+			return DTAERROR_UNSUPORTED_LOCKING_RANGE;
+		}
+		if (i > maxRanges) continue;
+		if (0 != i) {
+			LR[5] = 0x03;  // non global ranges are 00000802000300nn
+			LR[7] = i & 0xff;
+		}
+		if ((lastRC = getLockingRangeRow(LR, current[i])) != 0) {
+			delete session;
+			return lastRC;
+		}
+		current[i].lockingrange_num = i & 0xff;
+	}
+	vector<lrStatus_t> target(current);
+	vector<bool> pending(current.size(), false);
+	for (uint32_t i = 0; i < layout.size(); i++) {
+		lrStatus_t & lr = target[layout[i].lockingrange_num];
+		lr = layout[i];
+		if (0 == lr.lockingrange_num) {
+			lr.start = current[0].start;
+			lr.size = current[0].size;
+		}
+		pending[lr.lockingrange_num] = true;
+	}
+	if ((lastRC = checkRangeLayout(target)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	uint32_t changes = 0;
+	if ((lastRC = writeRangeLayout(current, target, pending, false, changes)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	delete session;
+	LOG(I) << layout.size() << " locking ranges set up on " << dev;
+	LOG(D1) << "Exiting DtaDevOpal:applyRangeLayout()";
+	return 0;
+}
+uint8_t DtaDevOpal::writeRangeLayout(vector<lrStatus_t> & current, const vector<lrStatus_t> & target,
+	vector<bool> pending, bool dryrun, uint32_t & changes)
+{
+	LOG(D1) << "Entering DtaDevOpal:writeRangeLayout()";
+	uint8_t lastRC;
+	uint8_t LR[8];
+	const char * verb = dryrun ? "would set " : "set ";
+	vector<lrStatus_t> layout(current);
+	vector<uint32_t> order;
+	uint32_t left = (uint32_t)count(pending.begin(), pending.end(), true);
+	// a range can only move into space that the others have already left:
+	// pass over the rows until each is clear of where the others still are,
+	// so shrinking, disabling and moving away come before growing and
+	// moving in, and settle the order before anything is written
+	while (left) {
+		uint32_t placed = 0;
+		for (uint32_t i = 0; i < layout.size(); i++) {
+			if (!pending[i]) continue;
+			const lrStatus_t & want = target[i];
+			bool extent = (0 != i) && ((want.start != layout[i].start) || (want.size != layout[i].size));
+			bool blocked = false;
+			for (uint32_t j = 1; extent && want.size && (j < layout.size()); j++) {
+				if ((j != i) && layout[j].size && (want.start < layout[j].start + layout[j].size) &&
+					(layout[j].start < want.start + want.size))
+					blocked = true;
+			}
+			if (blocked) continue;
+			layout[i] = want;
+			pending[i] = false;
+			order.push_back(i);
+			left--;
+			placed++;
+		}
+		if (0 == placed) {
+			LOG(E) << "The locking ranges can't be moved without overlapping each other";
+			return DTAERROR_INVALID_PARAMETER;
+		}
+	}
+	for (uint32_t k = 0; k < order.size(); k++) {
+		uint32_t i = order[k];
+		const lrStatus_t & want = target[i];
+		bool extent = (0 != i) && ((want.start != current[i].start) || (want.size != current[i].size));
+		changes++;
+		LOG(I) << verb << "LR" << i << " " << want.start << " for " << want.size <<
+			" RLKEna=" << (want.RLKEna ? "Y" : "N") << " WLKEna=" << (want.WLKEna ? "Y" : "N") <<
+			" RLocked=" << (want.RLocked ? "Y" : "N") << " WLocked=" << (want.WLocked ? "Y" : "N");
+		memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
+		if (0 != i) {
+			LR[5] = 0x03;
+			LR[7] = i & 0xff;
+		}
+		if (!dryrun && ((lastRC = setLockingRangeRow(LR, want, extent)) != 0)) {
+			LOG(E) << "Unable to set up LR" << i;
+			return lastRC;
+		}
+		current[i] = want;
+	}
+	LOG(D1) << "Exiting DtaDevOpal:writeRangeLayout()";
+	return 0;
+}
+uint8_t DtaDevOpal::reconcile(char * password, char * filename, bool dryrun)
+{
+	LOG(D1) << "Entering DtaDevOpal:reconcile() " << filename;
+	desiredState_t desired;
+	string line, keyword, what, value;
+	uint32_t lineno = 0;
+	desired.lockingSPActive = desired.mbrEnable = desired.mbrDone = -1;
+	ifstream specfile(filename);
+	if (!specfile) {
+		LOG(E) << "Unable to open desired state file " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	while (getline(specfile, line)) {
+		lineno++;
+		istringstream fields(line);
+		bool valid = false;
+		if (!(fields >> keyword) || ('#' == keyword[0])) continue;
+		if ("lockingsp" == keyword) {
+			valid = (fields >> what) && ("active" == what);
+			desired.lockingSPActive = 1;
+		}
+		else if ("mbr" == keyword) {
+			valid = (fields >> what >> value) && (("enable" == what) || ("done" == what)) &&
+				(("Y" == value) || ("N" == value));
+			(("enable" == what) ? desired.mbrEnable : desired.mbrDone) = ("Y" == value);
+		}
+		else if ("user" == keyword) {
+			userProvision_t user;
+			valid = (fields >> user.userid >> what) && (("enable" == what) || ("disable" == what));
+			user.enable = ("enable" == what);
+			user.setPassword = false;
+			user.status = 0;
+			desired.users.push_back(user);
+		}
+		else if ("range" == keyword) {
+			lrStatus_t lr;
+			valid = parseRangeFields(fields, lr);
+			desired.ranges.push_back(lr);
+		}
+		if (!valid) {
+			LOG(E) << filename << ":" << lineno << " not understood: " << line;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+	}
+	uint8_t lastRC = reconcile(password, desired, dryrun);
+	LOG(D1) << "Exiting DtaDevOpal:reconcile()";
+	return lastRC;
+}
+uint8_t DtaDevOpal::reconcile(char * password, desiredState_t & desired, bool dryrun)
+{
+	LOG(D1) << "Entering DtaDevOpal:reconcile() " << (dryrun ? "dry run" : "");
+	uint8_t lastRC;
+	uint64_t value, maxRanges = 0;
+	uint32_t changes = 0;
+	int8_t mbrEnable = -1, mbrDone = -1;
+	vector<int8_t> userEnabled;
+	vector<lrStatus_t> current;
+	vector<uint8_t> authority;
+	vector<uint8_t> mbrControl;
+	mbrControl.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
 	for (int i = 0; i < 8; i++) {
-		table.push_back(OPALUID[OPAL_UID::OPAL_LOCKING_INFO_TABLE][i]);
+		mbrControl.push_back(OPALUID[OPAL_UID::OPAL_MBRCONTROL][i]);
+	}
+	const char * verb = dryrun ? "would set " : "set ";
+	uint8_t LR[8];
+
+	if (1 == desired.lockingSPActive) {
+		// the SP table can be read by anybody, activating needs SID
+		session = new DtaSession(this);
+		if (NULL == session) {
+			LOG(E) << "Unable to create session object ";
+			return DTAERROR_OBJECT_CREATE_FAILED;
+		}
+		if (((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID)) != 0) ||
+			((lastRC = getTable(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID], 0x06, 0x06)) != 0)) {
+			LOG(E) << "Unable to determine LockingSP Lifecycle state";
+			delete session;
+			return lastRC;
+		}
+		delete session;
+		if (!response.getColumn(0x06, value) || (0x09 != value)) { // Manufactured
+			LOG(E) << "Locking SP is not active, activate it with the SID password first";
+			return DTAERROR_INVALID_LIFECYCLE;
+		}
+	}
+	for (uint32_t i = 0; i < desired.ranges.size(); i++) {
+		if ((0 == desired.ranges[i].lockingrange_num) && (desired.ranges[i].start || desired.ranges[i].size)) {
+			LOG(E) << "the start and length of the global locking range cannot be changed";
+			return DTAERROR_UNSUPORTED_LOCKING_RANGE;
+		}
+	}
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
-	if ((lastRC = getTable(table, _OPAL_TOKEN::MAXRANGES, _OPAL_TOKEN::MAXRANGES)) != 0) {
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
 		delete session;
 		return lastRC;
 	}
-	if (response.tokenIs(4) != _OPAL_TOKEN::DTA_TOKENID_UINT) {
-		LOG(E) << "Unable to determine number of ranges ";
+	// read everything that is to be compared before changing anything
+	if ((-1 != desired.mbrEnable) || (-1 != desired.mbrDone)) {
+		uint64_t enable, done;
+		if (((lastRC = getTable(mbrControl, OPAL_TOKEN::MBRENABLE, OPAL_TOKEN::MBRDONE)) != 0) ||
+			!response.getColumn(OPAL_TOKEN::MBRENABLE, enable) || !response.getColumn(OPAL_TOKEN::MBRDONE, done)) {
+			LOG(E) << "Unable to read MBRControl";
+			delete session;
+			return lastRC ? lastRC : DTAERROR_INVALID_PARAMETER;
+		}
+		mbrEnable = (enable != 0);
+		mbrDone = (done != 0);
+	}
+	for (uint32_t i = 0; i < desired.users.size(); i++) {
+		if (((lastRC = getAuth4User((char *)desired.users[i].userid.c_str(), 0, authority)) != 0) ||
+			((lastRC = getTable(authority, 0x05, 0x05)) != 0) || !response.getColumn(0x05, value)) {
+			LOG(E) << "Unable to read " << desired.users[i].userid << " from the Authority Table";
+			delete session;
+			return lastRC ? lastRC : DTAERROR_INVALID_PARAMETER;
+		}
+		userEnabled.push_back(value != 0);
+	}
+	if (!desired.ranges.empty()) {
+		if ((lastRC = getMaxRanges(maxRanges)) != 0) {
+			delete session;
+			return lastRC;
+		}
+		current.resize(maxRanges + 1);
+		memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
+		for (uint32_t i = 0; i <= maxRanges; i++) {
+			if (0 != i) {
+				LR[5] = 0x03;
+				LR[7] = i & 0xff;
+			}
+			if ((lastRC = getLockingRangeRow(LR, current[i])) != 0) {
+				delete session;
+				return lastRC;
+			}
+			current[i].lockingrange_num = i & 0xff;
+		}
+	}
+	// the layout the drive will end up with has to be valid as a whole
+	vector<lrStatus_t> target(current);
+	vector<bool> listed(current.size(), false);
+	for (uint32_t i = 0; i < desired.ranges.size(); i++) {
+		lrStatus_t & lr = desired.ranges[i];
+		if ((lr.lockingrange_num > maxRanges) || listed[lr.lockingrange_num]) {
+			LOG(E) << "LR" << (uint16_t)lr.lockingrange_num << " is beyond the " << maxRanges <<
+				" ranges of " << dev << " or listed more than once";
+			delete session;
+			return DTAERROR_UNSUPORTED_LOCKING_RANGE;
+		}
+		listed[lr.lockingrange_num] = true;
+		if (0 == lr.lockingrange_num) {
+			lr.start = current[0].start;
+			lr.size = current[0].size;
+		}
+		target[lr.lockingrange_num] = lr;
+	}
+	if ((lastRC = checkRangeLayout(target)) != 0) {
 		delete session;
-		return DTAERROR_NO_LOCKING_INFO;
+		return lastRC;
 	}
-	LOG(I) << "Locking Range Configuration for " << dev;
-	uint32_t numRanges = response.getUint32(4) + 1;
-	for (uint32_t i = 0; i < numRanges; i++){
-		if(0 != i) LR[8] = i & 0xff;
-		if ((lastRC = getTable(LR, _OPAL_TOKEN::RANGESTART, _OPAL_TOKEN::WRITELOCKED)) != 0) {
+
+	// then issue the Sets for whatever differs
+	if ((-1 != desired.mbrEnable) && (desired.mbrEnable != mbrEnable)) {
+		changes++;
+		LOG(I) << verb << "MBRControl Enable " << (desired.mbrEnable ? "Y" : "N");
+		if (!dryrun && ((lastRC = setTable(mbrControl, OPAL_TOKEN::MBRENABLE,
+			desired.mbrEnable ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE)) != 0)) {
+			delete session;
+			return lastRC;
+		}
+	}
+	if ((-1 != desired.mbrDone) && (desired.mbrDone != mbrDone)) {
+		changes++;
+		LOG(I) << verb << "MBRControl Done " << (desired.mbrDone ? "Y" : "N");
+		if (!dryrun && ((lastRC = setTable(mbrControl, OPAL_TOKEN::MBRDONE,
+			desired.mbrDone ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE)) != 0)) {
+			delete session;
+			return lastRC;
+		}
+	}
+	for (uint32_t i = 0; i < desired.users.size(); i++) {
+		userProvision_t & user = desired.users[i];
+		if (user.enable == userEnabled[i]) continue;
+		changes++;
+		LOG(I) << verb << user.userid << (user.enable ? " enabled" : " disabled");
+		if (dryrun) continue;
+		getAuth4User((char *)user.userid.c_str(), 0, authority);
+		if ((lastRC = setTable(authority, (OPAL_TOKEN)0x05,
+			user.enable ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE)) != 0) {
 			delete session;
 			return lastRC;
 		}
-		LR[6] = 0x03;  // non global ranges are 00000802000300nn 
-		LOG(I) << "LR" << i << " Begin " << response.getUint64(4) <<
-			" for " << response.getUint64(8);
-		LOG(I)	<< "            RLKEna =" << (response.getUint8(12) ? " Y " : " N ") <<
-			" WLKEna =" << (response.getUint8(16) ? " Y " : " N ") <<
-			" RLocked =" << (response.getUint8(20) ? " Y " : " N ") <<
-			" WLocked =" << (response.getUint8(24) ? " Y " : " N ");
+	}
+	vector<bool> pending(current.size(), false);
+	for (uint32_t i = 0; i < current.size(); i++) {
+		lrStatus_t & want = target[i];
+		lrStatus_t & have = current[i];
+		pending[i] = listed[i] && ((want.start != have.start) || (want.size != have.size) ||
+			(want.RLKEna != have.RLKEna) || (want.WLKEna != have.WLKEna) ||
+			(want.RLocked != have.RLocked) || (want.WLocked != have.WLocked));
+	}
+	if ((lastRC = writeRangeLayout(current, target, pending, dryrun, changes)) != 0) {
+		delete session;
+		return lastRC;
 	}
 	delete session;
-	LOG(D1) << "Exiting DtaDevOpal:listLockingRanges()";
+	if (changes) {
+		LOG(I) << changes << (dryrun ? " changes needed on " : " changes made on ") << dev;
+	}
+	else {
+		LOG(I) << dev << " already matches the desired state";
+	}
+	LOG(D1) << "Exiting DtaDevOpal:reconcile()";
 	return 0;
 }
 uint8_t DtaDevOpal::setupLockingRange(uint8_t lockingrange, uint64_t start,
@@ -271,13 +768,10 @@ uint8_t DtaDevOpal::setupLockingRange(uint8_t lockingrange, uint64_t start,
 		LOG(E) << "global locking range cannot be changed";
 		return DTAERROR_UNSUPORTED_LOCKING_RANGE;
 	}
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
-	LR[6] = 0x03;
-	LR[8] = lockingrange;
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
+	LR[5] = 0x03;
+	LR[7] = lockingrange;
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
@@ -287,7 +781,7 @@ uint8_t DtaDevOpal::setupLockingRange(uint8_t lockingrange, uint64_t start,
 		delete session;
 		return lastRC;
 	}
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (NULL == set) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -329,11 +823,11 @@ uint8_t DtaDevOpal::setupLockingRange(uint8_t lockingrange, uint64_t start,
 	set->complete();
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "setupLockingRange Failed ";
-		delete set;
+		releaseCommand(set);
 		delete session;
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	if ((lastRC = rekeyLockingRange(lockingrange, password)) != 0) {
 		LOG(E) << "setupLockingRange Unable to reKey Locking range -- Possible security issue ";
@@ -376,7 +870,7 @@ uint8_t DtaDevOpal::setupLockingRange_SUM(uint8_t lockingrange, uint64_t start,
 		delete session;
 		return lastRC;
 	}
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (NULL == set) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -418,11 +912,11 @@ uint8_t DtaDevOpal::setupLockingRange_SUM(uint8_t lockingrange, uint64_t start,
 	set->complete();
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "setupLockingRange Failed ";
-		delete set;
+		releaseCommand(set);
 		delete session;
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	if ((lastRC = rekeyLockingRange_SUM(LR, auth, password)) != 0) {
 		LOG(E) << "setupLockingRange Unable to reKey Locking range -- Possible security issue ";
@@ -437,14 +931,11 @@ uint8_t DtaDevOpal::configureLockingRange(uint8_t lockingrange, uint8_t enabled,
 {
 	uint8_t lastRC;
 	LOG(D1) << "Entering DtaDevOpal::configureLockingRange()";
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 	if (lockingrange != 0) {
-		LR[6] = 0x03;
-		LR[8] = lockingrange;
+		LR[5] = 0x03;
+		LR[7] = lockingrange;
 	}
 	session = new DtaSession(this);
 	if (NULL == session) {
@@ -455,7 +946,7 @@ uint8_t DtaDevOpal::configureLockingRange(uint8_t lockingrange, uint8_t enabled,
 		delete session;
 		return lastRC;
 	}
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (NULL == set) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -481,11 +972,11 @@ uint8_t DtaDevOpal::configureLockingRange(uint8_t lockingrange, uint8_t enabled,
 	set->complete();
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "configureLockingRange Failed ";
-		delete set;
+		releaseCommand(set);
 		delete session;
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	LOG(I) << "LockingRange" << (uint16_t) lockingrange 
 		<< (enabled ? " enabled " : " disabled ") 
@@ -499,14 +990,11 @@ uint8_t DtaDevOpal::rekeyLockingRange(uint8_t lockingrange, char * password)
 {
 	LOG(D1) << "Entering DtaDevOpal::rekeyLockingRange()";
 	uint8_t lastRC;
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 	if (lockingrange != 0) {
-		LR[6] = 0x03;
-		LR[8] = lockingrange;
+		LR[5] = 0x03;
+		LR[7] = lockingrange;
 	}
 	session = new DtaSession(this);
 	if (NULL == session) {
@@ -517,34 +1005,44 @@ uint8_t DtaDevOpal::rekeyLockingRange(uint8_t lockingrange, char * password)
 		delete session;
 		return lastRC;
 	}
-	if ((lastRC = getTable(LR, OPAL_TOKEN::ACTIVEKEY, OPAL_TOKEN::ACTIVEKEY)) != 0) {
+	if ((lastRC = generateKey(LR)) != 0) {
+		LOG(E) << "rekeyLockingRange Failed ";
 		delete session;
 		return lastRC;
 	}
-	DtaCommand *rekey = new DtaCommand();
+	delete session;
+	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " reKeyed ";
+	LOG(D1) << "Exiting DtaDevOpal::rekeyLockingRange()";
+	return 0;
+}
+uint8_t DtaDevOpal::generateKey(const uint8_t LR[8])
+{
+	LOG(D1) << "Entering DtaDevOpal::generateKey()";
+	uint8_t lastRC;
+	if ((lastRC = getTable(LR, OPAL_TOKEN::ACTIVEKEY, OPAL_TOKEN::ACTIVEKEY)) != 0) {
+		return lastRC;
+	}
+	uint32_t activeKey = response.column(OPAL_TOKEN::ACTIVEKEY);
+	if ((DTA_NOCOLUMN == activeKey) || (9 != response.getLength(activeKey))) {
+		LOG(E) << "Unable to read the ActiveKey of the locking range";
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	DtaCommand *rekey = getCommand();
 	if (NULL == rekey) {
 		LOG(E) << "Unable to create command object ";
-		delete session;
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	rekey->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::GENKEY);
-	rekey->changeInvokingUid(response.getRawToken(4));
+	rekey->changeInvokingUid(response.getRawToken(activeKey));
 	rekey->addToken(OPAL_TOKEN::STARTLIST);
 	rekey->addToken(OPAL_TOKEN::ENDLIST);
 	rekey->complete();
-	if ((lastRC = session->sendCommand(rekey, response)) != 0) {
-		LOG(E) << "rekeyLockingRange Failed ";
-		delete rekey;
-		delete session;
-		return lastRC;
-	}
-	delete rekey;
-	delete session;
-	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " reKeyed ";
-	LOG(D1) << "Exiting DtaDevOpal::rekeyLockingRange()";
-	return 0;
+	lastRC = session->sendCommand(rekey, response);
+	releaseCommand(rekey);
+	LOG(D1) << "Exiting DtaDevOpal::generateKey()";
+	return lastRC;
 }
-uint8_t DtaDevOpal::rekeyLockingRange_SUM(vector<uint8_t> LR, vector<uint8_t>  UID, char * password)
+uint8_t DtaDevOpal::rekeyLockingRange_SUM(const vector<uint8_t> & LR, const vector<uint8_t> & UID, char * password)
 {
 	LOG(D1) << "Entering DtaDevOpal::rekeyLockingRange_SUM()";
 	uint8_t lastRC;
@@ -562,24 +1060,30 @@ uint8_t DtaDevOpal::rekeyLockingRange_SUM(vector<uint8_t> LR, vector<uint8_t>  U
 		delete session;
 		return lastRC;
 	}
-	DtaCommand *rekey = new DtaCommand();
+	uint32_t activeKey = response.column(OPAL_TOKEN::ACTIVEKEY);
+	if ((DTA_NOCOLUMN == activeKey) || (9 != response.getLength(activeKey))) {
+		LOG(E) << "Unable to read the ActiveKey of the locking range";
+		delete session;
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	DtaCommand *rekey = getCommand();
 	if (NULL == rekey) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	rekey->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::GENKEY);
-	rekey->changeInvokingUid(response.getRawToken(4));
+	rekey->changeInvokingUid(response.getRawToken(activeKey));
 	rekey->addToken(OPAL_TOKEN::STARTLIST);
 	rekey->addToken(OPAL_TOKEN::ENDLIST);
 	rekey->complete();
 	if ((lastRC = session->sendCommand(rekey, response)) != 0) {
 		LOG(E) << "rekeyLockingRange_SUM Failed ";
-		delete rekey;
+		releaseCommand(rekey);
 		delete session;
 		return lastRC;
 	}
-	delete rekey;
+	releaseCommand(rekey);
 	delete session;
 	LOG(I) << "LockingRange reKeyed ";
 	LOG(D1) << "Exiting DtaDevOpal::rekeyLockingRange_SUM()";
@@ -602,7 +1106,7 @@ uint8_t DtaDevOpal::revertLockingSP(char * password, uint8_t keep)
 	keepGlobalLocking.push_back(0x06);
 	keepGlobalLocking.push_back(0x00);
 	keepGlobalLocking.push_back(0x00);
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Create session object failed";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -610,11 +1114,11 @@ uint8_t DtaDevOpal::revertLockingSP(char * password, uint8_t keep)
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Create session object failed";
-		delete cmd;
+		releaseCommand(cmd);
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
                 LOG(E) << "Start session failed";
 		return lastRC;
@@ -631,7 +1135,7 @@ uint8_t DtaDevOpal::revertLockingSP(char * password, uint8_t keep)
 	cmd->complete();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
                 LOG(E) << "Command failed";
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
@@ -650,6 +1154,106 @@ uint8_t DtaDevOpal::eraseLockingRange(uint8_t lockingrange, char * password)
 	LOG(D1) << "Exiting DtaDevOpal::eraseLockingRange()";
 	return 0;
 }
+uint8_t DtaDevOpal::eraseAllLockingRanges(char * password)
+{
+	LOG(D1) << "Entering DtaDevOpal::eraseAllLockingRanges() " << dev;
+	uint8_t lastRC, rangeRC;
+	uint8_t firstRC = 0;
+	uint16_t erased = 0;
+	uint64_t maxRanges;
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
+	// Opal has no Erase method, a new key for a range erases it just as well
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	if ((lastRC = getMaxRanges(maxRanges)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	std::chrono::steady_clock::time_point all = std::chrono::steady_clock::now();
+	for (uint16_t range = 0; range <= maxRanges; range++) {
+		if (0 != range) {
+			LR[5] = 0x03;
+			LR[7] = range & 0xff;
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		rangeRC = generateKey(LR);
+		uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		if (0 == rangeRC) {
+			LOG(I) << "LockingRange" << range << " erased in " << ms << " ms";
+			erased++;
+			continue;
+		}
+		if (0 == firstRC) firstRC = rangeRC;
+		if ((DTAERROR_TIMEOUT == rangeRC) || (DTAERROR_CANCELLED == rangeRC)) {
+			// the ComID was reset, the session is gone with it
+			LOG(E) << "LockingRange" << range << " erase abandoned after " << ms << " ms";
+			break;
+		}
+		LOG(E) << "LockingRange" << range << " erase failed after " << ms << " ms, status "
+			<< DtaSession::methodStatus(rangeRC);
+	}
+	delete session;
+	LOG(I) << erased << " of " << maxRanges + 1 << " locking ranges erased in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - all).count() << " ms";
+	LOG(D1) << "Exiting DtaDevOpal::eraseAllLockingRanges()";
+	return firstRC;
+}
+uint8_t DtaDevOpal::getRangeExtents(uint8_t lockingrange, char * password,
+	std::vector<DTA_EXTENT> & extents)
+{
+	uint8_t lastRC;
+	LOG(D1) << "Entering DtaDevOpal::getRangeExtents() " << (uint16_t)lockingrange;
+	extents.clear();
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	uint64_t maxRanges = lockingrange;
+	if ((0 == lockingrange) && ((lastRC = getMaxRanges(maxRanges)) != 0)) {
+		delete session;
+		return lastRC;
+	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
+	LR[5] = 0x03;  // non global ranges are 00000802000300nn
+	vector<DTA_EXTENT> ranges;
+	for (uint64_t i = lockingrange ? lockingrange : 1; i <= maxRanges; i++) {
+		lrStatus_t lr;
+		LR[7] = (uint8_t)i;
+		if ((lastRC = getLockingRangeRow(LR, lr)) != 0) {
+			delete session;
+			return lastRC;
+		}
+		DTA_EXTENT extent = { lr.start, lr.size };
+		ranges.push_back(extent);
+	}
+	delete session;
+	if (0 == lockingrange)
+		globalExtents(ranges, extents);
+	else if (ranges[0].length)
+		extents = ranges;
+	else {
+		LOG(E) << "Locking range " << (uint16_t)lockingrange << " is empty";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	LOG(D1) << "Exiting DtaDevOpal::getRangeExtents() " << extents.size();
+	return 0;
+}
 uint8_t DtaDevOpal::getAuth4User(char * userid, uint8_t uidorcpin, std::vector<uint8_t> &userData)
 {
 	LOG(D1) << "Entering DtaDevOpal::getAuth4User()";
@@ -862,14 +1466,11 @@ uint8_t DtaDevOpal::setLockingRange(uint8_t lockingrange, uint8_t lockingstate,
 		LOG(E) << "Invalid locking state for setLockingRange";
 		return DTAERROR_INVALID_PARAMETER;
 	}
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 	if (lockingrange != 0) {
-		LR[6] = 0x03;
-		LR[8] = lockingrange;
+		LR[5] = 0x03;
+		LR[7] = lockingrange;
 	}
 	session = new DtaSession(this);
 	if (NULL == session) {
@@ -880,7 +1481,7 @@ uint8_t DtaDevOpal::setLockingRange(uint8_t lockingrange, uint8_t lockingstate,
 		delete session;
 		return lastRC;
 	}
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (NULL == set) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -908,11 +1509,11 @@ uint8_t DtaDevOpal::setLockingRange(uint8_t lockingrange, uint8_t lockingstate,
 	set->complete();
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "setLockingRange Failed ";
-		delete set;
+		releaseCommand(set);
 		delete session;
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " set to " << msg;
 	LOG(D1) << "Exiting DtaDevOpal::setLockingRange";
@@ -944,14 +1545,11 @@ uint8_t DtaDevOpal::setLockingRange_SUM(uint8_t lockingrange, uint8_t lockingsta
 		LOG(E) << "Invalid locking state for setLockingRange";
 		return DTAERROR_INVALID_PARAMETER;
 	}
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 	if (lockingrange != 0) {
-		LR[6] = 0x03;
-		LR[8] = lockingrange;
+		LR[5] = 0x03;
+		LR[7] = lockingrange;
 	}
 	session = new DtaSession(this);
 	if (NULL == session) {
@@ -970,7 +1568,7 @@ uint8_t DtaDevOpal::setLockingRange_SUM(uint8_t lockingrange, uint8_t lockingsta
 		return lastRC;
 	}
 
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (NULL == set) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -1008,11 +1606,11 @@ uint8_t DtaDevOpal::setLockingRange_SUM(uint8_t lockingrange, uint8_t lockingsta
 	set->complete();
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "setLockingRange Failed ";
-		delete set;
+		releaseCommand(set);
 		delete session;
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	delete session;
 	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " set to " << msg;
 	LOG(D1) << "Exiting DtaDevOpal::setLockingRange_SUM";
@@ -1081,11 +1679,111 @@ uint8_t DtaDevOpal::enableUser(char * password, char * userid, OPAL_TOKEN status
 	LOG(D1) << "Exiting DtaDevOpal::enableUser()";
 	return 0;
 }
+uint8_t DtaDevOpal::provisionUsers(char * password, char * filename)
+{
+	LOG(D1) << "Entering DtaDevOpal::provisionUsers() " << filename << " " << dev;
+	vector<userProvision_t> users;
+	string line, action;
+	uint32_t lineno = 0;
+	ifstream specfile(filename);
+	if (!specfile) {
+		LOG(E) << "Unable to open user provisioning file " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	while (getline(specfile, line)) {
+		lineno++;
+		istringstream fields(line);
+		userProvision_t user;
+		if (!(fields >> user.userid) || ('#' == user.userid[0])) continue;
+		if (!(fields >> action)) action = "";
+		if ("enable" == action) user.enable = 1;
+		else if ("disable" == action) user.enable = 0;
+		else if ("keep" == action) user.enable = -1;
+		else {
+			LOG(E) << filename << ":" << lineno << " expected enable, disable or keep after " << user.userid;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		user.setPassword = (bool)(fields >> user.newpassword);
+		user.status = 0;
+		users.push_back(user);
+	}
+	if (users.empty()) {
+		LOG(E) << "No users found in " << filename;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	uint8_t lastRC = provisionUsers(password, users);
+	LOG(D1) << "Exiting DtaDevOpal::provisionUsers()";
+	return lastRC;
+}
+uint8_t DtaDevOpal::provisionUsers(char * password, vector<userProvision_t> & users)
+{
+	LOG(D1) << "Entering DtaDevOpal::provisionUsers() " << users.size() << " users";
+	uint8_t lastRC, failRC = 0;
+	vector<uint8_t> authority;
+	vector<thread> hashers;
+	atomic<uint32_t> next(0);
+	// PBKDF2 dominates the run time, so get every hash before the session
+	// opens rather than holding the session while each one is computed,
+	// one worker per CPU taking the next user from the list
+	uint32_t workers = thread::hardware_concurrency();
+	if (0 == workers) workers = 1;
+	if (workers > users.size()) workers = (uint32_t)users.size();
+	for (uint32_t w = 0; w < workers; w++) {
+		hashers.push_back(thread([this, &users, &next]() {
+			for (uint32_t i = next++; i < users.size(); i = next++) {
+				if (users[i].setPassword)
+					DtaHashPwd(users[i].hash, (char *)users[i].newpassword.c_str(), this);
+			}
+		}));
+	}
+	for (uint32_t i = 0; i < hashers.size(); i++)
+		hashers[i].join();
+
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	for (uint32_t i = 0; i < users.size(); i++) {
+		userProvision_t & user = users[i];
+		char * userid = (char *)user.userid.c_str();
+		if ((-1 != user.enable) &&
+			(((user.status = getAuth4User(userid, 0, authority)) != 0) ||
+			((user.status = setTable(authority, (OPAL_TOKEN)0x05,
+				user.enable ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE)) != 0))) {
+			LOG(E) << userid << " could not be " << (user.enable ? "enabled" : "disabled");
+		}
+		else if (user.setPassword &&
+			(((user.status = getAuth4User(userid, 10, authority)) != 0) ||
+			((user.status = setTable(authority, OPAL_TOKEN::PIN, user.hash)) != 0))) {
+			LOG(E) << userid << " password could not be changed";
+		}
+		else {
+			LOG(I) << userid << ((1 == user.enable) ? " enabled" : (0 == user.enable) ? " disabled" : "")
+				<< (user.setPassword ? " password changed" : "");
+			continue;
+		}
+		failRC = user.status;
+		// the session is gone, the remaining entries can't be applied
+		if ((DTAERROR_TIMEOUT == failRC) || (DTAERROR_CANCELLED == failRC)) {
+			for (uint32_t j = i + 1; j < users.size(); j++)
+				users[j].status = failRC;
+			break;
+		}
+	}
+	delete session;
+	LOG(D1) << "Exiting DtaDevOpal::provisionUsers()";
+	return failRC;
+}
 uint8_t DtaDevOpal::revertTPer(char * password, uint8_t PSID, uint8_t AdminSP)
 {
 	LOG(D1) << "Entering DtaDevOpal::revertTPer() " << AdminSP;
 	uint8_t lastRC;
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1093,7 +1791,7 @@ uint8_t DtaDevOpal::revertTPer(char * password, uint8_t PSID, uint8_t AdminSP)
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
-		delete cmd;
+		releaseCommand(cmd);
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	OPAL_UID uid = OPAL_UID::OPAL_SID_UID;
@@ -1102,7 +1800,7 @@ uint8_t DtaDevOpal::revertTPer(char * password, uint8_t PSID, uint8_t AdminSP)
 		uid = OPAL_UID::OPAL_PSID_UID;
 		}
 	if ((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID, password, uid)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
@@ -1112,12 +1810,12 @@ uint8_t DtaDevOpal::revertTPer(char * password, uint8_t PSID, uint8_t AdminSP)
 	cmd->complete();
 	session->expectAbort();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "revertTper completed successfully";
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(D1) << "Exiting DtaDevOpal::revertTPer()";
 	return 0;
@@ -1131,9 +1829,7 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 	ifstream pbafile;
 	(MAX_BUFFER_LENGTH > tperMaxPacket) ? blockSize = tperMaxPacket : blockSize = MAX_BUFFER_LENGTH;
 	if (blockSize > (tperMaxToken - 4)) blockSize = tperMaxToken - 4;
-	vector <uint8_t> buffer, lengthtoken;
 	blockSize -= sizeof(OPALHeader) + 50;  // packet overhead
-	buffer.resize(blockSize);
 	pbafile.open(filename, ios::in | ios::binary);
 	if (!pbafile) {
 		LOG(E) << "Unable to open PBA image file " << filename;
@@ -1143,7 +1839,7 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 	eofpos = (uint32_t) pbafile.tellg(); 
 	pbafile.seekg(0, pbafile.beg);
 
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1155,7 +1851,7 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		pbafile.close();
 		return lastRC;
@@ -1166,14 +1862,7 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 		if (eofpos == filepos) break;
 		if ((eofpos - filepos) < blockSize) {
 			blockSize = eofpos - filepos; // handle a short last block
-			buffer.resize(blockSize);
-		}
-		lengthtoken.clear();
-		lengthtoken.push_back(0xe2);
-		lengthtoken.push_back((uint8_t) ((blockSize >> 16) & 0x000000ff));
-		lengthtoken.push_back((uint8_t)((blockSize >> 8) & 0x000000ff));
-		lengthtoken.push_back((uint8_t)(blockSize & 0x000000ff));
-		pbafile.read((char *)buffer.data(), blockSize);
+		}
 		cmd->reset(OPAL_UID::OPAL_MBR, OPAL_METHOD::SET);
 		cmd->addToken(OPAL_TOKEN::STARTLIST);
 		cmd->addToken(OPAL_TOKEN::STARTNAME);
@@ -1182,13 +1871,18 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 		cmd->addToken(OPAL_TOKEN::ENDNAME);
 		cmd->addToken(OPAL_TOKEN::STARTNAME);
 		cmd->addToken(OPAL_TOKEN::VALUES);
-		cmd->addToken(lengthtoken);
-		cmd->addToken(buffer);
+		if (cmd->addToken(pbafile, blockSize) != blockSize) {
+			LOG(E) << "Unable to read PBA image file " << filename;
+			releaseCommand(cmd);
+			delete session;
+			pbafile.close();
+			return DTAERROR_OPEN_ERR;
+		}
 		cmd->addToken(OPAL_TOKEN::ENDNAME);
 		cmd->addToken(OPAL_TOKEN::ENDLIST);
-		cmd->complete();
-		if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-			delete cmd;
+		if (((lastRC = cmd->complete()) != 0) ||
+			((lastRC = session->sendCommand(cmd, response)) != 0)) {
+			releaseCommand(cmd);
 			delete session;
 			pbafile.close();
 			return lastRC;
@@ -1197,13 +1891,258 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 		cout << filepos << " of " << eofpos << " " << (uint16_t) (((float)filepos/(float)eofpos) * 100) << "% blk=" << blockSize << " \r";
 	}
 	cout << "\n";
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	pbafile.close();
 	LOG(I) << "PBA image  " << filename << " written to " << dev;
 	LOG(D1) << "Exiting DtaDevOpal::loadPBAimage()";
 	return 0;
 }
+uint8_t DtaDevOpal::getMaxRanges(uint64_t & maxRanges)
+{
+	uint8_t lastRC;
+	if (getCached("MaxRanges", maxRanges)) return 0;
+	if ((lastRC = getTable(OPALUID[OPAL_UID::OPAL_LOCKING_INFO_TABLE], _OPAL_TOKEN::MAXRANGES, _OPAL_TOKEN::MAXRANGES)) != 0) {
+		return lastRC;
+	}
+	if (!response.getColumn(_OPAL_TOKEN::MAXRANGES, maxRanges)) {
+		LOG(E) << "Unable to determine number of ranges ";
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	setCached("MaxRanges", maxRanges);
+	return 0;
+}
+uint8_t DtaDevOpal::getTableRows(OPAL_UID table, uint32_t & rows)
+{
+	LOG(D1) << "Entering DtaDevOpal::getTableRows()";
+	uint8_t lastRC;
+	/* the Table table row describing a table is 00000001 followed by
+	 * the first half of the table's UID */
+	uint8_t row[8] = { 0x00, 0x00, 0x00, 0x01 };
+	memcpy(&row[4], OPALUID[table], 4);
+	if ((lastRC = getTable(row, OPAL_TOKEN::ROWS, OPAL_TOKEN::ROWS)) != 0) {
+		return lastRC;
+	}
+	uint64_t value;
+	if (!response.getColumn(OPAL_TOKEN::ROWS, value)) {
+		LOG(E) << "Unable to determine the size of the table";
+		return DTAERROR_COMMAND_ERROR;
+	}
+	rows = (uint32_t) value;
+	LOG(D1) << "Exiting DtaDevOpal::getTableRows() " << rows;
+	return 0;
+}
+uint32_t DtaDevOpal::dataStoreChunk(bool write)
+{
+	uint32_t chunk;
+	(MAX_BUFFER_LENGTH > tperMaxPacket) ? chunk = tperMaxPacket : chunk = MAX_BUFFER_LENGTH;
+	// the reply to a Get has to fit the response buffer
+	if ((!write) && (chunk > MIN_BUFFER_LENGTH)) chunk = MIN_BUFFER_LENGTH;
+	if ((tperMaxToken > 4) && (chunk > (tperMaxToken - 4))) chunk = tperMaxToken - 4;
+	if (chunk <= sizeof(OPALHeader) + 50) {
+		LOG(E) << "TPer packet size " << chunk << " leaves no room for DataStore data";
+		return 0;
+	}
+	chunk -= sizeof(OPALHeader) + 50;  // packet overhead
+	if ((disk_info.DataStore_alignment > 1) && (chunk >= disk_info.DataStore_alignment))
+		chunk -= chunk % disk_info.DataStore_alignment;
+	LOG(D1) << "DataStore chunk size " << chunk;
+	return chunk;
+}
+/** Show how far a DataStore transfer has got, on stderr so that
+ * machine readable output on stdout is not interleaved with it */
+static void showProgress(uint32_t done, uint32_t total, uint32_t blockSize)
+{
+	cerr << done << " of " << total << " " << (uint16_t)(((float)done / (float)total) * 100) << "% blk=" << blockSize << " \r";
+}
+/** Log the amount of data moved and the rate it was moved at */
+static void logThroughput(const char * what, uint32_t bytes,
+	std::chrono::steady_clock::time_point start)
+{
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	LOG(I) << what << " " << bytes << " bytes in " << std::fixed << std::setprecision(2)
+		<< secs << "s (" << ((secs > 0) ? (bytes / 1024.0) / secs : 0) << " KiB/s)";
+}
+uint8_t DtaDevOpal::writeDataStore(char * password, char * filename)
+{
+	LOG(D1) << "Entering DtaDevOpal::writeDataStore()" << filename << " " << dev;
+	uint8_t lastRC;
+	uint32_t chunk, rows;
+	uint32_t filepos = 0;
+	uint32_t eofpos;
+	ifstream datafile;
+	datafile.open(filename, ios::in | ios::binary);
+	if (!datafile) {
+		LOG(E) << "Unable to open DataStore file " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	datafile.seekg(0, datafile.end);
+	eofpos = (uint32_t)datafile.tellg();
+	datafile.seekg(0, datafile.beg);
+
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	if ((lastRC = getTableRows(OPAL_UID::OPAL_DATASTORE, rows)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	if (eofpos > rows) {
+		LOG(E) << filename << " is " << eofpos << " bytes, the DataStore holds " << rows;
+		delete session;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	DtaCommand *cmd = getCommand();
+	if (NULL == cmd) {
+		LOG(E) << "Unable to create command object ";
+		delete session;
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((chunk = dataStoreChunk(true)) == 0) {
+		releaseCommand(cmd);
+		delete session;
+		return DTAERROR_COMMAND_ERROR;
+	}
+	auto start = std::chrono::steady_clock::now();
+	while (filepos < eofpos) {
+		uint32_t blockSize = ((eofpos - filepos) < chunk) ? eofpos - filepos : chunk;
+		cmd->reset(OPAL_UID::OPAL_DATASTORE, OPAL_METHOD::SET);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::WHERE);
+		cmd->addToken(filepos);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::VALUES);
+		if (blockSize > cmd->bytestringRoom()) {
+			LOG(E) << "DataStore chunk of " << blockSize << " bytes does not fit in the command";
+			releaseCommand(cmd);
+			delete session;
+			return DTAERROR_BUFFER_OVERRUN;
+		}
+		if (cmd->addToken(datafile, blockSize) != blockSize) {
+			LOG(E) << "Unable to read DataStore file " << filename;
+			releaseCommand(cmd);
+			delete session;
+			return DTAERROR_OPEN_ERR;
+		}
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		if (((lastRC = cmd->complete()) != 0) ||
+			((lastRC = session->sendCommand(cmd, response)) != 0)) {
+			releaseCommand(cmd);
+			delete session;
+			return lastRC;
+		}
+		filepos += blockSize;
+		showProgress(filepos, eofpos, blockSize);
+	}
+	cerr << "\n";
+	releaseCommand(cmd);
+	delete session;
+	logThroughput("DataStore write", eofpos, start);
+	LOG(I) << filename << " written to DataStore on " << dev;
+	LOG(D1) << "Exiting DtaDevOpal::writeDataStore()";
+	return 0;
+}
+uint8_t DtaDevOpal::readDataStore(char * password, char * filename)
+{
+	LOG(D1) << "Entering DtaDevOpal::readDataStore()" << filename << " " << dev;
+	uint8_t lastRC;
+	uint32_t chunk, rows;
+	uint32_t filepos = 0;
+	ofstream datafile;
+	datafile.open(filename, ios::out | ios::binary | ios::trunc);
+	if (!datafile) {
+		LOG(E) << "Unable to open DataStore file " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	if ((lastRC = getTableRows(OPAL_UID::OPAL_DATASTORE, rows)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	DtaCommand *cmd = getCommand();
+	if (NULL == cmd) {
+		LOG(E) << "Unable to create command object ";
+		delete session;
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((chunk = dataStoreChunk(false)) == 0) {
+		releaseCommand(cmd);
+		delete session;
+		return DTAERROR_COMMAND_ERROR;
+	}
+	string data;
+	auto start = std::chrono::steady_clock::now();
+	while (filepos < rows) {
+		uint32_t blockSize = ((rows - filepos) < chunk) ? rows - filepos : chunk;
+		cmd->reset(OPAL_UID::OPAL_DATASTORE, OPAL_METHOD::GET);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::STARTROW);
+		cmd->addToken(filepos);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::ENDROW);
+		cmd->addToken(filepos + blockSize - 1);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		if (((lastRC = cmd->complete()) != 0) ||
+			((lastRC = session->sendCommand(cmd, response)) != 0)) {
+			releaseCommand(cmd);
+			delete session;
+			return lastRC;
+		}
+		// [ bytes ]
+		if (response.tokenIs(1) == _OPAL_TOKEN::DTA_TOKENID_BYTESTRING)
+			data = response.getString(1);
+		else
+			data.clear();
+		if (data.size() != blockSize) {
+			LOG(E) << "Short read from DataStore at " << filepos;
+			releaseCommand(cmd);
+			delete session;
+			return DTAERROR_COMMAND_ERROR;
+		}
+		if (!datafile.write(data.data(), blockSize)) {
+			LOG(E) << "Unable to write DataStore file " << filename;
+			releaseCommand(cmd);
+			delete session;
+			return DTAERROR_WRITE_ERR;
+		}
+		filepos += blockSize;
+		showProgress(filepos, rows, blockSize);
+	}
+	cerr << "\n";
+	releaseCommand(cmd);
+	delete session;
+	datafile.close();
+	if (!datafile) {
+		LOG(E) << "Unable to write DataStore file " << filename;
+		return DTAERROR_WRITE_ERR;
+	}
+	logThroughput("DataStore read", rows, start);
+	LOG(I) << "DataStore on " << dev << " written to " << filename;
+	LOG(D1) << "Exiting DtaDevOpal::readDataStore()";
+	return 0;
+}
 
 uint8_t DtaDevOpal::activateLockingSP(char * password)
 {
@@ -1214,7 +2153,7 @@ uint8_t DtaDevOpal::activateLockingSP(char * password)
 	for (int i = 0; i < 8; i++) {
 		table.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID][i]);
 	}
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1225,21 +2164,22 @@ uint8_t DtaDevOpal::activateLockingSP(char * password)
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	if ((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID, password, OPAL_UID::OPAL_SID_UID)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	if ((lastRC = getTable(table, 0x06, 0x06)) != 0) {
 		LOG(E) << "Unable to determine LockingSP Lifecycle state";
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
-	if ((0x06 != response.getUint8(3)) || // getlifecycle
-		(0x08 != response.getUint8(4))) // Manufactured-Inactive
+	uint64_t lifecycle;
+	if (!response.getColumn(0x06, lifecycle) || // getlifecycle
+		(0x08 != lifecycle)) // Manufactured-Inactive
 	{
 		LOG(E) << "Locking SP lifecycle is not Manufactured-Inactive";
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return DTAERROR_INVALID_LIFECYCLE;
 	}
@@ -1248,13 +2188,13 @@ uint8_t DtaDevOpal::activateLockingSP(char * password)
 	cmd->addToken(OPAL_TOKEN::ENDLIST);
 	cmd->complete();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "Locking SP Activate Complete";
 
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(D1) << "Exiting DtaDevOpal::activatLockingSP()";
 	return 0;
@@ -1269,16 +2209,13 @@ uint8_t DtaDevOpal::activateLockingSP_SUM(uint8_t lockingrange, char * password)
 	for (int i = 0; i < 8; i++) {
 		table.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID][i]);
 	}
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 	if (lockingrange > 0) {
-		LR[6] = 0x03;
-		LR[8] = lockingrange;
+		LR[5] = 0x03;
+		LR[7] = lockingrange;
 	}
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1290,28 +2227,29 @@ uint8_t DtaDevOpal::activateLockingSP_SUM(uint8_t lockingrange, char * password)
 	}
 	if ((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID, password, OPAL_UID::OPAL_SID_UID)) != 0) {
 		LOG(E) << "session->start failed with code " << lastRC;
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	if ((lastRC = getTable(table, 0x06, 0x06)) != 0) {
 		LOG(E) << "Unable to determine LockingSP Lifecycle state";
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
-	if ((0x06 != response.getUint8(3)) || // getlifecycle
-		(0x08 != response.getUint8(4))) // Manufactured-Inactive
+	uint64_t lifecycle;
+	if (!response.getColumn(0x06, lifecycle) || // getlifecycle
+		(0x08 != lifecycle)) // Manufactured-Inactive
 	{
 		LOG(E) << "Locking SP lifecycle is not Manufactured-Inactive";
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return DTAERROR_INVALID_LIFECYCLE;
 	}
 	/*if (!disk_info.SingleUser)
 	{
 		LOG(E) << "This Locking SP does not support Single User Mode";
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return DTAERROR_INVALID_COMMAND;
 	}*/
@@ -1324,21 +2262,21 @@ uint8_t DtaDevOpal::activateLockingSP_SUM(uint8_t lockingrange, char * password)
 			cmd->addToken(OPAL_TINY_ATOM::UINT_00);
 			cmd->addToken(OPAL_TINY_ATOM::UINT_00);
 			cmd->addToken(OPAL_TOKEN::STARTLIST);
-				cmd->addToken(LR);
+				cmd->addUID(LR);
 			cmd->addToken(OPAL_TOKEN::ENDLIST);
 		cmd->addToken(OPAL_TOKEN::ENDNAME);
 	cmd->addToken(OPAL_TOKEN::ENDLIST);
 	cmd->complete();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
 		LOG(E) << "session->sendCommand failed with code " << lastRC;
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	disk_info.Locking_lockingEnabled = 1;
 	LOG(I) << "Locking SP Activate Complete for single User" << (lockingrange+1) << " on locking range " << (int)lockingrange;
 
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(D1) << "Exiting DtaDevOpal::activateLockingSP_SUM()";
 	return 0;
@@ -1348,14 +2286,11 @@ uint8_t DtaDevOpal::eraseLockingRange_SUM(uint8_t lockingrange, char * password)
 {
 	uint8_t lastRC;
 	LOG(D1) << "Entering DtaDevOpal::eraseLockingRange_SUM";
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
 	if (lockingrange != 0) {
-		LR[6] = 0x03;
-		LR[8] = lockingrange;
+		LR[5] = 0x03;
+		LR[7] = lockingrange;
 	}
 	session = new DtaSession(this);
 	if (NULL == session) {
@@ -1367,7 +2302,7 @@ uint8_t DtaDevOpal::eraseLockingRange_SUM(uint8_t lockingrange, char * password)
 		return lastRC;
 	}
 
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
@@ -1380,11 +2315,11 @@ uint8_t DtaDevOpal::eraseLockingRange_SUM(uint8_t lockingrange, char * password)
 	cmd->complete();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
 		LOG(E) << "setLockingRange Failed ";
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " erased";
 	LOG(D1) << "Exiting DtaDevOpal::eraseLockingRange_SUM";
@@ -1395,11 +2330,12 @@ uint8_t DtaDevOpal::takeOwnership(char * newpassword)
 {
 	LOG(D1) << "Entering DtaDevOpal::takeOwnership()";
 	uint8_t lastRC;
-	if ((lastRC = getDefaultPassword()) != 0) {
+	string defaultPassword;
+	if ((lastRC = getMSID(defaultPassword)) != 0) {
 		LOG(E) << "Unable to read MSID password ";
 		return lastRC;
 	}
-	if ((lastRC = setSIDPassword((char *)response.getString(4).c_str(), newpassword, 0)) != 0) {
+	if ((lastRC = setSIDPassword((char *)defaultPassword.c_str(), newpassword, 0)) != 0) {
 		LOG(E) << "takeOwnership failed";
 		return lastRC;
 	}
@@ -1431,18 +2367,70 @@ uint8_t DtaDevOpal::getDefaultPassword()
 		delete session;
 		return lastRC;
 	}
+	if (DTA_NOCOLUMN == response.column(PIN)) {
+		LOG(E) << "C_PIN_MSID row has no PIN column";
+		delete session;
+		return DTAERROR_COMMAND_ERROR;
+	}
 	delete session;
 	LOG(D1) << "Exiting getDefaultPassword()";
 	return 0;
 }
+uint8_t DtaDevOpal::getMSID(string & msid)
+{
+	uint8_t lastRC;
+	if (getCached("MSID", msid)) return 0;
+	if ((lastRC = getDefaultPassword()) != 0) return lastRC;
+	// don't remember a failed read for the life of the device
+	if (!response.getColumn(PIN, msid) || msid.empty()) {
+		LOG(E) << "C_PIN_MSID row has no PIN";
+		msid.clear();
+		return DTAERROR_COMMAND_ERROR;
+	}
+	setCached("MSID", msid);
+	return 0;
+}
+uint8_t DtaDevOpal::getProgrammaticResetEnable(bool & enabled)
+{
+	LOG(D1) << "Entering DtaDevOpal::getProgrammaticResetEnable()";
+	static const uint8_t tperInfo[8] = { 0x00, 0x00, 0x02, 0x01, 0x00, 0x03, 0x00, 0x01 };
+	const uint16_t programmaticResetEnable = 0x08;
+	uint8_t lastRC;
+	uint64_t value;
+	enabled = false;
+	if (getCached("ProgrammaticResetEnable", value)) {
+		enabled = (0 != value);
+		return 0;
+	}
+	// called while another session is being started, keep that one
+	DtaSession * outer = session;
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		session = outer;
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if (((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID)) == 0) &&
+		((lastRC = getTable(tperInfo, programmaticResetEnable, programmaticResetEnable)) == 0) &&
+		!response.getColumn(programmaticResetEnable, value)) {
+		LOG(E) << "TPerInfo has no ProgrammaticResetEnable";
+		lastRC = DTAERROR_COMMAND_ERROR;
+	}
+	delete session;
+	session = outer;
+	if (lastRC) return lastRC;
+	setCached("ProgrammaticResetEnable", value);
+	enabled = (0 != value);
+	return 0;
+}
 uint8_t DtaDevOpal::printDefaultPassword()
 {
-    const uint8_t rc = getDefaultPassword();
+	string defaultPassword;
+    const uint8_t rc = getMSID(defaultPassword);
 	if (rc) {
 		LOG(E) << "unable to read MSID password";
 		return rc;
 	}
-	string defaultPassword = response.getString(4);
     fprintf(stdout, "MSID: %s\n", (char *)defaultPassword.c_str());
     return 0;
 }
@@ -1502,7 +2490,7 @@ uint8_t DtaDevOpal::setTable(vector<uint8_t> table, OPAL_TOKEN name,
 {
 	LOG(D1) << "Entering DtaDevOpal::setTable";
 	uint8_t lastRC;
-	DtaCommand *set = new DtaCommand();
+	DtaCommand *set = getCommand();
 	if (NULL == set) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1523,25 +2511,33 @@ uint8_t DtaDevOpal::setTable(vector<uint8_t> table, OPAL_TOKEN name,
 	set->complete();
 	if ((lastRC = session->sendCommand(set, response)) != 0) {
 		LOG(E) << "Set Failed ";
-		delete set;
+		releaseCommand(set);
 		return lastRC;
 	}
-	delete set;
+	releaseCommand(set);
 	LOG(D1) << "Leaving DtaDevOpal::setTable";
 	return 0;
 }
-uint8_t DtaDevOpal::getTable(vector<uint8_t> table, uint16_t startcol, 
+uint8_t DtaDevOpal::getTable(const vector<uint8_t> & table, uint16_t startcol, 
+	uint16_t endcol)
+{
+	if ((9 != table.size()) || (OPAL_SHORT_ATOM::BYTESTRING8 != table[0])) {
+		LOG(E) << "Invalid table UID";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	return getTable(&table[1], startcol, endcol);
+}
+uint8_t DtaDevOpal::getTable(const uint8_t table[8], uint16_t startcol,
 	uint16_t endcol)
 {
 	LOG(D1) << "Entering DtaDevOpal::getTable";
 	uint8_t lastRC;
-	DtaCommand *get = new DtaCommand();
+	DtaCommand *get = getCommand();
 	if (NULL == get) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
-	get->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::GET);
-	get->changeInvokingUid(table);
+	get->reset(table, OPAL_METHOD::GET);
 	get->addToken(OPAL_TOKEN::STARTLIST);
 	get->addToken(OPAL_TOKEN::STARTLIST);
 	get->addToken(OPAL_TOKEN::STARTNAME);
@@ -1556,30 +2552,50 @@ uint8_t DtaDevOpal::getTable(vector<uint8_t> table, uint16_t startcol,
 	get->addToken(OPAL_TOKEN::ENDLIST);
 	get->complete();
 	if ((lastRC = session->sendCommand(get, response)) != 0) {
-		delete get;
+		releaseCommand(get);
 		return lastRC;
 	}
-	delete get;
+	releaseCommand(get);
 	return 0;
 }
 uint8_t DtaDevOpal::exec(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol)
 {
+	std::lock_guard<DtaDev> hold(*this);
 	uint8_t lastRC;
+	if (cmd->overrun) {
+		LOG(E) << "Command not sent, it did not fit in the command buffer";
+		return DTAERROR_BUFFER_OVERRUN;
+	}
     OPALHeader * hdr = (OPALHeader *) cmd->getCmdBuffer();
     LOG(D3) << endl << "Dumping command buffer";
     IFLOG(D3) DtaHexDump(cmd->getCmdBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
+    DtaStats::clock::time_point start;
+    uint64_t sendNs = 0;
+    uint32_t polls = 0;
+    if (DtaStats::enabled()) start = DtaStats::clock::now();
     if((lastRC = sendCmd(IF_SEND, protocol, comID(), cmd->getCmdBuffer(), cmd->outputBufferSize())) != 0) {
 		LOG(E) << "Command failed on send " << (uint16_t) lastRC;
         return lastRC;
     }
+    if (DtaStats::enabled()) {
+        sendNs = DtaStats::since(start);
+        start = DtaStats::clock::now();
+    }
+    std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+    uint8_t abandonRC = 0;
     hdr = (OPALHeader *) cmd->getRespBuffer();
     do {
+        polls++;
         osmsSleep(25);
         memset(cmd->getRespBuffer(), 0, MIN_BUFFER_LENGTH);
         lastRC = sendCmd(IF_RECV, protocol, comID(), cmd->getRespBuffer(), MIN_BUFFER_LENGTH);
 
     }
-    while ((0 != hdr->cp.outstandingData) && (0 == hdr->cp.minTransfer));
+    while ((0 != hdr->cp.outstandingData) && (0 == hdr->cp.minTransfer) &&
+        (0 == (abandonRC = checkDeadline(cmd, sent))));
+    if (DtaStats::enabled()) DtaStats::transport(sendNs, polls, DtaStats::since(start));
+    if (0 != abandonRC)
+        return abandonCommand(abandonRC);
     LOG(D3) << std::endl << "Dumping reply buffer";
     IFLOG(D3) DtaHexDump(cmd->getRespBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
 	if (0 != lastRC) {
@@ -1600,12 +2616,13 @@ uint8_t DtaDevOpal::properties()
 		LOG(E) << "Unable to create session object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
-	DtaCommand *props = new DtaCommand(OPAL_UID::OPAL_SMUID_UID, OPAL_METHOD::PROPERTIES);
+	DtaCommand *props = getCommand();
 	if (NULL == props) {
 		LOG(E) << "Unable to create command object ";
 		delete session;
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
+	props->reset(OPAL_UID::OPAL_SMUID_UID, OPAL_METHOD::PROPERTIES);
 	props->addToken(OPAL_TOKEN::STARTLIST);
 	props->addToken(OPAL_TOKEN::STARTNAME);
 	props->addToken(OPAL_TOKEN::HOSTPROPERTIES);
@@ -1639,11 +2656,11 @@ uint8_t DtaDevOpal::properties()
 	props->addToken(OPAL_TOKEN::ENDLIST);
 	props->complete();
 	if ((lastRC = session->sendCommand(props, propertiesResponse)) != 0) {
-		delete props;
+		releaseCommand(props);
 		return lastRC;
 	}
 	disk_info.Properties = 1;
-	delete props;
+	releaseCommand(props);
 	for (uint32_t i = 0; i < propertiesResponse.getTokenCount(); i++) {
 		if (OPAL_TOKEN::STARTNAME == propertiesResponse.tokenIs(i)) {
 			if (OPAL_TOKEN::DTA_TOKENID_BYTESTRING != propertiesResponse.tokenIs(i + 1))
@@ -1689,33 +2706,16 @@ uint8_t DtaDevOpal::objDump(char *sp, char * auth, char *pass,
 	LOG(D1) << "Entering DtaDevEnterprise::objDump";
 	LOG(D1) << sp << " " << auth << " " << pass << " " << objID;
 	uint8_t lastRC;
-	DtaCommand *get = new DtaCommand();
+	DtaCommand *get = getCommand();
 	if (NULL == get) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	vector<uint8_t> authority, object;
-	uint8_t work;
-	if (16 != strnlen(auth, 32)) {
-		LOG(E) << "Authority must be 16 byte ascii string of hex authority uid";
-		return DTAERROR_INVALID_PARAMETER;
-	}
-	if (16 != strnlen(objID, 32)) {
-		LOG(E) << "ObjectID must be 16 byte ascii string of hex object uid";
+	if (DtaUIDToken(auth, authority) || DtaUIDToken(objID, object)) {
+		releaseCommand(get);
 		return DTAERROR_INVALID_PARAMETER;
 	}
-	authority.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = auth[i] & 0x40 ? 16 * ((auth[i] & 0xf) + 9) : 16 * (auth[i] & 0x0f);
-		work += auth[i + 1] & 0x40 ? (auth[i + 1] & 0xf) + 9 : auth[i + 1] & 0x0f;
-		authority.push_back(work);
-	}
-	object.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = objID[i] & 0x40 ? 16 * ((objID[i] & 0xf) + 9) : 16 * (objID[i] & 0x0f);
-		work += objID[i + 1] & 0x40 ? (objID[i + 1] & 0xf) + 9 : objID[i + 1] & 0x0f;
-		object.push_back(work);
-	}
 	get->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::GET);
 	get->changeInvokingUid(object);
 	get->addToken(OPAL_TOKEN::STARTLIST);
@@ -1728,22 +2728,22 @@ uint8_t DtaDevOpal::objDump(char *sp, char * auth, char *pass,
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
-		delete get;
+		releaseCommand(get);
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	if ((lastRC = session->start((OPAL_UID)atoi(sp), pass, authority)) != 0) {
-		delete get;
+		releaseCommand(get);
 		delete session;
 		return lastRC;
 	}
 	if ((lastRC = session->sendCommand(get, response)) != 0) {
-		delete get;
+		releaseCommand(get);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "Response:";
 	get->dumpResponse();
-	delete get;
+	releaseCommand(get);
 	delete session;
 	LOG(D1) << "Exiting DtaDevEnterprise::objDump";
 	return 0;
@@ -1754,38 +2754,11 @@ uint8_t DtaDevOpal::rawCmd(char *sp, char * hexauth, char *pass,
 	LOG(D1) << sp << " " << hexauth << " " << pass << " ";
 	LOG(D1) << hexinvokingUID << " " << hexmethod << " " << hexparms;
 	uint8_t lastRC;
-	vector<uint8_t> authority, object, invokingUID, method, parms;
+	vector<uint8_t> authority, invokingUID, method, parms;
 	uint8_t work;
-	if (16 != strnlen(hexauth, 32)) {
-		LOG(E) << "Authority must be 16 byte ascii string of hex authority uid";
+	if (DtaUIDToken(hexauth, authority) || DtaUIDToken(hexinvokingUID, invokingUID) ||
+		DtaUIDToken(hexmethod, method))
 		return DTAERROR_INVALID_PARAMETER;
-	}
-	authority.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = hexauth[i] & 0x40 ? 16 * ((hexauth[i] & 0xf) + 9) : 16 * (hexauth[i] & 0x0f);
-		work += hexauth[i + 1] & 0x40 ? (hexauth[i + 1] & 0xf) + 9 : hexauth[i + 1] & 0x0f;
-		authority.push_back(work);
-	}
-	if (16 != strnlen(hexinvokingUID, 32)) {
-		LOG(E) << "invoker must be 16 byte ascii string of invoking uid";
-		return DTAERROR_INVALID_PARAMETER;
-	}
-	invokingUID.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = hexinvokingUID[i] & 0x40 ? 16 * ((hexinvokingUID[i] & 0xf) + 9) : 16 * (hexinvokingUID[i] & 0x0f);
-		work += hexinvokingUID[i + 1] & 0x40 ? (hexinvokingUID[i + 1] & 0xf) + 9 : hexinvokingUID[i + 1] & 0x0f;
-		invokingUID.push_back(work);
-	}
-	if (16 != strnlen(hexmethod, 32)) {
-		LOG(E) << "invoker must be 16 byte ascii string of method uid";
-		return DTAERROR_INVALID_PARAMETER;
-	}
-	method.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (uint32_t i = 0; i < 16; i += 2) {
-		work = hexmethod[i] & 0x40 ? 16 * ((hexmethod[i] & 0xf) + 9) : 16 * (hexmethod[i] & 0x0f);
-		work += hexmethod[i + 1] & 0x40 ? (hexmethod[i + 1] & 0xf) + 9 : hexmethod[i + 1] & 0x0f;
-		method.push_back(work);
-	}
 	if (1020 < strnlen(hexparms, 1024)) {
 		LOG(E) << "Parmlist limited to 1020 characters";
 		return DTAERROR_INVALID_PARAMETER;
@@ -1800,7 +2773,7 @@ uint8_t DtaDevOpal::rawCmd(char *sp, char * hexauth, char *pass,
 		work += hexparms[i + 1] & 0x40 ? (hexparms[i + 1] & 0xf) + 9 : hexparms[i + 1] & 0x0f;
 		parms.push_back(work);
 	}
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -1812,24 +2785,24 @@ uint8_t DtaDevOpal::rawCmd(char *sp, char * hexauth, char *pass,
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
-		delete cmd;
+		releaseCommand(cmd);
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	if ((lastRC = session->start((OPAL_UID)atoi(sp), pass, authority)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "Command:";
 	cmd->dumpCommand();
 	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-		delete cmd;
+		releaseCommand(cmd);
 		delete session;
 		return lastRC;
 	}
 	LOG(I) << "Response:";
 	cmd->dumpResponse();
-	delete cmd;
+	releaseCommand(cmd);
 	delete session;
 	LOG(D1) << "Exiting DtaDevEnterprise::rawCmd";
 	return 0;
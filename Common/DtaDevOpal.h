@@ -27,6 +27,8 @@ class DtaSession;
 #include "DtaLexicon.h"
 #include "DtaResponse.h"   // wouldn't take class
 #include <vector>
+#include <string>
+#include <istream>
 
 using namespace std;
 /** Common code for OPAL SSCs.
@@ -65,12 +67,27 @@ public:
 	uint8_t takeOwnership(char * newpassword);
         /** retrieve the MSID password */
 	uint8_t printDefaultPassword();
+        /** The MSID password, read from the drive the first time only
+         * @param msid where the MSID is returned
+         */
+	uint8_t getMSID(std::string & msid);
+	/** Read ProgrammaticResetEnable from the TPerInfo table in an Admin SP session
+	 * @param enabled the value of the column
+	 */
+	uint8_t getProgrammaticResetEnable(bool & enabled);
         /** retrieve a single row from a table 
          * @param table the UID of the table
          * @param startcol the starting column of data requested
          * @param endcol the ending column of the data requested 
          */
-	uint8_t getTable(vector<uint8_t> table, uint16_t startcol,
+	uint8_t getTable(const vector<uint8_t> & table, uint16_t startcol,
+		uint16_t endcol);
+        /** retrieve a single row from a table
+         * @param table bare 8 byte UID of the table row
+         * @param startcol the starting column of data requested
+         * @param endcol the ending column of the data requested
+         */
+	uint8_t getTable(const uint8_t table[8], uint16_t startcol,
 		uint16_t endcol);
          /** Set the SID password.
          * Requires special handling because password is not always hashed.
@@ -128,6 +145,29 @@ public:
          * @param userid Character name of the user to be enabled
          */
 	uint8_t enableUser(char * password, char * userid, OPAL_TOKEN status = OPAL_TOKEN::OPAL_TRUE);
+	/** One entry of a bulk user provisioning request */
+	typedef struct userProvision
+	{
+		std::string userid;       //Admin<n> or User<n>
+		int8_t enable;            //1 enable, 0 disable, -1 leave as is
+		bool setPassword;         //change the password to newpassword
+		std::string newpassword;
+		std::vector<uint8_t> hash; //newpassword hashed for this drive
+		uint8_t status;           //result for this entry
+	}userProvision_t;
+        /** Enable or disable users and set their passwords from a file.
+         * @param password the password of the Locking SP administrative authority
+         * @param filename lines of "<userid> <enable|disable|keep> [newpassword]"
+         */
+	uint8_t provisionUsers(char * password, char * filename);
+        /** Apply a list of user changes to the Authority and C_PIN tables in
+         * a single Admin1 session.  The new passwords are all hashed in
+         * parallel before the session is opened.  Each entry's status is
+         * filled in; the last failure, if any, is returned.
+         * @param password the password of the Locking SP administrative authority
+         * @param users the changes to make
+         */
+	uint8_t provisionUsers(char * password, std::vector<userProvision_t> & users);
         /** Primitive to set the MBRDone flag.
          * @param state 0 or 1  
          * @param Admin1Password Locking SP authority with access to flag
@@ -188,6 +228,23 @@ public:
 	*  @param password Password of administrator
 	*/
 	uint8_t listLockingRanges(char * password, int16_t rangeid);
+	/** Set up the locking ranges listed in a file in one session.  Each line is
+	*  "<range> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>".
+	*  @param password Password of administrator
+	*  @param filename the range layout
+	*/
+	uint8_t applyRangeLayout(char * password, char * filename);
+	/** Bring the drive to the state described in a file, changing only what
+	* differs.  Each line is one of
+	*   lockingsp active
+	*   mbr <enable|done> <Y|N>
+	*   user <userid> <enable|disable>
+	*   range <0...n> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>
+	* @param password Password of administrator
+	* @param filename the desired state
+	* @param dryrun report the changes without making them
+	*/
+	uint8_t reconcile(char * password, char * filename, bool dryrun);
         /** User command to enable/disable a locking range.
          * RW|RO|LK are the supported states @see OPAL_LOCKINGSTATE
          * @param lockingrange locking range number
@@ -205,7 +262,7 @@ public:
 	* @param UID user UID in vector format
         * @param password password of the UID authority
         */
-	uint8_t rekeyLockingRange_SUM(vector<uint8_t> LR, vector<uint8_t>  UID, char * password);
+	uint8_t rekeyLockingRange_SUM(const vector<uint8_t> & LR, const vector<uint8_t> & UID, char * password);
 	/** Reset the TPER to its factory condition   
          * ERASES ALL DATA!
          * @param password password of authority (SID or PSID)
@@ -221,11 +278,33 @@ public:
 	    * @param password Password of administrative authority for locking range
 	    */
 	uint8_t eraseLockingRange(uint8_t lockingrange, char * password);
+	    /** Erase every locking range by giving each a new key as Admin1
+	    * in a single session, Opal has no Erase method
+	    * @param password Password of administrative authority for locking range
+	    */
+	uint8_t eraseAllLockingRanges(char * password);
+	    /** The blocks an erase of a locking range destroys, read as Admin1
+	    * @param lockingrange The number of the locking range (0 = global)
+	    * @param password Admin1 password
+	    * @param extents receives the extents
+	    */
+	uint8_t getRangeExtents(uint8_t lockingrange, char * password,
+		std::vector<DTA_EXTENT> & extents);
         /** Loads a disk image file to the shadow MBR table.
          * @param password the password for the administrative authority with access to the table
          * @param filename the filename of the disk image
          */
 	uint8_t loadPBA(char * password, char * filename);
+        /** Copy the contents of the DataStore table to a file.
+         * @param password the password for the administrative authority with access to the table
+         * @param filename the file to be written
+         */
+	uint8_t readDataStore(char * password, char * filename);
+        /** Write a file to the start of the DataStore table.
+         * @param password the password for the administrative authority with access to the table
+         * @param filename the file to be written to the table
+         */
+	uint8_t writeDataStore(char * password, char * filename);
         /** User command to prepare the device for management by sedutil. 
          * Specific to the SSC that the device supports
          * @param password the password that is to be assigned to the SSC master entities 
@@ -272,6 +351,21 @@ protected:
 		char * password, char * msg = (char *) "New Value Set");
 
 	uint8_t getDefaultPassword();
+	/** Read MaxRanges from LockingInfo in the open session, or from the
+	 * cache after the first time
+	 * @param maxRanges where the number of non global ranges is returned
+	 */
+	uint8_t getMaxRanges(uint64_t & maxRanges);
+	/** Read the number of rows (bytes for a byte table) of a table
+	 * from the Table table, in the open session.
+	 * @param table the table
+	 * @param rows where the row count is returned
+	 */
+	uint8_t getTableRows(OPAL_UID table, uint32_t & rows);
+	/** Size of the DataStore chunk moved by one Get (read) or Set (write),
+	 * from the negotiated packet and token limits and the table alignment,
+	 * 0 if the limits leave no room for data */
+	uint32_t dataStoreChunk(bool write);
 	typedef struct lrStatus
 	{
 		uint8_t command_status; //return code of locking range query command
@@ -288,5 +382,64 @@ protected:
 	 *  @param password Admin1 Password for TPer
 	 */
 	lrStatus_t getLockingRange_status(uint8_t lockingrange, char * password);
+	/** Read the whole row of a locking range with one Get in the open session
+	 *  and fill in the status from the named columns.
+	 *  @param LR UID of the locking range
+	 *  @param lrStatus where the columns are returned
+	 */
+	uint8_t getLockingRangeRow(const uint8_t LR[8], lrStatus_t & lrStatus);
+	/** Write the row of a locking range with one Set in the open session.
+	 *  @param LR UID of the locking range
+	 *  @param lrStatus the columns to write
+	 *  @param extent also write RangeStart and RangeLength
+	 */
+	uint8_t setLockingRangeRow(const uint8_t LR[8], const lrStatus_t & lrStatus, bool extent);
+	/** Check a set of locking ranges against the size and alignment of the
+	 *  drive and against each other.
+	 *  @param ranges the ranges, the global range (0) is skipped
+	 */
+	uint8_t checkRangeLayout(std::vector<lrStatus_t> & ranges);
+	/** Read "<range> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>"
+	 *  @param fields the text to read from
+	 *  @param lr where the range is returned
+	 */
+	bool parseRangeFields(std::istream & fields, lrStatus_t & lr);
+	/** Validate a layout and write every range in it in a single Admin1
+	 *  session.  Ranges on the drive that are not in the layout are read
+	 *  back so the layout can't overlap them either.
+	 *  @param password Password of administrator
+	 *  @param layout one entry per range to set up
+	 */
+	uint8_t applyRangeLayout(char * password, std::vector<lrStatus_t> & layout);
+	/** Write the pending rows of a layout in the open session, in an order
+	 *  in which no range ever overlaps another on the drive.
+	 *  @param current the rows on the drive, updated as they are written
+	 *  @param target the rows wanted
+	 *  @param pending the rows to write
+	 *  @param dryrun log the Sets without making them
+	 *  @param changes incremented for every row written
+	 */
+	uint8_t writeRangeLayout(std::vector<lrStatus_t> & current, const std::vector<lrStatus_t> & target,
+		std::vector<bool> pending, bool dryrun, uint32_t & changes);
+	/** Generate a new key for a locking range in the open session
+	* @param LR UID of the locking range
+	*/
+	uint8_t generateKey(const uint8_t LR[8]);
+	/** The state a drive should be brought to by reconcile, -1 is don't care */
+	typedef struct desiredState
+	{
+		int8_t lockingSPActive;    //1 the Locking SP must be Manufactured
+		int8_t mbrEnable;          //MBRControl Enable
+		int8_t mbrDone;            //MBRControl Done
+		std::vector<lrStatus_t> ranges;
+		std::vector<userProvision_t> users; //only userid and enable are used
+	}desiredState_t;
+	/** Read the parts of the drive state named in desired in one pass and
+	 *  issue only the Sets needed to make the drive match it.
+	 *  @param password Password of administrator
+	 *  @param desired the state to converge to
+	 *  @param dryrun report the changes without making them
+	 */
+	uint8_t reconcile(char * password, desiredState_t & desired, bool dryrun);
 
 };
@@ -24,6 +24,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaLexicon.h"
 #include "DtaOptions.h"
 #include "DtaDev.h"
+#include "DtaStats.h"
 #include "log.h"
 
 extern "C" {
@@ -81,7 +82,10 @@ void DtaHashPwd(vector<uint8_t> &hash, char * password, DtaDev * d)
     serNum = d->getSerialNum();
     vector<uint8_t> salt(serNum, serNum + 20);
     //	vector<uint8_t> salt(DEFAULTSALT);
+    DtaStats::clock::time_point start;
+    if (DtaStats::enabled()) start = DtaStats::clock::now();
     DtaHashPassword(hash, password, salt);
+    if (DtaStats::enabled()) DtaStats::hash(d->getDevName(), DtaStats::since(start));
     LOG(D1) << " Exit DtaHashPwd"; // log for hash timing
 }
 
@@ -52,6 +52,7 @@ static const uint8_t OPALUID[][8]{
 	{ 0x00, 0x00, 0x00, 0x08, 0x00, 0x03, 0xF8, 0x01 }, /**< ACE_MBRControl_Set_DoneToDOR */
 	{ 0x00, 0x00, 0x08, 0x03, 0x00, 0x00, 0x00, 0x01 }, /**< MBR Control */
         { 0x00, 0x00, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00 }, /**< Shadow MBR */
+        { 0x00, 0x00, 0x10, 0x01, 0x00, 0x00, 0x00, 0x00 }, /**< DataStore */
         { 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x00}, /**< AUTHORITY_TABLE */
         { 0x00, 0x00, 0x00, 0x0B, 0x00, 0x00, 0x00, 0x00}, /**< C_PIN_TABLE */
 		{ 0x00, 0x00, 0x08, 0x01, 0x00, 0x00, 0x00, 0x01 }, /**< OPAL Locking Info */
@@ -91,6 +92,7 @@ typedef enum _OPAL_UID {
 	OPAL_MBRControl_Set_DoneToDOR,
     OPAL_MBRCONTROL,
     OPAL_MBR,
+    OPAL_DATASTORE,
     OPAL_AUTHORITY_TABLE,
     OPAL_C_PIN_TABLE,
 	OPAL_LOCKING_INFO_TABLE,
@@ -105,6 +107,46 @@ typedef enum _OPAL_UID {
     // omitted optional parameter
     OPAL_UID_HEXFF,
 } OPAL_UID;
+/** Names of the OPALUID entries, in OPAL_UID order */
+static const char * const OPALUIDNAME[]{
+	// users
+	"SMUID",
+	"ThisSP",
+	"AdminSP",
+	"LockingSP",
+	"Enterprise_LockingSP",
+	"Anybody",
+	"SID",
+	"Admin1",
+	"User1",
+	"User2",
+	"PSID",
+	"BandMaster0",
+	"EraseMaster",
+	// tables
+	"Locking_GlobalRange",
+	"ACE_Locking_Range1_Set_RdLocked",
+	"ACE_Locking_Range1_Set_WrLocked",
+	"ACE_Locking_GlobalRange_Set_RdLocked",
+	"ACE_Locking_GlobalRange_Set_WrLocked",
+	"ACE_MBRControl_Set_DoneToDOR",
+	"MBRControl",
+	"MBR",
+	"DataStore",
+	"Authority",
+	"C_PIN",
+	"LockingInfo",
+	"Enterprise_LockingInfo",
+	//C_PIN_TABLE object ID's
+	"C_PIN_MSID",
+	"C_PIN_SID",
+	"C_PIN_Admin1",
+	//half UID's (only first 4 bytes used)
+	"Authority_object_ref",
+	"Boolean_ACE",
+	// omitted optional parameter
+	"HEXFF",
+};
 
 /** TCG Storage SSC Methods.
  */
@@ -145,6 +187,25 @@ typedef enum _OPAL_METHOD {
     RANDOM,
 	ERASE,
 } OPAL_METHOD;
+/** Names of the OPALMETHOD entries, in OPAL_METHOD order */
+static const char * const OPALMETHODNAME[]{
+	"Properties",
+	"StartSession",
+	"Revert",
+	"Activate",
+	"EGet",
+	"ESet",
+	"Next",
+	"EAuthenticate",
+	"GetACL",
+	"GenKey",
+	"RevertSP",
+	"Get",
+	"Set",
+	"Authenticate",
+	"Random",
+	"Erase",
+};
 
 /** Opal SSC TOKENS
  * Single byte non atom tokens used in Opal SSC psuedo code
@@ -173,6 +234,8 @@ typedef enum _OPAL_TOKEN {
 	ACTIVEKEY = 0x0A,
 	//locking info table
 	MAXRANGES = 0x04,
+	// table table
+	ROWS = 0x07,
     // mbr control
     MBRENABLE = 0x01,
     MBRDONE = 0x02,
@@ -0,0 +1,139 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <time.h>
+#include <chrono>
+#include <thread>
+#include "DtaLockWatch.h"
+#include "DtaDev.h"
+#include "DtaDevGeneric.h"
+
+using namespace std;
+
+#define DTA_WATCH_LOCKINGENABLED 0x01
+#define DTA_WATCH_LOCKED 0x02
+#define DTA_WATCH_MBRENABLED 0x04
+#define DTA_WATCH_MBRDONE 0x08
+
+DtaLockWatch::DtaLockWatch(FILE * output)
+{
+	out = output;
+}
+DtaLockWatch::~DtaLockWatch()
+{
+	for (uint32_t i = 0; i < watched.size(); i++)
+		delete watched[i].device;
+}
+DtaDev * DtaLockWatch::openDevice(const char * devref)
+{
+	DtaDev * d = new DtaDevGeneric(devref);
+	if (!d->isPresent()) {
+		delete d;
+		return NULL;
+	}
+	return d;
+}
+bool DtaLockWatch::add(const char * devref)
+{
+	DtaDev * d = openDevice(devref);
+	if (NULL == d) return false;
+	DTA_WATCHED w = { devref, d->getSerialNum(), d, false, 0, 0 };
+	watched.push_back(w);
+	return true;
+}
+void DtaLockWatch::reopen(DTA_WATCHED & w)
+{
+	LOG(D1) << "Entering DtaLockWatch::reopen " << w.devref;
+	delete w.device;
+	w.device = openDevice(w.devref.c_str());
+	if (NULL == w.device) return;
+	if (w.serial != w.device->getSerialNum()) {
+		LOG(I) << w.devref << " is now drive " << w.device->getSerialNum();
+		w.serial = w.device->getSerialNum();
+		w.known = false;
+	}
+}
+void DtaLockWatch::report(DTA_WATCHED & w, const char * event)
+{
+	char stamp[32];
+	time_t now = time(NULL);
+	struct tm local;
+#if defined(_WIN32)
+	localtime_s(&local, &now);
+#else
+	localtime_r(&now, &local);
+#endif
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+	if (w.rc) {
+		fprintf(out, "%s %s %s rc=%u\n", stamp, w.devref.c_str(), event, w.rc);
+	}
+	else {
+		fprintf(out, "%s %s %s LockingEnabled=%c Locked=%c MBREnabled=%c MBRDone=%c\n",
+			stamp, w.devref.c_str(), event,
+			(w.state & DTA_WATCH_LOCKINGENABLED) ? 'Y' : 'N',
+			(w.state & DTA_WATCH_LOCKED) ? 'Y' : 'N',
+			(w.state & DTA_WATCH_MBRENABLED) ? 'Y' : 'N',
+			(w.state & DTA_WATCH_MBRDONE) ? 'Y' : 'N');
+	}
+	fflush(out);
+	events++;
+}
+void DtaLockWatch::poll()
+{
+	LOG(D1) << "Entering DtaLockWatch::poll " << watched.size();
+	for (uint32_t i = 0; i < watched.size(); i++) {
+		DTA_WATCHED & w = watched[i];
+		uint8_t rc = w.device ? w.device->refreshLocking() : DTAERROR_OPEN_ERR;
+		if (rc) {
+			/* the handle may be stale after a reset or hot swap */
+			reopen(w);
+			rc = w.device ? w.device->refreshLocking() : DTAERROR_OPEN_ERR;
+		}
+		if (rc) {
+			if (!w.known || (0 == w.rc)) {
+				w.rc = rc;
+				report(w, "error");
+			}
+			w.known = true;
+			continue;
+		}
+		uint8_t state = (w.device->LockingEnabled() ? DTA_WATCH_LOCKINGENABLED : 0) |
+			(w.device->Locked() ? DTA_WATCH_LOCKED : 0) |
+			(w.device->MBREnabled() ? DTA_WATCH_MBRENABLED : 0) |
+			(w.device->MBRDone() ? DTA_WATCH_MBRDONE : 0);
+		bool first = !w.known || w.rc;
+		if (first || (state != w.state)) {
+			w.rc = 0;
+			w.state = state;
+			w.known = true;
+			report(w, first ? "state" : "change");
+		}
+	}
+}
+void DtaLockWatch::run(uint32_t interval, uint32_t count)
+{
+	LOG(D1) << "Entering DtaLockWatch::run " << interval;
+	chrono::steady_clock::time_point next = chrono::steady_clock::now();
+	for (uint32_t n = 0; (0 == count) || (n < count); n++) {
+		if (n) this_thread::sleep_until(next);
+		poll();
+		next += chrono::milliseconds(interval);
+	}
+}
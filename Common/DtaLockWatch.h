@@ -0,0 +1,80 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+class DtaDev;
+
+using namespace std;
+/** Watch the lock state of devices without opening any session.
+ * Each poll is a single Discovery 0 IF_RECV per device, of which only the
+ * Locking feature is decoded.  A line is written for the first state read,
+ * whenever LockingEnabled, Locked, MBREnabled or MBRDone change and when a
+ * device stops answering:
+ *
+ *     2026-10-19 14:02:03 /dev/sda change LockingEnabled=Y Locked=N MBREnabled=Y MBRDone=Y
+ *
+ * A device that fails a reading is closed and opened again by name, so a
+ * drive that was reset or removed and reinserted is picked up again; if
+ * another drive turns up under the name its first state is reported again.
+ */
+class DtaLockWatch {
+public:
+	/** @param out where the events are written */
+	DtaLockWatch(FILE * out = stdout);
+	~DtaLockWatch();
+	/** Watch a device
+	 * @param devref the device, opened here
+	 * @return false if it could not be opened
+	 */
+	bool add(const char * devref);
+	/** Read every device once and report what changed */
+	void poll();
+	/** Poll at a fixed interval
+	 * @param interval ms from the start of one poll to the next
+	 * @param count number of polls, 0 to poll until killed
+	 */
+	void run(uint32_t interval, uint32_t count = 0);
+	uint32_t events = 0;  /**< number of lines written */
+protected:
+	/** Open a device
+	 * @param devref the device
+	 * @return the device, NULL if it is not there
+	 */
+	virtual DtaDev * openDevice(const char * devref);
+private:
+	/** a watched device and what it last reported */
+	typedef struct _DTA_WATCHED {
+		std::string devref;
+		std::string serial;  /**< serial number of the drive opened */
+		DtaDev * device;     /**< NULL while it cannot be opened */
+		bool known;     /**< state holds a reading */
+		uint8_t rc;     /**< result of the last reading */
+		uint8_t state;  /**< LockingEnabled, Locked, MBREnabled and MBRDone as bits */
+	} DTA_WATCHED;
+	/** close the device and open it again by name */
+	void reopen(DTA_WATCHED & w);
+	/** write one event line */
+	void report(DTA_WATCHED & w, const char * event);
+	vector<DTA_WATCHED> watched;
+	FILE * out;
+};
@@ -0,0 +1,230 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <string.h>
+#include <thread>
+#include "DtaMultiplexer.h"
+#include "DtaDev.h"
+#include "DtaCommand.h"
+#include "DtaSession.h"
+#include "DtaHashPwd.h"
+#include "DtaStats.h"
+#include "DtaEndianFixup.h"
+#include "DtaStructures.h"
+
+using namespace std;
+
+DtaMuxOperation::DtaMuxOperation(DtaDev * dev)
+{
+	device = dev;
+}
+DtaMuxOperation::~DtaMuxOperation()
+{
+}
+void DtaMuxOperation::startSession(DtaCommand * cmd, OPAL_UID SP,
+	const vector<uint8_t> & hash, OPAL_UID SignAuthority)
+{
+	LOG(D1) << "Entering DtaMuxOperation::startSession";
+	cmd->reset(OPAL_UID::OPAL_SMUID_UID, OPAL_METHOD::STARTSESSION);
+	cmd->addToken(OPAL_TOKEN::STARTLIST);
+	cmd->addToken(105); // HostSessionID
+	cmd->addToken(SP);
+	cmd->addToken(OPAL_TINY_ATOM::UINT_01); // write
+	if (!hash.empty()) {
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TINY_ATOM::UINT_00);
+		cmd->addToken(hash);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TINY_ATOM::UINT_03);
+		cmd->addToken(SignAuthority);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+	}
+	cmd->addToken(OPAL_TOKEN::ENDLIST);
+	cmd->complete();
+}
+void DtaMuxOperation::sessionStarted(DtaResponse & response)
+{
+	// call user method SL HSN TSN EL EOD SL 00 00 00 EL
+	HSN = SWAP32(response.getUint32(4));
+	TSN = SWAP32(response.getUint32(5));
+}
+void DtaMuxOperation::endSession(DtaCommand * cmd)
+{
+	LOG(D1) << "Entering DtaMuxOperation::endSession";
+	cmd->reset();
+	cmd->addToken(OPAL_TOKEN::ENDOFSESSION);
+	cmd->complete(0);
+	ending = true;
+}
+
+DtaMuxUnlock::DtaMuxUnlock(DtaDev * dev, char * password) : DtaMuxOperation(dev)
+{
+	DtaHashPwd(hash, password, device);
+}
+bool DtaMuxUnlock::next(DtaCommand * cmd, DtaResponse & response)
+{
+	switch (step++) {
+	case 0:
+		startSession(cmd, OPAL_UID::OPAL_LOCKINGSP_UID, hash, OPAL_UID::OPAL_ADMIN1_UID);
+		return true;
+	case 1:
+		sessionStarted(response);
+		cmd->reset(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], OPAL_METHOD::SET);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::VALUES);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::READLOCKED);
+		cmd->addToken(OPAL_TOKEN::OPAL_FALSE);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::WRITELOCKED);
+		cmd->addToken(OPAL_TOKEN::OPAL_FALSE);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->complete();
+		return true;
+	case 2:
+		cmd->reset(OPALUID[OPAL_UID::OPAL_MBRCONTROL], OPAL_METHOD::SET);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::VALUES);
+		cmd->addToken(OPAL_TOKEN::STARTLIST);
+		cmd->addToken(OPAL_TOKEN::STARTNAME);
+		cmd->addToken(OPAL_TOKEN::MBRDONE);
+		cmd->addToken(OPAL_TOKEN::OPAL_TRUE);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->addToken(OPAL_TOKEN::ENDNAME);
+		cmd->addToken(OPAL_TOKEN::ENDLIST);
+		cmd->complete();
+		return true;
+	case 3:
+		endSession(cmd);
+		return true;
+	default:
+		return false;
+	}
+}
+
+DtaMultiplexer::DtaMultiplexer(uint32_t maxInFlight, uint32_t pollms)
+{
+	window = maxInFlight ? maxInFlight : 1;
+	interval = pollms;
+}
+DtaMultiplexer::~DtaMultiplexer()
+{
+	for (uint32_t i = 0; i < active.size(); i++) {
+		active[i]->op->device->releaseCommand(active[i]->cmd);
+		delete active[i];
+	}
+}
+void DtaMultiplexer::add(DtaMuxOperation * op)
+{
+	queue.push_back(op);
+}
+bool DtaMultiplexer::post(DTA_MUX_SLOT & slot)
+{
+	DtaMuxOperation * op = slot.op;
+	slot.cmd->setHSN(op->HSN);
+	slot.cmd->setTSN(op->TSN);
+	slot.cmd->setcomID(op->device->comID());
+	uint8_t lastRC = op->device->post(slot.cmd);
+	if (0 != lastRC) {
+		if (0 == op->rc) op->rc = lastRC;
+		return false;
+	}
+	slot.sent = std::chrono::steady_clock::now();
+	slot.due = slot.sent + std::chrono::milliseconds(interval);
+	return true;
+}
+bool DtaMultiplexer::service(DTA_MUX_SLOT & slot)
+{
+	DtaMuxOperation * op = slot.op;
+	bool done;
+	uint8_t lastRC = op->device->poll(slot.cmd, slot.response, 0x01, slot.sent, done);
+	if (!done) {
+		slot.due = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval);
+		return true;
+	}
+	if (0 != lastRC) {
+		// timed out or cancelled, the ComID was reset and the session with it
+		if (0 == op->rc) op->rc = lastRC;
+		return false;
+	}
+	if (DtaStats::enabled())
+		DtaStats::command(op->device->getDevName(), slot.cmd, DtaStats::since(slot.sent));
+	lastRC = DtaSession::checkResponse(slot.response);
+	if (op->ending) {
+		op->ending = false;
+		op->HSN = op->TSN = 0;
+	}
+	if (0 != lastRC) {
+		if (0 == op->rc) op->rc = lastRC;
+		if (0 == op->TSN) return false;
+		op->endSession(slot.cmd);
+		return post(slot);
+	}
+	if ((0 != op->rc) && (0 == op->TSN)) return false;
+	if (!op->next(slot.cmd, slot.response)) return false;
+	return post(slot);
+}
+uint8_t DtaMultiplexer::run()
+{
+	LOG(D1) << "Entering DtaMultiplexer::run " << queue.size();
+	uint32_t started = 0;
+	while ((started < queue.size()) || !active.empty()) {
+		while ((active.size() < window) && (started < queue.size())) {
+			DTA_MUX_SLOT * slot = new DTA_MUX_SLOT;
+			slot->op = queue[started++];
+			slot->cmd = slot->op->device->getCommand();
+			if (NULL == slot->cmd) {
+				LOG(E) << "Unable to create command object ";
+				slot->op->rc = DTAERROR_OBJECT_CREATE_FAILED;
+				delete slot;
+				continue;
+			}
+			if (slot->op->next(slot->cmd, slot->response) && post(*slot)) {
+				active.push_back(slot);
+			}
+			else {
+				slot->op->device->releaseCommand(slot->cmd);
+				delete slot;
+			}
+		}
+		if (active.empty()) continue;
+		uint32_t first = 0;
+		for (uint32_t i = 1; i < active.size(); i++)
+			if (active[i]->due < active[first]->due) first = i;
+		std::this_thread::sleep_until(active[first]->due);
+		if (!service(*active[first])) {
+			active[first]->op->device->releaseCommand(active[first]->cmd);
+			delete active[first];
+			active.erase(active.begin() + first);
+		}
+	}
+	for (uint32_t i = 0; i < queue.size(); i++)
+		if (0 != queue[i]->rc) return queue[i]->rc;
+	return 0;
+}
@@ -0,0 +1,126 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "DtaLexicon.h"
+#include "DtaResponse.h"
+class DtaDev;
+class DtaCommand;
+
+using namespace std;
+/** The work for one device, written as a state machine the multiplexer
+ * advances each time the TPer answers.  The operation builds the commands,
+ * the multiplexer sends them, fills in the session numbers, waits for the
+ * reply and checks its method status.  A failed command ends the
+ * operation, closing its session first if one is open.  Opal only.
+ */
+class DtaMuxOperation {
+public:
+	/** @param dev the device the operation is for */
+	DtaMuxOperation(DtaDev * dev);
+	virtual ~DtaMuxOperation();
+	/** Build the next command
+	 * @param cmd where the command is built
+	 * @param response the reply to the previous command, empty on the first call
+	 * @return false once there is nothing more to send
+	 */
+	virtual bool next(DtaCommand * cmd, DtaResponse & response) = 0;
+	/** Build an EndSession and mark the session closed once it is answered
+	 * @param cmd where the command is built
+	 */
+	void endSession(DtaCommand * cmd);
+	DtaDev * device;  /**< the device the operation is for */
+	uint8_t rc = 0;  /**< 0 or the error that ended the operation */
+	uint32_t HSN = 0;  /**< Host session number, 0 outside a session */
+	uint32_t TSN = 0;  /**< TPer session number, 0 outside a session */
+	bool ending = false;  /**< the command in flight is an EndSession */
+protected:
+	/** Build a StartSession
+	 * @param cmd where the command is built
+	 * @param SP the security provider to start the session with
+	 * @param hash the hashed password, empty for an anonymous session
+	 * @param SignAuthority the authority to sign in as
+	 */
+	void startSession(DtaCommand * cmd, OPAL_UID SP, const vector<uint8_t> & hash,
+		OPAL_UID SignAuthority);
+	/** Pick the session numbers out of the reply to a StartSession */
+	void sessionStarted(DtaResponse & response);
+	uint8_t step = 0;  /**< state of the operation */
+};
+
+/** Unlock the global range for reading and writing and set MBRDone, all
+ * in one Locking SP session as Admin1.  The password is hashed when the
+ * operation is created, so several can be created on worker threads and
+ * the multiplexer never stalls the other drives on PBKDF2.
+ */
+class DtaMuxUnlock : public DtaMuxOperation {
+public:
+	/** @param dev the device to unlock
+	 * @param password the Admin1 password, hashed unless no_hash_passwords is set */
+	DtaMuxUnlock(DtaDev * dev, char * password);
+	bool next(DtaCommand * cmd, DtaResponse & response);
+private:
+	vector<uint8_t> hash;  /**< Admin1 credential */
+};
+
+/** Drive many devices from one thread.
+ * Each operation has at most one command outstanding on its device.  The
+ * multiplexer posts the command with IF_SEND and then, rather than sleeping
+ * in exec, polls whichever device is due next with IF_RECV, so while one
+ * TPer works on a command the others are being served.  Only the window of
+ * operations in flight hold a command buffer, the rest wait their turn.
+ */
+class DtaMultiplexer {
+public:
+	/** @param window how many operations may be in flight at once
+	 * @param interval ms between IF_RECV polls of one device */
+	DtaMultiplexer(uint32_t window = 64, uint32_t interval = 25);
+	~DtaMultiplexer();
+	/** Queue an operation, the caller keeps ownership
+	 * @param op the operation
+	 */
+	void add(DtaMuxOperation * op);
+	/** Run every queued operation to completion
+	 * @return 0 if all succeeded, else the error of the first one that failed
+	 */
+	uint8_t run();
+private:
+	/** an operation in flight */
+	typedef struct _DTA_MUX_SLOT {
+		DtaMuxOperation * op;
+		DtaCommand * cmd;     /**< command object borrowed from the device */
+		DtaResponse response; /**< reply to the last command */
+		std::chrono::steady_clock::time_point sent;  /**< when the command was posted */
+		std::chrono::steady_clock::time_point due;   /**< when to poll next */
+	} DTA_MUX_SLOT;
+	/** post the command the slot holds
+	 * @return false if the operation is finished */
+	bool post(DTA_MUX_SLOT & slot);
+	/** poll the slot and advance its operation when the TPer answered
+	 * @return false if the operation is finished */
+	bool service(DTA_MUX_SLOT & slot);
+	vector<DtaMuxOperation *> queue;  /**< operations in the order they were added */
+	vector<DTA_MUX_SLOT *> active;  /**< operations in flight */
+	uint32_t window;
+	uint32_t interval;
+};
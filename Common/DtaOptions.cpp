@@ -31,10 +31,24 @@ void usage()
     printf("-v (optional)                       increase verbosity, one to five v's\n");
     printf("-n (optional)                       no password hashing. Passwords will be sent in clear text!\n");
     printf("-l (optional)                       log style output to stderr only\n");
+    printf("-c <file> (optional)                capture all drive traffic to a trace file\n");
+    printf("-r <file> (optional)                replay a trace file instead of using the device\n");
+    printf("-t <seconds> (optional)             give up on a command the drive has not answered in time\n");
+    printf("-m (optional)                       if the Locking SP refuses Admin1, try User1..User8\n");
+    printf("-S (optional)                       reset a ComID that stays busy, aborting the session on it\n");
+    printf("-R (optional)                       as -S and allow a TPer Reset if the ComID can't be reset\n");
+    printf("--stats (optional)                  print per method latency statistics after the action\n");
+    printf("--statsJSON (optional)              print the latency statistics as JSON\n");
     printf("actions \n");
     printf("--scan \n");
     printf("                                Scans the devices on the system \n");
     printf("                                identifying Opal compliant devices \n");
+    printf("--unlockAgent <Admin1password> <file>\n");
+    printf("                                Stay running and unlock the drives whose serial\n");
+    printf("                                numbers are listed in <file> whenever they appear\n");
+    printf("--watchLocking <seconds> <device>[,<device>...]\n");
+    printf("                                Report Locked/MBREnabled/MBRDone changes, reading\n");
+    printf("                                only Discovery 0 every <seconds>, until killed\n");
     printf("--query <device>\n");
     printf("                                Display the Discovery 0 response of a device\n");
     printf("--isValidSED <device>\n");
@@ -44,6 +58,15 @@ void usage()
     printf("--listLockingRange <0...n> <password> <device>\n");
 	printf("                                List all Locking Ranges\n");
 	printf("                                0 = GLobal 1..n  = LRn \n");
+    printf("--applyRangeLayout <Admin1password> <file> <device>\n");
+	printf("                                Set up every Locking Range in <file> in one session\n");
+	printf("                                <0...n> <start> <length> <RLKEna Y|N> <WLKEna Y|N> <RW|RO|LK>\n");
+    printf("--reconcile <Admin1password> <file> <device>\n");
+	printf("                                Change only what differs from the state in <file>\n");
+	printf("                                lockingsp active | mbr <enable|done> <Y|N> |\n");
+	printf("                                user <userid> <enable|disable> | range <as above>\n");
+    printf("--reconcileDryRun <Admin1password> <file> <device>\n");
+	printf("                                List the changes --reconcile would make\n");
     printf("--rekeyLockingRange <0...n> <password> <device>\n");
 	printf("                                0 = GLobal 1..n  = LRn \n");
 	printf("                                Rekey Locking Range\n");
@@ -56,6 +79,15 @@ void usage()
     printf("--eraseLockingRange <0...n> <password> <device>\n");
 	printf("                                Erase a Locking Range\n");
 	printf("                                0 = GLobal 1..n  = LRn \n");
+    printf("--eraseAllLockingRanges <password> <device>\n");
+	printf("                                Erase every Locking Range in one session\n");
+	printf("                                (passwort = \"\" for MSID) \n");
+    printf("--eraseFingerprint <0...n|all> <password> <file> <device>\n");
+	printf("                                Save fingerprints of blocks sampled from a\n");
+	printf("                                Locking Range before erasing it, or from\n");
+	printf("                                the whole device before a revert (all)\n");
+    printf("--verifyErase <file> <device>\n");
+	printf("                                Check the sampled blocks changed after an erase\n");
     printf("--setupLockingRange <0...n> <RangeStart> <RangeLength> <password> <device>\n");
 	printf("                                Setup a new Locking Range\n");
 	printf("                                0 = GLobal 1..n  = LRn \n");
@@ -84,6 +116,13 @@ void usage()
 	printf("                                set|unset MBRDone\n");
 	printf("--loadPBAimage <Admin1password> <file> <device> \n");
 	printf("                                Write <file> to MBR Shadow area\n");
+	printf("--readDataStore <Admin1password> <file> <device> \n");
+	printf("                                Copy the DataStore table to <file>\n");
+	printf("--writeDataStore <Admin1password> <file> <device> \n");
+	printf("                                Write <file> to the start of the DataStore table\n");
+	printf("--provisionUsers <Admin1password> <file> <device> \n");
+	printf("                                Apply the lines of <file> in one session, each\n");
+	printf("                                <userid> <enable|disable|keep> [newpassword]\n");
     printf("--revertTPer <SIDpassword> <device>\n");
     printf("                                set the device back to factory defaults \n");
 	printf("                                This **ERASES ALL DATA** \n");
@@ -140,6 +179,43 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			opts->output_format = sedutilNormal;
 			outputFormat = sedutilNormal;
 		}
+		else if (!strcmp("-c", argv[i]) || !strcmp("-r", argv[i])) {
+			if (i + 1 >= argc) {
+				LOG(E) << argv[i] << " requires a trace file name";
+				return DTAERROR_INVALID_COMMAND;
+			}
+			baseOptions += 2;
+			if ('c' == argv[i][1])
+				opts->capturefile = ++i;
+			else
+				opts->replayfile = ++i;
+		}
+		else if (!strcmp("-t", argv[i])) {
+			if ((i + 1 >= argc) || (0 >= atoi(argv[i + 1]))) {
+				LOG(E) << argv[i] << " requires a timeout in seconds";
+				return DTAERROR_INVALID_COMMAND;
+			}
+			baseOptions += 2;
+			opts->timeout = ++i;
+		}
+		else if (!strcmp("-m", argv[i])) {
+			baseOptions += 1;
+			opts->multistart = true;
+		}
+		else if (!strcmp("-S", argv[i])) {
+			baseOptions += 1;
+			opts->stack_reset = true;
+		}
+		else if (!strcmp("-R", argv[i])) {
+			baseOptions += 1;
+			opts->stack_reset = true;
+			opts->tper_reset = true;
+		}
+		else if (!strcmp("--stats", argv[i]) || !strcmp("--statsJSON", argv[i])) {
+			baseOptions += 1;
+			opts->stats = true;
+			opts->statsJSON = ('J' == argv[i][7]);
+		}
 		else if (!(('-' == argv[i][0]) && ('-' == argv[i][1])) && 
 			(0 == opts->action))
 		{
@@ -177,6 +253,12 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(loadPBAimage, 3) OPTION_IS(password) OPTION_IS(pbafile) 
 			OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(readDataStore, 3) OPTION_IS(password) OPTION_IS(datastorefile)
+			OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(writeDataStore, 3) OPTION_IS(password) OPTION_IS(datastorefile)
+			OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(provisionUsers, 3) OPTION_IS(password) OPTION_IS(specfile)
+			OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(revertTPer, 2) OPTION_IS(password) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(revertNoErase, 2) OPTION_IS(password) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(PSIDrevert, 2) OPTION_IS(password) OPTION_IS(device) END_OPTION
@@ -226,6 +308,8 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			OPTION_IS(password) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(query, 1) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(scan, 0)  END_OPTION
+		BEGIN_OPTION(unlockAgent, 2) OPTION_IS(password) OPTION_IS(specfile) END_OPTION
+		BEGIN_OPTION(watchLocking, 2) OPTION_IS(interval) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(isValidSED, 1) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(eraseLockingRange, 3)
 			TESTARG(0, lockingrange, 0)
@@ -248,6 +332,31 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			OPTION_IS(password)
 			OPTION_IS(device)
 			END_OPTION
+		BEGIN_OPTION(eraseAllLockingRanges, 2) OPTION_IS(password) OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(eraseFingerprint, 4)
+			TESTARG(0, lockingrange, 0)
+			TESTARG(1, lockingrange, 1)
+			TESTARG(2, lockingrange, 2)
+			TESTARG(3, lockingrange, 3)
+			TESTARG(4, lockingrange, 4)
+			TESTARG(5, lockingrange, 5)
+			TESTARG(6, lockingrange, 6)
+			TESTARG(7, lockingrange, 7)
+			TESTARG(8, lockingrange, 8)
+			TESTARG(9, lockingrange, 9)
+			TESTARG(10, lockingrange, 10)
+			TESTARG(11, lockingrange, 11)
+			TESTARG(12, lockingrange, 12)
+			TESTARG(13, lockingrange, 13)
+			TESTARG(14, lockingrange, 14)
+			TESTARG(15, lockingrange, 15)
+			TESTARG(all, lockingrange, DTA_WHOLE_DEVICE)
+			TESTFAIL("Invalid Locking Range (0-15 or all)")
+			OPTION_IS(password)
+			OPTION_IS(samplefile)
+			OPTION_IS(device)
+			END_OPTION
+		BEGIN_OPTION(verifyErase, 2) OPTION_IS(samplefile) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(takeOwnership, 2) OPTION_IS(password) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(revertLockingSP, 2) OPTION_IS(password) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(setPassword, 4) OPTION_IS(password) OPTION_IS(userid)
@@ -442,6 +551,21 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			OPTION_IS(password)
 			OPTION_IS(device)
 			END_OPTION
+		BEGIN_OPTION(applyRangeLayout, 3)
+			OPTION_IS(password)
+			OPTION_IS(specfile)
+			OPTION_IS(device)
+			END_OPTION
+		BEGIN_OPTION(reconcile, 3)
+			OPTION_IS(password)
+			OPTION_IS(specfile)
+			OPTION_IS(device)
+			END_OPTION
+		BEGIN_OPTION(reconcileDryRun, 3)
+			OPTION_IS(password)
+			OPTION_IS(specfile)
+			OPTION_IS(device)
+			END_OPTION
 		BEGIN_OPTION(listLockingRange, 3)
 			TESTARG(0, lockingrange, 0)
 			TESTARG(1, lockingrange, 1)
@@ -29,6 +29,9 @@ typedef enum _sedutiloutput {
 	sedutilJSON
 } sedutiloutput;
 
+/** lockingrange of --eraseFingerprint all, sample the whole device */
+#define DTA_WHOLE_DEVICE 0xff
+
 /** Structure representing the command line issued to the program */
 typedef struct _DTA_OPTIONS {
     uint8_t password;   /**< password supplied */
@@ -42,8 +45,20 @@ typedef struct _DTA_OPTIONS {
 	uint8_t lockingstate;  /**< locking state to set a lockingrange to */
 	uint8_t lrstart;		/** the starting block of a lockingrange */
 	uint8_t lrlength;		/** the length in blocks of a lockingrange */
+	uint8_t capturefile;	/** trace file to capture drive traffic to */
+	uint8_t replayfile;	/** trace file to replay instead of the device */
+	uint8_t datastorefile;	/** file name for the DataStore commands */
+	uint8_t timeout;	/** seconds allowed for each command */
+	uint8_t specfile;	/** file describing a bulk change to the drive */
+	uint8_t samplefile;	/** fingerprints of the blocks sampled to verify an erase */
+	uint8_t interval;	/** seconds between the polls of watchLocking */
 
 	bool no_hash_passwords; /** global parameter, disables hashing of passwords */
+	bool multistart;	/** try the password as User1..User8 when Admin1 is refused */
+	bool stack_reset;	/** a busy ComID may be recovered with STACK_RESET */
+	bool tper_reset;	/** a busy ComID may be recovered with a TPer Reset */
+	bool stats;		/** print latency statistics after the action */
+	bool statsJSON;		/** print the latency statistics as JSON */
 	sedutiloutput output_format;
 } DTA_OPTIONS;
 /** Print a usage message */
@@ -64,6 +79,9 @@ typedef enum _sedutiloption {
 	setPassword,
 	setPassword_SUM,
 	loadPBAimage,
+	readDataStore,
+	writeDataStore,
+	provisionUsers,
 	setLockingRange,
 	revertTPer,
 	revertNoErase,
@@ -79,6 +97,9 @@ typedef enum _sedutiloption {
 	setupLockingRange_SUM,
 	listLockingRanges,
 	listLockingRange,
+	applyRangeLayout,
+	reconcile,
+	reconcileDryRun,
     rekeyLockingRange,
     setBandsEnabled,
     setBandEnabled,
@@ -90,8 +111,13 @@ typedef enum _sedutiloption {
 	eraseLockingRange_SUM,
 	query,
 	scan,
+	unlockAgent,
+	watchLocking,
 	isValidSED,
     eraseLockingRange,
+	eraseAllLockingRanges,
+	eraseFingerprint,
+	verifyErase,
 	takeOwnership,
 	validatePBKDF2,
 	objDump,
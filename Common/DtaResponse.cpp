@@ -25,6 +25,8 @@ using namespace std;
 DtaResponse::DtaResponse()
 {
     LOG(D1) << "Creating  DtaResponse()";
+    for (uint32_t i = 0; i < DTA_COLUMNINDEX_SIZE; i++)
+        columnIndex[i] = DTA_NOCOLUMN;
 }
 
 DtaResponse::DtaResponse(void * buffer)
@@ -33,123 +35,201 @@ DtaResponse::DtaResponse(void * buffer)
     init(buffer);
 }
 
+OPAL_TOKEN DtaResponse::decodeType(const uint8_t * p)
+{
+    if (!(p[0] & 0x80)) { //tiny atom
+        if ((p[0] & 0x40))
+            return OPAL_TOKEN::DTA_TOKENID_SINT;
+        else
+            return OPAL_TOKEN::DTA_TOKENID_UINT;
+    }
+    else if (!(p[0] & 0x40)) { // short atom
+        if ((p[0] & 0x20))
+            return OPAL_TOKEN::DTA_TOKENID_BYTESTRING;
+        else if ((p[0] & 0x10))
+            return OPAL_TOKEN::DTA_TOKENID_SINT;
+        else
+            return OPAL_TOKEN::DTA_TOKENID_UINT;
+    }
+    else if (!(p[0] & 0x20)) { // medium atom
+        if ((p[0] & 0x10))
+            return OPAL_TOKEN::DTA_TOKENID_BYTESTRING;
+        else if ((p[0] & 0x08))
+            return OPAL_TOKEN::DTA_TOKENID_SINT;
+        else
+            return OPAL_TOKEN::DTA_TOKENID_UINT;
+    }
+    else if (!(p[0] & 0x10)) { // long atom
+        if ((p[0] & 0x02))
+            return OPAL_TOKEN::DTA_TOKENID_BYTESTRING;
+        else if ((p[0] & 0x01))
+            return OPAL_TOKEN::DTA_TOKENID_SINT;
+        else
+            return OPAL_TOKEN::DTA_TOKENID_UINT;
+    }
+    else // TOKEN
+        return (OPAL_TOKEN) p[0];
+}
+
 void
 DtaResponse::init(void * buffer)
 {
     LOG(D1) << "Entering  DtaResponse::init";
-    std::vector<uint8_t> bytestring, empty_atom(1, 0xff);
     uint8_t * reply = (uint8_t *) buffer;
     uint32_t cpos = 0;
-    uint32_t tokenLength;
+    uint32_t tokenLength, length;
+    DtaResponseToken t;
     memcpy(&h, buffer, sizeof (OPALHeader));
-    response.clear();
     reply += sizeof (OPALHeader);
-    while (cpos < SWAP32(h.subpkt.length)) {
-        bytestring.clear();
+    length = SWAP32(h.subpkt.length);
+    payload.assign(reply, reply + length);
+    malformed = false;
+    tokens.clear();
+    open.clear();
+    names.clear();
+    largeNames.clear();
+    for (uint32_t i = 0; i < DTA_COLUMNINDEX_SIZE; i++)
+        columnIndex[i] = DTA_NOCOLUMN;
+    reply = payload.data();
+    while (cpos < length) {
         if (!(reply[cpos] & 0x80)) //tiny atom
             tokenLength = 1;
         else if (!(reply[cpos] & 0x40)) // short atom
             tokenLength = (reply[cpos] & 0x0f) + 1;
         else if (!(reply[cpos] & 0x20)) // medium atom
-            tokenLength = (((reply[cpos] & 0x07) << 8) | reply[cpos + 1]) + 2;
+            tokenLength = (cpos + 1 < length) ?
+                (((reply[cpos] & 0x07) << 8) | reply[cpos + 1]) + 2 : 2;
         else if (!(reply[cpos] & 0x10)) // long atom
-            tokenLength = ((reply[cpos + 1] << 16) | (reply[cpos + 2] << 8) | reply[cpos + 3]) + 4;
+            tokenLength = (cpos + 3 < length) ?
+                ((reply[cpos + 1] << 16) | (reply[cpos + 2] << 8) | reply[cpos + 3]) + 4 : 4;
         else // TOKEN
             tokenLength = 1;
-
-        for (uint32_t i = 0; i < tokenLength; i++) {
-            bytestring.push_back(reply[cpos++]);
+        if (tokenLength > length - cpos) {
+            LOG(E) << "Response token overruns the subpacket, response truncated";
+            break;
+        }
+        if (0xff == reply[cpos]) { // empty atom
+            cpos++;
+            continue;
         }
-		if (bytestring != empty_atom)
-			response.push_back(bytestring);
+        t.offset = cpos;
+        t.length = tokenLength;
+        t.end = (uint32_t) tokens.size();
+        t.type = decodeType(&reply[cpos]);
+        cpos += tokenLength;
+        switch (t.type) {
+        case OPAL_TOKEN::STARTLIST:
+        case OPAL_TOKEN::STARTNAME:
+            open.push_back(t.end);
+            break;
+        case OPAL_TOKEN::ENDLIST:
+        case OPAL_TOKEN::ENDNAME:
+            if (!open.empty()) {
+                tokens[open.back()].end = t.end;
+                open.pop_back();
+            }
+            break;
+        default:
+            break;
+        }
+        tokens.push_back(t);
+        /* the first atom after a STARTNAME is the name, the next token its value */
+        uint32_t n = (uint32_t) tokens.size() - 1;
+        if ((n > 0) && (OPAL_TOKEN::STARTNAME == tokens[n - 1].type)) {
+            if (OPAL_TOKEN::DTA_TOKENID_BYTESTRING == t.type)
+                names.push_back(n - 1);
+            else if ((OPAL_TOKEN::DTA_TOKENID_UINT == t.type) && (t.length <= 9)) {
+                uint64_t id = getUint64(n);
+                if (id < DTA_COLUMNINDEX_SIZE) {
+                    if (DTA_NOCOLUMN == columnIndex[id])
+                        columnIndex[id] = n + 1;
+                }
+                else
+                    largeNames.push_back(n - 1);
+            }
+        }
+    }
+    /* close anything the TPer left open at the end of the response */
+    while (!open.empty()) {
+        tokens[open.back()].end = (uint32_t) tokens.size() - 1;
+        open.pop_back();
     }
 }
 
+bool DtaResponse::isMalformed()
+{
+    return malformed;
+}
+
+void DtaResponse::fail(const char * what)
+{
+    LOG(E) << what;
+    malformed = true;
+}
+
+bool DtaResponse::exists(uint32_t tokenNum)
+{
+    if (tokenNum < tokens.size()) return true;
+    fail("token requested beyond the end of the response");
+    return false;
+}
+
 OPAL_TOKEN DtaResponse::tokenIs(uint32_t tokenNum)
 {
     LOG(D1) << "Entering  DtaResponse::tokenIs";
-    if (!(response[tokenNum][0] & 0x80)) { //tiny atom
-        if ((response[tokenNum][0] & 0x40))
-            return OPAL_TOKEN::DTA_TOKENID_SINT;
-        else
-            return OPAL_TOKEN::DTA_TOKENID_UINT;
-    }
-    else if (!(response[tokenNum][0] & 0x40)) { // short atom
-        if ((response[tokenNum][0] & 0x20))
-            return OPAL_TOKEN::DTA_TOKENID_BYTESTRING;
-        else if ((response[tokenNum][0] & 0x10))
-            return OPAL_TOKEN::DTA_TOKENID_SINT;
-        else
-            return OPAL_TOKEN::DTA_TOKENID_UINT;
-    }
-    else if (!(response[tokenNum][0] & 0x20)) { // medium atom
-        if ((response[tokenNum][0] & 0x10))
-            return OPAL_TOKEN::DTA_TOKENID_BYTESTRING;
-        else if ((response[tokenNum][0] & 0x08))
-            return OPAL_TOKEN::DTA_TOKENID_SINT;
-        else
-            return OPAL_TOKEN::DTA_TOKENID_UINT;
-    }
-    else if (!(response[tokenNum][0] & 0x10)) { // long atom
-        if ((response[tokenNum][0] & 0x02))
-            return OPAL_TOKEN::DTA_TOKENID_BYTESTRING;
-        else if ((response[tokenNum][0] & 0x01))
-            return OPAL_TOKEN::DTA_TOKENID_SINT;
-        else
-            return OPAL_TOKEN::DTA_TOKENID_UINT;
-    }
-    else // TOKEN
-        return (OPAL_TOKEN) response[tokenNum][0];
+    if (!exists(tokenNum)) return OPAL_TOKEN::EMPTYATOM;
+    return tokens[tokenNum].type;
 }
 
 uint32_t DtaResponse::getLength(uint32_t tokenNum)
 {
-    return (uint32_t) response[tokenNum].size();
+    if (!exists(tokenNum)) return 0;
+    return tokens[tokenNum].length;
 }
 
 uint64_t DtaResponse::getUint64(uint32_t tokenNum)
 {
     LOG(D1) << "Entering  DtaResponse::getUint64";
-    if (!(response[tokenNum][0] & 0x80)) { //tiny atom
-        if ((response[tokenNum][0] & 0x40)) {
-            LOG(E) << "unsigned int requested for signed tiny atom";
-			exit(EXIT_FAILURE);
+    if (!exists(tokenNum)) return 0;
+    const uint8_t * t = &payload[tokens[tokenNum].offset];
+    uint32_t length = tokens[tokenNum].length;
+    if (!(t[0] & 0x80)) { //tiny atom
+        if ((t[0] & 0x40)) {
+            fail("unsigned int requested for signed tiny atom");
+            return 0;
         }
         else {
-            return (uint64_t) (response[tokenNum][0] & 0x3f);
+            return (uint64_t) (t[0] & 0x3f);
         }
     }
-    else if (!(response[tokenNum][0] & 0x40)) { // short atom
-        if ((response[tokenNum][0] & 0x10)) {
-            LOG(E) << "unsigned int requested for signed short atom";
-			exit(EXIT_FAILURE);
+    else if (!(t[0] & 0x40)) { // short atom
+        if ((t[0] & 0x10)) {
+            fail("unsigned int requested for signed short atom");
+            return 0;
         }
         else {
             uint64_t whatever = 0;
-            if (response[tokenNum].size() > 9) { LOG(E) << "UINT64 with greater than 8 bytes"; }
+            if (length > 9) { LOG(E) << "UINT64 with greater than 8 bytes"; }
             int b = 0;
-            for (uint32_t i = (uint32_t) response[tokenNum].size() - 1; i > 0; i--) {
-				whatever |= ((uint64_t)response[tokenNum][i] << (8 * b));
+            for (uint32_t i = length - 1; i > 0; i--) {
+				whatever |= ((uint64_t)t[i] << (8 * b));
                 b++;
             }
             return whatever;
         }
 
     }
-    else if (!(response[tokenNum][0] & 0x20)) { // medium atom
-        LOG(E) << "unsigned int requested for medium atom is unsupported";
-		exit(EXIT_FAILURE);
+    else if (!(t[0] & 0x20)) { // medium atom
+        fail("unsigned int requested for medium atom is unsupported");
     }
-    else if (!(response[tokenNum][0] & 0x10)) { // long atom
-        LOG(E) << "unsigned int requested for long atom is unsupported";
-		exit(EXIT_FAILURE);
+    else if (!(t[0] & 0x10)) { // long atom
+        fail("unsigned int requested for long atom is unsupported");
     }
     else { // TOKEN
-        LOG(E) << "unsigned int requested for token is unsupported";
-		exit(EXIT_FAILURE);
+        fail("unsigned int requested for token is unsupported");
     }
+    return 0;
 }
-
 uint32_t DtaResponse::getUint32(uint32_t tokenNum)
 {
     LOG(D1) << "Entering  DtaResponse::getUint32";
@@ -180,7 +260,24 @@ uint8_t DtaResponse::getUint8(uint32_t tokenNum)
 
 std::vector<uint8_t> DtaResponse::getRawToken(uint32_t tokenNum)
 {
-    return response[tokenNum];
+    if (!exists(tokenNum)) return std::vector<uint8_t>();
+    const uint8_t * t = &payload[tokens[tokenNum].offset];
+    return std::vector<uint8_t>(t, t + tokens[tokenNum].length);
+}
+
+uint32_t DtaResponse::overhead(uint32_t tokenNum)
+{
+    const uint8_t * t = &payload[tokens[tokenNum].offset];
+    if (!(t[0] & 0x80)) //tiny atom
+        return 0;
+    else if (!(t[0] & 0x40)) // short atom
+        return 1;
+    else if (!(t[0] & 0x20)) // medium atom
+        return 2;
+    else if (!(t[0] & 0x10)) // long atom
+        return 4;
+    else
+        return 0;
 }
 
 std::string DtaResponse::getString(uint32_t tokenNum)
@@ -188,61 +285,117 @@ std::string DtaResponse::getString(uint32_t tokenNum)
     LOG(D1) << "Entering  DtaResponse::getString";
     std::string s;
     s.erase();
-    int overhead = 0;
-    if (!(response[tokenNum][0] & 0x80)) { //tiny atom
-        LOG(E) << "Cannot get a string from a tiny atom";
-		exit(EXIT_FAILURE);
-    }
-    else if (!(response[tokenNum][0] & 0x40)) { // short atom
-        overhead = 1;
-    }
-    else if (!(response[tokenNum][0] & 0x20)) { // medium atom
-        overhead = 2;
-    }
-    else if (!(response[tokenNum][0] & 0x10)) { // long atom
-        overhead = 4;
+    if (!exists(tokenNum)) return s;
+    const uint8_t * t = &payload[tokens[tokenNum].offset];
+    if (!(t[0] & 0x80)) { //tiny atom
+        fail("Cannot get a string from a tiny atom");
+        return s;
     }
-    else {
+    else if ((t[0] & 0xf0) == 0xf0) {
         LOG(E) << "Cannot get a string from a TOKEN";
         return s;
     }
-    for (uint32_t i = overhead; i < response[tokenNum].size(); i++) {
-        s.push_back(response[tokenNum][i]);
-    }
+    uint32_t o = overhead(tokenNum);
+    s.assign((const char *) t + o, tokens[tokenNum].length - o);
     return s;
 }
 
 void DtaResponse::getBytes(uint32_t tokenNum, uint8_t bytearray[])
 {
     LOG(D1) << "Entering  DtaResponse::getBytes";
-    int overhead = 0;
-    if (!(response[tokenNum][0] & 0x80)) { //tiny atom
-        LOG(E) << "Cannot get a bytestring from a tiny atom";
-		exit(EXIT_FAILURE);
-    }
-    else if (!(response[tokenNum][0] & 0x40)) { // short atom
-        overhead = 1;
-    }
-    else if (!(response[tokenNum][0] & 0x20)) { // medium atom
-        overhead = 2;
+    if (!exists(tokenNum)) return;
+    const uint8_t * t = &payload[tokens[tokenNum].offset];
+    if (!(t[0] & 0x80)) { //tiny atom
+        fail("Cannot get a bytestring from a tiny atom");
+        return;
     }
-    else if (!(response[tokenNum][0] & 0x10)) { // long atom
-        overhead = 4;
-    }
-    else {
-        LOG(E) << "Cannot get a bytestring from a TOKEN";
-		exit(EXIT_FAILURE);
-    }
-
-    for (uint32_t i = overhead; i < response[tokenNum].size(); i++) {
-        bytearray[i - overhead] = response[tokenNum][i];
+    else if ((t[0] & 0xf0) == 0xf0) {
+        fail("Cannot get a bytestring from a TOKEN");
+        return;
     }
+    uint32_t o = overhead(tokenNum);
+    memcpy(bytearray, t + o, tokens[tokenNum].length - o);
 }
 
 uint32_t DtaResponse::getTokenCount()
 {
     LOG(D1) << "Entering  DtaResponse::getTokenCount()";
-    return (uint32_t) response.size();
+    return (uint32_t) tokens.size();
+}
+
+uint32_t DtaResponse::listEnd(uint32_t tokenNum)
+{
+    if (!exists(tokenNum)) return tokenNum;
+    return tokens[tokenNum].end;
+}
+
+uint32_t DtaResponse::column(uint32_t id)
+{
+    if (id < DTA_COLUMNINDEX_SIZE)
+        return columnIndex[id];
+    for (uint32_t i = 0; i < largeNames.size(); i++)
+        if (getUint64(largeNames[i] + 1) == id)
+            return largeNames[i] + 2;
+    return DTA_NOCOLUMN;
+}
+
+uint32_t DtaResponse::column(const char * name)
+{
+    size_t len = strlen(name);
+    for (uint32_t i = 0; i < names.size(); i++) {
+        uint32_t n = names[i] + 1;
+        uint32_t o = overhead(n);
+        if ((tokens[n].length - o == len) &&
+            !memcmp(&payload[tokens[n].offset + o], name, len))
+            return n + 1;
+    }
+    return DTA_NOCOLUMN;
+}
+
+bool DtaResponse::isUint(uint32_t tokenNum)
+{
+    /* integers wider than a short atom are not supported by getUint64 */
+    return (tokenNum < tokens.size()) &&
+        (OPAL_TOKEN::DTA_TOKENID_UINT == tokens[tokenNum].type) &&
+        (tokens[tokenNum].length <= 9);
+}
+
+bool DtaResponse::isBytes(uint32_t tokenNum)
+{
+    return (tokenNum < tokens.size()) &&
+        (OPAL_TOKEN::DTA_TOKENID_BYTESTRING == tokens[tokenNum].type);
+}
+
+bool DtaResponse::getColumn(uint32_t id, uint64_t & value)
+{
+    uint32_t n = column(id);
+    if (!isUint(n)) return false;
+    value = getUint64(n);
+    return true;
+}
+
+bool DtaResponse::getColumn(uint32_t id, std::string & value)
+{
+    uint32_t n = column(id);
+    if (!isBytes(n)) return false;
+    value = getString(n);
+    return true;
+}
+
+bool DtaResponse::getColumn(const char * name, uint64_t & value)
+{
+    uint32_t n = column(name);
+    if (!isUint(n)) return false;
+    value = getUint64(n);
+    return true;
+}
+
+bool DtaResponse::getColumn(const char * name, std::string & value)
+{
+    uint32_t n = column(name);
+    if (!isBytes(n)) return false;
+    value = getString(n);
+    return true;
 }
 
 DtaResponse::~DtaResponse()
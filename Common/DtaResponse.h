@@ -23,10 +23,17 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaStructures.h"
 #include "DtaLexicon.h"
 
+/** returned by DtaResponse::column when the name is not in the response */
+#define DTA_NOCOLUMN 0xffffffff
+/** column ids below this are looked up through a direct index */
+#define DTA_COLUMNINDEX_SIZE 64
 
 /** Object containing the parsed tokens.
- * a vector of vector<uint8_T> that contains each token
- * returned in the TCG response
+ * The response is parsed once into a flat tree: every token records where
+ * it lives in a single copy of the payload, its type and, for STARTLIST and
+ * STARTNAME, the position of the matching end token. Named values are
+ * indexed as they are parsed so a column can be found without walking the
+ * response again.
  */
 class DtaResponse {
 public:
@@ -68,13 +75,70 @@ public:
     * @param tokenNum the 0 based number of the token
     * @param bytearray pointer to array for return data */
     void getBytes(uint32_t tokenNum, uint8_t bytearray[]);
+    /** return the token number of the matching ENDLIST or ENDNAME
+     * @param tokenNum the 0 based number of a STARTLIST or STARTNAME token */
+    uint32_t listEnd(uint32_t tokenNum);
+    /** return the token number of the value named by an integer
+     * (the column number in a Get response) or DTA_NOCOLUMN
+     * @param id the name of the value */
+    uint32_t column(uint32_t id);
+    /** return the token number of the value named by a string
+     * (the column name in an Enterprise Get response) or DTA_NOCOLUMN
+     * @param name the name of the value */
+    uint32_t column(const char * name);
+    /** fetch an unsigned integer column
+     * @param id the name of the value
+     * @param value returned value
+     * @return false if the column is missing or is not an unsigned integer */
+    bool getColumn(uint32_t id, uint64_t & value);
+    /** fetch a bytestring column
+     * @param id the name of the value
+     * @param value returned value
+     * @return false if the column is missing or is not a bytestring */
+    bool getColumn(uint32_t id, std::string & value);
+    /** fetch an unsigned integer column by string name
+     * @param name the name of the value
+     * @param value returned value
+     * @return false if the column is missing or is not an unsigned integer */
+    bool getColumn(const char * name, uint64_t & value);
+    /** fetch a bytestring column by string name
+     * @param name the name of the value
+     * @param value returned value
+     * @return false if the column is missing or is not a bytestring */
+    bool getColumn(const char * name, std::string & value);
+    /** true if a token was asked for that the response does not hold or
+     * that is not of the type asked for; the getters then return 0 or an
+     * empty value.  Cleared by init. */
+    bool isMalformed();
     
     OPALHeader h; /**< TCG Header fields of the response */
 
 private:
+    /** one node of the parsed response */
+    typedef struct _DtaResponseToken {
+        uint32_t offset;    /**< start of the token in the payload */
+        uint32_t length;    /**< length including the atom header */
+        uint32_t end;       /**< matching end token, or the token itself */
+        OPAL_TOKEN type;    /**< decoded token type */
+    } DtaResponseToken;
+    /** decode the type of the token starting at p */
+    static OPAL_TOKEN decodeType(const uint8_t * p);
+    /** length of the atom header of the token */
+    uint32_t overhead(uint32_t tokenNum);
+    /** true if the token exists and is an unsigned integer atom */
+    bool isUint(uint32_t tokenNum);
+    /** true if the token exists and is a bytestring atom */
+    bool isBytes(uint32_t tokenNum);
+    /** true if the token exists, otherwise log and note the response as malformed */
+    bool exists(uint32_t tokenNum);
+    /** log what was wrong with the response and note it as malformed */
+    void fail(const char * what);
 
-    std::vector<std::vector<uint8_t>> response;   /**< tokenized resonse  */
+    std::vector<uint8_t> payload;           /**< copy of the subpacket payload */
+    std::vector<DtaResponseToken> tokens;   /**< tokenized resonse  */
+    std::vector<uint32_t> open;             /**< parse stack of open lists */
+    std::vector<uint32_t> names;            /**< STARTNAME tokens with bytestring names */
+    std::vector<uint32_t> largeNames;       /**< STARTNAME tokens with large integer names */
+    uint32_t columnIndex[DTA_COLUMNINDEX_SIZE]; /**< value token by integer name */
+    bool malformed;                         /**< a getter was given a bad token */
 };
-
-
-
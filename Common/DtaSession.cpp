@@ -19,6 +19,9 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
  * C:E********************************************************************** */
 #include "os.h"
 #include <stdio.h>
+#include <mutex>
+#include <thread>
+#include <chrono>
 #include "DtaSession.h"
 #include "DtaOptions.h"
 #include "DtaDev.h"
@@ -27,10 +30,14 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaEndianFixup.h"
 #include "DtaHexDump.h"
 #include "DtaHashPwd.h"
+#include "DtaStats.h"
 #include "DtaStructures.h"
 
 using namespace std;
 
+map<string, uint8_t> DtaSession::lastAuthority;
+static mutex lastAuthorityLock;
+
 DtaSession::DtaSession(DtaDev * device)
 {
     LOG(D1) << "Creating DtaSsession()";
@@ -38,6 +45,11 @@ DtaSession::DtaSession(DtaDev * device)
     d = device;
 }
 
+/** The SP refused StartSession because some other session holds it */
+static bool spBusy(uint8_t rc)
+{
+	return (OPALSTATUSCODE::SP_BUSY == rc) || (OPALSTATUSCODE::NO_SESSIONS_AVAILABLE == rc);
+}
 uint8_t
 DtaSession::start(OPAL_UID SP)
 {
@@ -48,59 +60,71 @@ uint8_t
 DtaSession::start(OPAL_UID SP, char * HostChallenge, OPAL_UID SignAuthority)
 {
 	LOG(D1) << "Entering DtaSession::startSession ";
-	vector<uint8_t> auth;
-	auth.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		auth.push_back(OPALUID[SignAuthority][i]);
+	return(start(SP, HostChallenge, OPALUID[SignAuthority]));
+}
+uint8_t
+DtaSession::start(OPAL_UID SP, char * HostChallenge, const vector<uint8_t> & SignAuthority)
+{
+	/* the vector holds an encoded UID: BYTESTRING8 header + 8 bytes */
+	if ((9 != SignAuthority.size()) || (OPAL_SHORT_ATOM::BYTESTRING8 != SignAuthority[0])) {
+		LOG(E) << "Invalid signing authority";
+		return DTAERROR_INVALID_PARAMETER;
 	}
-	return(start(SP, HostChallenge, auth));
+	return(start(SP, HostChallenge, &SignAuthority[1]));
 }
 uint8_t DtaSession::authuser() {
 	return sessionauth;
 }
-#ifdef MULTISTART
 uint8_t
-DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthority)
+DtaSession::start(OPAL_UID SP, char * HostChallenge, const uint8_t SignAuthority[8])
 {
-	vector <uint8_t> auth;
-	if ((lastRC = unistart(SP, HostChallenge, SignAuthority)) == 0) {
-		sessionauth = 0;
-		return 0;
+	LOG(D1) << "Entering DtaSession::start ";
+	vector<uint8_t> hash;
+	uint8_t auth[8];
+	uint8_t first = 0;
+	sessionauth = 0;
+	if ((NULL != HostChallenge) && hashPwd && !d->isEprise())
+		DtaHashPwd(hash, HostChallenge, d);
+	if (!d->multistart || (OPAL_UID::OPAL_LOCKINGSP_UID != SP) ||
+		(NULL == HostChallenge) || d->isEprise())
+		return unistart(SP, HostChallenge, hash, SignAuthority);
+	string serial(d->getSerialNum(), strnlen(d->getSerialNum(), 20));
+	{
+		lock_guard<mutex> guard(lastAuthorityLock);
+		map<string, uint8_t>::iterator last = lastAuthority.find(serial);
+		if (last != lastAuthority.end()) first = last->second;
 	}
-	else {
-		for (uint8_t i = 1; i < 9; i++) {
+	// the authority that worked last time, then the others in order
+	for (uint8_t n = 0; n < 9; n++) {
+		uint8_t i = (0 == n) ? first : ((n <= first) ? n - 1 : n);
+		if (0 == i)
+			memcpy(auth, SignAuthority, 8);
+		else {
 			// { 0x00, 0x00, 0x00, 0x09, 0x00, 0x03, 0x00, 0x01 }, /**< USER1 */
-			auth.clear();
-			auth.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-			auth.push_back(0x00);
-			auth.push_back(0x00);
-			auth.push_back(0x00);
-			auth.push_back(0x09);
-			auth.push_back(0x00);
-			auth.push_back(0x03);
-			auth.push_back(0x00);
-			auth.push_back(i);
-			if ((lastRC = unistart(SP, HostChallenge, auth)) == 0) {
-				sessionauth = i;
-				return 0;
-			}
+			memcpy(auth, OPALUID[OPAL_UID::OPAL_USER1_UID], 8);
+			auth[7] = i;
 		}
-
+		if ((lastRC = unistart(SP, HostChallenge, hash, auth)) == 0) {
+			LOG(D1) << "Session started as authority " << (uint16_t)i << " after " << (uint16_t)(n + 1) << " tries";
+			sessionauth = i;
+			lock_guard<mutex> guard(lastAuthorityLock);
+			lastAuthority[serial] = i;
+			return 0;
+		}
+		// a busy SP refuses every authority alike, unistart has waited already
+		if ((DTAERROR_TIMEOUT == lastRC) || (DTAERROR_CANCELLED == lastRC) || spBusy(lastRC))
+			break;
 	}
 	return lastRC;
 }
 uint8_t
-DtaSession::unistart(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthority)
-#else
-uint8_t
-DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthority)
-#endif
+DtaSession::unistart(OPAL_UID SP, char * HostChallenge, const vector<uint8_t> & hash,
+	const uint8_t SignAuthority[8])
 {
     LOG(D1) << "Entering DtaSession::startSession ";
-	vector<uint8_t> hash;
 	lastRC = 0;
 
-    DtaCommand *cmd = new DtaCommand();
+    DtaCommand *cmd = d->getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create session object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -115,8 +139,6 @@ DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthori
 		cmd->addToken(OPAL_TOKEN::STARTNAME);
 		cmd->addToken(OPAL_TINY_ATOM::UINT_00);
 		if (hashPwd) {
-			hash.clear();
-			DtaHashPwd(hash, HostChallenge, d);
 			cmd->addToken(hash);
 		} else {
 			cmd->addToken(HostChallenge);
@@ -124,13 +146,15 @@ DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthori
 		cmd->addToken(OPAL_TOKEN::ENDNAME);
 		cmd->addToken(OPAL_TOKEN::STARTNAME);
 		cmd->addToken(OPAL_TINY_ATOM::UINT_03);
-		cmd->addToken(SignAuthority);
+		cmd->addUID(SignAuthority);
 		cmd->addToken(OPAL_TOKEN::ENDNAME);
 	}
  
-	// w/o the timeout the session may wedge and require a power-cycle,
-	// e.g., when interrupted by ^C. 60 seconds is inconveniently long,
-	// but revert may require that long to complete.
+	// an Enterprise TPer ends a session idle for the timeout by itself, so
+	// one left open by a process that died frees the SP without -S.  Opal
+	// sessions get none and stay open until recoverComID resets the ComID.
+	// 60 seconds is inconveniently long, but revert may require that long
+	// to complete.
 	if (d->isEprise()) {
 		cmd->addToken(OPAL_TOKEN::STARTNAME);
 		cmd->addToken("SessionTimeout");
@@ -140,27 +164,55 @@ DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthori
 
     cmd->addToken(OPAL_TOKEN::ENDLIST); // ]  (Close Bracket)
     cmd->complete();
-	if ((lastRC = sendCommand(cmd, response)) != 0) {
+	lastRC = sendCommand(cmd, response);
+	// usually another host process (the unlock agent, a second sedutil)
+	// is in a session of its own that ends shortly, wait for it
+	for (uint32_t wait = 50, waited = 0; spBusy(lastRC) && (waited < d->busy_wait); wait *= 2) {
+		wait = min(wait, d->busy_wait - waited);
+		LOG(D) << "SP busy, StartSession again in " << wait << " ms";
+		this_thread::sleep_for(chrono::milliseconds(wait));
+		waited += wait;
+		lastRC = sendCommand(cmd, response);
+	}
+	// still busy, most likely a session left open by a process that died;
+	// taking the ComID back aborts whatever session holds it, so only on request
+	if (spBusy(lastRC) && d->stack_reset && (d->recoverComID() == 0))
+		lastRC = sendCommand(cmd, response);
+	if (lastRC != 0) {
 		LOG(E) << "Session start failed rc = " << (int)lastRC;
-		delete cmd;
+		d->releaseCommand(cmd);
 		return lastRC;
 	}  
     // call user method SL HSN TSN EL EOD SL 00 00 00 EL
     //   0   1     2     3  4   5   6  7   8
     HSN = SWAP32(response.getUint32(4));
     TSN = SWAP32(response.getUint32(5));
-	delete cmd;
+	d->releaseCommand(cmd);
+	if (response.isMalformed()) {
+		LOG(E) << "Session start failed, the SyncSession response is malformed";
+		return DTAERROR_COMMAND_ERROR;
+	}
+	d->comIDWorking();
 	if ((NULL != HostChallenge) && (d->isEprise())) {
 		return(authenticate(SignAuthority, HostChallenge));
 	}
     return 0;
 }
 uint8_t
-DtaSession::authenticate(vector<uint8_t> Authority, char * Challenge)
+DtaSession::authenticate(const vector<uint8_t> & Authority, char * Challenge)
+{
+	if ((9 != Authority.size()) || (OPAL_SHORT_ATOM::BYTESTRING8 != Authority[0])) {
+		LOG(E) << "Invalid authority";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	return(authenticate(&Authority[1], Challenge));
+}
+uint8_t
+DtaSession::authenticate(const uint8_t Authority[8], char * Challenge)
 {
 	LOG(D1) << "Entering DtaSession::authenticate ";
 	vector<uint8_t> hash;
-	DtaCommand *cmd = new DtaCommand();
+	DtaCommand *cmd = d->getCommand();
 	if (NULL == cmd) {
 		LOG(E) << "Unable to create session object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
@@ -168,7 +220,7 @@ DtaSession::authenticate(vector<uint8_t> Authority, char * Challenge)
 	DtaResponse response;
 	cmd->reset(OPAL_UID::OPAL_THISSP_UID, d->isEprise() ? OPAL_METHOD::EAUTHENTICATE : OPAL_METHOD::AUTHENTICATE);
 	cmd->addToken(OPAL_TOKEN::STARTLIST); // [  (Open Bracket)
-	cmd->addToken(Authority);
+	cmd->addUID(Authority);
     if (Challenge && *Challenge)
     {
 		cmd->addToken(OPAL_TOKEN::STARTNAME);
@@ -189,17 +241,17 @@ DtaSession::authenticate(vector<uint8_t> Authority, char * Challenge)
 	cmd->complete();
 	if ((lastRC = sendCommand(cmd, response)) != 0) {
 		LOG(E) << "Session Authenticate failed";
-		delete cmd;
+		d->releaseCommand(cmd);
 		return lastRC;
 	}
-	if (0 == response.getUint8(1)) {
+	if ((0 == response.getUint8(1)) || response.isMalformed()) {
 		LOG(E) << "Session Authenticate failed (response = false)";
-		delete cmd;
+		d->releaseCommand(cmd);
 		return DTAERROR_AUTH_FAILED;
 	}
 
 	LOG(D1) << "Exiting DtaSession::authenticate "; 
-	delete cmd;
+	d->releaseCommand(cmd);
 	return 0;
 }
 uint8_t
@@ -210,12 +262,26 @@ DtaSession::sendCommand(DtaCommand * cmd, DtaResponse & response)
     cmd->setTSN(TSN);
     cmd->setcomID(d->comID());
 
+    DtaStats::clock::time_point start;
+    if (DtaStats::enabled()) start = DtaStats::clock::now();
     uint8_t exec_rc = d->exec(cmd, response, SecurityProtocol);
     if (0 != exec_rc)
     {
         LOG(E) << "Command failed on exec " << (uint16_t) exec_rc;
+        if (DtaStats::enabled()) DtaStats::discard();
+        // the ComID was reset, there is no session left to end
+        if ((DTAERROR_TIMEOUT == exec_rc) || (DTAERROR_CANCELLED == exec_rc))
+            willAbort = 1;
         return exec_rc;
     }
+    uint8_t rc = checkResponse(response);
+    if (DtaStats::enabled()) DtaStats::command(d->getDevName(), cmd, DtaStats::since(start));
+    return rc;
+}
+
+uint8_t
+DtaSession::checkResponse(DtaResponse & response)
+{
     /*
      * Check out the basics that so that we know we
      * have a sane reply to work with
@@ -238,11 +304,15 @@ DtaSession::sendCommand(DtaCommand * cmd, DtaResponse & response)
         LOG(E) << "Method Status missing";
 		return DTAERROR_NO_METHOD_STATUS;
     }
-    if (OPALSTATUSCODE::SUCCESS != response.getUint8(response.getTokenCount() - 4)) {
-        LOG(E) << "method status code " <<
-                methodStatus(response.getUint8(response.getTokenCount() - 4));
+    uint8_t status = response.getUint8(response.getTokenCount() - 4);
+    if (response.isMalformed()) {
+        LOG(E) << "Method Status malformed";
+        return DTAERROR_NO_METHOD_STATUS;
+    }
+    if (OPALSTATUSCODE::SUCCESS != status) {
+        LOG(E) << "method status code " << methodStatus(status);
     }
-    return response.getUint8(response.getTokenCount() - 4);
+    return status;
 }
 
 void
@@ -317,7 +387,7 @@ DtaSession::~DtaSession()
     LOG(D1) << "Destroying DtaSession";
 	DtaResponse response;
     if (!willAbort) {
-        DtaCommand *cmd = new DtaCommand();
+        DtaCommand *cmd = d->getCommand();
 		if (NULL == cmd) {
 			LOG(E) << "Unable to create command object ";
 		} 
@@ -328,7 +398,7 @@ DtaSession::~DtaSession()
 			if (sendCommand(cmd, response)) {
 				LOG(E) << "EndSession Failed";
 			}
-			delete cmd;
+			d->releaseCommand(cmd);
 		}
     }
 }
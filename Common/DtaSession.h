@@ -23,6 +23,8 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "DtaLexicon.h"
 #include <vector>
+#include <map>
+#include <string>
 class DtaCommand;
 class DtaDev;
 class DtaResponse;
@@ -40,14 +42,6 @@ public:
     /** start an anonymous session 
      * @param SP the Security Provider to start the session with */
     uint8_t start(OPAL_UID SP);    
-    /** Start an authenticated session with any user(1-8) or admint (OPAL only) 
-     * @param SP the securitly provider to start the session with
-     * @param HostChallenge the password to start the session
-     * @param SignAuthority the Signing authority (in a simple session this is the user)
-     *  */    
-#ifdef MULTISTART
-	uint8_t unistart(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthority);
-#endif
 	/** Start an authenticated session (OPAL only)
 	* @param SP the securitly provider to start the session with
 	* @param HostChallenge the password to start the session
@@ -59,12 +53,28 @@ public:
      * @param HostChallenge the password to start the session
      * @param SignAuthority the Signing authority (in a simple session this is the user)
      *  */
-    uint8_t start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthority);
+    uint8_t start(OPAL_UID SP, char * HostChallenge, const vector<uint8_t> & SignAuthority);
+    /** Start an authenticated session.
+     * When the device has multistart set, a Locking SP session that the
+     * signing authority can't start is retried as User1..User8 with the
+     * same password.  The password is hashed once for all the attempts and
+     * the authority that worked is tried first the next time for a drive
+     * with the same serial number.
+     * @param SP the securitly provider to start the session with
+     * @param HostChallenge the password to start the session
+     * @param SignAuthority bare 8 byte UID of the signing authority
+     *  */
+    uint8_t start(OPAL_UID SP, char * HostChallenge, const uint8_t SignAuthority[8]);
     /** Authenticate an already started session 
-     * @param Authority the authority to authenticate
+     * @param Authority the authority to authenticate (encoded bytestring token)
+     * @param Challenge the password
+     */
+    uint8_t authenticate(const vector<uint8_t> & Authority, char * Challenge);
+    /** Authenticate an already started session
+     * @param Authority bare 8 byte UID of the authority to authenticate
      * @param Challenge the password
      */
-    uint8_t authenticate(vector<uint8_t> Authority, char * Challenge);
+    uint8_t authenticate(const uint8_t Authority[8], char * Challenge);
     /** assign the security protocol to be used in the sessiion
      * @param value the security protocol number 
      */
@@ -79,20 +89,33 @@ public:
      * to suppress the normal error checking 
      */
     void expectAbort();
-	/** return the authorization the session has started under */
+	/** return the authorization the session has started under,
+	 * 0 for the signing authority asked for or 1-8 for User1-8 */
 	uint8_t authuser();
     /** send a command to the device in this session 
      * @param cmd  The DtaCommand object 
      * @param response The MesdResponse object 
      */
     uint8_t sendCommand(DtaCommand * cmd, DtaResponse & response);
+    /** check the reply to a command is sane and return its method status
+     * @param response the parsed reply
+     */
+    static uint8_t checkResponse(DtaResponse & response);
+    /** return a string explaining the method status 
+     * @param status the method status code returned 
+     */
+    static char * methodStatus(uint8_t status);
 private:
     /** Default constructor, private should never be called */
     DtaSession();
-    /** return a string explaining the method status 
-     * @param status the method status code returned 
+    /** Send one StartSession
+     * @param SP the securitly provider to start the session with
+     * @param HostChallenge the password to start the session
+     * @param hash HostChallenge already hashed, used unless dontHashPwd was called
+     * @param SignAuthority bare 8 byte UID of the signing authority
      */
-    char * methodStatus(uint8_t status);
+    uint8_t unistart(OPAL_UID SP, char * HostChallenge, const vector<uint8_t> & hash,
+        const uint8_t SignAuthority[8]);
     DtaDev * d;   /**< Pointer to device this session is with */
     uint32_t bufferpos = 0;   /**< psooition in the response buffer the parser is at */
     uint32_t TSN = 0;   /**< TPer session number */
@@ -102,5 +125,7 @@ private:
     uint8_t SecurityProtocol = 0x01;  /**< The seurity protocol to be used */
 	uint8_t lastRC;  /**< last return code */
 	uint8_t sessionauth; /** authid for multistart */
+	/** authid that last started a multistart session, by drive serial number */
+	static std::map<std::string, uint8_t> lastAuthority;
 };
 
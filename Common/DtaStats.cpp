@@ -0,0 +1,191 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <algorithm>
+#include <mutex>
+#include "DtaStats.h"
+#include "DtaCommand.h"
+#include "DtaUIDTable.h"
+
+using namespace std;
+
+bool DtaStats::active = false;
+bool DtaStats::asJSON = false;
+thread_local uint64_t DtaStats::pendingSendNs = 0;
+thread_local uint64_t DtaStats::pendingRecvNs = 0;
+thread_local uint32_t DtaStats::pendingPolls = 0;
+map<string, DTA_STATS_DEVICE> DtaStats::devices;
+static mutex devicesLock; // devices and password hashes may be driven in parallel
+
+void DtaStats::enable(bool json)
+{
+	active = true;
+	asJSON = json;
+}
+
+bool DtaStats::enabled() { return active; }
+
+uint64_t DtaStats::since(clock::time_point start)
+{
+	return (uint64_t) chrono::duration_cast<chrono::nanoseconds>(clock::now() - start).count();
+}
+
+void DtaStats::transport(uint64_t sendNs, uint32_t polls, uint64_t recvNs)
+{
+	pendingSendNs = sendNs;
+	pendingPolls = polls;
+	pendingRecvNs = recvNs;
+}
+
+void DtaStats::discard()
+{
+	pendingSendNs = pendingRecvNs = 0;
+	pendingPolls = 0;
+}
+
+string DtaStats::methodName(DtaCommand * cmd)
+{
+	char buf[64];
+	const uint8_t * p = (uint8_t *) cmd->getCmdBuffer() + sizeof (OPALHeader);
+	if (OPAL_TOKEN::ENDOFSESSION == p[0])
+		return "EndSession";
+	if ((OPAL_TOKEN::CALL != p[0]) || (OPAL_SHORT_ATOM::BYTESTRING8 != p[10]))
+		return "unknown";
+	const char * name = DtaUIDName(&p[11], buf, sizeof(buf));
+	if (NULL != name)
+		return name;
+	snprintf(buf, sizeof(buf), "%02x%02x%02x%02x%02x%02x%02x%02x",
+		p[11], p[12], p[13], p[14], p[15], p[16], p[17], p[18]);
+	return buf;
+}
+
+void DtaStats::command(const char * dev, DtaCommand * cmd, uint64_t latencyNs)
+{
+	string name = methodName(cmd);
+	lock_guard<mutex> guard(devicesLock);
+	DTA_STATS_METHOD & m = devices[dev].methods[name];
+	m.count++;
+	m.sendNs += pendingSendNs;
+	m.recvNs += pendingRecvNs;
+	m.polls += pendingPolls;
+	m.latencyNs.push_back(latencyNs);
+	pendingSendNs = pendingRecvNs = 0;
+	pendingPolls = 0;
+}
+
+void DtaStats::hash(const char * dev, uint64_t ns)
+{
+	lock_guard<mutex> guard(devicesLock);
+	DTA_STATS_DEVICE & d = devices[dev];
+	d.hashCount++;
+	d.hashNs += ns;
+}
+
+void DtaStats::print(FILE * stream)
+{
+	lock_guard<mutex> guard(devicesLock);
+	if (asJSON)
+		printJSON(stream);
+	else
+		printText(stream);
+}
+
+void DtaStats::report()
+{
+	print(stdout);
+}
+
+/** min, p50, p99 and max of the latencies in microseconds */
+static void percentiles(vector<uint64_t> v, double us[4])
+{
+	if (v.empty()) {
+		us[0] = us[1] = us[2] = us[3] = 0;
+		return;
+	}
+	sort(v.begin(), v.end());
+	size_t n = v.size() - 1;
+	us[0] = v[0] / 1000.0;
+	us[1] = v[n * 50 / 100] / 1000.0;
+	us[2] = v[n * 99 / 100] / 1000.0;
+	us[3] = v[n] / 1000.0;
+}
+
+void DtaStats::printText(FILE * stream)
+{
+	double us[4];
+	for (map<string, DTA_STATS_DEVICE>::iterator d = devices.begin(); d != devices.end(); ++d) {
+		fprintf(stream, "Statistics for %s\n", d->first.c_str());
+		fprintf(stream, "%-20s %6s %10s %6s %10s %10s %10s %10s %10s\n", "method", "count",
+			"send_us", "polls", "recv_us", "min_us", "p50_us", "p99_us", "max_us");
+		for (map<string, DTA_STATS_METHOD>::iterator m = d->second.methods.begin();
+			m != d->second.methods.end(); ++m) {
+			percentiles(m->second.latencyNs, us);
+			fprintf(stream, "%-20s %6u %10.1f %6llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+				m->first.c_str(), m->second.count, m->second.sendNs / 1000.0,
+				(unsigned long long) m->second.polls, m->second.recvNs / 1000.0,
+				us[0], us[1], us[2], us[3]);
+		}
+		fprintf(stream, "%-20s %6u %10.1f\n", "password hash", d->second.hashCount,
+			d->second.hashNs / 1000.0);
+	}
+}
+
+/** s as the contents of a JSON string, Windows device names are full of backslashes */
+static string jsonEscape(const string & s)
+{
+	string out;
+	char buf[8];
+	for (size_t i = 0; i < s.size(); i++) {
+		if (('"' == s[i]) || ('\\' == s[i])) {
+			out += '\\';
+			out += s[i];
+		}
+		else if ((unsigned char)s[i] < 0x20) {
+			snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)s[i]);
+			out += buf;
+		}
+		else
+			out += s[i];
+	}
+	return out;
+}
+
+void DtaStats::printJSON(FILE * stream)
+{
+	double us[4];
+	fprintf(stream, "{\"devices\":[");
+	for (map<string, DTA_STATS_DEVICE>::iterator d = devices.begin(); d != devices.end(); ++d) {
+		if (d != devices.begin()) fprintf(stream, ",");
+		fprintf(stream, "{\"device\":\"%s\",\"hash\":{\"count\":%u,\"total_us\":%.1f},\"methods\":[",
+			jsonEscape(d->first).c_str(), d->second.hashCount, d->second.hashNs / 1000.0);
+		for (map<string, DTA_STATS_METHOD>::iterator m = d->second.methods.begin();
+			m != d->second.methods.end(); ++m) {
+			if (m != d->second.methods.begin()) fprintf(stream, ",");
+			percentiles(m->second.latencyNs, us);
+			fprintf(stream, "{\"method\":\"%s\",\"count\":%u,\"send_us\":%.1f,\"polls\":%llu,"
+				"\"recv_us\":%.1f,\"latency_us\":{\"min\":%.1f,\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f}}",
+				jsonEscape(m->first).c_str(), m->second.count, m->second.sendNs / 1000.0,
+				(unsigned long long) m->second.polls, m->second.recvNs / 1000.0,
+				us[0], us[1], us[2], us[3]);
+		}
+		fprintf(stream, "]}");
+	}
+	fprintf(stream, "]}\n");
+}
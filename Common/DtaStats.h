@@ -0,0 +1,102 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include "DtaStructures.h"
+
+class DtaCommand;
+
+/** Timing collected for one method on one device */
+typedef struct _DTA_STATS_METHOD {
+	uint32_t count;      /**< number of commands */
+	uint64_t sendNs;     /**< total time spent in IF_SEND */
+	uint64_t recvNs;     /**< total time spent polling with IF_RECV, sleeps included */
+	uint64_t polls;      /**< total IF_RECV iterations */
+	std::vector<uint64_t> latencyNs; /**< latency of each command as seen by the session */
+} DTA_STATS_METHOD;
+
+/** Timing collected for one device */
+typedef struct _DTA_STATS_DEVICE {
+	uint32_t hashCount;  /**< number of password hashes */
+	uint64_t hashNs;     /**< total time spent hashing passwords */
+	std::map<std::string, DTA_STATS_METHOD> methods; /**< by method name */
+} DTA_STATS_DEVICE;
+
+/** Process wide latency statistics, per device and per method.
+ * The transport timing (send, poll iterations, receive) is noted by the
+ * exec of the device and attached to the command when the session that
+ * sent it sees the reply, together with the total latency of the command.
+ * Nothing is measured unless statistics have been enabled.
+ * Commands and hashes may be recorded from several threads at once.
+ */
+class DtaStats {
+public:
+	typedef std::chrono::steady_clock clock;
+	/** Start collecting statistics
+	 * @param json report as JSON rather than as a table
+	 */
+	static void enable(bool json);
+	/** Are statistics being collected */
+	static bool enabled();
+	/** Note the transport timing of the command exec is about to return
+	 * @param sendNs time spent sending the command
+	 * @param polls number of IF_RECV calls made
+	 * @param recvNs time spent receiving the reply
+	 */
+	static void transport(uint64_t sendNs, uint32_t polls, uint64_t recvNs);
+	/** Forget the transport timing noted for a command that failed and
+	 * will not be recorded, so it isn't added to the next one */
+	static void discard();
+	/** Record a completed command
+	 * @param dev the device the command was sent to
+	 * @param cmd the command, the method is taken from the buffer
+	 * @param latencyNs time from sending the command to having the reply checked
+	 */
+	static void command(const char * dev, DtaCommand * cmd, uint64_t latencyNs);
+	/** Record a password hash
+	 * @param dev the device the password was hashed for
+	 * @param ns time spent hashing
+	 */
+	static void hash(const char * dev, uint64_t ns);
+	/** Nanoseconds since a time point */
+	static uint64_t since(clock::time_point start);
+	/** Print the statistics in the format chosen by enable()
+	 * @param stream where to print
+	 */
+	static void print(FILE * stream = stdout);
+	/** Print the statistics to stdout, suitable for atexit() */
+	static void report();
+private:
+	/** name the method of a command from the call at the start of the subpacket */
+	static std::string methodName(DtaCommand * cmd);
+	static void printText(FILE * stream);
+	static void printJSON(FILE * stream);
+	static bool active;
+	static bool asJSON;
+	/* exec and the command it records run on the same thread */
+	static thread_local uint64_t pendingSendNs;
+	static thread_local uint64_t pendingRecvNs;
+	static thread_local uint32_t pendingPolls;
+	static std::map<std::string, DTA_STATS_DEVICE> devices;
+};
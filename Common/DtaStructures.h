@@ -280,6 +280,12 @@ typedef enum _DTA_DEVICE_TYPE {
 } DTA_DEVICE_TYPE;
 
 /** structure to store Disk information. */
+/** A run of logical blocks */
+typedef struct _DTA_EXTENT {
+    uint64_t start;   /**< first LBA */
+    uint64_t length;  /**< number of blocks */
+} DTA_EXTENT;
+
 typedef struct _OPAL_DiskInfo {
     // parsed the Function block?
 	uint8_t Unknown;
@@ -0,0 +1,266 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#include "DtaTrace.h"
+
+using namespace std;
+
+FILE * DtaTrace::captureFile = NULL;
+bool DtaTrace::replayLoaded = false;
+map<string, deque<DtaTrace::DTA_TRACE_ENTRY> > DtaTrace::replays;
+DtaTrace::DTA_TRACE_ENTRY DtaTrace::current;
+static mutex traceLock; // records of devices driven in parallel must not interleave
+
+/** fopen without the MSVC deprecation warning */
+static FILE * openTrace(const char * filename, const char * mode)
+{
+#if defined(_WIN32)
+	FILE * f = NULL;
+	if (0 != fopen_s(&f, filename, mode)) return NULL;
+	return f;
+#else
+	if ('w' != mode[0]) return fopen(filename, mode);
+	// the trace holds credentials, keep it to the owner
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0) return NULL;
+	if (fchmod(fd, S_IRUSR | S_IWUSR) < 0) {
+		close(fd);
+		return NULL;
+	}
+	FILE * f = fdopen(fd, mode);
+	if (NULL == f) close(fd);
+	return f;
+#endif
+}
+
+uint8_t DtaTrace::startCapture(const char * filename)
+{
+	LOG(D1) << "Entering DtaTrace::startCapture " << filename;
+	DTA_TRACE_FILEHEADER hdr;
+	lock_guard<mutex> guard(traceLock);
+	if (NULL != captureFile) fclose(captureFile);
+	captureFile = openTrace(filename, "wb");
+	if (NULL == captureFile) {
+		LOG(E) << "Unable to open trace file " << filename << " for writing";
+		return DTAERROR_OPEN_ERR;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DTA_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = DTA_TRACE_VERSION;
+	if (1 != fwrite(&hdr, sizeof(hdr), 1, captureFile)) {
+		LOG(E) << "Unable to write trace file " << filename;
+		fclose(captureFile);
+		captureFile = NULL;
+		return DTAERROR_TRACE_ERROR;
+	}
+	fflush(captureFile);
+	LOG(D1) << "Exiting DtaTrace::startCapture";
+	return 0;
+}
+
+uint8_t DtaTrace::startReplay(const char * filename)
+{
+	LOG(D1) << "Entering DtaTrace::startReplay " << filename;
+	DTA_TRACE_FILEHEADER hdr;
+	DTA_TRACE_ENTRY e;
+	string device;
+	size_t records = 0;
+	lock_guard<mutex> guard(traceLock);
+	replays.clear();
+	replayLoaded = false;
+	FILE * replayFile = openTrace(filename, "rb");
+	if (NULL == replayFile) {
+		LOG(E) << "Unable to open trace file " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	if ((1 != fread(&hdr, sizeof(hdr), 1, replayFile)) ||
+		memcmp(hdr.magic, DTA_TRACE_MAGIC, sizeof(hdr.magic)) ||
+		(DTA_TRACE_VERSION != hdr.version)) {
+		LOG(E) << filename << " is not a sedutil trace file or has the wrong version";
+		fclose(replayFile);
+		return DTAERROR_TRACE_ERROR;
+	}
+	// read it all up front so each device is served its own records
+	while (1 == fread(&e.rec, sizeof(e.rec), 1, replayFile)) {
+		device.resize(e.rec.devlen);
+		e.payload.resize(e.rec.length);
+		if ((e.rec.devlen && (e.rec.devlen != fread(&device[0], 1, e.rec.devlen, replayFile))) ||
+			(e.rec.length && (e.rec.length != fread(e.payload.data(), 1, e.rec.length, replayFile)))) {
+			LOG(E) << "Trace file " << filename << " is truncated";
+			fclose(replayFile);
+			replays.clear();
+			return DTAERROR_TRACE_ERROR;
+		}
+		replays[device].push_back(e);
+		records++;
+	}
+	fclose(replayFile);
+	replayLoaded = true;
+	LOG(D1) << "Exiting DtaTrace::startReplay " << records << " records of "
+		<< replays.size() << " devices";
+	return 0;
+}
+
+void DtaTrace::stop()
+{
+	lock_guard<mutex> guard(traceLock);
+	if (NULL != captureFile) fclose(captureFile);
+	captureFile = NULL;
+	replays.clear();
+	replayLoaded = false;
+}
+
+bool DtaTrace::capturing() { return (NULL != captureFile); }
+bool DtaTrace::replaying() { return replayLoaded; }
+
+void DtaTrace::write(const char * dev, uint8_t cmd, uint8_t protocol,
+	uint16_t comID, uint8_t status, uint32_t bufferlen,
+	void * data, uint32_t length)
+{
+	DTA_TRACE_RECORD rec;
+	size_t devlen = strnlen(dev, 255);
+	lock_guard<mutex> guard(traceLock);
+	if (NULL == captureFile) return; // stopped meanwhile
+	memset(&rec, 0, sizeof(rec));
+	rec.timestamp = (uint64_t)chrono::duration_cast<chrono::microseconds>(
+		chrono::system_clock::now().time_since_epoch()).count();
+	rec.bufferlen = bufferlen;
+	rec.length = length;
+	rec.comID = comID;
+	rec.cmd = cmd;
+	rec.protocol = protocol;
+	rec.status = status;
+	rec.devlen = (uint8_t)devlen;
+	if ((1 != fwrite(&rec, sizeof(rec), 1, captureFile)) ||
+		(devlen != fwrite(dev, 1, devlen, captureFile)) ||
+		(length != fwrite(data, 1, length, captureFile))) {
+		LOG(E) << "Write to trace file failed, capture stopped";
+		fclose(captureFile);
+		captureFile = NULL;
+		return;
+	}
+	// flush every record so a trace of a hung drive is complete
+	fflush(captureFile);
+}
+
+void DtaTrace::record(const char * dev, ATACOMMAND cmd, uint8_t protocol,
+	uint16_t comID, void * buffer, uint32_t bufferlen, uint8_t status)
+{
+	if (NULL == captureFile) return;
+	uint8_t * buf = (uint8_t *)buffer;
+	uint32_t length = bufferlen;
+	// the buffers are mostly zero fill, replay pads them back out
+	while ((length > 0) && (0 == buf[length - 1])) length--;
+	write(dev, cmd, protocol, comID, status, bufferlen, buffer, length);
+}
+
+void DtaTrace::recordIdentify(const char * dev, OPAL_DiskInfo & disk_info)
+{
+	if (NULL == captureFile) return;
+	DTA_TRACE_IDENTIFY id;
+	id.devType = (uint8_t)disk_info.devType;
+	memcpy(id.serialNum, disk_info.serialNum, sizeof(id.serialNum));
+	memcpy(id.firmwareRev, disk_info.firmwareRev, sizeof(id.firmwareRev));
+	memcpy(id.modelNum, disk_info.modelNum, sizeof(id.modelNum));
+	write(dev, IDENTIFY, 0, 0, 0, sizeof(id), &id, sizeof(id));
+}
+
+DtaTrace::DTA_TRACE_ENTRY * DtaTrace::next(const char * dev, uint8_t cmd)
+{
+	if (!replayLoaded) return NULL;
+	map<string, deque<DTA_TRACE_ENTRY> >::iterator q = replays.find(dev);
+	if ((replays.end() == q) && (1 == replays.size())) {
+		q = replays.begin();
+		LOG(D) << "Trace recorded on " << q->first << " replayed on " << dev;
+	}
+	if (replays.end() == q) {
+		LOG(E) << "The trace holds no traffic of " << dev;
+		return NULL;
+	}
+	if (q->second.empty()) {
+		LOG(E) << "End of trace reached for " << dev;
+		return NULL;
+	}
+	current = q->second.front();
+	q->second.pop_front();
+	if (cmd != current.rec.cmd) {
+		LOG(E) << "Trace out of step, expected command " << HEXON(2) << (uint16_t)cmd
+			<< " found " << HEXON(2) << (uint16_t)current.rec.cmd << HEXOFF;
+		return NULL;
+	}
+	return &current;
+}
+
+uint8_t DtaTrace::replay(const char * dev, ATACOMMAND cmd, uint8_t protocol,
+	uint16_t comID, void * buffer, uint32_t bufferlen)
+{
+	DTA_TRACE_ENTRY * e;
+	uint8_t * buf = (uint8_t *)buffer;
+	lock_guard<mutex> guard(traceLock);
+	if (NULL == (e = next(dev, cmd))) return 0xff;
+	DTA_TRACE_RECORD & rec = e->rec;
+	if ((protocol != rec.protocol) || (comID != rec.comID)) {
+		LOG(W) << "Trace out of step, protocol " << HEXON(2) << (uint16_t)protocol
+			<< " comID " << HEXON(4) << comID << " recorded as protocol "
+			<< HEXON(2) << (uint16_t)rec.protocol << " comID " << HEXON(4) << rec.comID << HEXOFF;
+	}
+	if (IF_RECV == cmd) {
+		if (rec.length > bufferlen) {
+			LOG(E) << "Recorded response does not fit the receive buffer";
+			return 0xff;
+		}
+		memcpy(buf, e->payload.data(), rec.length);
+		memset(buf + rec.length, 0, bufferlen - rec.length);
+	}
+	else {
+		uint32_t length = bufferlen;
+		while ((length > 0) && (0 == buf[length - 1])) length--;
+		if ((length != rec.length) || memcmp(buf, e->payload.data(), length)) {
+			LOG(D) << "Command differs from the one recorded in the trace";
+		}
+	}
+	return rec.status;
+}
+
+uint8_t DtaTrace::replayIdentify(const char * dev, OPAL_DiskInfo & disk_info)
+{
+	DTA_TRACE_ENTRY * e;
+	DTA_TRACE_IDENTIFY * id;
+	lock_guard<mutex> guard(traceLock);
+	if (NULL == (e = next(dev, IDENTIFY))) return DTAERROR_TRACE_ERROR;
+	if (sizeof(DTA_TRACE_IDENTIFY) != e->rec.length) {
+		LOG(E) << "Bad identify record in trace";
+		return DTAERROR_TRACE_ERROR;
+	}
+	id = (DTA_TRACE_IDENTIFY *)e->payload.data();
+	disk_info.devType = (DTA_DEVICE_TYPE)id->devType;
+	memcpy(disk_info.serialNum, id->serialNum, sizeof(id->serialNum));
+	memcpy(disk_info.firmwareRev, id->firmwareRev, sizeof(id->firmwareRev));
+	memcpy(disk_info.modelNum, id->modelNum, sizeof(id->modelNum));
+	return 0;
+}
@@ -0,0 +1,139 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include "DtaStructures.h"
+
+/** Binary capture and replay of the traffic between sedutil and a drive.
+ *
+ * A trace file is a DTA_TRACE_FILEHEADER followed by any number of records.
+ * Each record is a DTA_TRACE_RECORD, the device name (devlen bytes, no NUL)
+ * and then length bytes of payload.  IF_SEND and IF_RECV records carry the
+ * command buffer with trailing zero bytes trimmed, IDENTIFY records carry a
+ * DTA_TRACE_IDENTIFY.  Integers are stored in host byte order, a trace from
+ * a machine of the other endianess is rejected by the version check.
+ * The commands carry passwords (hashed unless -n) and C_PIN values, so
+ * the file is created readable by its owner only.
+ */
+#pragma pack(push,1)
+typedef struct _DTA_TRACE_FILEHEADER {
+	char magic[8];       /**< "DTATRACE" */
+	uint16_t version;    /**< DTA_TRACE_VERSION */
+	uint16_t reserved0;
+	uint32_t reserved1;
+} DTA_TRACE_FILEHEADER;
+
+typedef struct _DTA_TRACE_RECORD {
+	uint64_t timestamp;  /**< microseconds since the epoch */
+	uint32_t bufferlen;  /**< length of the buffer handed to the OS layer */
+	uint32_t length;     /**< number of payload bytes that follow the device name */
+	uint16_t comID;      /**< communications ID */
+	uint8_t cmd;         /**< ATACOMMAND */
+	uint8_t protocol;    /**< security protocol */
+	uint8_t status;      /**< return code of the OS layer */
+	uint8_t devlen;      /**< length of the device name */
+	uint16_t reserved;
+} DTA_TRACE_RECORD;
+
+typedef struct _DTA_TRACE_IDENTIFY {
+	uint8_t devType;
+	uint8_t serialNum[20];
+	uint8_t firmwareRev[8];
+	uint8_t modelNum[40];
+} DTA_TRACE_IDENTIFY;
+#pragma pack(pop)
+
+#define DTA_TRACE_MAGIC "DTATRACE"
+#define DTA_TRACE_VERSION 1
+
+/** Process wide capture and replay of drive traffic.
+ * Capture is fed by the OS layer after every command, replay is consumed
+ * by the replay drive backend in the order the commands were issued to
+ * each device, so several device objects opened on the same drive share
+ * its records.  Each record is written whole under a lock, so devices
+ * driven from several threads still produce a well formed capture that
+ * replays per device whatever order the threads run in.  A trace of a
+ * single device may be replayed under another device name.
+ */
+class DtaTrace {
+public:
+	/** Start writing a trace file, any existing file is overwritten
+	 * @param filename the file to write
+	 */
+	static uint8_t startCapture(const char * filename);
+	/** Read a trace file to be fed back through the replay backend
+	 * @param filename the file to read
+	 */
+	static uint8_t startReplay(const char * filename);
+	/** Close any open capture or replay file */
+	static void stop();
+	/** Is a capture running */
+	static bool capturing();
+	/** Is a replay running */
+	static bool replaying();
+	/** Record one IF_SEND or IF_RECV
+	 * @param dev the device the command was sent to
+	 * @param cmd IF_SEND or IF_RECV
+	 * @param protocol security protocol used in the command
+	 * @param comID communications ID used
+	 * @param buffer the command buffer
+	 * @param bufferlen length of the command buffer
+	 * @param status return code from the OS layer
+	 */
+	static void record(const char * dev, ATACOMMAND cmd, uint8_t protocol,
+		uint16_t comID, void * buffer, uint32_t bufferlen, uint8_t status);
+	/** Record the identify fields of a device
+	 * @param dev the device
+	 * @param disk_info the structure filled in by the identify
+	 */
+	static void recordIdentify(const char * dev, OPAL_DiskInfo & disk_info);
+	/** Replay the next IF_SEND or IF_RECV from the trace.
+	 * An IF_RECV fills the buffer from the trace, an IF_SEND is compared
+	 * against the recorded command and a difference is logged.
+	 * Parameters as for record(), returns the recorded status.
+	 */
+	static uint8_t replay(const char * dev, ATACOMMAND cmd, uint8_t protocol,
+		uint16_t comID, void * buffer, uint32_t bufferlen);
+	/** Replay the next identify from the trace
+	 * @param dev the device
+	 * @param disk_info the structure to be filled in
+	 */
+	static uint8_t replayIdentify(const char * dev, OPAL_DiskInfo & disk_info);
+private:
+	static void write(const char * dev, uint8_t cmd, uint8_t protocol,
+		uint16_t comID, uint8_t status, uint32_t bufferlen,
+		void * payload, uint32_t length);
+	/** one record read back from a trace */
+	typedef struct _DTA_TRACE_ENTRY {
+		DTA_TRACE_RECORD rec;
+		std::vector<uint8_t> payload;
+	} DTA_TRACE_ENTRY;
+	/** take the next record of dev off its queue, NULL if out of step */
+	static DTA_TRACE_ENTRY * next(const char * dev, uint8_t cmd);
+	static FILE * captureFile;
+	static bool replayLoaded;  /**< a trace has been read for replay */
+	/** the records of the trace being replayed, per recorded device name */
+	static std::map<std::string, std::deque<DTA_TRACE_ENTRY> > replays;
+	static DTA_TRACE_ENTRY current;  /**< the record last taken off a queue */
+};
@@ -0,0 +1,187 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include "DtaUIDTable.h"
+#include "DtaLexicon.h"
+
+using namespace std;
+
+static_assert(sizeof(OPALUIDNAME) / sizeof(OPALUIDNAME[0]) == sizeof(OPALUID) / sizeof(OPALUID[0]),
+	"OPALUIDNAME must name every OPALUID entry");
+static_assert(sizeof(OPALMETHODNAME) / sizeof(OPALMETHODNAME[0]) == sizeof(OPALMETHOD) / sizeof(OPALMETHOD[0]),
+	"OPALMETHODNAME must name every OPALMETHOD entry");
+
+typedef struct _uidname {
+	uint64_t uid;
+	const char * name;
+} uidname;
+
+/** UIDs that are not in the lexicon but show up in traffic */
+static const uidname extranames[] = {
+	{ 0x000000000000FF03ULL, "SyncSession" },
+	{ 0x000000000000FF04ULL, "StartTrustedSession" },
+	{ 0x000000000000FF05ULL, "SyncTrustedSession" },
+	{ 0x000000000000FF06ULL, "CloseSession" },
+	{ 0x0000000100000000ULL, "Table" },
+	{ 0x0000000200000000ULL, "SPInfo" },
+	{ 0x0000000800000000ULL, "ACE" },
+	{ 0x0000020500000000ULL, "SP" },
+	{ 0x0000080200000000ULL, "Locking" },
+	{ 0x0000080300000000ULL, "MBRControl_Table" },
+	{ 0x0000080500000000ULL, "K_AES_128" },
+	{ 0x0000080600000000ULL, "K_AES_256" },
+	{ 0x0000080600000001ULL, "K_AES_256_GlobalRange_Key" },
+};
+
+/** Numbered families, the masked off bits less base give the number */
+typedef struct _uidfamily {
+	uint64_t uid;
+	uint64_t mask;
+	uint16_t base;
+	const char * name;
+} uidfamily;
+
+static const uidfamily families[] = {
+	{ 0x0000000900010000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "Admin%u" },
+	{ 0x0000000900030000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "User%u" },
+	{ 0x0000000900008000ULL, 0xFFFFFFFFFFFFF000ULL, 1, "BandMaster%u" },
+	{ 0x0000000B00010000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "C_PIN_Admin%u" },
+	{ 0x0000000B00030000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "C_PIN_User%u" },
+	{ 0x0000000B00008000ULL, 0xFFFFFFFFFFFFF000ULL, 1, "C_PIN_BandMaster%u" },
+	{ 0x000000080003E000ULL, 0xFFFFFFFFFFFFFF00ULL, 0, "ACE_Locking_Range%u_Set_RdLocked" },
+	{ 0x000000080003E800ULL, 0xFFFFFFFFFFFFFF00ULL, 0, "ACE_Locking_Range%u_Set_WrLocked" },
+	{ 0x0000080200030000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "Locking_Range%u" },
+	{ 0x0000080200000000ULL, 0xFFFFFFFFFFFF0000ULL, 1, "Band%u" },
+	{ 0x0000080500030000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "K_AES_128_Range%u_Key" },
+	{ 0x0000080600030000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "K_AES_256_Range%u_Key" },
+	{ 0x0000080600000000ULL, 0xFFFFFFFFFFFF0000ULL, 1, "Band%u_AES_256" },
+	{ 0x0000100100000000ULL, 0xFFFFFFFFFFFF0000ULL, 0, "DataStore%u" },
+};
+
+static uint64_t uid2int(const uint8_t uid[8])
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++) v = (v << 8) | uid[i];
+	return v;
+}
+
+static void int2uid(uint64_t v, uint8_t uid[8])
+{
+	for (int i = 7; i >= 0; i--) {
+		uid[i] = (uint8_t)v;
+		v >>= 8;
+	}
+}
+
+static bool uidless(const uidname & a, const uidname & b) { return a.uid < b.uid; }
+
+/** The sorted table, built on first use */
+static const vector<uidname> & uidtable()
+{
+	static const vector<uidname> table = [] {
+		vector<uidname> t;
+		// half UIDs and the omitted parameter marker are not real objects
+		for (int i = 0; i < OPAL_UID::OPAL_HALF_UID_AUTHORITY_OBJ_REF; i++)
+			t.push_back({ uid2int(OPALUID[i]), OPALUIDNAME[i] });
+		for (size_t i = 0; i < sizeof(OPALMETHOD) / sizeof(OPALMETHOD[0]); i++)
+			t.push_back({ uid2int(OPALMETHOD[i]), OPALMETHODNAME[i] });
+		for (size_t i = 0; i < sizeof(extranames) / sizeof(extranames[0]); i++)
+			t.push_back(extranames[i]);
+		stable_sort(t.begin(), t.end(), uidless);
+		return t;
+	}();
+	return table;
+}
+
+const char * DtaUIDName(const uint8_t uid[8], char * buf, size_t buflen)
+{
+	const vector<uidname> & table = uidtable();
+	uidname key = { uid2int(uid), NULL };
+	vector<uidname>::const_iterator it = lower_bound(table.begin(), table.end(), key, uidless);
+	if ((it != table.end()) && (it->uid == key.uid))
+		return it->name;
+	for (size_t i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+		if ((key.uid & families[i].mask) != families[i].uid) continue;
+		uint64_t n = key.uid & ~families[i].mask;
+		if (n < families[i].base) continue;
+		snprintf(buf, buflen, families[i].name, (unsigned int)(n - families[i].base));
+		return buf;
+	}
+	return NULL;
+}
+
+/** match name against a family format, returning the number */
+static bool familymatch(const char * name, const char * format, unsigned long * n)
+{
+	const char * pct = strstr(format, "%u");
+	size_t prefix = pct - format;
+	char * end;
+	if (strncasecmp(name, format, prefix)) return false;
+	if (!isdigit((unsigned char)name[prefix])) return false;
+	*n = strtoul(name + prefix, &end, 10);
+	return (0 == strcasecmp(end, pct + 2));
+}
+
+uint8_t DtaUIDLookup(const char * name, uint8_t uid[8])
+{
+	const vector<uidname> & table = uidtable();
+	size_t len = strnlen(name, 64);
+	if ((16 == len) && (strspn(name, "0123456789abcdefABCDEF") == 16)) {
+		uint64_t v = 0;
+		for (size_t i = 0; i < 16; i++) {
+			char c = name[i];
+			v = (v << 4) | (uint64_t)(isdigit((unsigned char)c) ? c - '0' : (c & 0x0f) + 9);
+		}
+		int2uid(v, uid);
+		return 0;
+	}
+	for (vector<uidname>::const_iterator it = table.begin(); it != table.end(); ++it) {
+		if (!strcasecmp(name, it->name)) {
+			int2uid(it->uid, uid);
+			return 0;
+		}
+	}
+	for (size_t i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+		unsigned long n;
+		if (!familymatch(name, families[i].name, &n)) continue;
+		n += families[i].base;
+		if (n & families[i].mask) continue; // too big for this family, try the others
+		int2uid(families[i].uid | n, uid);
+		return 0;
+	}
+	LOG(E) << "Unknown UID " << name;
+	return DTAERROR_INVALID_PARAMETER;
+}
+
+uint8_t DtaUIDToken(const char * name, vector<uint8_t> & token)
+{
+	uint8_t uid[8];
+	uint8_t lastRC;
+	if ((lastRC = DtaUIDLookup(name, uid)) != 0)
+		return lastRC;
+	token.clear();
+	token.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	token.insert(token.end(), uid, uid + 8);
+	return 0;
+}
@@ -0,0 +1,51 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Symbolic names for the UIDs used in the TCG storage SSCs.
+ *
+ * The table is built once from OPALUID/OPALMETHOD and their name arrays in
+ * DtaLexicon.h plus a few well known UIDs sedutil does not otherwise use,
+ * sorted and searched by value.  Numbered families (Admin<n>, User<n>,
+ * BandMaster<n>, Locking_Range<n> ...) are recognized by a masked compare
+ * so every row of those tables gets a name.
+ */
+
+/** Look up the name of a UID
+ * @param uid the 8 byte UID
+ * @param buf buffer used to format the name of a numbered family member
+ * @param buflen size of buf
+ * @return the name, or NULL if the UID is not known
+ */
+const char * DtaUIDName(const uint8_t uid[8], char * buf, size_t buflen);
+/** Translate a UID name, or a UID written as 16 hex digits, to a UID
+ * @param name the name or hex string
+ * @param uid receives the 8 byte UID
+ * @return 0 on success, DTAERROR_INVALID_PARAMETER if the name is not known
+ */
+uint8_t DtaUIDLookup(const char * name, uint8_t uid[8]);
+/** Translate a UID name or hex string to a BYTESTRING8 token
+ * @param name the name or hex string
+ * @param token receives the atom header and the 8 byte UID
+ */
+uint8_t DtaUIDToken(const char * name, std::vector<uint8_t> & token);
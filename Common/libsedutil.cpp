@@ -0,0 +1,263 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include "libsedutil.h"
+#include "DtaDev.h"
+#include "DtaSession.h"
+#include "DtaCommand.h"
+#include "DtaResponse.h"
+#include "DtaStats.h"
+
+using namespace std;
+
+struct sedutil_dev {
+	DtaDev * d;
+	DtaSession * session;  /**< session from sedutil_session_start, NULL if none */
+	DtaResponse response;
+};
+
+/** Start an Admin1 Locking SP session unless the held one is to be used */
+static int startSession(sedutil_dev * dev, const char * password, DtaSession * & session)
+{
+	if (NULL == password) {
+		session = dev->session;
+		if (NULL == session) {
+			LOG(E) << "No password given and no session started";
+			return SEDUTIL_ERR_INVALID_PARAMETER;
+		}
+		return 0;
+	}
+	if (!dev->d->isOpal1() && !dev->d->isOpal2()) {
+		LOG(E) << "Only Opal drives are supported";
+		return SEDUTIL_ERR_INVALID_COMMAND;
+	}
+	vector<char> pw(password, password + strlen(password) + 1);
+	session = new DtaSession(dev->d);
+	int rc = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, pw.data(), OPAL_UID::OPAL_ADMIN1_UID);
+	memset(pw.data(), 0, pw.size());
+	if (rc) {
+		delete session;
+		session = NULL;
+	}
+	return rc;
+}
+
+/** End a session started by startSession for a single call */
+static void endSession(sedutil_dev * dev, DtaSession * session)
+{
+	if (session != dev->session) delete session;
+}
+
+/** Set columns of one row in the Locking SP */
+static int setColumns(sedutil_dev * dev, const char * password, const uint8_t row[8],
+	const vector<OPAL_TOKEN> & names, const vector<OPAL_TOKEN> & values)
+{
+	std::lock_guard<DtaDev> hold(*dev->d);
+	DtaSession * session;
+	int rc = startSession(dev, password, session);
+	if (rc) return rc;
+	DtaCommand * set = dev->d->getCommand();
+	if (NULL == set) {
+		LOG(E) << "Unable to create command object ";
+		endSession(dev, session);
+		return SEDUTIL_ERR_COMMAND;
+	}
+	set->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::SET);
+	set->changeInvokingUid(row);
+	set->addToken(OPAL_TOKEN::STARTLIST);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::VALUES);
+	set->addToken(OPAL_TOKEN::STARTLIST);
+	for (size_t i = 0; i < names.size(); i++) {
+		set->addToken(OPAL_TOKEN::STARTNAME);
+		set->addToken(names[i]);
+		set->addToken(values[i]);
+		set->addToken(OPAL_TOKEN::ENDNAME);
+	}
+	set->addToken(OPAL_TOKEN::ENDLIST);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::ENDLIST);
+	set->complete();
+	rc = session->sendCommand(set, dev->response);
+	dev->d->releaseCommand(set);
+	endSession(dev, session);
+	return rc;
+}
+
+/** set once the program chooses a log level, until then the library logs
+ * at its own default rather than the everything of the log.h default */
+static bool logLevelChosen = false;
+
+int sedutil_open(const char * devref, sedutil_dev ** dev)
+{
+	if (!logLevelChosen) sedutil_log_level(2);
+	LOG(D1) << "Entering sedutil_open " << devref;
+	if ((NULL == devref) || (NULL == dev)) return SEDUTIL_ERR_INVALID_PARAMETER;
+	*dev = NULL;
+	DtaDev * d;
+	int rc = DtaDev::getDevice(devref, d);
+	if (rc) return rc;
+	*dev = new sedutil_dev;
+	(*dev)->d = d;
+	(*dev)->session = NULL;
+	return 0;
+}
+
+void sedutil_close(sedutil_dev * dev)
+{
+	if (NULL == dev) return;
+	sedutil_session_end(dev);
+	delete dev->d;
+	delete dev;
+}
+
+int sedutil_query(sedutil_dev * dev, sedutil_state * state)
+{
+	if ((NULL == dev) || (NULL == state)) return SEDUTIL_ERR_INVALID_PARAMETER;
+	DtaDev * d = dev->d;
+	std::lock_guard<DtaDev> hold(*d);
+	memset(state, 0, sizeof(*state));
+	int rc = d->discovery0();
+	if (rc) return rc;
+	if (!d->isPresent() || !d->isAnySSC()) {
+		LOG(E) << "The drive does not answer Discovery 0 with a TCG SSC";
+		return SEDUTIL_ERR_COMMAND;
+	}
+	if (d->isOpal1()) state->ssc |= SEDUTIL_SSC_OPAL1;
+	if (d->isOpal2()) state->ssc |= SEDUTIL_SSC_OPAL2;
+	if (d->isEprise()) state->ssc |= SEDUTIL_SSC_ENTERPRISE;
+	state->locking_enabled = d->LockingEnabled();
+	state->locked = d->Locked();
+	state->mbr_enabled = d->MBREnabled();
+	state->mbr_done = d->MBRDone();
+	strncpy(state->serial, d->getSerialNum(), sizeof(state->serial) - 1);
+	strncpy(state->model, d->getModelNum(), sizeof(state->model) - 1);
+	strncpy(state->firmware, d->getFirmwareRev(), sizeof(state->firmware) - 1);
+	return 0;
+}
+
+int sedutil_session_start(sedutil_dev * dev, const char * password)
+{
+	LOG(D1) << "Entering sedutil_session_start";
+	if ((NULL == dev) || (NULL == password)) return SEDUTIL_ERR_INVALID_PARAMETER;
+	std::lock_guard<DtaDev> hold(*dev->d);
+	if (NULL != dev->session) return 0;
+	return startSession(dev, password, dev->session);
+}
+
+int sedutil_session_end(sedutil_dev * dev)
+{
+	if (NULL == dev) return SEDUTIL_ERR_INVALID_PARAMETER;
+	std::lock_guard<DtaDev> hold(*dev->d);
+	delete dev->session;  // closes the session with the drive
+	dev->session = NULL;
+	return 0;
+}
+
+int sedutil_set_range(sedutil_dev * dev, unsigned int range, int state,
+	const char * password)
+{
+	LOG(D1) << "Entering sedutil_set_range " << range;
+	if ((NULL == dev) || (range > 0xff)) return SEDUTIL_ERR_INVALID_PARAMETER;
+	OPAL_TOKEN readlocked, writelocked;
+	switch (state) {
+	case SEDUTIL_RANGE_RW:
+		readlocked = writelocked = OPAL_TOKEN::OPAL_FALSE;
+		break;
+	case SEDUTIL_RANGE_RO:
+		readlocked = OPAL_TOKEN::OPAL_FALSE;
+		writelocked = OPAL_TOKEN::OPAL_TRUE;
+		break;
+	case SEDUTIL_RANGE_LK:
+		readlocked = writelocked = OPAL_TOKEN::OPAL_TRUE;
+		break;
+	default:
+		return SEDUTIL_ERR_INVALID_PARAMETER;
+	}
+	uint8_t LR[8];
+	memcpy(LR, OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL], 8);
+	if (range != 0) {
+		LR[5] = 0x03;
+		LR[7] = (uint8_t)range;
+	}
+	return setColumns(dev, password, LR,
+		{ OPAL_TOKEN::READLOCKED, OPAL_TOKEN::WRITELOCKED }, { readlocked, writelocked });
+}
+
+int sedutil_set_mbr_done(sedutil_dev * dev, int done, const char * password)
+{
+	LOG(D1) << "Entering sedutil_set_mbr_done " << done;
+	if (NULL == dev) return SEDUTIL_ERR_INVALID_PARAMETER;
+	return setColumns(dev, password, OPALUID[OPAL_UID::OPAL_MBRCONTROL],
+		{ OPAL_TOKEN::MBRDONE }, { done ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE });
+}
+
+int sedutil_set_mbr_enable(sedutil_dev * dev, int enable, const char * password)
+{
+	LOG(D1) << "Entering sedutil_set_mbr_enable " << enable;
+	if (NULL == dev) return SEDUTIL_ERR_INVALID_PARAMETER;
+	return setColumns(dev, password, OPALUID[OPAL_UID::OPAL_MBRCONTROL],
+		{ OPAL_TOKEN::MBRDONE, OPAL_TOKEN::MBRENABLE },
+		{ OPAL_TOKEN::OPAL_TRUE, enable ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE });
+}
+
+int sedutil_set_timeout(sedutil_dev * dev, unsigned int ms)
+{
+	if (NULL == dev) return SEDUTIL_ERR_INVALID_PARAMETER;
+	std::lock_guard<DtaDev> hold(*dev->d);
+	dev->d->command_timeout = ms;
+	return 0;
+}
+
+void sedutil_stats_enable(int json)
+{
+	DtaStats::enable(0 != json);
+}
+
+void sedutil_stats_print(FILE * stream)
+{
+	DtaStats::print(stream);
+}
+
+void sedutil_log_level(int level)
+{
+	logLevelChosen = true;
+	CLog::Level() = CLog::FromInt(level);
+	RCLog::Level() = RCLog::FromInt(level);
+}
+
+const char * sedutil_strerror(int rc)
+{
+	switch (rc) {
+	case SEDUTIL_OK: return "success";
+	case SEDUTIL_ERR_NOT_AUTHORIZED: return "not authorized";
+	case SEDUTIL_ERR_SP_BUSY: return "SP busy";
+	case SEDUTIL_ERR_INVALID_PARAMETER: return "invalid parameter";
+	case SEDUTIL_ERR_OPEN: return "unable to open";
+	case SEDUTIL_ERR_INVALID_COMMAND: return "not supported by this drive";
+	case SEDUTIL_ERR_COMMAND: return "invalid or unsupported disk";
+	case SEDUTIL_ERR_TIMEOUT: return "timed out";
+	case SEDUTIL_ERR_CANCELLED: return "cancelled";
+	default: return (rc < 0x40) ? "method failed" : "internal error";
+	}
+}
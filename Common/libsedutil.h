@@ -0,0 +1,138 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#ifndef LIBSEDUTIL_H
+#define LIBSEDUTIL_H
+/** @file
+ * C interface to sedutil for programs that manage drives themselves.
+ *
+ * A drive is opened once and used through an opaque handle for as long
+ * as the program likes. Every call returns 0 on success, one of the
+ * SEDUTIL_ERR_ codes below or the TCG method status the drive returned
+ * (1 to 0x3f, SEDUTIL_ERR_NOT_AUTHORIZED being the usual one).
+ *
+ * Calls on a handle are serialized, a handle and the session started on
+ * it may be used from several threads; calls on different handles run in
+ * parallel. sedutil_close must be the last call on its handle.
+ */
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SEDUTIL_API_VERSION 1
+
+/* the library is built with hidden symbols, only these calls are exported */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define SEDUTIL_EXPORT __attribute__((visibility("default")))
+#else
+#define SEDUTIL_EXPORT
+#endif
+
+/* error codes, the same values the CLI exits with */
+#define SEDUTIL_OK                    0x00
+#define SEDUTIL_ERR_NOT_AUTHORIZED    0x01
+#define SEDUTIL_ERR_SP_BUSY           0x03
+#define SEDUTIL_ERR_INVALID_PARAMETER 0x83
+#define SEDUTIL_ERR_OPEN              0x84
+#define SEDUTIL_ERR_INVALID_COMMAND   0x86
+#define SEDUTIL_ERR_COMMAND           0x88
+#define SEDUTIL_ERR_TIMEOUT           0x8d
+#define SEDUTIL_ERR_CANCELLED         0x8e
+
+/* security subsystem classes, sedutil_state.ssc */
+#define SEDUTIL_SSC_OPAL1      0x01
+#define SEDUTIL_SSC_OPAL2      0x02
+#define SEDUTIL_SSC_ENTERPRISE 0x04
+
+/* locking range states */
+#define SEDUTIL_RANGE_RW 0x01
+#define SEDUTIL_RANGE_RO 0x02
+#define SEDUTIL_RANGE_LK 0x03
+
+/** An open drive */
+typedef struct sedutil_dev sedutil_dev;
+
+/** What the drive reports in its Level 0 Discovery and identify data */
+typedef struct sedutil_state {
+	unsigned int ssc;          /**< SEDUTIL_SSC_ bits */
+	int locking_enabled;
+	int locked;                /**< some range is locked */
+	int mbr_enabled;           /**< MBR shadowing is enabled */
+	int mbr_done;              /**< the shadow MBR is not presented */
+	char serial[21];
+	char model[41];
+	char firmware[9];
+} sedutil_state;
+
+/** Open a drive and identify its security subsystem
+ * @param devref the device, /dev/sda or \\.\PhysicalDrive0
+ * @param dev receives the handle
+ */
+SEDUTIL_EXPORT int sedutil_open(const char * devref, sedutil_dev ** dev);
+/** End any session and release the handle */
+SEDUTIL_EXPORT void sedutil_close(sedutil_dev * dev);
+/** Read the current state, the Level 0 Discovery is done again
+ * @param state receives the state
+ */
+SEDUTIL_EXPORT int sedutil_query(sedutil_dev * dev, sedutil_state * state);
+/** Start an Admin1 session on the Locking SP that later calls reuse
+ * until sedutil_session_end, a session that is already open is kept.
+ * @param password Admin1 password, hashed as the CLI does
+ */
+SEDUTIL_EXPORT int sedutil_session_start(sedutil_dev * dev, const char * password);
+/** End the session started by sedutil_session_start */
+SEDUTIL_EXPORT int sedutil_session_end(sedutil_dev * dev);
+/** Set the state of a locking range
+ * @param range 0 for the global range, 1..n
+ * @param state SEDUTIL_RANGE_RW, _RO or _LK
+ * @param password Admin1 password for a session of this call only,
+ *        NULL to use the session from sedutil_session_start
+ */
+SEDUTIL_EXPORT int sedutil_set_range(sedutil_dev * dev, unsigned int range, int state,
+	const char * password);
+/** Set or clear MBRDone, password as for sedutil_set_range */
+SEDUTIL_EXPORT int sedutil_set_mbr_done(sedutil_dev * dev, int done, const char * password);
+/** Enable or disable MBR shadowing, MBRDone is set in the same call so
+ * the shadow is not presented by surprise; password as for sedutil_set_range
+ */
+SEDUTIL_EXPORT int sedutil_set_mbr_enable(sedutil_dev * dev, int enable, const char * password);
+/** Give up on a command the drive has not answered in time
+ * @param ms milliseconds allowed per command, 0 for the default
+ */
+SEDUTIL_EXPORT int sedutil_set_timeout(sedutil_dev * dev, unsigned int ms);
+/** Start collecting per method latency statistics for all handles
+ * @param json report as JSON rather than as a table
+ */
+SEDUTIL_EXPORT void sedutil_stats_enable(int json);
+/** Print the statistics collected so far */
+SEDUTIL_EXPORT void sedutil_stats_print(FILE * stream);
+/** How much is logged to stderr
+ * @param level 0 errors only, 2 (the default) information, 7 everything
+ */
+SEDUTIL_EXPORT void sedutil_log_level(int level);
+/** A short description of a return code */
+SEDUTIL_EXPORT const char * sedutil_strerror(int rc);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -38,6 +38,7 @@
 #ifndef __LOG_H__
 #define __LOG_H__
 
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <stdio.h>
@@ -244,14 +245,25 @@ TLogLevel RLog<T>::FromInt(const int level) {
 }
 
 
+/* Messages are formatted in the Log object of the calling thread and
+ * written whole under a lock, so threads never interleave within a line.
+ * The levels and streams are meant to be set up before threads start.
+ */
 class Output2FILE {
 public:
     static FILE*& Stream();
     static FILE*& StreamStdout();
     static void Output(const std::string& msg);
     static void OutputErr(const std::string& msg);
+private:
+    static std::mutex& Lock();
 };
 
+inline std::mutex& Output2FILE::Lock() {
+    static std::mutex lock;
+    return lock;
+}
+
 inline FILE*& Output2FILE::StreamStdout() {
     static FILE* pStream = stdout;
     return pStream;
@@ -263,6 +275,7 @@ inline FILE*& Output2FILE::Stream() {
 }
 
 inline void Output2FILE::OutputErr(const std::string& msg) {
+    std::lock_guard<std::mutex> guard(Lock());
     FILE* pStream = Stream();
     if (!pStream)
         return;
@@ -271,6 +284,7 @@ inline void Output2FILE::OutputErr(const std::string& msg) {
 }
 
 inline void Output2FILE::Output(const std::string& msg) {
+    std::lock_guard<std::mutex> guard(Lock());
     FILE* pStream = StreamStdout();
     if (!pStream)
         return;
@@ -18,6 +18,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 
 * C:E********************************************************************** */
 #include <iostream>
+#include <signal.h>
 #include "os.h"
 #include "DtaHashPwd.h"
 #include "DtaOptions.h"
@@ -26,11 +27,24 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaDevOpal1.h"
 #include "DtaDevOpal2.h"
 #include "DtaDevEnterprise.h"
+#include "DtaTrace.h"
+#include "DtaStats.h"
+#include "DtaLockWatch.h"
 
 using namespace std;
 
-/* Default to output that omits timestamps and goes to stdout */
-sedutiloutput outputFormat = sedutilReadable;
+/** set by the first ^C, the command in flight is abandoned */
+static volatile sig_atomic_t interrupted = 0;
+static void interrupt(int sig)
+{
+	interrupted = 1;
+	signal(sig, SIG_DFL); // a second ^C ends the program at once
+}
+/** cancel hook of the device, see DtaDev::setCancelHook */
+static bool cancelled(void *)
+{
+	return 0 != interrupted;
+}
 
 int isValidSEDDisk(char *devname)
 {
@@ -50,50 +64,75 @@ int isValidSEDDisk(char *devname)
 	return 0;
 }
 
+/** Report lock state changes of a comma separated list of drives until killed */
+uint8_t watchLockState(char * seconds, char * devnames)
+{
+	DtaLockWatch watch;
+	uint32_t added = 0;
+	string names(devnames);
+	size_t start = 0;
+	if (atoi(seconds) < 1) {
+		LOG(E) << "Invalid interval " << seconds << ", it is in whole seconds";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	while (start <= names.size()) {
+		size_t comma = names.find(',', start);
+		if (string::npos == comma) comma = names.size();
+		string name = names.substr(start, comma - start);
+		start = comma + 1;
+		if (name.empty()) continue;
+		if (!watch.add(name.c_str())) {
+			LOG(E) << "Unable to open " << name;
+			continue;
+		}
+		added++;
+	}
+	if (!added) return DTAERROR_OPEN_ERR;
+	watch.run(atoi(seconds) * 1000);
+	return 0;
+}
+
 int main(int argc, char * argv[])
 {
 	DTA_OPTIONS opts;
-	DtaDev *tempDev = NULL, *d = NULL;
+	DtaDev *d = NULL;
+	uint8_t rc;
+	/* Default to output that omits timestamps and goes to stdout */
+	outputFormat = sedutilReadable;
 	if (DtaOptions(argc, argv, &opts)) {
 		return DTAERROR_COMMAND_ERROR;
 	}
+	if ((opts.capturefile) && (DtaTrace::startCapture(argv[opts.capturefile])))
+		return DTAERROR_TRACE_ERROR;
+	if ((opts.replayfile) && (DtaTrace::startReplay(argv[opts.replayfile])))
+		return DTAERROR_TRACE_ERROR;
+	if (opts.stats) {
+		DtaStats::enable(opts.statsJSON);
+		atexit(DtaStats::report);
+	}
 	
 	if ((opts.action != sedutiloption::scan) && 
+		(opts.action != sedutiloption::unlockAgent) &&
+		(opts.action != sedutiloption::verifyErase) &&
+		!((opts.action == sedutiloption::eraseFingerprint) && (DTA_WHOLE_DEVICE == opts.lockingrange)) &&
+		(opts.action != sedutiloption::watchLocking) &&
 		(opts.action != sedutiloption::validatePBKDF2) &&
 		(opts.action != sedutiloption::isValidSED)) {
 		if (opts.device > (argc - 1)) opts.device = 0;
-		tempDev = new DtaDevGeneric(argv[opts.device]);
-		if (NULL == tempDev) {
-			LOG(E) << "Create device object failed";
-			return DTAERROR_OBJECT_CREATE_FAILED;
-		}
-		if ((!tempDev->isPresent()) || (!tempDev->isAnySSC())) {
-			LOG(E) << "Invalid or unsupported disk " << argv[opts.device];
-			delete tempDev;
-			return DTAERROR_COMMAND_ERROR;
-		}
-		if (tempDev->isOpal2())
-			d = new DtaDevOpal2(argv[opts.device]);
-		else
-			if (tempDev->isOpal1())
-				d = new DtaDevOpal1(argv[opts.device]);
-			else
-				if (tempDev->isEprise())
-					d = new DtaDevEnterprise(argv[opts.device]);
-				else
-				{
-					LOG(E) << "Unknown OPAL SSC ";
-					return DTAERROR_INVALID_COMMAND;
-				}
-		delete tempDev;
-		if (NULL == d) {
-			LOG(E) << "Create device object failed";
-			return DTAERROR_OBJECT_CREATE_FAILED;
-		}
+		if ((rc = DtaDev::getDevice(argv[opts.device], d)) != 0)
+			return rc;
 		// make sure DtaDev::no_hash_passwords is initialized
 		d->no_hash_passwords = opts.no_hash_passwords;
+		d->multistart = opts.multistart;
+		d->stack_reset = opts.stack_reset;
+		d->tper_reset = opts.tper_reset;
 
 		d->output_format = opts.output_format;
+		if (opts.timeout)
+			d->command_timeout = atoi(argv[opts.timeout]) * 1000;
+		// ^C abandons the command rather than leaving the session open
+		d->setCancelHook(cancelled, NULL);
+		signal(SIGINT, interrupt);
 	}
 
     switch (opts.action) {
@@ -118,6 +157,18 @@ int main(int argc, char * argv[])
         LOG(D) << "Loading PBA image " << argv[opts.pbafile] << " to " << opts.device;
         return d->loadPBA(argv[opts.password], argv[opts.pbafile]);
 		break;
+	case sedutiloption::readDataStore:
+		LOG(D) << "Reading DataStore to " << argv[opts.datastorefile];
+		return d->readDataStore(argv[opts.password], argv[opts.datastorefile]);
+		break;
+	case sedutiloption::writeDataStore:
+		LOG(D) << "Writing " << argv[opts.datastorefile] << " to DataStore";
+		return d->writeDataStore(argv[opts.password], argv[opts.datastorefile]);
+		break;
+	case sedutiloption::provisionUsers:
+		LOG(D) << "Provisioning users from " << argv[opts.specfile];
+		return d->provisionUsers(argv[opts.password], argv[opts.specfile]);
+		break;
 	case sedutiloption::setLockingRange:
         LOG(D) << "Setting Locking Range " << (uint16_t) opts.lockingrange << " " << (uint16_t) opts.lockingstate;
         return d->setLockingRange(opts.lockingrange, opts.lockingstate, argv[opts.password]);
@@ -159,6 +210,18 @@ int main(int argc, char * argv[])
 		LOG(D) << "List Locking Range[" << opts.lockingrange << "]";
 		return (d->listLockingRanges(argv[opts.password], opts.lockingrange));
 		break;
+	case sedutiloption::applyRangeLayout:
+		LOG(D) << "Applying Locking Range layout " << argv[opts.specfile];
+		return (d->applyRangeLayout(argv[opts.password], argv[opts.specfile]));
+		break;
+	case sedutiloption::reconcile:
+		LOG(D) << "Reconciling with " << argv[opts.specfile];
+		return (d->reconcile(argv[opts.password], argv[opts.specfile], false));
+		break;
+	case sedutiloption::reconcileDryRun:
+		LOG(D) << "Comparing with " << argv[opts.specfile];
+		return (d->reconcile(argv[opts.password], argv[opts.specfile], true));
+		break;
     case sedutiloption::rekeyLockingRange:
 		LOG(D) << "Rekey Locking Range[" << opts.lockingrange << "]";
 		return (d->rekeyLockingRange(opts.lockingrange, argv[opts.password]));
@@ -204,6 +267,12 @@ int main(int argc, char * argv[])
         LOG(D) << "Performing diskScan() ";
         return(DtaDevOS::diskScan());
         break;
+	case sedutiloption::unlockAgent:
+		LOG(D) << "Unlocking the drives listed in " << argv[opts.specfile] << " as they appear";
+		return DtaDevOS::unlockAgent(argv[opts.password], argv[opts.specfile]);
+	case sedutiloption::watchLocking:
+		LOG(D) << "Watching the lock state of " << argv[opts.device];
+		return watchLockState(argv[opts.interval], argv[opts.device]);
 	case sedutiloption::isValidSED:
 		LOG(D) << "Verify whether " << argv[opts.device] << "is valid SED or not";
         return isValidSEDDisk(argv[opts.device]);
@@ -251,6 +320,27 @@ int main(int argc, char * argv[])
 		LOG(D) << "Erase Locking Range " << (uint16_t)opts.lockingrange;
 		return (d->eraseLockingRange(opts.lockingrange, argv[opts.password]));
 		break;
+	case sedutiloption::eraseAllLockingRanges:
+		LOG(D) << "Erase all Locking Ranges";
+		return (d->eraseAllLockingRanges(argv[opts.password]));
+		break;
+	case sedutiloption::eraseFingerprint: {
+		vector<DTA_EXTENT> extents;
+		if (DTA_WHOLE_DEVICE == opts.lockingrange) {
+			// a revert erases everything, no need to ask the drive what
+			LOG(D) << "Fingerprinting a sample of all of " << argv[opts.device] << " to " << argv[opts.samplefile];
+			return DtaDevOS::eraseFingerprint(argv[opts.samplefile], argv[opts.device], extents, 512);
+		}
+		LOG(D) << "Fingerprinting a sample of range " << (uint16_t)opts.lockingrange << " of "
+			<< argv[opts.device] << " to " << argv[opts.samplefile];
+		if ((rc = d->getRangeExtents(opts.lockingrange, argv[opts.password], extents)) != 0)
+			return rc;
+		return DtaDevOS::eraseFingerprint(argv[opts.samplefile], argv[opts.device], extents,
+			d->getLogicalBlockSize());
+	}
+	case sedutiloption::verifyErase:
+		LOG(D) << "Verifying the erase of " << argv[opts.device] << " against " << argv[opts.samplefile];
+		return DtaDevOS::verifyErase(argv[opts.samplefile], argv[opts.device]);
 	case sedutiloption::objDump:
 		LOG(D) << "Performing objDump " ;
 		return d->objDump(argv[argc - 5], argv[argc - 4], argv[argc - 3], argv[argc - 2]);
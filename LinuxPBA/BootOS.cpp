@@ -0,0 +1,303 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+* C:E********************************************************************** */
+#include "os.h"
+#include "BootOS.h"
+#include "DtaDevLinuxScan.h"
+
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/reboot.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/kexec.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#define PBA_BOOT_MOUNT "/mnt/sedutil-boot"
+
+void GetBootOptions(PBA_BOOT & boot, const char * cmdline) {
+    boot.delay = 5;
+    boot.kexec = false;
+    boot.bootdev.clear();
+    boot.kernel.clear();
+    boot.initrd.clear();
+    boot.append.clear();
+    ifstream f(cmdline);
+    string line;
+    getline(f, line);
+    /* split on blanks, "" keeps blanks in a value */
+    vector<string> args;
+    string arg;
+    bool quoted = false;
+    for (uint32_t i = 0; i <= line.size(); i++) {
+        char c = (i < line.size()) ? line[i] : ' ';
+        if ('"' == c) quoted = !quoted;
+        else if (!quoted && ((' ' == c) || ('\t' == c) || ('\n' == c))) {
+            if (!arg.empty()) args.push_back(arg);
+            arg.clear();
+        }
+        else arg += c;
+    }
+    for (uint32_t i = 0; i < args.size(); i++) {
+        size_t eq = args[i].find('=');
+        if (string::npos == eq) continue;
+        string key = args[i].substr(0, eq);
+        string value = args[i].substr(eq + 1);
+        if ("sedutil.delay" == key) boot.delay = atoi(value.c_str());
+        else if ("sedutil.kexec" == key) boot.kexec = ("0" != value);
+        else if ("sedutil.bootdev" == key) boot.bootdev = value;
+        else if ("sedutil.kernel" == key) boot.kernel = value;
+        else if ("sedutil.initrd" == key) boot.initrd = value;
+        else if ("sedutil.append" == key) boot.append = value;
+    }
+    LOG(D1) << "Boot delay " << boot.delay << " kexec " << boot.kexec;
+}
+
+/* the drives were locked when the kernel first looked at them */
+static void RereadPartitions() {
+    vector<DTA_BLOCKDEV> devices;
+    vector<string> disks;
+    DtaDevLinuxScan::enumerate(devices);
+    for (uint32_t i = 0; i < devices.size(); i++) {
+        if (!devices[i].candidate) continue;
+        if (devices[i].namespaces.empty())
+            disks.push_back(devices[i].devref);
+        for (uint32_t j = 0; j < devices[i].namespaces.size(); j++)
+            disks.push_back("/dev/" + devices[i].namespaces[j]);
+    }
+    for (uint32_t i = 0; i < disks.size(); i++) {
+        int fd = open(disks[i].c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        if (ioctl(fd, BLKRRPART) < 0) {
+            LOG(D1) << "BLKRRPART failed on " << disks[i] << " " << strerror(errno);
+        }
+        close(fd);
+    }
+}
+
+static vector<string> Partitions() {
+    vector<string> partitions;
+    struct stat st;
+    DIR * dir = opendir("/sys/class/block");
+    if (NULL == dir) return partitions;
+    struct dirent * dirent;
+    while (NULL != (dirent = readdir(dir))) {
+        string attr = string("/sys/class/block/") + dirent->d_name + "/partition";
+        if (!stat(attr.c_str(), &st))
+            partitions.push_back(string("/dev/") + dirent->d_name);
+    }
+    closedir(dir);
+    std::sort(partitions.begin(), partitions.end());
+    return partitions;
+}
+
+/* the kernel, initrd and command line of the OS's default boot entry */
+typedef struct _BOOT_ENTRY {
+    string kernel;
+    string initrd;
+    string options;
+} BOOT_ENTRY;
+
+static vector<string> SplitWords(const string & line) {
+    vector<string> words;
+    string word;
+    for (uint32_t i = 0; i <= line.size(); i++) {
+        char c = (i < line.size()) ? line[i] : ' ';
+        if ((' ' == c) || ('\t' == c) || ('\r' == c)) {
+            if (!word.empty()) words.push_back(word);
+            word.clear();
+        }
+        else word += c;
+    }
+    return words;
+}
+
+/* systemd-boot / BLS entries, the highest version is the default */
+static bool ReadLoaderEntry(BOOT_ENTRY & entry, const char * dirname) {
+    string path = string(PBA_BOOT_MOUNT) + dirname;
+    DIR * dir = opendir(path.c_str());
+    if (NULL == dir) return false;
+    vector<string> names;
+    struct dirent * dirent;
+    while (NULL != (dirent = readdir(dir))) {
+        string name = dirent->d_name;
+        if ((name.size() > 5) && (".conf" == name.substr(name.size() - 5)))
+            names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.rbegin(), names.rend());
+    for (uint32_t i = 0; i < names.size(); i++) {
+        ifstream f((path + "/" + names[i]).c_str());
+        BOOT_ENTRY e;
+        string line;
+        while (getline(f, line)) {
+            vector<string> words = SplitWords(line);
+            if (words.size() < 2) continue;
+            if ("linux" == words[0]) e.kernel = words[1];
+            else if (("initrd" == words[0]) && e.initrd.empty()) e.initrd = words[1];
+            else if ("options" == words[0])
+                for (uint32_t j = 1; j < words.size(); j++)
+                    e.options += (e.options.empty() ? "" : " ") + words[j];
+        }
+        if (e.kernel.empty() || e.options.empty()) continue;
+        LOG(D1) << "Boot entry " << names[i];
+        entry = e;
+        return true;
+    }
+    return false;
+}
+
+/* the first menuentry of a GRUB config, grub variables are left out */
+static bool ReadGrubEntry(BOOT_ENTRY & entry, const char * filename) {
+    ifstream f((string(PBA_BOOT_MOUNT) + filename).c_str());
+    if (!f) return false;
+    bool inentry = false;
+    string line;
+    while (getline(f, line)) {
+        vector<string> words = SplitWords(line);
+        if (words.empty()) continue;
+        if ("menuentry" == words[0]) inentry = true;
+        else if (!inentry) continue;
+        else if ("}" == words[0]) break;
+        else if ((words.size() > 2) && (("linux" == words[0]) || ("linuxefi" == words[0]))) {
+            entry.kernel = words[1];
+            entry.options.clear();
+            for (uint32_t j = 2; j < words.size(); j++) {
+                if (string::npos != words[j].find('$')) continue;
+                entry.options += (entry.options.empty() ? "" : " ") + words[j];
+            }
+        }
+        else if ((words.size() > 1) && (("initrd" == words[0]) || ("initrdefi" == words[0])))
+            entry.initrd = words[1];
+    }
+    if (entry.kernel.empty() || entry.options.empty()) return false;
+    LOG(D1) << "Boot entry from " << filename;
+    return true;
+}
+
+static bool ReadBootEntry(BOOT_ENTRY & entry) {
+    static const char * loaders[] = { "/loader/entries", "/boot/loader/entries" };
+    static const char * grubs[] = { "/grub/grub.cfg", "/boot/grub/grub.cfg",
+        "/grub2/grub.cfg", "/boot/grub2/grub.cfg" };
+    for (uint32_t i = 0; i < sizeof(loaders) / sizeof(loaders[0]); i++)
+        if (ReadLoaderEntry(entry, loaders[i])) return true;
+    for (uint32_t i = 0; i < sizeof(grubs) / sizeof(grubs[0]); i++)
+        if (ReadGrubEntry(entry, grubs[i])) return true;
+    return false;
+}
+
+/* open the first of the paths that exists on the mounted partition,
+ * paths from a boot entry are relative to the partition or to /boot on it */
+static int OpenOnBootVolume(const string & wanted, const string & entry,
+        const char * fallback1, const char * fallback2) {
+    vector<string> paths;
+    if (!wanted.empty()) paths.push_back(wanted);
+    else if (!entry.empty()) {
+        paths.push_back(entry);
+        paths.push_back("/boot" + entry);
+    }
+    else {
+        paths.push_back(fallback1);
+        paths.push_back(fallback2);
+    }
+    for (uint32_t i = 0; i < paths.size(); i++) {
+        int fd = open((string(PBA_BOOT_MOUNT) + paths[i]).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            LOG(D1) << "Found " << paths[i];
+            return fd;
+        }
+    }
+    return -1;
+}
+
+static bool TryKexec(const PBA_BOOT & boot, const string & partition) {
+    static const char * fstypes[] = { "ext4", "xfs", "btrfs", "vfat", "ext3", "ext2" };
+    bool mounted = false;
+    for (uint32_t i = 0; !mounted && (i < sizeof(fstypes) / sizeof(fstypes[0])); i++)
+        mounted = !mount(partition.c_str(), PBA_BOOT_MOUNT, fstypes[i], MS_RDONLY, NULL);
+    if (!mounted) return false;
+    bool loaded = false;
+    /* without sedutil.append the OS's own boot config says how to start it,
+     * a guessed root= would not survive LVM, crypto or a separate /boot */
+    BOOT_ENTRY entry;
+    if (boot.append.empty() && !ReadBootEntry(entry)) {
+        LOG(D1) << "No sedutil.append and no boot config on " << partition;
+        umount(PBA_BOOT_MOUNT);
+        return false;
+    }
+    int kernel = OpenOnBootVolume(boot.kernel, entry.kernel, "/vmlinuz", "/boot/vmlinuz");
+    if (kernel >= 0) {
+        int initrd = OpenOnBootVolume(boot.initrd, boot.kernel.empty() ? entry.initrd : "",
+            "/initrd.img", "/boot/initrd.img");
+        string cmdline = boot.append.empty() ? entry.options : boot.append;
+        unsigned long flags = (initrd < 0) ? KEXEC_FILE_NO_INITRAMFS : 0;
+        printf("Loading the OS kernel from %s\n", partition.c_str());
+#ifdef SYS_kexec_file_load
+        if (syscall(SYS_kexec_file_load, kernel, initrd, cmdline.size() + 1,
+                cmdline.c_str(), flags)) {
+            LOG(E) << "kexec_file_load failed " << strerror(errno);
+        }
+        else
+            loaded = true;
+#else
+        (void)flags;
+#endif
+        if (initrd >= 0) close(initrd);
+        close(kernel);
+    }
+    umount(PBA_BOOT_MOUNT);
+    return loaded;
+}
+
+static bool LoadKexec(const PBA_BOOT & boot) {
+    LOG(D1) << "Entering LoadKexec";
+#ifndef SYS_kexec_file_load
+    /* i386 has no kexec_file_load, kexec_load would need the bzImage
+     * parsing of kexec-tools */
+    printf("This PBA can't load the OS kernel with kexec, rebooting instead\n");
+    return false;
+#endif
+    mkdir(PBA_BOOT_MOUNT, 0700);
+    RereadPartitions();
+    vector<string> partitions;
+    if (!boot.bootdev.empty()) partitions.push_back(boot.bootdev);
+    else partitions = Partitions();
+    for (uint32_t i = 0; i < partitions.size(); i++)
+        if (TryKexec(boot, partitions[i])) return true;
+    printf("No OS kernel could be loaded, rebooting instead\n");
+    return false;
+}
+
+void BootOS(const PBA_BOOT & boot) {
+    bool kexec = boot.kexec && LoadKexec(boot);
+    sync();
+    if (boot.delay) sleep(boot.delay); // give the user time to see results
+    if (kexec) {
+        reboot(RB_KEXEC);
+        LOG(E) << "kexec failed " << strerror(errno);
+    }
+    reboot(RB_AUTOBOOT);
+}
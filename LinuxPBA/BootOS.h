@@ -0,0 +1,52 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+* C:E********************************************************************** */
+#pragma once
+#include "os.h"
+#include <string>
+using namespace std;
+/** How the PBA hands over to the OS, taken from its kernel command line
+ *  sedutil.delay=<seconds>   time to show the unlock results, default 5
+ *  sedutil.kexec=1           load the OS kernel with kexec instead of rebooting,
+ *                            64 bit PBA only
+ *  sedutil.bootdev=<device>  partition holding the kernel, default search all
+ *  sedutil.kernel=<path>     kernel on that partition, default /vmlinuz or /boot/vmlinuz
+ *  sedutil.initrd=<path>     initrd, default /initrd.img or /boot/initrd.img if present
+ *  sedutil.append="<args>"   OS command line
+ * Without sedutil.append the kernel, initrd and command line come from the
+ * default entry of the OS's loader entries or grub.cfg on the partition;
+ * a partition with neither is not booted with kexec.
+ */
+typedef struct _PBA_BOOT {
+    uint32_t delay;
+    bool kexec;
+    string bootdev;
+    string kernel;
+    string initrd;
+    string append;
+} PBA_BOOT;
+/** Read the boot options
+ * @param boot receives the options
+ * @param cmdline file holding the kernel command line
+ */
+void GetBootOptions(PBA_BOOT & boot, const char * cmdline = "/proc/cmdline");
+/** Start the OS after the delay, with kexec if asked for and the kernel
+ * can be loaded, by rebooting otherwise. Does not return.
+ */
+void BootOS(const PBA_BOOT & boot);
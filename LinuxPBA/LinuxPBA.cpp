@@ -19,19 +19,15 @@ This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.co
 * C:E********************************************************************** */
 
 
-#include <unistd.h>
-#include <sys/reboot.h>
 #include <iostream>
 #include "log.h"
 #include "DtaOptions.h"
 #include "GetPassPhrase.h"
 #include "UnlockSEDs.h"
+#include "BootOS.h"
 
 using namespace std;
 
-/* Default to output that includes timestamps and goes to stderr*/
-sedutiloutput outputFormat = sedutilNormal;
-
 int main(int argc, char** argv) {
     
     CLog::Level() = CLog::FromInt(2);
@@ -42,10 +38,10 @@ int main(int argc, char** argv) {
     string p = GetPassPhrase("Please enter pass-phrase to unlock OPAL drives: ");
     UnlockSEDs((char *)p.c_str());
     if (strcmp(p.c_str(), "debug")) {
+        PBA_BOOT boot;
+        GetBootOptions(boot);
         printf("Starting OS \n");
-        sync();
-        usleep(5000000); // give the user time to see results
-        reboot(RB_AUTOBOOT);
+        BootOS(boot);
     }
     return 0;
 }
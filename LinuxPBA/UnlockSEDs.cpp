@@ -18,49 +18,34 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 
 * C:E********************************************************************** */
 #include "os.h"
+#include <atomic>
+#include <thread>
 #include "UnlockSEDs.h"
 #include "DtaDevGeneric.h"
 #include "DtaDevOpal1.h"
 #include "DtaDevOpal2.h"
-
-#include <dirent.h>
-#include <fnmatch.h>
-#include <algorithm>
+#include "DtaDevLinuxScan.h"
+#include "DtaMultiplexer.h"
 
 using namespace std;
 
 uint8_t UnlockSEDs(char * password) {
 /* Loop through drives */
-    char devref[25];
-    int failed = 0;
+    const char * devref;
     DtaDev *tempDev;
     DtaDev *d;
-    DIR *dir;
-    struct dirent *dirent;
-    vector<string> devices;
-     string tempstring;
+    vector<DTA_BLOCKDEV> devices;
+    vector<DtaDev *> locked;
     LOG(D4) << "Enter UnlockSEDs";
-    dir = opendir("/dev");
-    if(dir!=NULL)
-    {
-        while((dirent=readdir(dir))!=NULL) {
-            if((!fnmatch("sd[a-z]",dirent->d_name,0)) || 
-                    (!fnmatch("nvme[0-9]",dirent->d_name,0)) ||
-                    (!fnmatch("nvme[0-9][0-9]",dirent->d_name,0))
-                    ) {
-                tempstring = dirent->d_name;
-                devices.push_back(tempstring);
-            }
-        }
-        closedir(dir);
-    }
-    std::sort(devices.begin(),devices.end());
+    DtaDevLinuxScan::enumerate(devices);
     printf("\nScanning....\n");
-    for(uint16_t i = 0; i < devices.size(); i++) {
-                snprintf(devref,23,"/dev/%s",devices[i].c_str());
+    for(uint32_t i = 0; i < devices.size(); i++) {
+        if (!devices[i].candidate) continue;
+        devref = devices[i].devref.c_str();
         tempDev = new DtaDevGeneric(devref);
         if (!tempDev->isPresent()) {
-            break;
+            delete tempDev;
+            continue;
         }
         if ((!tempDev->isOpal1()) && (!tempDev->isOpal2())) {
             printf("Drive %-10s %-40s not OPAL  \n", devref, tempDev->getModelNum());
@@ -74,25 +59,36 @@ uint8_t UnlockSEDs(char * password) {
             d = new DtaDevOpal1(devref);
         delete tempDev;
         d->no_hash_passwords = false;
-        failed = 0;
-        if (d->Locked()) {
-            if (d->MBREnabled()) {
-                if (d->setMBRDone(1, password)) {
-                    failed = 1;
-                }
-            }
-            if (d->setLockingRange(0, OPAL_LOCKINGSTATE::READWRITE, password)) {
-                failed = 1;
-            }
-            failed ? printf("Drive %-10s %-40s is OPAL Failed  \n", devref, d->getModelNum()) :
-                    printf("Drive %-10s %-40s is OPAL Unlocked   \n", devref, d->getModelNum());
-            delete d;
-        }
+        if (d->Locked())
+            locked.push_back(d);
         else {
             printf("Drive %-10s %-40s is OPAL NOT LOCKED   \n", devref, d->getModelNum());
             delete d;
         }
-
+    }
+    /* hash the password for each drive on a few threads, then unlock the
+     * drives side by side from this one */
+    vector<DtaMuxUnlock *> unlocks(locked.size());
+    atomic<uint32_t> next(0);
+    uint32_t workers = thread::hardware_concurrency();
+    if (0 == workers) workers = 1;
+    if (workers > locked.size()) workers = (uint32_t)locked.size();
+    vector<thread> pool;
+    for (uint32_t w = 0; w < workers; w++)
+        pool.push_back(thread([&]() {
+            for (uint32_t i = next++; i < locked.size(); i = next++)
+                unlocks[i] = new DtaMuxUnlock(locked[i], password);
+        }));
+    for (uint32_t w = 0; w < pool.size(); w++) pool[w].join();
+    DtaMultiplexer mux;
+    for (uint32_t i = 0; i < unlocks.size(); i++) mux.add(unlocks[i]);
+    mux.run();
+    for (uint32_t i = 0; i < unlocks.size(); i++) {
+        d = locked[i];
+        unlocks[i]->rc ? printf("Drive %-10s %-40s is OPAL Failed  \n", d->getDevName(), d->getModelNum()) :
+                printf("Drive %-10s %-40s is OPAL Unlocked   \n", d->getDevName(), d->getModelNum());
+        delete unlocks[i];
+        delete d;
     }
     return 0x00;
 };
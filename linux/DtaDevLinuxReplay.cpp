@@ -0,0 +1,52 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include "DtaDevLinuxReplay.h"
+#include "DtaTrace.h"
+
+using namespace std;
+
+DtaDevLinuxReplay::DtaDevLinuxReplay()
+{
+	dev = "";
+}
+
+DtaDevLinuxReplay::~DtaDevLinuxReplay()
+{
+}
+
+bool DtaDevLinuxReplay::init(const char * devref)
+{
+	LOG(D1) << "Replaying trace for " << devref;
+	dev = devref;
+	return DtaTrace::replaying();
+}
+
+uint8_t DtaDevLinuxReplay::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen)
+{
+	return DtaTrace::replay(dev, cmd, protocol, comID, buffer, bufferlen);
+}
+
+void DtaDevLinuxReplay::identify(OPAL_DiskInfo& disk_info)
+{
+	if (DtaTrace::replayIdentify(dev, disk_info))
+		disk_info.devType = DEVICE_TYPE_OTHER;
+}
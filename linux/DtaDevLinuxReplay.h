@@ -0,0 +1,52 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include "DtaStructures.h"
+#include "DtaDevLinuxDrive.h"
+
+/** Replay implementation of DtaDevLinuxDrive.
+ * Serves commands from the trace opened with DtaTrace::startReplay()
+ * instead of a device so the protocol code can be exercised without
+ * a drive attached.
+ */
+class DtaDevLinuxReplay: public DtaDevLinuxDrive {
+public:
+    /** Default constructor */
+    DtaDevLinuxReplay();
+    /** Destructor */
+    ~DtaDevLinuxReplay();
+    /** Replay initialization, nothing is opened.
+     * @param devref character representation of the device is standard OS lexicon
+     */
+    bool init(const char * devref);
+    /** Replay the next command from the trace
+     * @param cmd command to be sent to the device
+     * @param protocol security protocol to be used in the command
+     * @param comID communications ID to be used
+     * @param buffer input/output buffer
+     * @param bufferlen length of the input/output buffer
+     */
+    uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen);
+    /** Replay the recorded identify of the device */
+    void identify(OPAL_DiskInfo& disk_info);
+private:
+    const char * dev; /**< device name the trace is replayed for */
+};
@@ -0,0 +1,172 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include "DtaDevLinuxScan.h"
+
+using namespace std;
+
+void DtaDevLinuxScan::enumerate(vector<DTA_BLOCKDEV> & devices, const char * sysfs)
+{
+	LOG(D1) << "Entering DtaDevLinuxScan::enumerate " << sysfs;
+	string root = sysfs;
+	vector<DTA_BLOCKDEV> nvme, block;
+	DTA_BLOCKDEV d;
+
+	vector<string> names = entries(root + "/class/nvme/");
+	for (uint32_t i = 0; i < names.size(); i++)
+		if (describeNvme(root, names[i], d)) nvme.push_back(d);
+	names = entries(root + "/class/block/");
+	for (uint32_t i = 0; i < names.size(); i++)
+		if (describeBlock(root, names[i], d)) block.push_back(d);
+
+	sort(nvme.begin(), nvme.end(), nameOrder);
+	sort(block.begin(), block.end(), nameOrder);
+	devices = nvme;
+	devices.insert(devices.end(), block.begin(), block.end());
+	LOG(D1) << "Exiting DtaDevLinuxScan::enumerate " << devices.size() << " devices";
+}
+
+bool DtaDevLinuxScan::describe(const string & name, DTA_BLOCKDEV & device, const char * sysfs)
+{
+	LOG(D1) << "Entering DtaDevLinuxScan::describe " << name;
+	string root = sysfs;
+	if (describeNvme(root, name, device)) return true;
+	return describeBlock(root, name, device);
+}
+
+bool DtaDevLinuxScan::describeNvme(const string & root, const string & name, DTA_BLOCKDEV & d)
+{
+	/* security commands go to the controller, whatever namespaces it has */
+	struct stat st;
+	if (name.compare(0, 4, "nvme")) return false;
+	string dir = root + "/class/nvme/" + name + "/";
+	if (stat(dir.c_str(), &st)) return false;
+	d = DTA_BLOCKDEV();
+	d.name = name;
+	d.devref = "/dev/" + name;
+	d.transport = attribute(dir + "transport");
+	if (d.transport.empty()) d.transport = "pcie";
+	d.model = attribute(dir + "model");
+	d.serial = attribute(dir + "serial");
+	d.removable = false;
+	d.rotational = false;
+	vector<string> ns = entries(dir);
+	string prefix = name + "n";
+	for (uint32_t j = 0; j < ns.size(); j++) {
+		if (ns[j].compare(0, prefix.size(), prefix)) continue;
+		d.namespaces.push_back(ns[j]);
+		if ("1" == attribute(dir + ns[j] + "/queue/rotational"))
+			d.rotational = true;
+	}
+	sort(d.namespaces.begin(), d.namespaces.end());
+	d.candidate = true;
+	return true;
+}
+
+bool DtaDevLinuxScan::describeBlock(const string & root, const string & name, DTA_BLOCKDEV & d)
+{
+	/* everything else that the kernel shows as a whole SCSI disk */
+	struct stat st;
+	if (!name.compare(0, 4, "nvme")) return false; // namespaces, seen as controllers
+	string dir = root + "/class/block/" + name + "/";
+	if (!stat((dir + "partition").c_str(), &st)) return false;
+	if (stat((dir + "device").c_str(), &st)) return false; // loop, dm, md, zram
+	string type = attribute(dir + "device/type");
+	if (!type.empty() && ("0" != type)) return false; // not a direct access device
+	d = DTA_BLOCKDEV();
+	d.name = name;
+	d.devref = "/dev/" + name;
+	d.transport = scsiTransport(dir);
+	d.model = attribute(dir + "device/model");
+	d.serial = vpdSerial(dir + "device/vpd_pg80");
+	d.removable = ("1" == attribute(dir + "removable"));
+	d.rotational = ("1" == attribute(dir + "queue/rotational"));
+	/* only the SCSI disk driver passes security commands through */
+	d.candidate = !d.removable && !d.name.compare(0, 2, "sd");
+	return true;
+}
+
+string DtaDevLinuxScan::attribute(const string & path)
+{
+	ifstream f(path.c_str());
+	string value;
+	if (!f.is_open()) return value;
+	getline(f, value);
+	size_t end = value.find_last_not_of(" \t\r\n");
+	value.erase((string::npos == end) ? 0 : end + 1);
+	return value;
+}
+
+string DtaDevLinuxScan::vpdSerial(const string & path)
+{
+	ifstream f(path.c_str(), ios::binary);
+	string serial;
+	if (!f.is_open()) return serial;
+	char page[256];
+	f.read(page, sizeof(page));
+	streamsize len = f.gcount();
+	if ((len < 4) || (0x80 != (uint8_t)page[1])) return serial;
+	streamsize end = min<streamsize>(len, 4 + (uint8_t)page[3]);
+	serial.assign(page + 4, page + end);
+	size_t first = serial.find_first_not_of(' ');
+	size_t last = serial.find_last_not_of(" \0", string::npos, 2);
+	if (string::npos == first) return string();
+	return serial.substr(first, last - first + 1);
+}
+
+string DtaDevLinuxScan::scsiTransport(const string & path)
+{
+	char real[PATH_MAX];
+	if (NULL == realpath(path.c_str(), real)) return "scsi";
+	string p = real;
+	if (string::npos != p.find("/usb")) return "usb";
+	if (string::npos != p.find("/virtio")) return "virtio";
+	if (string::npos != p.find("/ata")) return "sata";
+	if ((string::npos != p.find("/end_device-")) ||
+		(string::npos != p.find("/expander-")))
+		return "sas";
+	return "scsi";
+}
+
+vector<string> DtaDevLinuxScan::entries(const string & path)
+{
+	vector<string> names;
+	DIR * dir = opendir(path.c_str());
+	if (NULL == dir) return names;
+	struct dirent * dirent;
+	while (NULL != (dirent = readdir(dir))) {
+		if ('.' == dirent->d_name[0]) continue;
+		names.push_back(dirent->d_name);
+	}
+	closedir(dir);
+	return names;
+}
+
+bool DtaDevLinuxScan::nameOrder(const DTA_BLOCKDEV & a, const DTA_BLOCKDEV & b)
+{
+	if (a.name.size() != b.name.size()) return a.name.size() < b.name.size();
+	return a.name < b.name;
+}
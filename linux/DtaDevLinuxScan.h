@@ -0,0 +1,75 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <string>
+#include <vector>
+
+/** A whole disk or NVMe controller found in sysfs */
+typedef struct _DTA_BLOCKDEV {
+    std::string name;      /**< kernel name, sdaa or nvme3 */
+    std::string devref;    /**< device node to open, /dev/sdaa or /dev/nvme3 */
+    std::string transport; /**< sata, sas, usb, virtio, scsi or the nvme transport */
+    std::string model;     /**< model as reported by the kernel */
+    std::string serial;    /**< serial number, empty if the kernel does not show it */
+    std::vector<std::string> namespaces; /**< NVMe namespaces of the controller */
+    bool removable;        /**< removable media */
+    bool rotational;       /**< spinning media */
+    bool candidate;        /**< worth opening to look for an SSC */
+} DTA_BLOCKDEV;
+
+/** Linux device enumeration from sysfs.
+ * Disks are found in class/block and NVMe controllers in class/nvme. All
+ * of the identity is read from sysfs attributes so nothing is opened;
+ * only entries flagged as candidates need to be opened to look for a
+ * security subsystem. Partitions, optical drives and virtual block devices
+ * are skipped; removable media and disks not driven by sd are listed but
+ * are not candidates.
+ */
+class DtaDevLinuxScan {
+public:
+    /** Enumerate the disks and NVMe controllers
+     * @param devices receives the devices, NVMe controllers first, each
+     *        group in kernel name order (sdz before sdaa)
+     * @param sysfs root of the sysfs tree, a fake tree can be given for testing
+     */
+    static void enumerate(std::vector<DTA_BLOCKDEV> & devices, const char * sysfs = "/sys");
+    /** Describe a single disk or NVMe controller
+     * @param name kernel name, sdaa or nvme3
+     * @param device receives the description
+     * @param sysfs root of the sysfs tree
+     * @return false if name is not a whole disk or an NVMe controller
+     */
+    static bool describe(const std::string & name, DTA_BLOCKDEV & device, const char * sysfs = "/sys");
+private:
+    /** describe an NVMe controller from class/nvme */
+    static bool describeNvme(const std::string & root, const std::string & name, DTA_BLOCKDEV & d);
+    /** describe a whole disk from class/block */
+    static bool describeBlock(const std::string & root, const std::string & name, DTA_BLOCKDEV & d);
+    /** first line of a sysfs attribute without trailing white space, empty if absent */
+    static std::string attribute(const std::string & path);
+    /** the serial number from a SCSI unit serial number VPD page */
+    static std::string vpdSerial(const std::string & path);
+    /** the transport a SCSI disk is attached by, from its sysfs device path */
+    static std::string scsiTransport(const std::string & path);
+    /** names of the entries of a directory */
+    static std::vector<std::string> entries(const std::string & path);
+    /** kernel name order, shorter names first */
+    static bool nameOrder(const DTA_BLOCKDEV & a, const DTA_BLOCKDEV & b);
+};
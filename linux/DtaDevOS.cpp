@@ -20,10 +20,9 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "os.h"
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <dirent.h>
-#include <fnmatch.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mount.h>
 #include <scsi/sg.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,6 +36,11 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaHexDump.h"
 #include "DtaDevLinuxSata.h"
 #include "DtaDevLinuxNvme.h"
+#include "DtaDevLinuxReplay.h"
+#include "DtaDevLinuxScan.h"
+#include "DtaUnlockAgent.h"
+#include "DtaEraseVerify.h"
+#include "DtaTrace.h"
 #include "DtaDevGeneric.h"
 
 using namespace std;
@@ -45,7 +49,20 @@ using namespace std;
   * At initialization we determine if we map to the NVMe or SATA derived class
  */
 unsigned long long DtaDevOS::getSize()
-{ return 0;
+{
+	uint64_t size = 0;
+	if (DtaTrace::replaying()) return 0; // no block device behind a trace
+	int sizefd = open(dev, O_RDONLY);
+	if (sizefd < 0) {
+		LOG(D1) << "Unable to open " << dev << " to read its size";
+		return 0;
+	}
+	if (ioctl(sizefd, BLKGETSIZE64, &size) < 0) {
+		LOG(D1) << "BLKGETSIZE64 failed on " << dev;
+		size = 0;
+	}
+	close(sizefd);
+	return size;
 }
 DtaDevOS::DtaDevOS()
 {
@@ -60,7 +77,11 @@ void DtaDevOS::init(const char * devref)
 	memset(&disk_info, 0, sizeof(OPAL_DiskInfo));
 	dev = devref;
 
-	if (!strncmp(devref, "/dev/nvme", 9))
+	if (DtaTrace::replaying())
+	{
+		drive = new DtaDevLinuxReplay();
+	}
+	else if (!strncmp(devref, "/dev/nvme", 9))
 	{
 //		DtaDevLinuxNvme *NvmeDrive = new DtaDevLinuxNvme();
 		drive = new DtaDevLinuxNvme();
@@ -81,6 +102,7 @@ void DtaDevOS::init(const char * devref)
 	{
 		isOpen = TRUE;
 		drive->identify(disk_info);
+		DtaTrace::recordIdentify(devref, disk_info);
 		if (disk_info.devType != DEVICE_TYPE_OTHER)
 			discovery0();
 	}
@@ -101,7 +123,9 @@ uint8_t DtaDevOS::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
 		return 0xff;
 	}
 
-	return drive->sendCmd(cmd, protocol, comID, buffer, bufferlen);
+	uint8_t rc = drive->sendCmd(cmd, protocol, comID, buffer, bufferlen);
+	DtaTrace::record(dev, cmd, protocol, comID, buffer, bufferlen, rc);
+	return rc;
 }
 
 void DtaDevOS::identify(OPAL_DiskInfo& disk_info)
@@ -118,53 +142,66 @@ void DtaDevOS::identify(OPAL_DiskInfo& disk_info)
 
 void DtaDevOS::osmsSleep(uint32_t ms)
 {
+	if (DtaTrace::replaying()) return; // the trace already holds the polls
 	usleep(ms * 1000); //convert to microseconds
     return;
 }
 int  DtaDevOS::diskScan()
 {
-    DIR *dir;
-    struct dirent *dirent;
     DtaDev * d;
-    char devname[25];
-    vector<string> devices;
-    string tempstring;
-    
+    vector<DTA_BLOCKDEV> devices;
+
     LOG(D1) << "Entering DtaDevOS:diskScan ";
-    dir = opendir("/dev");
-    if(dir!=NULL)
-    {
-        while((dirent=readdir(dir))!=NULL) {
-            if((!fnmatch("sd[a-z]",dirent->d_name,0)) || 
-                    (!fnmatch("nvme[0-9]",dirent->d_name,0)) ||
-                    (!fnmatch("nvme[0-9][0-9]",dirent->d_name,0))
-                    ) {
-                tempstring = dirent->d_name;
-                devices.push_back(tempstring);
-            }
+    DtaDevLinuxScan::enumerate(devices);
+    printf("Scanning for Opal compliant disks\n");
+    for (uint32_t i = 0; i < devices.size(); i++) {
+        printf("%-10s", devices[i].devref.c_str());
+        if (!devices[i].candidate) {
+            printf("%s%s\n", " No  ", devices[i].model.c_str());
+            continue;
         }
-        closedir(dir);
+        d = new DtaDevGeneric(devices[i].devref.c_str());
+        if (d->isAnySSC())
+            printf(" %s%s%s ", (d->isOpal1() ? "1" : " "),
+                (d->isOpal2() ? "2" : " "), (d->isEprise() ? "E" : " "));
+        else
+            printf("%s", " No  ");
+
+        printf("%s %s\n",d->getModelNum(),d->getFirmwareRev());
+        delete d;
     }
-    std::sort(devices.begin(),devices.end());
-    printf("Scanning for Opal compliant disks\n");
-    for(uint16_t i = 0; i < devices.size(); i++) {
-                snprintf(devname,23,"/dev/%s",devices[i].c_str());
-                printf("%-10s", devname);
-                d = new DtaDevGeneric(devname);
-		if (d->isAnySSC())
-                    printf(" %s%s%s ", (d->isOpal1() ? "1" : " "),
-			(d->isOpal2() ? "2" : " "), (d->isEprise() ? "E" : " "));
-		else
-                    printf("%s", " No  ");
-                
-                printf("%s %s\n",d->getModelNum(),d->getFirmwareRev());
-                delete d;
-          }
 	printf("No more disks present ending scan\n");
         LOG(D1) << "Exiting DtaDevOS::scanDisk ";
 	return 0;
 }
 
+uint8_t DtaDevOS::unlockAgent(char * password, char * serialfile)
+{
+    LOG(D1) << "Entering DtaDevOS::unlockAgent";
+    DtaNetlinkEventSource events;
+    DtaUnlockAgent agent(password);
+    uint8_t rc = agent.loadSerials(serialfile);
+    if (rc) return rc;
+    /* subscribe before the sweep so nothing that appears meanwhile is missed */
+    if (!events.open()) return DTAERROR_OPEN_ERR;
+    return agent.run(events);
+}
+
+uint8_t DtaDevOS::eraseFingerprint(char * samplefile, char * devref,
+    const std::vector<DTA_EXTENT> & extents, uint32_t lbaSize)
+{
+    LOG(D1) << "Entering DtaDevOS::eraseFingerprint";
+    DtaEraseVerify verifier(devref);
+    return verifier.fingerprint(samplefile, extents, lbaSize);
+}
+
+uint8_t DtaDevOS::verifyErase(char * samplefile, char * devref)
+{
+    LOG(D1) << "Entering DtaDevOS::verifyErase";
+    DtaEraseVerify verifier(devref);
+    return verifier.verify(samplefile);
+}
+
 /** Close the device reference so this object can be delete. */
 DtaDevOS::~DtaDevOS()
 {
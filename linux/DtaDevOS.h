@@ -49,6 +49,25 @@ public:
             void * buffer, uint32_t bufferlen);
     /** A static class to scan for supported drives */
     static int diskScan();
+    /** Unlock the listed drives now and whenever they appear again, until killed
+     * @param password Admin1 password of the drives
+     * @param serialfile serial numbers of the drives to unlock
+     */
+    static uint8_t unlockAgent(char * password, char * serialfile);
+    /** Fingerprint a sample of the blocks an erase is to destroy
+     * @param samplefile where the fingerprints go
+     * @param devref the device
+     * @param extents the blocks of the locking range to be erased, empty
+     * for the whole device
+     * @param lbaSize logical block size of the device
+     */
+    static uint8_t eraseFingerprint(char * samplefile, char * devref,
+        const std::vector<DTA_EXTENT> & extents, uint32_t lbaSize);
+    /** Check the blocks fingerprinted before an erase have all changed
+     * @param samplefile fingerprints written by eraseFingerprint
+     * @param devref the device, or a file standing in for one
+     */
+    static uint8_t verifyErase(char * samplefile, char * devref);
 protected:
     /** OS specific command to Wait for specified number of milliseconds 
      * @param ms  number of milliseconds to wait
@@ -0,0 +1,300 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <fstream>
+#include <iomanip>
+#include "DtaEraseVerify.h"
+extern "C" {
+#include "sha1.h"
+}
+
+using namespace std;
+
+DtaEraseVerify::DtaEraseVerify(const char * device, uint32_t reads)
+{
+	devref = device;
+	inflight = reads ? reads : 1;
+}
+
+DtaEraseVerify::~DtaEraseVerify()
+{
+	if (fd >= 0) close(fd);
+}
+
+double DtaEraseVerify::tolerance(uint64_t n)
+{
+	if (0 == n) return 1.0;
+	return 1.0 - pow(1.0 - DTA_VERIFY_CONFIDENCE, 1.0 / (double) n);
+}
+
+uint8_t DtaEraseVerify::open()
+{
+	LOG(D1) << "Entering DtaEraseVerify::open " << devref;
+	struct stat st;
+	if (fd >= 0) return 0;
+	fd = ::open(devref.c_str(), O_RDONLY | O_DIRECT);
+	if ((fd < 0) && (EINVAL == errno)) {
+		/* tmpfs and some other filesystems refuse O_DIRECT */
+		LOG(W) << devref << " does not support O_DIRECT, reading through the page cache";
+		fd = ::open(devref.c_str(), O_RDONLY);
+	}
+	if (fd < 0) {
+		LOG(E) << "Unable to open " << devref << ": " << strerror(errno);
+		return DTAERROR_OPEN_ERR;
+	}
+	if (fstat(fd, &st) < 0) {
+		LOG(E) << "Unable to stat " << devref << ": " << strerror(errno);
+		return DTAERROR_OPEN_ERR;
+	}
+	if (S_ISBLK(st.st_mode)) {
+		if (ioctl(fd, BLKGETSIZE64, &size) < 0) {
+			LOG(E) << "BLKGETSIZE64 failed on " << devref;
+			return DTAERROR_OPEN_ERR;
+		}
+	}
+	else
+		size = st.st_size;
+	if (size < DTA_VERIFY_BLOCK) {
+		LOG(E) << devref << " is too small to sample";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	return 0;
+}
+
+uint8_t DtaEraseVerify::readSample(vector<DTA_SAMPLE> & blocks)
+{
+	LOG(D1) << "Entering DtaEraseVerify::readSample " << blocks.size();
+	atomic<size_t> next(0);
+	atomic<int> failed(0);
+	vector<thread> readers;
+	for (uint32_t r = 0; r < inflight; r++) {
+		readers.push_back(thread([&]() {
+			void * buffer;
+			if (posix_memalign(&buffer, DTA_VERIFY_BLOCK, DTA_VERIFY_BLOCK)) {
+				failed = ENOMEM;
+				return;
+			}
+			uint8_t * block = (uint8_t *) buffer;
+			for (size_t i = next++; (i < blocks.size()) && (0 == failed); i = next++) {
+				ssize_t got = pread(fd, block, DTA_VERIFY_BLOCK, blocks[i].offset);
+				if (got != DTA_VERIFY_BLOCK) {
+					failed = (got < 0) ? errno : EIO;
+					break;
+				}
+				cf_sha1_context ctx;
+				cf_sha1_init(&ctx);
+				cf_sha1_update(&ctx, block, DTA_VERIFY_BLOCK);
+				cf_sha1_digest_final(&ctx, blocks[i].digest);
+				blocks[i].blank = true;
+				for (uint32_t j = 1; j < DTA_VERIFY_BLOCK; j++)
+					if (block[j] != block[0]) {
+						blocks[i].blank = false;
+						break;
+					}
+				if ((0x00 != block[0]) && (0xff != block[0])) blocks[i].blank = false;
+			}
+			free(buffer);
+		}));
+	}
+	for (uint32_t r = 0; r < readers.size(); r++)
+		readers[r].join();
+	if (failed) {
+		LOG(E) << "Read from " << devref << " failed: " << strerror(failed);
+		return DTAERROR_COMMAND_ERROR;
+	}
+	return 0;
+}
+
+uint8_t DtaEraseVerify::fingerprint(const char * samplefile, const vector<DTA_EXTENT> & extents,
+	uint32_t lbaSize, uint32_t samples)
+{
+	LOG(D1) << "Entering DtaEraseVerify::fingerprint " << samplefile;
+	uint8_t lastRC;
+	if ((lastRC = open()) != 0) return lastRC;
+	blank = 0;
+	/* the whole sample blocks inside each extent, as first and end block */
+	vector<pair<uint64_t, uint64_t> > runs;
+	uint64_t blocks = 0;
+	if (extents.empty())
+		runs.push_back(make_pair((uint64_t) 0, size / DTA_VERIFY_BLOCK));
+	for (uint32_t i = 0; i < extents.size(); i++) {
+		uint64_t lbas = size / lbaSize;
+		if (extents[i].start >= lbas) continue;
+		uint64_t end = (extents[i].length > lbas - extents[i].start) ? lbas :
+			extents[i].start + extents[i].length;
+		uint64_t first = (extents[i].start * lbaSize + DTA_VERIFY_BLOCK - 1) / DTA_VERIFY_BLOCK;
+		uint64_t last = end * lbaSize / DTA_VERIFY_BLOCK;
+		if (last > first) runs.push_back(make_pair(first, last));
+	}
+	for (uint32_t i = 0; i < runs.size(); i++)
+		blocks += runs[i].second - runs[i].first;
+	if (0 == blocks) {
+		LOG(E) << "The erased extents hold no whole " << DTA_VERIFY_BLOCK << " byte block of " << devref;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	if (0 == samples)
+		samples = (uint32_t) ceil(log(1.0 - DTA_VERIFY_CONFIDENCE) / log(1.0 - DTA_VERIFY_TOLERANCE));
+	if (samples > blocks) samples = (uint32_t) blocks;
+	/* one block at random from each of samples equal strata of the erased
+	 * blocks taken end to end, so the sample is spread over all of them */
+	random_device seed;
+	mt19937_64 rng(((uint64_t) seed() << 32) | seed());
+	sample.clear();
+	uint32_t run = 0;
+	uint64_t before = 0;  // erased blocks in the runs ahead of run
+	for (uint64_t i = 0; i < samples; i++) {
+		uint64_t first = i * blocks / samples;
+		uint64_t last = (i + 1) * blocks / samples;
+		uint64_t n = first + rng() % (last - first);
+		while (n >= before + runs[run].second - runs[run].first) {
+			before += runs[run].second - runs[run].first;
+			run++;
+		}
+		DTA_SAMPLE s;
+		s.offset = (runs[run].first + n - before) * DTA_VERIFY_BLOCK;
+		sample.push_back(s);
+	}
+	if ((lastRC = readSample(sample)) != 0) return lastRC;
+	ofstream f(samplefile);
+	if (!f.is_open()) {
+		LOG(E) << "Unable to create " << samplefile;
+		return DTAERROR_OPEN_ERR;
+	}
+	f << "# sedutil erase verification sample of " << devref << endl;
+	f << "size " << size << endl;
+	for (uint32_t i = 0; i < runs.size(); i++)
+		f << "# erased bytes " << runs[i].first * DTA_VERIFY_BLOCK << " to "
+			<< runs[i].second * DTA_VERIFY_BLOCK << endl;
+	for (uint32_t i = 0; i < sample.size(); i++) {
+		f << sample[i].offset << " " << hex << setfill('0');
+		for (uint32_t j = 0; j < sizeof(sample[i].digest); j++)
+			f << setw(2) << (uint16_t) sample[i].digest[j];
+		f << dec << setfill(' ');
+		if (sample[i].blank) {
+			f << " blank";
+			blank++;
+		}
+		f << endl;
+	}
+	f.close();
+	if (f.fail()) {
+		LOG(E) << "Unable to write " << samplefile;
+		return DTAERROR_OPEN_ERR;
+	}
+	LOG(I) << "Fingerprinted " << sample.size() << " blocks of " << devref
+		<< ", " << blank << " of them blank";
+	return 0;
+}
+
+uint8_t DtaEraseVerify::verify(const char * samplefile)
+{
+	LOG(D1) << "Entering DtaEraseVerify::verify " << samplefile;
+	uint8_t lastRC;
+	uint64_t recorded = 0;
+	if ((lastRC = open()) != 0) return lastRC;
+	ifstream f(samplefile);
+	if (!f.is_open()) {
+		LOG(E) << "Unable to open " << samplefile;
+		return DTAERROR_OPEN_ERR;
+	}
+	string line;
+	sample.clear();
+	while (getline(f, line)) {
+		size_t comment = line.find('#');
+		if (string::npos != comment) line.erase(comment);
+		char digest[41], flag[8] = "";
+		unsigned long long value;
+		if (1 == sscanf(line.c_str(), "size %llu", &value)) {
+			recorded = value;
+			if (recorded != size) {
+				LOG(E) << samplefile << " was taken of a device of " << recorded
+					<< " bytes, " << devref << " has " << size;
+				return DTAERROR_INVALID_PARAMETER;
+			}
+			continue;
+		}
+		int fields = sscanf(line.c_str(), "%llu %40s %7s", &value, digest, flag);
+		if (fields < 0) continue;  // blank line
+		DTA_SAMPLE s;
+		s.offset = value;
+		s.blank = !strcmp(flag, "blank");
+		if ((fields < 2) || (40 != strlen(digest)) || (s.offset % DTA_VERIFY_BLOCK) ||
+			(s.offset + DTA_VERIFY_BLOCK > size)) {
+			LOG(E) << "Invalid sample in " << samplefile << ": " << line;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		for (uint32_t j = 0; j < sizeof(s.digest); j++)
+			s.digest[j] = (uint8_t) strtoul(string(digest + 2 * j, 2).c_str(), NULL, 16);
+		sample.push_back(s);
+	}
+	if (sample.empty()) {
+		LOG(E) << "No samples in " << samplefile;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	if (recorded != size) {
+		LOG(E) << samplefile << " does not record the size of the device";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	vector<DTA_SAMPLE> now(sample);
+	if ((lastRC = readSample(now)) != 0) return lastRC;
+	changed = unchanged = blank = 0;
+	for (uint32_t i = 0; i < sample.size(); i++) {
+		if (sample[i].blank) {
+			blank++;
+		}
+		else if (memcmp(sample[i].digest, now[i].digest, sizeof(now[i].digest))) {
+			changed++;
+		}
+		else {
+			/* a failed erase would list the whole sample, the first few make the point */
+			if (++unchanged <= 10) {
+				LOG(E) << "Block at offset " << sample[i].offset << " was not erased";
+			}
+		}
+	}
+	LOG(I) << changed << " of " << (changed + unchanged) << " sampled blocks changed, "
+		<< blank << " blank before the erase were not counted";
+	if (unchanged) {
+		LOG(E) << "Erase of " << devref << " not verified, "
+			<< fixed << setprecision(3) << (100.0 * unchanged / (changed + unchanged))
+			<< "% of the sample still reads as before";
+		return DTAERROR_ERASE_NOT_VERIFIED;
+	}
+	if (0 == changed) {
+		LOG(E) << "Every sampled block was blank, nothing to verify";
+		return DTAERROR_ERASE_NOT_VERIFIED;
+	}
+	LOG(I) << "Erase of " << devref << " verified: with " << (uint32_t) (100 * DTA_VERIFY_CONFIDENCE)
+		<< "% confidence fewer than " << setprecision(3) << (100.0 * tolerance(changed))
+		<< "% of the blocks still hold their old contents";
+	return 0;
+}
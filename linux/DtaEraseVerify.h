@@ -0,0 +1,92 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "DtaStructures.h"
+
+/** size of the blocks sampled by DtaEraseVerify, a multiple of every logical
+ * block size in use so O_DIRECT reads of it are always aligned */
+#define DTA_VERIFY_BLOCK 4096
+/** confidence DtaEraseVerify reports and sizes its sample for */
+#define DTA_VERIFY_CONFIDENCE 0.99
+/** fraction of blocks still holding old data the default sample detects
+ * with DTA_VERIFY_CONFIDENCE */
+#define DTA_VERIFY_TOLERANCE 0.001
+
+/** One sampled block and its fingerprint from before the erase */
+typedef struct _DTA_SAMPLE {
+    uint64_t offset;   /**< byte offset of the block */
+    uint8_t digest[20]; /**< SHA-1 of the block */
+    bool blank;        /**< the block was all zeros or all ones */
+} DTA_SAMPLE;
+
+/** Evidence that an erase or revert left no readable plaintext.
+ * Before the erase fingerprint() reads a stratified random sample of
+ * blocks spread over the extents that are to be erased, so every part of
+ * them holds a share of it, and saves their SHA-1 to a file.  After the erase verify() reads
+ * the same blocks again; any block that still hashes the same was not
+ * erased.  Reads are O_DIRECT, several in flight at once.  Anything that
+ * can be read works, a regular file or loop device included.
+ */
+class DtaEraseVerify {
+public:
+    /** @param devref the device or file to sample
+     * @param inflight number of reads in flight at once
+     */
+    DtaEraseVerify(const char * devref, uint32_t inflight = 16);
+    ~DtaEraseVerify();
+    /** Choose the sample and write its fingerprints
+     * @param samplefile where the fingerprints go
+     * @param extents the blocks the erase covers, clipped to the device;
+     * empty for the whole device
+     * @param lbaSize size of the logical blocks the extents count
+     * @param samples number of blocks, 0 for the number that detects
+     * DTA_VERIFY_TOLERANCE with DTA_VERIFY_CONFIDENCE
+     */
+    uint8_t fingerprint(const char * samplefile, const std::vector<DTA_EXTENT> & extents,
+        uint32_t lbaSize = 512, uint32_t samples = 0);
+    /** Read the sample again and compare it with the fingerprints
+     * @param samplefile fingerprints written by fingerprint()
+     * @return DTAERROR_ERASE_NOT_VERIFIED if any block was not changed
+     */
+    uint8_t verify(const char * samplefile);
+    /** Largest fraction of blocks that could still hold old data given
+     * that none of a sample of n did, at DTA_VERIFY_CONFIDENCE
+     * @param n number of blocks sampled
+     */
+    static double tolerance(uint64_t n);
+    uint64_t changed = 0;   /**< sampled blocks verify found changed */
+    uint64_t unchanged = 0; /**< sampled blocks verify found unchanged */
+    uint64_t blank = 0;     /**< sampled blocks that were blank before, not counted */
+private:
+    /** open the device and find its size */
+    uint8_t open();
+    /** read blocks and hash them
+     * @param blocks the blocks, digest and blank are filled in from offset
+     */
+    uint8_t readSample(std::vector<DTA_SAMPLE> & blocks);
+    std::string devref;   /**< the device or file */
+    uint32_t inflight;    /**< reads in flight at once */
+    int fd = -1;          /**< open device, -1 if not open */
+    uint64_t size = 0;    /**< size of the device in bytes */
+    std::vector<DTA_SAMPLE> sample;  /**< the blocks sampled */
+};
@@ -0,0 +1,248 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fstream>
+#include "DtaUnlockAgent.h"
+#include "DtaDevGeneric.h"
+#include "DtaDevOpal1.h"
+#include "DtaDevOpal2.h"
+
+using namespace std;
+
+/** serial numbers are compared without the padding drives put around them */
+static string trimSerial(const string & serial)
+{
+	size_t first = serial.find_first_not_of(" \t");
+	if (string::npos == first) return string();
+	size_t last = serial.find_last_not_of(" \t\r\n");
+	return serial.substr(first, last - first + 1);
+}
+
+bool DtaEventSource::parse(const char * buffer, size_t length, DTA_UEVENT & event)
+{
+	event = DTA_UEVENT();
+	size_t pos = strnlen(buffer, length);
+	if (NULL == memchr(buffer, '@', pos)) return false; // udev or garbage
+	while (++pos < length) {
+		size_t len = strnlen(buffer + pos, length - pos);
+		string pair(buffer + pos, len);
+		size_t eq = pair.find('=');
+		if (string::npos != eq) {
+			string key = pair.substr(0, eq);
+			if ("ACTION" == key) event.action = pair.substr(eq + 1);
+			else if ("SUBSYSTEM" == key) event.subsystem = pair.substr(eq + 1);
+			else if ("DEVTYPE" == key) event.devtype = pair.substr(eq + 1);
+			else if ("DEVNAME" == key) event.devname = pair.substr(eq + 1);
+		}
+		pos += len;
+	}
+	/* DEVNAME may be given relative to /dev or not at all */
+	if (!event.devname.compare(0, 5, "/dev/")) event.devname.erase(0, 5);
+	return !event.action.empty();
+}
+
+DtaNetlinkEventSource::DtaNetlinkEventSource()
+{
+	sock = -1;
+}
+
+DtaNetlinkEventSource::~DtaNetlinkEventSource()
+{
+	if (sock >= 0) close(sock);
+}
+
+bool DtaNetlinkEventSource::open()
+{
+	LOG(D1) << "Entering DtaNetlinkEventSource::open";
+	struct sockaddr_nl addr;
+	sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (sock < 0) {
+		LOG(E) << "Unable to open the uevent socket " << strerror(errno);
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_pid = 0;
+	addr.nl_groups = 1; // kernel events, not the udev rebroadcast
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		LOG(E) << "Unable to subscribe to uevents " << strerror(errno);
+		close(sock);
+		sock = -1;
+		return false;
+	}
+	return true;
+}
+
+bool DtaNetlinkEventSource::next(DTA_UEVENT & event)
+{
+	char buffer[8192];
+	while (sock >= 0) {
+		ssize_t len = recv(sock, buffer, sizeof(buffer), 0);
+		if (len < 0) {
+			if ((EINTR == errno) || (ENOBUFS == errno)) continue;
+			LOG(E) << "Reading uevents failed " << strerror(errno);
+			return false;
+		}
+		if (parse(buffer, len, event)) return true;
+	}
+	return false;
+}
+
+DtaUnlockAgent::DtaUnlockAgent(const char * pw, const char * sysfsroot)
+{
+	password.assign(pw, pw + strlen(pw) + 1);
+	sysfs = sysfsroot;
+	unlocked = 0;
+	failures = 0;
+}
+
+DtaUnlockAgent::~DtaUnlockAgent()
+{
+	/* don't leave the password lying around in freed memory */
+	memset(password.data(), 0, password.size());
+}
+
+uint8_t DtaUnlockAgent::loadSerials(const char * filename)
+{
+	LOG(D1) << "Entering DtaUnlockAgent::loadSerials " << filename;
+	ifstream f(filename);
+	if (!f.is_open()) {
+		LOG(E) << "Unable to open " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	string line;
+	while (getline(f, line)) {
+		size_t hash = line.find('#');
+		if (string::npos != hash) line.erase(hash);
+		line = trimSerial(line);
+		if (!line.empty()) manage(line);
+	}
+	if (serials.empty()) {
+		LOG(E) << "No serial numbers in " << filename;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	LOG(I) << "Managing " << serials.size() << " drives";
+	return 0;
+}
+
+void DtaUnlockAgent::manage(const string & serial)
+{
+	serials.insert(trimSerial(serial));
+}
+
+void DtaUnlockAgent::sweep()
+{
+	LOG(D1) << "Entering DtaUnlockAgent::sweep";
+	vector<DTA_BLOCKDEV> devices;
+	DtaDevLinuxScan::enumerate(devices, sysfs.c_str());
+	for (uint32_t i = 0; i < devices.size(); i++)
+		if (devices[i].candidate) unlock(devices[i]);
+}
+
+void DtaUnlockAgent::handle(const DTA_UEVENT & event)
+{
+	if (("add" != event.action) && ("change" != event.action)) return;
+	if ((("block" != event.subsystem) || ("disk" != event.devtype)) &&
+		("nvme" != event.subsystem))
+		return;
+	LOG(D1) << "uevent " << event.action << " " << event.subsystem << " " << event.devname;
+	DTA_BLOCKDEV device;
+	if (!DtaDevLinuxScan::describe(event.devname, device, sysfs.c_str())) return;
+	if (device.candidate) unlock(device);
+}
+
+uint8_t DtaUnlockAgent::run(DtaEventSource & source)
+{
+	LOG(D1) << "Entering DtaUnlockAgent::run";
+	DTA_UEVENT event;
+	sweep();
+	while (source.next(event))
+		handle(event);
+	LOG(D1) << "Exiting DtaUnlockAgent::run";
+	return 0;
+}
+
+DtaDev * DtaUnlockAgent::openDevice(const char * devref)
+{
+	DtaDev * probe = NULL;
+	/* the node can lag the uevent a little */
+	for (int retry = 0; retry < 10; retry++) {
+		probe = new DtaDevGeneric(devref);
+		if (probe->isPresent()) break;
+		delete probe;
+		probe = NULL;
+		usleep(10000);
+	}
+	if (NULL == probe) return NULL;
+	DtaDev * d = NULL;
+	if (probe->isOpal2())
+		d = new DtaDevOpal2(devref);
+	else if (probe->isOpal1())
+		d = new DtaDevOpal1(devref);
+	delete probe;
+	if (NULL != d) d->no_hash_passwords = false;
+	return d;
+}
+
+void DtaUnlockAgent::unlock(const DTA_BLOCKDEV & device)
+{
+	string serial = trimSerial(device.serial);
+	/* known serial, decide without touching the drive */
+	if (!serial.empty() && !serials.count(serial)) return;
+	DtaDev * d = openDevice(device.devref.c_str());
+	if (NULL == d) {
+		if (!serial.empty()) {
+			LOG(E) << device.devref << " " << serial << " is not an Opal drive";
+			failures++;
+		}
+		return;
+	}
+	if (serial.empty()) {
+		serial = trimSerial(d->getSerialNum());
+		if (!serials.count(serial)) {
+			delete d;
+			return;
+		}
+	}
+	if (!d->Locked()) {
+		LOG(I) << device.devref << " " << serial << " is not locked";
+		delete d;
+		return;
+	}
+	uint8_t rc = 0;
+	if (d->MBREnabled())
+		rc = d->setMBRDone(1, password.data());
+	if (!rc)
+		rc = d->setLockingRange(0, OPAL_LOCKINGSTATE::READWRITE, password.data());
+	if (rc) {
+		LOG(E) << "Unable to unlock " << device.devref << " " << serial << " rc " << (uint16_t) rc;
+		failures++;
+	}
+	else {
+		LOG(I) << device.devref << " " << serial << " unlocked";
+		unlocked++;
+	}
+	delete d;
+}
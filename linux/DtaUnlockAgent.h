@@ -0,0 +1,107 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <set>
+#include <string>
+#include <vector>
+#include "DtaDev.h"
+#include "DtaDevLinuxScan.h"
+
+/** A kernel uevent, reduced to the keys the unlock agent looks at */
+typedef struct _DTA_UEVENT {
+    std::string action;    /**< add, change, remove ... */
+    std::string subsystem; /**< block, nvme ... */
+    std::string devtype;   /**< disk or partition for block devices */
+    std::string devname;   /**< kernel name, sdaa or nvme3 */
+} DTA_UEVENT;
+
+/** Where the unlock agent gets its events from.
+ * The kernel is the normal source, tests can feed synthetic events.
+ */
+class DtaEventSource {
+public:
+    virtual ~DtaEventSource() {};
+    /** Wait for the next event
+     * @param event receives the event
+     * @return false when no more events will come
+     */
+    virtual bool next(DTA_UEVENT & event) = 0;
+    /** Parse a kernel uevent message, action@devpath followed by
+     * NUL separated KEY=value pairs
+     * @param buffer the message
+     * @param length length of the message
+     * @param event receives the event
+     * @return false if the message is not a kernel uevent
+     */
+    static bool parse(const char * buffer, size_t length, DTA_UEVENT & event);
+};
+
+/** Kernel uevents read from a NETLINK_KOBJECT_UEVENT socket */
+class DtaNetlinkEventSource : public DtaEventSource {
+public:
+    DtaNetlinkEventSource();
+    ~DtaNetlinkEventSource();
+    /** Subscribe to the kernel uevents, false if the socket can't be set up */
+    bool open();
+    bool next(DTA_UEVENT & event);
+private:
+    int sock; /**< netlink socket, -1 if not open */
+};
+
+/** Unlock managed drives as soon as they appear.
+ * Drives are recognised by serial number, taken from sysfs or if sysfs
+ * does not show it from the identify data. A managed drive that is
+ * locked gets MBRDone set, if shadowing is enabled, and the global
+ * range set read/write.
+ */
+class DtaUnlockAgent {
+public:
+    /** @param password Admin1 password of the managed drives
+     * @param sysfs root of the sysfs tree
+     */
+    DtaUnlockAgent(const char * password, const char * sysfs = "/sys");
+    virtual ~DtaUnlockAgent();
+    /** Read the serial numbers of the managed drives, one per line
+     * @param filename file to read, # starts a comment
+     */
+    uint8_t loadSerials(const char * filename);
+    /** Manage the drive with this serial number */
+    void manage(const std::string & serial);
+    /** Unlock the managed drives that are already present */
+    void sweep();
+    /** Unlock the drive an event is about if it is managed and locked */
+    void handle(const DTA_UEVENT & event);
+    /** Sweep, then handle events until the source has no more */
+    uint8_t run(DtaEventSource & source);
+    uint32_t unlocked;  /**< drives unlocked */
+    uint32_t failures;  /**< managed drives that could not be unlocked */
+protected:
+    /** Open a drive as the Opal device object that matches it
+     * @param devref device to open
+     * @return NULL if the drive is absent or not Opal
+     */
+    virtual DtaDev * openDevice(const char * devref);
+    /** Unlock one drive if it is managed and locked */
+    void unlock(const DTA_BLOCKDEV & device);
+private:
+    std::set<std::string> serials; /**< managed drives */
+    std::vector<char> password;    /**< NUL terminated, the DtaDev calls want a char * */
+    std::string sysfs;
+};
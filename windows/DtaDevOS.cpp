@@ -34,14 +34,28 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaDiskATA.h"
 #include "DtaDiskUSB.h"
 #include "DtaDiskNVMe.h"
+#include "DtaTrace.h"
 
 using namespace std;
-DtaDevOS::DtaDevOS() {};
+DtaDevOS::DtaDevOS()
+{
+	disk = NULL;
+	hDev = INVALID_HANDLE_VALUE;
+	ataPointer = NULL;
+};
 void DtaDevOS::init(const char * devref)
 {
     LOG(D1) << "Creating DtaDevOS::DtaDevOS() " << devref;
     dev = devref;
     memset(&disk_info, 0, sizeof (OPAL_DiskInfo));
+	if (DtaTrace::replaying()) {
+		// no drive behind a trace, the recorded identify stands in for it
+		isOpen = 1;
+		if (DtaTrace::replayIdentify(devref, disk_info))
+			disk_info.devType = DEVICE_TYPE_OTHER;
+		if (DEVICE_TYPE_OTHER != disk_info.devType) discovery0();
+		return;
+	}
 	/*  Open the drive to see if we have access */
 	ATA_PASS_THROUGH_DIRECT * ata =
 		(ATA_PASS_THROUGH_DIRECT *)_aligned_malloc(sizeof(ATA_PASS_THROUGH_DIRECT), 8);
@@ -102,6 +116,7 @@ void DtaDevOS::init(const char * devref)
 
 	disk->init(dev);
     identify(disk_info);
+	DtaTrace::recordIdentify(devref, disk_info);
 	if (DEVICE_TYPE_OTHER != disk_info.devType) discovery0();
 }
 
@@ -109,8 +124,13 @@ uint8_t DtaDevOS::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
                         void * buffer, uint32_t bufferlen)
 {
     LOG(D1) << "Entering DtaDevOS::sendCmd";
+	if (DtaTrace::replaying())
+		return DtaTrace::replay(dev, cmd, protocol, comID, buffer, bufferlen);
+	if (NULL == disk) return 0xfe; // no supported drive behind the handle
+	uint8_t rc = disk->sendCmd(cmd, protocol, comID, buffer, bufferlen);
+	DtaTrace::record(dev, cmd, protocol, comID, buffer, bufferlen, rc);
 	LOG(D1) << "Exiting DtaDevOS::sendCmd";
-	return (disk->sendCmd(cmd, protocol, comID, buffer, bufferlen));
+	return rc;
 }
 
 void DtaDevOS::osmsSleep(uint32_t milliseconds)
@@ -118,6 +138,7 @@ void DtaDevOS::osmsSleep(uint32_t milliseconds)
     Sleep(milliseconds);
 }
 unsigned long long DtaDevOS::getSize() {
+	if (DtaTrace::replaying()) return 0; // no disk behind a trace
 	if (DeviceIoControl(
 		(HANDLE)hDev,              // handle to device
 		IOCTL_DISK_GET_LENGTH_INFO,    // dwIoControlCode
@@ -137,6 +158,7 @@ void DtaDevOS::identify(OPAL_DiskInfo& di)
 {
     LOG(D1) << "Entering DtaDevOS::identify()";
 	LOG(D1) << "Exiting DtaDevOS::identify()";
+	if (NULL == disk) return;
 	return(disk->identify(di));
 }
 /** Static member to scann for supported drives */
@@ -172,11 +194,31 @@ int DtaDevOS::diskScan()
 	printf("No more disks present ending scan\n");
 	return 0;
 }
+uint8_t DtaDevOS::unlockAgent(char * password, char * serialfile)
+{
+	LOG(D4) << "Referencing formal parameters " << password << " " << serialfile;
+	LOG(E) << "The unlock agent needs Linux uevents";
+	return DTAERROR_INVALID_COMMAND;
+}
+uint8_t DtaDevOS::eraseFingerprint(char * samplefile, char * devref,
+	const std::vector<DTA_EXTENT> & extents, uint32_t lbaSize)
+{
+	LOG(D4) << "Referencing formal parameters " << samplefile << " " << devref
+		<< " " << extents.size() << " " << lbaSize;
+	LOG(E) << "Erase verification is only implemented for Linux";
+	return DTAERROR_INVALID_COMMAND;
+}
+uint8_t DtaDevOS::verifyErase(char * samplefile, char * devref)
+{
+	LOG(D4) << "Referencing formal parameters " << samplefile << " " << devref;
+	LOG(E) << "Erase verification is only implemented for Linux";
+	return DTAERROR_INVALID_COMMAND;
+}
 /** Close the filehandle so this object can be delete. */
 
 DtaDevOS::~DtaDevOS()
 {
     LOG(D1) << "Destroying DtaDevOS";
 	delete disk;
-	CloseHandle(hDev);
+	if (INVALID_HANDLE_VALUE != hDev) CloseHandle(hDev);
 }
@@ -56,6 +56,13 @@ public:
 	unsigned long long	getSize();
 	/** A static class to scan for supported drives */
 	static int diskScan();
+	/** Unlock listed drives as they appear, only implemented for Linux */
+	static uint8_t unlockAgent(char * password, char * serialfile);
+	/** Fingerprint blocks before an erase, only implemented for Linux */
+	static uint8_t eraseFingerprint(char * samplefile, char * devref,
+		const std::vector<DTA_EXTENT> & extents, uint32_t lbaSize);
+	/** Compare blocks with their fingerprints, only implemented for Linux */
+	static uint8_t verifyErase(char * samplefile, char * devref);
 protected:
      /** OS specific command to Wait for specified number of milliseconds 
      * @param milliseconds  number of milliseconds to wait
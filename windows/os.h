@@ -32,6 +32,7 @@ along with sedutil.If not, see <http://www.gnu.org/licenses/>.
 /** OS specific implementation of the "safe" snprintf function */
 #define SNPRINTF sprintf_s
 #define strcasecmp _stricmp 
+#define strncasecmp _strnicmp
 /** OS specific example device to be used in help output*/
 #define DEVICEEXAMPLE "\\\\.\\PhysicalDrive3"
 // match types